@@ -0,0 +1,169 @@
+/*
+  bench_algebra.c
+  Compare scalar and SIMD versions of lida_algebra.c functions.
+ */
+
+#include "lida_bench.h"
+
+#define NUM_ELEMENTS 4096
+#define NUM_ROUNDS 256
+
+INTERNAL float
+RandomFloat(float min, float max)
+{
+  return min + (max - min) * (float)(Random(g_random) & 0xFFFF) / 65535.0f;
+}
+
+INTERNAL void
+RandomTransform(Transform* transform)
+{
+  Vec3 axis = { RandomFloat(0.1f, 1.0f), RandomFloat(0.1f, 1.0f), RandomFloat(0.1f, 1.0f) };
+  Vec3_Normalize(&axis, &axis);
+  QuatFromAxisAngle(&axis, RandomFloat(0.0f, 6.28f), &transform->rotation);
+  transform->position = VEC3_CREATE(RandomFloat(-100.0f, 100.0f),
+                                    RandomFloat(-10.0f, 10.0f),
+                                    RandomFloat(-100.0f, 100.0f));
+  transform->scale = RandomFloat(0.5f, 5.0f);
+}
+
+int
+main()
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+  SeedRandom(g_random, 420, 420);
+
+#if LIDA_SIMD_AVX
+  printf("SIMD: AVX\n");
+#elif LIDA_SIMD_SSE
+  printf("SIMD: SSE\n");
+#else
+  printf("SIMD: none\n");
+#endif
+
+  Mat4* mats = PersistentAllocate(NUM_ELEMENTS * sizeof(Mat4));
+  Mat4* out_mats = PersistentAllocate(NUM_ELEMENTS * sizeof(Mat4));
+  Mat4* ref_mats = PersistentAllocate(NUM_ELEMENTS * sizeof(Mat4));
+  Vec3* points = PersistentAllocate(NUM_ELEMENTS * sizeof(Vec3));
+  Vec4* out_points = PersistentAllocate(NUM_ELEMENTS * sizeof(Vec4));
+  Vec4* ref_points = PersistentAllocate(NUM_ELEMENTS * sizeof(Vec4));
+  Transform* transforms = PersistentAllocate(NUM_ELEMENTS * sizeof(Transform));
+  Vec3* half_sizes = PersistentAllocate(NUM_ELEMENTS * sizeof(Vec3));
+  OBB* obbs = PersistentAllocate(NUM_ELEMENTS * sizeof(OBB));
+  int* visible = PersistentAllocate(NUM_ELEMENTS * sizeof(int));
+
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+    float* m = &mats[i].m00;
+    for (int j = 0; j < 16; j++)
+      m[j] = RandomFloat(-1.0f, 1.0f);
+    points[i] = VEC3_CREATE(RandomFloat(-100.0f, 100.0f),
+                            RandomFloat(-100.0f, 100.0f),
+                            RandomFloat(-100.0f, 100.0f));
+    RandomTransform(&transforms[i]);
+    half_sizes[i] = VEC3_CREATE(RandomFloat(0.1f, 1.0f), RandomFloat(0.1f, 1.0f), RandomFloat(0.1f, 1.0f));
+  }
+
+  Camera camera = {
+    .position = VEC3_CREATE(0.0f, 0.0f, -2.0f),
+    .up = VEC3_CREATE(0.0f, 1.0f, 0.0f),
+    .front = VEC3_CREATE(0.0f, 0.0f, 1.0f),
+    .fovy = RADIANS(45.0f),
+    .aspect_ratio = 16.0f / 9.0f,
+    .z_near = 1.0f,
+  };
+  CameraUpdateProjection(&camera);
+  CameraUpdateView(&camera);
+  Mat4_Mul(&camera.projection_matrix, &camera.view_matrix, &camera.projview_matrix);
+  const Mat4* projview = &camera.projview_matrix;
+  const uint64_t ops = (uint64_t)NUM_ELEMENTS * NUM_ROUNDS;
+
+  // matrix multiplication
+  BENCH("Mat4_Mul_Scalar", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+          Mat4_Mul_Scalar(projview, &mats[i], &ref_mats[i]);
+      BENCH_USE(ref_mats);
+    });
+  BENCH("Mat4_Mul", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+          Mat4_Mul(projview, &mats[i], &out_mats[i]);
+      BENCH_USE(out_mats);
+    });
+  BENCH("Mat4_Mul_Batch", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        Mat4_Mul_Batch(projview, mats, out_mats, NUM_ELEMENTS);
+      BENCH_USE(out_mats);
+    });
+  float max_error = 0.0f;
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+    for (int j = 0; j < 16; j++)
+      max_error = fmaxf(max_error, fabsf((&out_mats[i].m00)[j] - (&ref_mats[i].m00)[j]));
+  printf("  max error: %g\n", max_error);
+
+  // point transformation
+  BENCH("Mat4_Mul_Vec4_Scalar", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+          Vec4 pos = { points[i].x, points[i].y, points[i].z, 1.0f };
+          Mat4_Mul_Vec4_Scalar(projview, &pos, &ref_points[i]);
+        }
+      BENCH_USE(ref_points);
+    });
+  BENCH("Mat4_Mul_Vec4", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+          Vec4 pos = { points[i].x, points[i].y, points[i].z, 1.0f };
+          Mat4_Mul_Vec4(projview, &pos, &out_points[i]);
+        }
+      BENCH_USE(out_points);
+    });
+  BENCH("TransformPoints", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        TransformPoints(projview, points, out_points, NUM_ELEMENTS);
+      BENCH_USE(out_points);
+    });
+  max_error = 0.0f;
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+    for (int j = 0; j < 4; j++)
+      max_error = fmaxf(max_error, fabsf((&out_points[i].x)[j] - (&ref_points[i].x)[j]));
+  printf("  max error: %g\n", max_error);
+
+  // OBB building
+  BENCH("CalculateObjectOBB", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+          CalculateObjectOBB(&half_sizes[i], &transforms[i], &obbs[i]);
+      BENCH_USE(obbs);
+    });
+  BENCH("CalculateObjectOBBs", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        CalculateObjectOBBs(half_sizes, transforms, obbs, NUM_ELEMENTS);
+      BENCH_USE(obbs);
+    });
+
+  // frustum culling
+  uint32_t num_visible_scalar = 0, num_visible = 0, mismatches = 0;
+  BENCH("TestFrustumOBB_Scalar", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+          visible[i] = TestFrustumOBB_Scalar(projview, &obbs[i]);
+      BENCH_USE(visible);
+    });
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+    num_visible_scalar += visible[i];
+  BENCH("TestFrustumOBBs", ops, {
+      for (int r = 0; r < NUM_ROUNDS; r++)
+        TestFrustumOBBs(projview, obbs, visible, NUM_ELEMENTS);
+      BENCH_USE(visible);
+    });
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++) {
+    num_visible += visible[i];
+    mismatches += visible[i] != TestFrustumOBB_Scalar(projview, &obbs[i]);
+  }
+  printf("  visible: %u/%u (scalar: %u), mismatches: %u\n",
+         num_visible, NUM_ELEMENTS, num_visible_scalar, mismatches);
+
+  BenchFree();
+  return 0;
+}
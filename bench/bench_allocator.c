@@ -0,0 +1,158 @@
+/*
+  bench_allocator.c
+  Compare bump and TLSF allocators under churn similar to voxel grid
+  edits and reloads.
+ */
+
+#include "lida_bench.h"
+
+#define ALLOCATOR_MEMORY_SIZE 96*1024*1024
+#define NUM_SLOTS 2048
+#define NUM_OPS 1000000
+
+typedef struct {
+  const char* name;
+  uint32_t min_size;
+  uint32_t max_size;
+  // percent of operations that resize instead of alloc/free
+  uint32_t resize_percent;
+} Workload;
+
+GLOBAL Workload g_workloads[] = {
+  { "small (16B-256B)", 16, 256, 0 },
+  { "voxel grids (1KB-64KB)", 1024, 64*1024, 0 },
+  { "voxel grids + resize", 1024, 64*1024, 30 },
+};
+
+enum {
+  BENCH_BUMP,
+  BENCH_TLSF,
+  // TLSF over reserved memory, commits memory as it grows
+  BENCH_TLSF_VIRTUAL,
+  BENCH_ALLOCATOR_COUNT
+};
+
+GLOBAL const char* g_allocator_names[] = { "bump", "tlsf", "tlsf (virtual)" };
+
+INTERNAL uint32_t
+RandomSize(const Workload* workload)
+{
+  return workload->min_size + Random(g_random) % (workload->max_size - workload->min_size + 1);
+}
+
+INTERNAL int
+CompareTimes(const void* a, const void* b)
+{
+  uint32_t l = *(const uint32_t*)a, r = *(const uint32_t*)b;
+  return (l > r) - (l < r);
+}
+
+INTERNAL void
+RunWorkload(void* memory, const Workload* workload, uint32_t type)
+{
+  Allocator allocator;
+  void* reserved = NULL;
+  switch (type) {
+  case BENCH_BUMP:
+    InitAllocator(&allocator, memory, ALLOCATOR_MEMORY_SIZE);
+    break;
+  case BENCH_TLSF:
+    InitAllocatorTLSF(&allocator, memory, ALLOCATOR_MEMORY_SIZE);
+    break;
+  case BENCH_TLSF_VIRTUAL:
+    reserved = PlatformReserveMemory(ALLOCATOR_MEMORY_SIZE);
+    if (InitVirtualAllocator(&allocator, ALLOCATOR_TLSF, reserved, ALLOCATOR_MEMORY_SIZE) != 0) {
+      if (reserved) {
+        PlatformReleaseMemory(reserved, ALLOCATOR_MEMORY_SIZE);
+      }
+      return;
+    }
+    break;
+  }
+  Allocation** slots = PersistentAllocate(NUM_SLOTS * sizeof(Allocation*));
+  memset(slots, 0, NUM_SLOTS * sizeof(Allocation*));
+  uint32_t* times = PersistentAllocate(NUM_OPS * sizeof(uint32_t));
+  SeedRandom(g_random, 420, 420);
+
+  uint64_t total = 0;
+  uint32_t failed = 0;
+  uint32_t corrupted = 0;
+  for (uint32_t i = 0; i < NUM_OPS; i++) {
+    uint32_t slot = Random(g_random) % NUM_SLOTS;
+    uint32_t size = RandomSize(workload);
+    int resize = slots[slot] && (Random(g_random) % 100 < workload->resize_percent);
+    uint64_t start = PlatformGetPerformanceCounter();
+    if (resize) {
+      Allocation* allocation = ChangeAllocationSize(&allocator, slots[slot], size);
+      if (allocation) {
+        slots[slot] = allocation;
+      } else {
+        failed++;
+      }
+    } else if (slots[slot]) {
+      corrupted += *(uint32_t*)slots[slot]->ptr != slot;
+      FreeAllocation(&allocator, slots[slot]);
+      slots[slot] = NULL;
+    } else {
+      slots[slot] = DoAllocation(&allocator, size, "bench");
+      if (slots[slot]) {
+        *(uint32_t*)slots[slot]->ptr = slot;
+      } else {
+        failed++;
+      }
+    }
+    uint64_t elapsed = PlatformGetPerformanceCounter() - start;
+    total += elapsed;
+    times[i] = (elapsed < UINT32_MAX) ? elapsed : UINT32_MAX;
+  }
+  // worst op is mostly preemption, percentiles are more telling
+  qsort(times, NUM_OPS, sizeof(uint32_t), &CompareTimes);
+  uint32_t p999 = times[NUM_OPS - NUM_OPS / 1000];
+  uint32_t p9999 = times[NUM_OPS - NUM_OPS / 10000];
+  uint32_t worst = times[NUM_OPS-1];
+
+  char name[64];
+  stbsp_snprintf(name, sizeof(name), "%s: %s", g_allocator_names[type], workload->name);
+  BenchReport(name, total, NUM_OPS);
+  printf("  p99.9 op: %.3f ms, p99.99 op: %.3f ms, worst op: %.3f ms\n",
+         (double)p999 * 1e-6, (double)p9999 * 1e-6, (double)worst * 1e-6);
+  printf("  failed: %u, live: %.2f MB in %u allocations, committed: %.2f MB\n",
+         failed,
+         (double)allocator.effective_size / (1024.0 * 1024.0), allocator.num_allocations,
+         (double)AllocatorCommittedSize(&allocator) / (1024.0 * 1024.0));
+  if (corrupted) {
+    LOG_ERROR("%u allocations were corrupted", corrupted);
+  }
+
+  for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+    if (slots[i]) {
+      FreeAllocation(&allocator, slots[i]);
+    }
+  }
+  if (ReleaseAllocator(&allocator)) {
+    LOG_WARN("memory leak detected");
+  }
+  PersistentRelease(slots);
+  if (reserved) {
+    PlatformReleaseMemory(reserved, ALLOCATOR_MEMORY_SIZE);
+  }
+}
+
+int
+main()
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+
+  void* memory = MemoryAllocateRight(&g_persistent_memory, ALLOCATOR_MEMORY_SIZE);
+  // touch all pages, so first run doesn't pay for page faults
+  memset(memory, 1, ALLOCATOR_MEMORY_SIZE);
+  for (uint32_t i = 0; i < ARR_SIZE(g_workloads); i++) {
+    for (uint32_t type = 0; type < BENCH_ALLOCATOR_COUNT; type++) {
+      RunWorkload(memory, &g_workloads[i], type);
+    }
+  }
+
+  BenchFree();
+  return 0;
+}
@@ -0,0 +1,187 @@
+/*
+  bench_ecs.c
+  Measure basic operations of lida_ecs.c at different entity counts.
+ */
+
+#include "lida_bench.h"
+
+#define ECS_MEMORY_SIZE 192*1024*1024
+
+typedef struct {
+  Vec3 position;
+  float mass;
+} Body;
+
+typedef struct {
+  Vec3 velocity;
+} Velocity;
+
+DECLARE_COMPONENT(Body);
+DECLARE_COMPONENT(Velocity);
+
+GLOBAL uint32_t g_counts[] = { 10000, 100000, 1000000 };
+
+// Fisher-Yates shuffle, so random access doesn't hit cache by accident
+INTERNAL void
+Shuffle(EID* ids, uint32_t count)
+{
+  for (uint32_t i = count-1; i > 0; i--) {
+    uint32_t j = Random(g_random) % (i+1);
+    EID t = ids[i];
+    ids[i] = ids[j];
+    ids[j] = t;
+  }
+}
+
+INTERNAL void
+RunBenchmarks(void* memory, uint32_t count)
+{
+  char name[64];
+  Allocator allocator;
+  InitAllocator(&allocator, memory, ECS_MEMORY_SIZE);
+  ECS ecs = {0};
+  CreateECS(&allocator, &ecs, 8);
+  EID* ids = PersistentAllocate(count * sizeof(EID));
+  EID* shuffled = PersistentAllocate(count * sizeof(EID));
+  float sum = 0.0f;
+
+  printf("--- %u entities ---\n", count);
+
+  stbsp_snprintf(name, sizeof(name), "CreateEntity");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        ids[i] = CreateEntity(&ecs);
+    });
+  memcpy(shuffled, ids, count * sizeof(EID));
+  Shuffle(shuffled, count);
+
+  stbsp_snprintf(name, sizeof(name), "AddComponent");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++) {
+        Body* body = AddComponent(&ecs, Body, ids[i]);
+        body->position = VEC3_CREATE((float)i, 0.0f, 0.0f);
+        body->mass = 1.0f;
+      }
+    });
+
+  stbsp_snprintf(name, sizeof(name), "AddComponent (random order)");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++) {
+        Velocity* velocity = AddComponent(&ecs, Velocity, shuffled[i]);
+        velocity->velocity = VEC3_CREATE(1.0f, 0.0f, 0.0f);
+      }
+    });
+
+  stbsp_snprintf(name, sizeof(name), "GetComponent (sequential)");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        sum += ((Body*)GetComponent(Body, ids[i]))->mass;
+    });
+
+  stbsp_snprintf(name, sizeof(name), "GetComponent (random)");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        sum += ((Body*)GetComponent(Body, shuffled[i]))->mass;
+    });
+
+  stbsp_snprintf(name, sizeof(name), "FOREACH_COMPONENT");
+  BENCH(name, count, {
+      FOREACH_COMPONENT(Body) {
+        components[i].position.y += components[i].mass;
+      }
+    });
+
+  // typical join of 2 components without groups
+  stbsp_snprintf(name, sizeof(name), "FOREACH_COMPONENT + GetComponent");
+  BENCH(name, count, {
+      FOREACH_COMPONENT(Body) {
+        Velocity* velocity = GetComponent(Velocity, entities[i]);
+        components[i].position = VEC3_ADD(components[i].position, velocity->velocity);
+      }
+    });
+
+  Component_Group group;
+  Sparse_Set* sets[] = { ComponentSet(Body), ComponentSet(Velocity) };
+  stbsp_snprintf(name, sizeof(name), "CreateOwningGroup");
+  BENCH(name, count, CreateOwningGroup(&group, sets, ARR_SIZE(sets)));
+
+  stbsp_snprintf(name, sizeof(name), "FOREACH_IN_GROUP");
+  BENCH(name, count, {
+      Body* bodies = GroupData(Body);
+      Velocity* velocities = GroupData(Velocity);
+      FOREACH_IN_GROUP(&group) {
+        bodies[i].position = VEC3_ADD(bodies[i].position, velocities[i].velocity);
+      }
+    });
+
+  stbsp_snprintf(name, sizeof(name), "RemoveComponent (grouped, random)");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        RemoveComponent(&ecs, Velocity, shuffled[i]);
+    });
+  DestroyOwningGroup(&group);
+
+  stbsp_snprintf(name, sizeof(name), "RemoveComponent (random)");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        RemoveComponent(&ecs, Body, shuffled[i]);
+    });
+
+  stbsp_snprintf(name, sizeof(name), "DestroyEntity");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        DestroyEntity(&ecs, ids[i]);
+    });
+
+  stbsp_snprintf(name, sizeof(name), "CreateEntities (bulk)");
+  BENCH(name, count, CreateEntities(&ecs, ids, count));
+
+  stbsp_snprintf(name, sizeof(name), "AddComponents (bulk)");
+  BENCH(name, count, AddComponents(&ecs, Body, ids, count));
+
+  // scene packages store dense and packed arrays as is and load them
+  // with AppendComponents(), see SaveScene() and LoadScene()
+  EID* saved_ids = PersistentAllocate(count * sizeof(EID));
+  Body* saved_bodies = PersistentAllocate(count * sizeof(Body));
+  stbsp_snprintf(name, sizeof(name), "snapshot save");
+  BENCH(name, count, {
+      memcpy(saved_ids, ComponentSet(Body)->dense->ptr, count * sizeof(EID));
+      memcpy(saved_bodies, ComponentData(Body), count * sizeof(Body));
+    });
+  UNREGISTER_COMPONENT(&ecs, Body);
+  stbsp_snprintf(name, sizeof(name), "snapshot load (AppendComponents)");
+  BENCH(name, count, {
+      Body* bodies = AppendComponents(&ecs, Body, saved_ids, count);
+      memcpy(bodies, saved_bodies, count * sizeof(Body));
+    });
+
+  BENCH_USE(&sum);
+  printf("  memory used: %.2f MB\n", (double)allocator.effective_size / (1024.0 * 1024.0));
+
+  UNREGISTER_COMPONENT(&ecs, Body);
+  UNREGISTER_COMPONENT(&ecs, Velocity);
+  DestroyECS(&ecs);
+  if (ReleaseAllocator(&allocator)) {
+    LOG_WARN("memory leak detected");
+  }
+  PersistentRelease(ids);
+}
+
+int
+main()
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+  SeedRandom(g_random, 420, 420);
+
+  REGISTER_COMPONENT(Body);
+  REGISTER_COMPONENT(Velocity);
+
+  void* memory = MemoryAllocateRight(&g_persistent_memory, ECS_MEMORY_SIZE);
+  for (uint32_t i = 0; i < ARR_SIZE(g_counts); i++) {
+    RunBenchmarks(memory, g_counts[i]);
+  }
+
+  BenchFree();
+  return 0;
+}
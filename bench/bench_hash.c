@@ -0,0 +1,136 @@
+/*
+  bench_hash.c
+  Compare MurmurHash2-based HashMemory64 that was used for voxel grids
+  with HashMemory64/HashAccumulate64 and measure incremental updates
+  of a grid's hash.
+ */
+
+#include "lida_bench.h"
+
+// previous HashMemory64
+INTERNAL uint64_t
+MurmurHash64(const void* key, uint32_t bytes)
+{
+  const uint32_t seed = LIDA_ENGINE_VERSION;
+  const uint64_t m = 0xc6a4a7935bd1e995;
+  const int r = 47;
+  uint64_t h = seed ^ (bytes * m);
+  const uint64_t* data = (const uint64_t*)key;
+  const uint64_t* end = data + (bytes/8);
+  while (data != end) {
+    uint64_t k = *(data++);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  const unsigned char* chars = (const unsigned char*)data;
+  for (uint32_t i = bytes & 7; i > 0; i--) {
+    h ^= (uint64_t)chars[i-1] << (8*(i-1));
+  }
+  if (bytes & 7)
+    h *= m;
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+// sizes of voxel grids: 16^3, 64^3, 256^3 and a huge scene
+GLOBAL uint32_t g_sizes[] = { 16*16*16, 64*64*64, 256*256*256, 128*1024*1024 };
+
+// hash roughly this many bytes per measurement
+#define BYTES_PER_RUN (1024ull*1024*1024)
+#define NUM_EDITS 1000000
+
+INTERNAL void
+BenchThroughput(uint8_t* data, uint32_t size)
+{
+  char name[64];
+  uint32_t runs = (uint32_t)(BYTES_PER_RUN / size);
+  if (runs == 0)
+    runs = 1;
+  uint64_t sum = 0;
+  const char* names[] = { "MurmurHash64", "HashMemory64", "HashAccumulate64" };
+  for (uint32_t type = 0; type < ARR_SIZE(names); type++) {
+    stbsp_snprintf(name, sizeof(name), "%s (%u KB)", names[type], size / 1024);
+    uint64_t start = PlatformGetPerformanceCounter();
+    for (uint32_t i = 0; i < runs; i++) {
+      // change data a bit so compiler doesn't hoist hashing out of the loop
+      data[i % size]++;
+      switch (type) {
+      case 0: sum += MurmurHash64(data, size); break;
+      case 1: sum += HashMemory64(data, size); break;
+      case 2: sum += HashAccumulate64(data, size, 0); break;
+      }
+    }
+    uint64_t elapsed = PlatformGetPerformanceCounter() - start;
+    BenchReport(name, elapsed, runs);
+    printf("  %.2f GB/s\n", (double)size * runs / (double)elapsed);
+  }
+  BENCH_USE(sum);
+}
+
+// set random voxels of a 64^3 grid, updating hash in place
+INTERNAL void
+BenchEdits(uint8_t* data)
+{
+  const uint32_t size = 64*64*64;
+  uint32_t* offsets = PersistentAllocate(NUM_EDITS * sizeof(uint32_t));
+  for (uint32_t i = 0; i < NUM_EDITS; i++)
+    offsets[i] = Random(g_random) % size;
+
+  uint64_t hash = HashAccumulate64(data, size, 0);
+  BENCH("incremental voxel edit (64^3 grid)", NUM_EDITS, {
+      for (uint32_t i = 0; i < NUM_EDITS; i++) {
+        uint32_t first = offsets[i] & ~7u;
+        hash -= HashAccumulate64(data + first, 8, first / 8);
+        data[offsets[i]] = (uint8_t)i;
+        hash += HashAccumulate64(data + first, 8, first / 8);
+      }
+    });
+  if (hash != HashAccumulate64(data, size, 0)) {
+    LOG_ERROR("incremental hash doesn't match hash of whole grid");
+  }
+
+  const uint32_t num_rehashes = NUM_EDITS / 1000;
+  BENCH("voxel edit + full rehash (64^3 grid)", num_rehashes, {
+      for (uint32_t i = 0; i < num_rehashes; i++) {
+        data[offsets[i]] = (uint8_t)i;
+        hash = HashAccumulate64(data, size, 0);
+      }
+    });
+  BENCH_USE(hash);
+  PersistentRelease(offsets);
+}
+
+int
+main()
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+  SeedRandom(g_random, 420, 420);
+
+#if HASH_SIMD_AVX2
+  printf("SIMD: AVX2\n");
+#elif HASH_SIMD_SSE2
+  printf("SIMD: SSE2\n");
+#else
+  printf("SIMD: none\n");
+#endif
+
+  uint32_t max_size = g_sizes[ARR_SIZE(g_sizes)-1];
+  uint8_t* data = PersistentAllocate(max_size);
+  // mostly empty space with some solid voxels, like real grids
+  for (uint32_t i = 0; i < max_size; i++)
+    data[i] = (Random(g_random) % 4 == 0) ? (uint8_t)Random(g_random) : 0;
+
+  for (uint32_t i = 0; i < ARR_SIZE(g_sizes); i++)
+    BenchThroughput(data, g_sizes[i]);
+  BenchEdits(data);
+
+  PersistentRelease(data);
+  BenchFree();
+  return 0;
+}
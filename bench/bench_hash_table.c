@@ -0,0 +1,224 @@
+/*
+  bench_hash_table.c
+  Compare Fixed_Hash_Table with tables generated by DECLARE_HASH_TABLE()
+  on keys similar to engine caches: asset paths and sampler infos.
+ */
+
+#include "lida_bench.h"
+
+// same as Asset_ID and Shader_Info: string key and some payload
+typedef struct {
+  const char* name;
+  uint32_t value;
+} Named_Entry;
+
+// same as Sampler_Info: key is the whole struct
+typedef struct {
+  uint32_t filter;
+  uint32_t mode;
+  uint32_t border_color;
+  float max_lod;
+  uint64_t handle;
+} Sampler_Entry;
+
+INTERNAL uint32_t
+HashNamedEntry(const void* obj)
+{
+  return HashString32(((const Named_Entry*)obj)->name);
+}
+
+INTERNAL int
+CompareNamedEntries(const void* lhs, const void* rhs)
+{
+  return strcmp(((const Named_Entry*)lhs)->name, ((const Named_Entry*)rhs)->name);
+}
+
+INTERNAL uint32_t
+HashSamplerEntry(const void* obj)
+{
+  return HashMemory32(obj, offsetof(Sampler_Entry, handle));
+}
+
+INTERNAL int
+CompareSamplerEntries(const void* lhs, const void* rhs)
+{
+  return memcmp(lhs, rhs, offsetof(Sampler_Entry, handle));
+}
+
+DECLARE_TYPE(Named_Entry);
+DECLARE_TYPE(Sampler_Entry);
+
+DECLARE_HASH_TABLE(Named_Table, Named_Entry, HashNamedEntry, CompareNamedEntries)
+DECLARE_HASH_TABLE(Sampler_Table, Sampler_Entry, HashSamplerEntry, CompareSamplerEntries)
+
+GLOBAL uint32_t g_counts[] = { 32, 256, 4096 };
+
+#define NUM_LOOKUPS 4000000
+
+INTERNAL void
+BenchNamed(uint32_t count)
+{
+  char name[64];
+  char* strings = PersistentAllocate(count * 48);
+  Named_Entry* keys = PersistentAllocate(2 * count * sizeof(Named_Entry));
+  // second half of keys is never inserted
+  for (uint32_t i = 0; i < 2 * count; i++) {
+    char* str = strings + (i % count) * 48;
+    if (i < count) {
+      stbsp_snprintf(str, 48, "data/models/asset_%u.vox", i);
+      keys[i].name = str;
+    } else {
+      keys[i].name = (i & 1) ? "data/models/missing.vox" : "shaders/missing.spv";
+    }
+    keys[i].value = i;
+  }
+  uint32_t* order = PersistentAllocate(NUM_LOOKUPS * sizeof(uint32_t));
+  for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+    order[i] = Random(g_random) % count;
+  uint32_t sum = 0;
+
+  Fixed_Hash_Table fht;
+  FHT_Init(&fht, PersistentAllocate(FHT_CALC_SIZE(GET_TYPE_INFO(Named_Entry), count)),
+           count, GET_TYPE_INFO(Named_Entry));
+  Named_Table table;
+  Named_Table_Init(&table, NULL, count);
+
+  printf("--- %u string keys ---\n", count);
+
+  stbsp_snprintf(name, sizeof(name), "FHT_Insert");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++) {
+        Named_Entry temp = keys[i];
+        FHT_Insert(&fht, GET_TYPE_INFO(Named_Entry), &temp);
+      }
+    });
+  stbsp_snprintf(name, sizeof(name), "Named_Table_Insert");
+  BENCH(name, count, {
+      for (uint32_t i = 0; i < count; i++)
+        Named_Table_Insert(&table, &keys[i]);
+    });
+
+  stbsp_snprintf(name, sizeof(name), "FHT_Search (hit)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += ((Named_Entry*)FHT_Search(&fht, GET_TYPE_INFO(Named_Entry), &keys[order[i]]))->value;
+    });
+  stbsp_snprintf(name, sizeof(name), "Named_Table_Search (hit)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += Named_Table_Search(&table, &keys[order[i]])->value;
+    });
+
+  stbsp_snprintf(name, sizeof(name), "FHT_Search (miss)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += FHT_Search(&fht, GET_TYPE_INFO(Named_Entry), &keys[count + (i & 1)]) != NULL;
+    });
+  stbsp_snprintf(name, sizeof(name), "Named_Table_Search (miss)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += Named_Table_Search(&table, &keys[count + (i & 1)]) != NULL;
+    });
+  BENCH_USE(sum);
+
+  Named_Table_Free(&table);
+  PersistentRelease(fht.ptr);
+  PersistentRelease(order);
+  PersistentRelease(keys);
+  PersistentRelease(strings);
+}
+
+INTERNAL void
+BenchSamplers(uint32_t count)
+{
+  char name[64];
+  Sampler_Entry* keys = PersistentAllocate(count * sizeof(Sampler_Entry));
+  for (uint32_t i = 0; i < count; i++) {
+    keys[i] = (Sampler_Entry) {
+      .filter = i & 1,
+      .mode = (i >> 1) & 3,
+      .border_color = i >> 3,
+      .max_lod = (float)(i & 7),
+      .handle = i,
+    };
+  }
+  uint32_t* order = PersistentAllocate(NUM_LOOKUPS * sizeof(uint32_t));
+  for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+    order[i] = Random(g_random) % count;
+  uint64_t sum = 0;
+
+  Fixed_Hash_Table fht;
+  FHT_Init(&fht, PersistentAllocate(FHT_CALC_SIZE(GET_TYPE_INFO(Sampler_Entry), count)),
+           count, GET_TYPE_INFO(Sampler_Entry));
+  Sampler_Table table;
+  Sampler_Table_Init(&table, NULL, count);
+  for (uint32_t i = 0; i < count; i++) {
+    Sampler_Entry temp = keys[i];
+    FHT_Insert(&fht, GET_TYPE_INFO(Sampler_Entry), &temp);
+    Sampler_Table_Insert(&table, &keys[i]);
+  }
+
+  printf("--- %u struct keys ---\n", count);
+
+  stbsp_snprintf(name, sizeof(name), "FHT_Search (hit)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += ((Sampler_Entry*)FHT_Search(&fht, GET_TYPE_INFO(Sampler_Entry), &keys[order[i]]))->handle;
+    });
+  stbsp_snprintf(name, sizeof(name), "Sampler_Table_Search (hit)");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++)
+        sum += Sampler_Table_Search(&table, &keys[order[i]])->handle;
+    });
+
+  // insert and remove all the time, like assets that get reloaded.
+  // FHT_Remove() doesn't shift elements back, so some of them become
+  // unreachable after removals.
+  uint32_t lost = 0;
+  stbsp_snprintf(name, sizeof(name), "FHT_Remove + FHT_Insert");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+        Sampler_Entry* removed = FHT_Remove(&fht, GET_TYPE_INFO(Sampler_Entry), &keys[order[i]]);
+        if (removed) {
+          Sampler_Entry temp = *removed;
+          FHT_Insert(&fht, GET_TYPE_INFO(Sampler_Entry), &temp);
+        } else {
+          lost++;
+        }
+      }
+    });
+  if (lost) {
+    printf("  %u removals didn't find an element\n", lost);
+  }
+  stbsp_snprintf(name, sizeof(name), "Sampler_Table_Remove + Insert");
+  BENCH(name, NUM_LOOKUPS, {
+      for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+        Sampler_Entry temp = *Sampler_Table_Remove(&table, &keys[order[i]]);
+        Sampler_Table_Insert(&table, &temp);
+      }
+    });
+  BENCH_USE(sum);
+
+  Sampler_Table_Free(&table);
+  PersistentRelease(fht.ptr);
+  PersistentRelease(order);
+  PersistentRelease(keys);
+}
+
+int
+main()
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+  SeedRandom(g_random, 420, 420);
+  REGISTER_TYPE(Named_Entry, &HashNamedEntry, &CompareNamedEntries);
+  REGISTER_TYPE(Sampler_Entry, &HashSamplerEntry, &CompareSamplerEntries);
+
+  for (uint32_t i = 0; i < ARR_SIZE(g_counts); i++) {
+    BenchNamed(g_counts[i]);
+    BenchSamplers(g_counts[i]);
+  }
+
+  BenchFree();
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+  bench_profiler.c
+  Stress test for the profiler: several threads record sections while
+  writer thread streams them to a trace, like job workers do. Reports
+  cost of recording an event, trace size and number of dropped
+  events, then converts the trace to JSON.
+
+  'make bench-tsan' builds it with ThreadSanitizer as
+  bin/bench_profiler_tsan.
+ */
+
+#include "lida_bench.h"
+
+#define NUM_THREADS 4
+// 4M events in total
+#define EVENTS_PER_THREAD (1024*1024)
+// frame length for ProfilerFlush(), as the engine calls it once per frame
+#define FRAME_MICROSECONDS 16000
+
+#define TRACE_PATH "bench_profiler.lprof"
+#define JSON_PATH "bench_profiler.json"
+
+// names are static strings, last one needs escaping and is longer
+// than 256 chars, so it gets cut when converted to JSON
+GLOBAL const char* g_names[] = {
+  "UpdateTransforms",
+  "GenerateVoxelGridMeshGreedy",
+  "PlaybackCommandBuffer",
+  "\"quoted\\name\" "
+  "0123456789012345678901234567890123456789012345678901234567890123456789"
+  "\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\""
+  "\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\"
+  "\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\""
+  "\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\"
+  "\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"",
+};
+
+GLOBAL atomic_uint g_finished_threads;
+
+INTERNAL int
+WorkerMain(void* udata)
+{
+  (void)udata;
+  ProfilerSetThreadName("worker");
+  volatile uint32_t work = 0;
+  for (uint32_t i = 0; i < EVENTS_PER_THREAD; i++) {
+    Profile_Section section;
+    ProfilerBeginSection(&section, g_names[i % ARR_SIZE(g_names)]);
+    // a bit of work, sections are never empty in the engine
+    for (uint32_t j = 0; j < 16; j++)
+      work += j;
+    ProfilerEndSection(&section);
+  }
+  atomic_fetch_add(&g_finished_threads, 1);
+  return 0;
+}
+
+// count records of each type, also checks that trace is well formed
+INTERNAL int
+CountTraceRecords(const char* path, uint64_t counts[PROFILE_RECORD_DROPPED+1], uint64_t* dropped)
+{
+  size_t size;
+  const uint8_t* data = PlatformLoadEntireFile(path, &size);
+  if (data == NULL)
+    return -1;
+  memset(counts, 0, (PROFILE_RECORD_DROPPED+1) * sizeof(uint64_t));
+  *dropped = 0;
+  size_t offset = 16;
+  int ret = 0;
+  while (offset < size && ret == 0) {
+    uint8_t type = data[offset++];
+    uint32_t length;
+    switch (type) {
+    case PROFILE_RECORD_NAME:
+      memcpy(&length, data + offset + 4, 4);
+      offset += 8 + length;
+      break;
+    case PROFILE_RECORD_THREAD:
+      offset += 16;
+      break;
+    case PROFILE_RECORD_SECTION:
+    case PROFILE_RECORD_COUNTER:
+      offset += 24;
+      break;
+    case PROFILE_RECORD_DROPPED:
+      memcpy(&length, data + offset + 4, 4);
+      *dropped += length;
+      offset += 8;
+      break;
+    default:
+      ret = -1;
+      continue;
+    }
+    counts[type]++;
+  }
+  if (offset != size)
+    ret = -1;
+  PlatformFreeLoadedFile((void*)data);
+  return ret;
+}
+
+int
+main()
+{
+  BenchInit();
+
+  ProfilerStart(TRACE_PATH);
+  if (!atomic_load(&g_profiler.enabled)) {
+    fprintf(stderr, "failed to start profiler\n");
+    return 1;
+  }
+  uint64_t start = PlatformGetPerformanceCounter();
+  void* threads[NUM_THREADS];
+  for (uint32_t i = 0; i < NUM_THREADS; i++) {
+    threads[i] = PlatformCreateThread(&WorkerMain, "worker", NULL);
+  }
+  uint32_t num_frames = 0;
+  while (atomic_load(&g_finished_threads) < NUM_THREADS) {
+    ProfilerFlush();
+    num_frames++;
+    usleep(FRAME_MICROSECONDS);
+  }
+  for (uint32_t i = 0; i < NUM_THREADS; i++) {
+    PlatformWaitThread(threads[i]);
+  }
+  uint64_t record_time = PlatformGetPerformanceCounter() - start;
+  ProfilerStop();
+  uint64_t total_events = (uint64_t)NUM_THREADS * EVENTS_PER_THREAD;
+  BenchReport("record events (4 threads)", record_time, total_events);
+
+  uint64_t counts[PROFILE_RECORD_DROPPED+1];
+  uint64_t dropped;
+  if (CountTraceRecords(TRACE_PATH, counts, &dropped) != 0) {
+    fprintf(stderr, "trace is corrupted\n");
+    return 1;
+  }
+  printf("  %lu frames, %.2f MB of trace, %lu sections written, %lu dropped\n",
+         (unsigned long)num_frames, (double)g_profiler.bytes_written / (1024.0*1024.0),
+         (unsigned long)counts[PROFILE_RECORD_SECTION], (unsigned long)dropped);
+  if (counts[PROFILE_RECORD_SECTION] + dropped != total_events) {
+    fprintf(stderr, "lost events: %lu recorded, %lu written, %lu dropped\n",
+             (unsigned long)total_events, (unsigned long)counts[PROFILE_RECORD_SECTION], (unsigned long)dropped);
+    return 1;
+  }
+
+  int ret = 0;
+  BENCH("convert trace to JSON", counts[PROFILE_RECORD_SECTION],
+        ret = ProfilerConvertTrace(TRACE_PATH, JSON_PATH));
+  remove(TRACE_PATH);
+  remove(JSON_PATH);
+
+  BenchFree();
+  return (ret == 0) ? 0 : 1;
+}
@@ -0,0 +1,409 @@
+/*
+  bench_voxel_mesh.c
+  Compare GenerateVoxelGridMeshNaive and GenerateVoxelGridMeshGreedy
+  on procedural grids, random noise and .vox models.
+
+  usage: bench_voxel_mesh [--verify] [DIRECTORY...]
+
+  All .vox files from DIRECTORY are added to the corpus. With --verify
+  every mesh is rasterized back to voxel faces and checked against the
+  naive mesh: each visible face must be covered exactly once and with
+  the same color.
+ */
+
+#include "lida_bench.h"
+
+// implementation is linked from ogt_vox.o, see Makefile
+#include "lib/ogt_vox.h"
+
+#include "lida_voxel_grid.c"
+#include "lida_gen.c"
+
+#include <dirent.h>
+
+#if !VX_USE_INDICES
+#error "bench_voxel_mesh expects indexed meshes"
+#endif
+
+#define MAX_MODELS 64
+#define VOXEL_MEMORY_SIZE (1024u*1024*1024)
+#define SCRATCH_MEMORY_SIZE (4*1024*1024)
+// mesh every model for at least this long
+#define MIN_BENCH_TIME 200000000ull
+
+typedef uint32_t(*Mesher_Func)(const Voxel_Grid* grid, Vertex_X3C* vertices, int face,
+                               uint32_t base_index, uint32_t* indices);
+
+typedef struct {
+  const char* name;
+  Mesher_Func func;
+} Mesher;
+
+// first one is the reference for --verify
+GLOBAL const Mesher g_meshers[] = {
+  { "naive",  &GenerateVoxelGridMeshNaive },
+  { "greedy", &GenerateVoxelGridMeshGreedy },
+};
+
+typedef struct {
+  char name[64];
+  Voxel_Grid grid;
+  // number of voxel faces that touch air, same as number of quads
+  // produced by naive mesher
+  uint32_t visible_faces[6];
+} Model;
+
+typedef struct {
+  Vertex_X3C* vertices;
+  uint32_t* indices;
+  // vertices of face i are [offsets[i], offsets[i+1])
+  uint32_t offsets[7];
+} Mesh;
+
+GLOBAL Model g_models[MAX_MODELS];
+GLOBAL uint32_t g_num_models;
+
+
+/// Corpus
+
+INTERNAL Model*
+AddModel(const char* name)
+{
+  if (g_num_models == MAX_MODELS) {
+    LOG_WARN("too many models, '%s' is skipped", name);
+    return NULL;
+  }
+  Model* model = &g_models[g_num_models++];
+  stbsp_snprintf(model->name, sizeof(model->name), "%s", name);
+  return model;
+}
+
+// every voxel value gets a distinct color, so --verify notices when a
+// quad is stretched over a voxel of different value
+INTERNAL void
+SetIdentityPalette(Voxel_Grid* grid)
+{
+  uint32_t colors[256];
+  for (uint32_t i = 0; i < 256; i++)
+    colors[i] = i;
+  SetVoxelGridPalette(grid, colors);
+}
+
+INTERNAL void
+AddNoiseModel(uint32_t size, uint32_t percent, uint32_t num_colors)
+{
+  char name[64];
+  stbsp_snprintf(name, sizeof(name), "noise %u^3 %u%% %u colors", size, percent, num_colors);
+  Model* model = AddModel(name);
+  if (model == NULL || AllocateVoxelGrid(g_vox_allocator, &model->grid, size, size, size))
+    return;
+  for (uint32_t z = 0; z < size; z++)
+    for (uint32_t y = 0; y < size; y++)
+      for (uint32_t x = 0; x < size; x++) {
+        if (Random(g_random) % 100 < percent)
+          GetInVoxelGrid(&model->grid, x, y, z) = 1 + Random(g_random) % num_colors;
+      }
+}
+
+INTERNAL void
+AddProceduralModels()
+{
+  Model* model;
+  if ((model = AddModel("sphere r=31"))) {
+    AllocateVoxelGrid(g_vox_allocator, &model->grid, 63, 63, 63);
+    GenerateVoxelSphere(&model->grid, 31, 1);
+  }
+  if ((model = AddModel("fractal1"))) {
+    GenerateFractal1(&model->grid);
+  }
+  if ((model = AddModel("fractal2 level 3"))) {
+    GenerateFractal2(&model->grid, 3);
+  }
+  if ((model = AddModel("fractal2 level 4"))) {
+    GenerateFractal2(&model->grid, 4);
+  }
+  AddNoiseModel(64, 10, 4);
+  AddNoiseModel(64, 50, 1);
+  AddNoiseModel(64, 90, 4);
+  for (uint32_t i = 0; i < g_num_models; i++)
+    SetIdentityPalette(&g_models[i].grid);
+}
+
+INTERNAL int
+CompareStrings(const void* lhs, const void* rhs)
+{
+  return strcmp(*(const char**)lhs, *(const char**)rhs);
+}
+
+INTERNAL void
+AddModelsFromDirectory(const char* dirname)
+{
+  DIR* dir = opendir(dirname);
+  if (dir == NULL) {
+    LOG_WARN("failed to open directory '%s': %s", dirname, strerror(errno));
+    return;
+  }
+  // sort files so output doesn't depend on file system
+  char* names[MAX_MODELS];
+  uint32_t num_names = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) && num_names < MAX_MODELS) {
+    size_t len = strlen(entry->d_name);
+    if (len > 4 && strcmp(entry->d_name + len - 4, ".vox") == 0)
+      names[num_names++] = strdup(entry->d_name);
+  }
+  closedir(dir);
+  qsort(names, num_names, sizeof(char*), &CompareStrings);
+
+  char path[512];
+  for (uint32_t i = 0; i < num_names; i++) {
+    Model* model = AddModel(names[i]);
+    if (model) {
+      stbsp_snprintf(path, sizeof(path), "%s/%s", dirname, names[i]);
+      if (LoadVoxelGridFromFile(g_vox_allocator, &model->grid, path) != 0) {
+        g_num_models--;
+      }
+    }
+    free(names[i]);
+  }
+}
+
+INTERNAL void
+CountVisibleFaces(Model* model)
+{
+  const Voxel_Grid* grid = &model->grid;
+  for (int face = 0; face < 6; face++) {
+    uint32_t count = 0;
+    for (uint32_t z = 0; z < grid->depth; z++)
+      for (uint32_t y = 0; y < grid->height; y++)
+        for (uint32_t x = 0; x < grid->width; x++) {
+          if (GetInVoxelGrid(grid, x, y, z) &&
+              GetInVoxelGridChecked(grid,
+                                    x + vox_normals[face].x,
+                                    y + vox_normals[face].y,
+                                    z + vox_normals[face].z) == 0)
+            count++;
+        }
+    model->visible_faces[face] = count;
+  }
+}
+
+
+/// Meshing
+
+// generate all 6 faces into one buffer, like voxel backends do
+INTERNAL uint32_t
+MeshVoxelGrid(const Mesher* mesher, const Voxel_Grid* grid, Mesh* mesh)
+{
+  uint32_t count = 0;
+  for (int face = 0; face < 6; face++) {
+    mesh->offsets[face] = count;
+    count += mesher->func(grid, mesh->vertices + count, face, count, mesh->indices + count/4*6);
+  }
+  mesh->offsets[6] = count;
+  return count;
+}
+
+INTERNAL void
+BenchMesher(const Mesher* mesher, const Model* model, Mesh* mesh)
+{
+  const Voxel_Grid* grid = &model->grid;
+  uint32_t visible_faces = 0;
+  for (int face = 0; face < 6; face++)
+    visible_faces += model->visible_faces[face];
+
+  g_scratch_memory->peak = g_scratch_memory->left;
+  uint32_t num_vertices = 0;
+  uint32_t runs = 0;
+  uint64_t start = PlatformGetPerformanceCounter();
+  uint64_t elapsed;
+  do {
+    num_vertices = MeshVoxelGrid(mesher, grid, mesh);
+    BENCH_USE(mesh->vertices);
+    runs++;
+    elapsed = PlatformGetPerformanceCounter() - start;
+  } while (elapsed < MIN_BENCH_TIME);
+  size_t scratch_peak = g_scratch_memory->peak - g_scratch_memory->left;
+
+  BenchReport(mesher->name, elapsed, runs);
+  double voxels = (double)grid->width * grid->height * grid->depth;
+  printf("  %.1f Mvoxels/s, %u quads, %.2f vertices per visible face, %zu bytes scratch\n",
+         voxels * runs / (double)elapsed * 1e3,
+         num_vertices / 4,
+         (visible_faces > 0) ? (double)num_vertices / (double)visible_faces : 0.0,
+         scratch_peak);
+}
+
+
+/// Verification
+
+// hits[] counts how many quads cover a voxel face, colors[] stores
+// color of the last quad
+typedef struct {
+  uint8_t* hits;
+  uint32_t* colors;
+} Face_Coverage;
+
+// NOTE: vertex positions are normalized, see CalculateVoxelGridSize()
+INTERNAL int
+VertexToVoxel(float pos, float half_size, float inv_size)
+{
+  return (int)floorf((pos + half_size) / inv_size + 0.5f);
+}
+
+// return: number of quads that lie outside of grid
+INTERNAL uint32_t
+RasterizeFace(const Voxel_Grid* grid, const Mesh* mesh, int face, Face_Coverage* coverage)
+{
+  Vec3 half_size;
+  float inv_size = CalculateVoxelGridSize(grid, &half_size);
+  const int dims[3] = { grid->width, grid->height, grid->depth };
+  const int d = face >> 1;
+  const int u = (d+1)%3, v = (d+2)%3;
+  uint32_t errors = 0;
+  memset(coverage->hits, 0, grid->width * grid->height * grid->depth);
+  for (uint32_t first = mesh->offsets[face]; first < mesh->offsets[face+1]; first += 4) {
+    int min[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+    int max[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+    for (uint32_t i = 0; i < 4; i++) {
+      const Vertex_X3C* vertex = &mesh->vertices[first + i];
+      int p[3] = { VertexToVoxel(vertex->position.x, half_size.x, inv_size),
+                   VertexToVoxel(vertex->position.y, half_size.y, inv_size),
+                   VertexToVoxel(vertex->position.z, half_size.z, inv_size) };
+      for (int a = 0; a < 3; a++) {
+        if (p[a] < min[a]) min[a] = p[a];
+        if (p[a] > max[a]) max[a] = p[a];
+      }
+    }
+    // quad lies on positive side of voxel for positive faces
+    int pos[3];
+    pos[d] = min[d] - (face & 1);
+    if (min[d] != max[d] || pos[d] < 0 || pos[d] >= dims[d] ||
+        min[u] < 0 || max[u] > dims[u] || min[v] < 0 || max[v] > dims[v]) {
+      errors++;
+      continue;
+    }
+    for (pos[v] = min[v]; pos[v] < max[v]; pos[v]++)
+      for (pos[u] = min[u]; pos[u] < max[u]; pos[u]++) {
+        uint32_t index = pos[0] + pos[1]*grid->width + pos[2]*grid->width*grid->height;
+        if (coverage->hits[index] < UINT8_MAX)
+          coverage->hits[index]++;
+        coverage->colors[index] = mesh->vertices[first].color;
+      }
+  }
+  return errors;
+}
+
+// return: 0 if all meshers produce same faces as the first one
+INTERNAL int
+VerifyModel(const Model* model, Mesh* meshes)
+{
+  const Voxel_Grid* grid = &model->grid;
+  uint32_t volume = grid->width * grid->height * grid->depth;
+  Face_Coverage reference = {
+    .hits = PlatformAllocateMemory(volume),
+    .colors = PlatformAllocateMemory(volume * sizeof(uint32_t)),
+  };
+  Face_Coverage coverage = {
+    .hits = PlatformAllocateMemory(volume),
+    .colors = PlatformAllocateMemory(volume * sizeof(uint32_t)),
+  };
+  int ret = 0;
+  for (uint32_t m = 0; m < ARR_SIZE(g_meshers); m++)
+    MeshVoxelGrid(&g_meshers[m], grid, &meshes[m]);
+
+  for (int face = 0; face < 6; face++) {
+    uint32_t bad_quads = RasterizeFace(grid, &meshes[0], face, &reference);
+    for (uint32_t m = 1; m < ARR_SIZE(g_meshers); m++) {
+      bad_quads += RasterizeFace(grid, &meshes[m], face, &coverage);
+      uint32_t missing = 0, extra = 0, overlapping = 0, wrong_color = 0;
+      for (uint32_t i = 0; i < volume; i++) {
+        if (coverage.hits[i] > 1)
+          overlapping++;
+        if (reference.hits[i] && !coverage.hits[i])
+          missing++;
+        else if (!reference.hits[i] && coverage.hits[i])
+          extra++;
+        else if (reference.hits[i] && reference.colors[i] != coverage.colors[i])
+          wrong_color++;
+      }
+      if (bad_quads || missing || extra || overlapping || wrong_color) {
+        LOG_ERROR("%s: '%s' face %d differs from '%s': %u missing, %u extra, %u overlapping, %u wrong color, %u bad quads",
+                  model->name, g_meshers[m].name, face, g_meshers[0].name,
+                  missing, extra, overlapping, wrong_color, bad_quads);
+        ret = -1;
+      }
+    }
+  }
+  PlatformFreeMemory(coverage.colors);
+  PlatformFreeMemory(coverage.hits);
+  PlatformFreeMemory(reference.colors);
+  PlatformFreeMemory(reference.hits);
+  return ret;
+}
+
+int
+main(int argc, char** argv)
+{
+  BenchInit();
+  g_random = PersistentAllocate(sizeof(Random_State));
+  SeedRandom(g_random, 420, 420);
+  InitScratchMemory(SCRATCH_MEMORY_SIZE);
+  g_vox_allocator = PersistentAllocate(sizeof(Allocator));
+  if (InitVirtualAllocator(g_vox_allocator, ALLOCATOR_TLSF,
+                           PlatformReserveMemory(VOXEL_MEMORY_SIZE), VOXEL_MEMORY_SIZE) != 0) {
+    BenchFree();
+    return 1;
+  }
+  g_vox_palettes = PersistentAllocate(sizeof(Voxel_Palette_Table));
+  InitVoxelPalettes(g_vox_palettes);
+
+  int verify = 0;
+  AddProceduralModels();
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verify") == 0) {
+      verify = 1;
+    } else {
+      AddModelsFromDirectory(argv[i]);
+    }
+  }
+
+  int ret = 0;
+  Mesh meshes[ARR_SIZE(g_meshers)];
+  for (uint32_t i = 0; i < g_num_models; i++) {
+    Model* model = &g_models[i];
+    CountVisibleFaces(model);
+    // no mesher produces more quads than there are visible faces
+    uint32_t max_quads = 0;
+    for (int face = 0; face < 6; face++)
+      max_quads += model->visible_faces[face];
+    for (uint32_t m = 0; m < ARR_SIZE(g_meshers); m++) {
+      meshes[m].vertices = PlatformAllocateMemory((max_quads*4 + 1) * sizeof(Vertex_X3C));
+      meshes[m].indices = PlatformAllocateMemory((max_quads*6 + 1) * sizeof(uint32_t));
+    }
+
+    printf("--- %s (%ux%ux%u, %u visible faces) ---\n", model->name,
+           model->grid.width, model->grid.height, model->grid.depth, max_quads);
+    for (uint32_t m = 0; m < ARR_SIZE(g_meshers); m++)
+      BenchMesher(&g_meshers[m], model, &meshes[m]);
+    if (verify) {
+      // errors go to stderr, keep them next to the model they are about
+      fflush(stdout);
+      if (VerifyModel(model, meshes) == 0) {
+        printf("  verified: meshes cover same faces\n");
+      } else {
+        ret = 1;
+      }
+    }
+
+    for (uint32_t m = 0; m < ARR_SIZE(g_meshers); m++) {
+      PlatformFreeMemory(meshes[m].indices);
+      PlatformFreeMemory(meshes[m].vertices);
+    }
+  }
+
+  for (uint32_t i = 0; i < g_num_models; i++)
+    FreeVoxelGrid(g_vox_allocator, &g_models[i].grid);
+  BenchFree();
+  return ret;
+}
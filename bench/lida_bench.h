@@ -0,0 +1,267 @@
+/* -*- mode: c -*-
+   lida_bench.h
+   Headless harness for micro-benchmarks.
+
+   Includes engine modules that don't need Vulkan and implements
+   platform functions with libc. Include this file exactly once from a
+   benchmark's main file.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+// for MAP_ANONYMOUS and MADV_HUGEPAGE
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stdalign.h"
+#include "string.h"
+#include "math.h"
+
+// benchmarks never touch Vulkan, so we don't need its headers
+typedef struct VkInstance_T* VkInstance;
+typedef struct VkSurfaceKHR_T* VkSurfaceKHR;
+
+#include "lida_platform.h"
+
+#define LIDA_ENGINE_VERSION 202304
+#define INTERNAL static
+#define GLOBAL static
+
+#include "lida_base.c"
+#include "lida_ecs.c"
+#include "lida_algebra.c"
+
+
+/// Platform
+
+void*
+PlatformAllocateMemory(size_t bytes)
+{
+  return calloc(1, bytes);
+}
+
+void
+PlatformFreeMemory(void* bytes)
+{
+  free(bytes);
+}
+
+void*
+PlatformReserveMemory(size_t bytes)
+{
+  void* ptr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+int
+PlatformCommitMemory(void* ptr, size_t bytes, int huge_pages)
+{
+  if (mprotect(ptr, bytes, PROT_READ|PROT_WRITE) != 0)
+    return -1;
+#ifdef MADV_HUGEPAGE
+  if (huge_pages)
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+#else
+  (void)huge_pages;
+#endif
+  return 0;
+}
+
+void
+PlatformReleaseMemory(void* ptr, size_t bytes)
+{
+  munmap(ptr, bytes);
+}
+
+uint64_t
+PlatformGetPerformanceCounter()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t
+PlatformGetPerformanceFrequency()
+{
+  return 1000000000;
+}
+
+uint32_t
+PlatformGetTicks()
+{
+  return PlatformGetPerformanceCounter() / 1000000;
+}
+
+size_t
+PlatformThreadId()
+{
+  return (size_t)pthread_self();
+}
+
+typedef struct {
+  pthread_t handle;
+  Platform_Thread_Func func;
+  void* udata;
+} Bench_Thread;
+
+INTERNAL void*
+BenchThreadMain(void* arg)
+{
+  Bench_Thread* thread = arg;
+  thread->func(thread->udata);
+  return NULL;
+}
+
+void*
+PlatformCreateThread(Platform_Thread_Func func, const char* name, void* udata)
+{
+  (void)name;
+  Bench_Thread* thread = malloc(sizeof(Bench_Thread));
+  thread->func = func;
+  thread->udata = udata;
+  if (pthread_create(&thread->handle, NULL, &BenchThreadMain, thread) != 0) {
+    free(thread);
+    return NULL;
+  }
+  return thread;
+}
+
+void
+PlatformWaitThread(void* thread)
+{
+  pthread_join(((Bench_Thread*)thread)->handle, NULL);
+  free(thread);
+}
+
+uint32_t
+PlatformNumCPUs()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? n : 1;
+}
+
+void*
+PlatformCreateSemaphore(uint32_t initial_value)
+{
+  sem_t* sem = malloc(sizeof(sem_t));
+  sem_init(sem, 0, initial_value);
+  return sem;
+}
+
+void
+PlatformDestroySemaphore(void* sem)
+{
+  sem_destroy(sem);
+  free(sem);
+}
+
+void
+PlatformSemaphoreWait(void* sem)
+{
+  while (sem_wait(sem) != 0 && errno == EINTR);
+}
+
+void
+PlatformSemaphorePost(void* sem)
+{
+  sem_post(sem);
+}
+
+void*
+PlatformLoadEntireFile(const char* path, size_t* buff_size)
+{
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char* data = malloc(size+1);
+  *buff_size = fread(data, 1, size, f);
+  data[*buff_size] = '\0';
+  fclose(f);
+  return data;
+}
+
+void
+PlatformFreeLoadedFile(void* data)
+{
+  free(data);
+}
+
+void*
+PlatformOpenFileForWrite(const char* path)
+{
+  return fopen(path, "wb");
+}
+
+void
+PlatformWriteToFile(void* file, const void* bytes, size_t sz)
+{
+  fwrite(bytes, 1, sz, file);
+}
+
+void
+PlatformCloseFileForWrite(void* file)
+{
+  fclose(file);
+}
+
+const char*
+PlatformGetError()
+{
+  return strerror(errno);
+}
+
+
+/// Benchmarking
+
+#define BENCH_MEMORY_SIZE 256*1024*1024
+
+INTERNAL void
+BenchLogger(const Log_Event* ev)
+{
+  fprintf(stderr, "%.*s\n", ev->strlen, ev->str);
+}
+
+INTERNAL void
+BenchInit()
+{
+  EngineAddLogger(&BenchLogger, 2, NULL);
+  InitMemoryChunk(&g_persistent_memory, PlatformAllocateMemory(BENCH_MEMORY_SIZE), BENCH_MEMORY_SIZE);
+}
+
+INTERNAL void
+BenchFree()
+{
+  PlatformFreeMemory(g_persistent_memory.ptr);
+}
+
+INTERNAL void
+BenchReport(const char* name, uint64_t nanoseconds, uint64_t ops)
+{
+  printf("%-44s %10.2f ns/op %12lu ops %10.3f ms\n",
+         name, (double)nanoseconds / (double)ops, (unsigned long)ops, (double)nanoseconds * 1e-6);
+}
+
+// prevent compiler from throwing away results of benchmarked code
+#ifdef __GNUC__
+#define BENCH_USE(ptr) __asm__ volatile("" : : "g"(ptr) : "memory")
+#else
+#define BENCH_USE(ptr) (void)(ptr)
+#endif
+
+// run code and report time per operation
+#define BENCH(name, ops, ...) do {                                      \
+    uint64_t bench_start_ = PlatformGetPerformanceCounter();            \
+    __VA_ARGS__;                                                        \
+    BenchReport(name, PlatformGetPerformanceCounter() - bench_start_, ops); \
+  } while (0)
@@ -50,6 +50,36 @@ struct Draw_Count {
   uint count;
 };
 
+// stride: 32 bytes, see VX_Cull_Stats in lida_voxel.c
+// faces are quads of voxel meshes, 4 vertices each
+struct Cull_Stats {
+  uint tested_faces;
+  uint frustum_culled_faces;
+  uint occlusion_culled_faces;
+  uint backface_culled_faces;
+  uint emitted_draws;
+  uint pad0;
+  uint pad1;
+  uint pad2;
+};
+
+// Cull statistics of a workgroup, invocations add to them in shared
+// memory and then first invocation adds the sums to Cull_Stats buffer.
+shared Cull_Stats wg_cull_stats;
+
+void begin_cull_stats()
+{
+  if (gl_LocalInvocationIndex == 0) {
+    wg_cull_stats.tested_faces = 0;
+    wg_cull_stats.frustum_culled_faces = 0;
+    wg_cull_stats.occlusion_culled_faces = 0;
+    wg_cull_stats.backface_culled_faces = 0;
+    wg_cull_stats.emitted_draws = 0;
+  }
+  memoryBarrierShared();
+  barrier();
+}
+
 vec3 transform_point(in vec3 pos, in Transform transform, in vec3 box[3])
 {
   vec3 basis[3];
@@ -3,6 +3,23 @@
   Vector and linear algebra.
  */
 
+// SSE is used when available, AVX and FMA are used when compiled with
+// -mavx/-mfma (or -march=native). Define LIDA_NO_SIMD to force scalar code.
+#if !defined(LIDA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <immintrin.h>
+#define LIDA_SIMD_SSE 1
+#ifdef __AVX__
+#define LIDA_SIMD_AVX 1
+#endif
+#ifdef __FMA__
+#define SIMD_MADD(a, b, c) _mm_fmadd_ps(a, b, c)
+#define SIMD_MADD256(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define SIMD_MADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define SIMD_MADD256(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+#endif
+
 typedef struct {
 
   float x;
@@ -49,10 +66,14 @@ typedef struct {
 } Transform;
 DECLARE_COMPONENT(Transform);
 
-// Oriented Bounding Box
+// Oriented Bounding Box, 40 bytes.
+// NOTE: corners are not stored, use GetCornersOBB when you need them.
 typedef struct {
 
-  Vec3 corners[8];
+  Quat rotation;
+  Vec3 center;
+  // already multiplied by transform's scale
+  Vec3 half_size;
 
 } OBB;
 DECLARE_COMPONENT(OBB);
@@ -222,7 +243,7 @@ Mat4_Sub(const Mat4* lhs, const Mat4* rhs, Mat4* out)
 }
 
 INTERNAL void
-Mat4_Mul(const Mat4* lhs, const Mat4* rhs, Mat4* out)
+Mat4_Mul_Scalar(const Mat4* lhs, const Mat4* rhs, Mat4* out)
 {
   Mat4 temp;
   temp.m00 = lhs->m00*rhs->m00 + lhs->m01*rhs->m10 + lhs->m02*rhs->m20 + lhs->m03*rhs->m30;
@@ -246,7 +267,7 @@ Mat4_Mul(const Mat4* lhs, const Mat4* rhs, Mat4* out)
 }
 
 INTERNAL void
-Mat4_Mul_Vec4(const Mat4* lhs, const Vec4* rhs, Vec4* out)
+Mat4_Mul_Vec4_Scalar(const Mat4* lhs, const Vec4* rhs, Vec4* out)
 {
   Vec4 temp;
   temp.x = rhs->x * lhs->m00 + rhs->y * lhs->m01 + rhs->z * lhs->m02 + rhs->w * lhs->m03;
@@ -256,6 +277,61 @@ Mat4_Mul_Vec4(const Mat4* lhs, const Vec4* rhs, Vec4* out)
   memcpy(out, &temp, sizeof(Vec4));
 }
 
+INTERNAL void
+Mat4_Mul(const Mat4* lhs, const Mat4* rhs, Mat4* out)
+{
+#if LIDA_SIMD_AVX
+  // compute 2 columns at once
+  const float* l = &lhs->m00;
+  const float* r = &rhs->m00;
+  __m256 c0 = _mm256_broadcast_ps((const __m128*)(l));
+  __m256 c1 = _mm256_broadcast_ps((const __m128*)(l+4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*)(l+8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*)(l+12));
+  __m256 r01 = _mm256_loadu_ps(r);
+  __m256 r23 = _mm256_loadu_ps(r+8);
+  __m256 o01 = _mm256_mul_ps(c0, _mm256_permute_ps(r01, 0x00));
+  o01 = SIMD_MADD256(c1, _mm256_permute_ps(r01, 0x55), o01);
+  o01 = SIMD_MADD256(c2, _mm256_permute_ps(r01, 0xAA), o01);
+  o01 = SIMD_MADD256(c3, _mm256_permute_ps(r01, 0xFF), o01);
+  __m256 o23 = _mm256_mul_ps(c0, _mm256_permute_ps(r23, 0x00));
+  o23 = SIMD_MADD256(c1, _mm256_permute_ps(r23, 0x55), o23);
+  o23 = SIMD_MADD256(c2, _mm256_permute_ps(r23, 0xAA), o23);
+  o23 = SIMD_MADD256(c3, _mm256_permute_ps(r23, 0xFF), o23);
+  _mm256_storeu_ps(&out->m00, o01);
+  _mm256_storeu_ps(&out->m00+8, o23);
+#elif LIDA_SIMD_SSE
+  // out's column j is a linear combination of lhs's columns
+  const float* l = &lhs->m00;
+  const float* r = &rhs->m00;
+  __m128 c0 = _mm_loadu_ps(l);
+  __m128 c1 = _mm_loadu_ps(l+4);
+  __m128 c2 = _mm_loadu_ps(l+8);
+  __m128 c3 = _mm_loadu_ps(l+12);
+  __m128 o[4];
+  for (int j = 0; j < 4; j++) {
+    o[j] = _mm_mul_ps(c0, _mm_set1_ps(r[4*j]));
+    o[j] = SIMD_MADD(c1, _mm_set1_ps(r[4*j+1]), o[j]);
+    o[j] = SIMD_MADD(c2, _mm_set1_ps(r[4*j+2]), o[j]);
+    o[j] = SIMD_MADD(c3, _mm_set1_ps(r[4*j+3]), o[j]);
+  }
+  // store after computing because 'out' may alias 'lhs' or 'rhs'
+  for (int j = 0; j < 4; j++) {
+    _mm_storeu_ps(&out->m00 + 4*j, o[j]);
+  }
+#else
+  Mat4_Mul_Scalar(lhs, rhs, out);
+#endif
+}
+
+// NOTE: for a single vector SIMD is slower than scalar code because
+// of the broadcasts (bench_algebra), use TransformPoints() for many points
+INTERNAL void
+Mat4_Mul_Vec4(const Mat4* lhs, const Vec4* rhs, Vec4* out)
+{
+  Mat4_Mul_Vec4_Scalar(lhs, rhs, out);
+}
+
 INTERNAL void
 Mat4Transpose(const Mat4* in, Mat4* out)
 {
@@ -537,53 +613,74 @@ CameraUpdate(Camera* camera, float dt, uint32_t window_width, uint32_t window_he
 INTERNAL void
 GetCenterOBB(const OBB* obb, Vec3* center)
 {
-  // compute average value between corners
-  center->x = (obb->corners[0].x + obb->corners[7].x) / 2.0f;
-  center->y = (obb->corners[0].y + obb->corners[7].y) / 2.0f;
-  center->z = (obb->corners[0].z + obb->corners[7].z) / 2.0f;
+  *center = obb->center;
 }
 
+// get box's axes scaled by half size
 INTERNAL void
-CalculateObjectOBB(const Vec3* half_size, const Transform* transform, OBB* obb)
+GetAxesOBB(const OBB* obb, Vec3 axes[3])
 {
-  Vec3 box[3];
-  box[0] = VEC3_CREATE(half_size->x, 0.0f, 0.0f);
-  box[1] = VEC3_CREATE(0.0f, half_size->y, 0.0f);
-  box[2] = VEC3_CREATE(0.0f, 0.0f, half_size->z);
-  RotateByQuat(&box[0], &transform->rotation, &box[0]);
-  RotateByQuat(&box[1], &transform->rotation, &box[1]);
-  RotateByQuat(&box[2], &transform->rotation, &box[2]);
-  const Vec3 muls[8] = {
-    { -1.0f, -1.0f, -1.0f },
-    { -1.0f, -1.0f, 1.0f },
-    { -1.0f, 1.0f, -1.0f },
-    { -1.0f, 1.0f, 1.0f },
-    { 1.0f, -1.0f, -1.0f },
-    { 1.0f, -1.0f, 1.0f },
-    { 1.0f, 1.0f, -1.0f },
-    { 1.0f, 1.0f, 1.0f },
-  };
+  // columns of rotation matrix made from quaternion
+  const Quat* q = &obb->rotation;
+  float xx = q->x*q->x, yy = q->y*q->y, zz = q->z*q->z;
+  float xy = q->x*q->y, xz = q->x*q->z, yz = q->y*q->z;
+  float wx = q->w*q->x, wy = q->w*q->y, wz = q->w*q->z;
+  axes[0] = VEC3_CREATE(1.0f - 2.0f*(yy+zz), 2.0f*(xy+wz), 2.0f*(xz-wy));
+  axes[1] = VEC3_CREATE(2.0f*(xy-wz), 1.0f - 2.0f*(xx+zz), 2.0f*(yz+wx));
+  axes[2] = VEC3_CREATE(2.0f*(xz+wy), 2.0f*(yz-wx), 1.0f - 2.0f*(xx+yy));
+  axes[0] = VEC3_MUL(axes[0], obb->half_size.x);
+  axes[1] = VEC3_MUL(axes[1], obb->half_size.y);
+  axes[2] = VEC3_MUL(axes[2], obb->half_size.z);
+}
+
+// Corner i has bit 2 set for +X, bit 1 for +Y and bit 0 for +Z.
+// This is slow, use only for debugging.
+INTERNAL void
+GetCornersOBB(const OBB* obb, Vec3 corners[8])
+{
+  Vec3 axes[3];
+  GetAxesOBB(obb, axes);
   for (size_t i = 0; i < 8; i++) {
-    Vec3 basis[3];
-    basis[0] = VEC3_MUL(box[0], muls[i].x * (transform->scale + 0.01f));
-    basis[1] = VEC3_MUL(box[1], muls[i].y * (transform->scale + 0.01f));
-    basis[2] = VEC3_MUL(box[2], muls[i].z * (transform->scale + 0.01f));
-    obb->corners[i].x = basis[0].x + basis[1].x + basis[2].x + transform->position.x;
-    obb->corners[i].y = basis[0].y + basis[1].y + basis[2].y + transform->position.y;
-    obb->corners[i].z = basis[0].z + basis[1].z + basis[2].z + transform->position.z;
+    float sx = (i & 4) ? 1.0f : -1.0f;
+    float sy = (i & 2) ? 1.0f : -1.0f;
+    float sz = (i & 1) ? 1.0f : -1.0f;
+    corners[i].x = obb->center.x + sx * axes[0].x + sy * axes[1].x + sz * axes[2].x;
+    corners[i].y = obb->center.y + sx * axes[0].y + sy * axes[1].y + sz * axes[2].y;
+    corners[i].z = obb->center.z + sx * axes[0].z + sy * axes[1].z + sz * axes[2].z;
   }
 }
 
+INTERNAL void
+CalculateObjectOBB(const Vec3* half_size, const Transform* transform, OBB* obb)
+{
+  obb->rotation = transform->rotation;
+  obb->center = transform->position;
+  obb->half_size = VEC3_MUL(*half_size, transform->scale + 0.01f);
+}
+
 INTERNAL int
-TestFrustumOBB(const Mat4* projview, const OBB* obb)
+TestFrustumOBB_Scalar(const Mat4* projview, const OBB* obb)
 {
   // modified version of
   // https://gamedev.ru/code/articles/FrustumCulling
+  Vec3 axes[3];
+  GetAxesOBB(obb, axes);
+  // transformation is linear, so we need only 4 matrix multiplications
+  // instead of 8: corner = center +- axis0 +- axis1 +- axis2
+  Vec4 clip_center, clip_axes[3];
+  Mat4_Mul_Vec4_Scalar(projview, &VEC4_CREATE(obb->center.x, obb->center.y, obb->center.z, 1.0f), &clip_center);
+  for (size_t i = 0; i < 3; i++) {
+    Mat4_Mul_Vec4_Scalar(projview, &VEC4_CREATE(axes[i].x, axes[i].y, axes[i].z, 0.0f), &clip_axes[i]);
+  }
   Vec4 points[8];
   for (size_t i = 0; i < 8; i++) {
-    // transform to clip space
-    Vec4 pos = { obb->corners[i].x, obb->corners[i].y, obb->corners[i].z, 1.0f };
-    Mat4_Mul_Vec4(projview, &pos, &points[i]);
+    float sx = (i & 4) ? 1.0f : -1.0f;
+    float sy = (i & 2) ? 1.0f : -1.0f;
+    float sz = (i & 1) ? 1.0f : -1.0f;
+    points[i].x = clip_center.x + sx * clip_axes[0].x + sy * clip_axes[1].x + sz * clip_axes[2].x;
+    points[i].y = clip_center.y + sx * clip_axes[0].y + sy * clip_axes[1].y + sz * clip_axes[2].y;
+    points[i].z = clip_center.z + sx * clip_axes[0].z + sy * clip_axes[1].z + sz * clip_axes[2].z;
+    points[i].w = clip_center.w + sx * clip_axes[0].w + sy * clip_axes[1].w + sz * clip_axes[2].w;
     // try to early test visible objects. This check is not necessary,
     // in fact if there're many objects that are not visible you may
     // consider to remove this check.
@@ -594,7 +691,6 @@ TestFrustumOBB(const Mat4* projview, const OBB* obb)
       return 1;
     }
   }
-  // TODO: SIMD version of this
   // clip against right plane
   if (points[0].x > points[0].w &&
       points[1].x > points[1].w &&
@@ -653,27 +749,224 @@ TestFrustumOBB(const Mat4* projview, const OBB* obb)
   return 1;
 }
 
+#if LIDA_SIMD_SSE
+// Test 4 points in clip space. Return mask of points which are inside
+// of frustum. outside[i] is mask of points which are outside of plane
+// i (right, left, bottom, top, near).
+INTERNAL int
+ClipTestPoints_SSE(__m128 x, __m128 y, __m128 z, __m128 w, int outside[5])
+{
+  const __m128 zero = _mm_setzero_ps();
+  __m128 nw = _mm_sub_ps(zero, w);
+  // NOTE: no upper check for z because we have inifinite z
+  __m128 in = _mm_and_ps(_mm_cmple_ps(nw, x), _mm_cmple_ps(x, w));
+  in = _mm_and_ps(in, _mm_and_ps(_mm_cmple_ps(nw, y), _mm_cmple_ps(y, w)));
+  in = _mm_and_ps(in, _mm_cmple_ps(zero, z));
+  outside[0] = _mm_movemask_ps(_mm_cmpgt_ps(x, w));
+  outside[1] = _mm_movemask_ps(_mm_cmplt_ps(x, nw));
+  outside[2] = _mm_movemask_ps(_mm_cmpgt_ps(y, w));
+  outside[3] = _mm_movemask_ps(_mm_cmplt_ps(y, nw));
+  outside[4] = _mm_movemask_ps(_mm_cmplt_ps(z, zero));
+  return _mm_movemask_ps(in);
+}
+#endif
+
+INTERNAL int
+TestFrustumOBB(const Mat4* projview, const OBB* obb)
+{
+#if LIDA_SIMD_SSE
+  // same as TestFrustumOBB_Scalar but points are kept in registers
+  Vec3 axes[3];
+  GetAxesOBB(obb, axes);
+  const float* m = &projview->m00;
+  __m128 m0 = _mm_loadu_ps(m);
+  __m128 m1 = _mm_loadu_ps(m+4);
+  __m128 m2 = _mm_loadu_ps(m+8);
+  __m128 m3 = _mm_loadu_ps(m+12);
+#define TRANSFORM_DIR(v) SIMD_MADD(m0, _mm_set1_ps((v).x), SIMD_MADD(m1, _mm_set1_ps((v).y), _mm_mul_ps(m2, _mm_set1_ps((v).z))))
+  __m128 c = _mm_add_ps(TRANSFORM_DIR(obb->center), m3);
+  __m128 a0 = TRANSFORM_DIR(axes[0]);
+  __m128 a1 = TRANSFORM_DIR(axes[1]);
+  __m128 a2 = TRANSFORM_DIR(axes[2]);
+#undef TRANSFORM_DIR
+  // corners, bit 2 of index is X, bit 1 is Y and bit 0 is Z
+  __m128 px0 = _mm_sub_ps(c, a0), px1 = _mm_add_ps(c, a0);
+  __m128 py00 = _mm_sub_ps(px0, a1), py01 = _mm_add_ps(px0, a1);
+  __m128 py10 = _mm_sub_ps(px1, a1), py11 = _mm_add_ps(px1, a1);
+  __m128 p0 = _mm_sub_ps(py00, a2), p1 = _mm_add_ps(py00, a2);
+  __m128 p2 = _mm_sub_ps(py01, a2), p3 = _mm_add_ps(py01, a2);
+  __m128 p4 = _mm_sub_ps(py10, a2), p5 = _mm_add_ps(py10, a2);
+  __m128 p6 = _mm_sub_ps(py11, a2), p7 = _mm_add_ps(py11, a2);
+  // after transposing p0..p3 are x, y, z, w of first 4 points and
+  // p4..p7 are x, y, z, w of last 4 points
+  _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+  _MM_TRANSPOSE4_PS(p4, p5, p6, p7);
+  int outside_lo[5], outside_hi[5];
+  if (ClipTestPoints_SSE(p0, p1, p2, p3, outside_lo) |
+      ClipTestPoints_SSE(p4, p5, p6, p7, outside_hi))
+    return 1;
+  // box is not visible if all of it's corners are outside of one plane
+  for (int i = 0; i < 5; i++) {
+    if ((outside_lo[i] & outside_hi[i]) == 0xF)
+      return 0;
+  }
+  return 1;
+#else
+  return TestFrustumOBB_Scalar(projview, obb);
+#endif
+}
+
+// 'dir' must be normalized. On hit, 'dist' is distance to the point
+// where ray enters the box (or leaves it if origin is inside).
 INTERNAL int
 CheckRayHitOBB(const Vec3* origin, const Vec3* dir, const OBB* obb, float* dist)
 {
-  Vec3 center;
-  GetCenterOBB(obb, &center);
-
-  // FIXME: this isn't correct at all. I just made a sample
-  // implementation to get things working. Obviously, when we would
-  // need proper mouse picking stuff we would want to implement a
-  // proper algorithm using SAT or transforming ray to unitcube space.
-
-  Vec3 q = VEC3_SUB(center, *origin);
-  Vec3_Normalize(&q, &q);
-  float angle = VEC3_DOT(*dir, q);
-  for (int i = 0; i < 8; i++) {
-    Vec3 t = VEC3_SUB(obb->corners[i], *origin);
-    Vec3_Normalize(&t, &t);
-    float p = VEC3_DOT(*dir, t);
-    if (angle < p)
+  // transform ray to box's space and do slab test
+  Quat inv = { -obb->rotation.x, -obb->rotation.y, -obb->rotation.z, obb->rotation.w };
+  Vec3 o = VEC3_SUB(*origin, obb->center);
+  Vec3 d;
+  RotateByQuat(&o, &inv, &o);
+  RotateByQuat(dir, &inv, &d);
+  const float* po = &o.x;
+  const float* pd = &d.x;
+  const float* ph = &obb->half_size.x;
+  float tmin = -INFINITY;
+  float tmax = INFINITY;
+  for (int i = 0; i < 3; i++) {
+    if (fabsf(pd[i]) < 1e-6f) {
+      // ray is parallel to slab
+      if (po[i] < -ph[i] || po[i] > ph[i])
+        return 0;
+      continue;
+    }
+    float inv_d = 1.0f / pd[i];
+    float t1 = (-ph[i] - po[i]) * inv_d;
+    float t2 = (ph[i] - po[i]) * inv_d;
+    if (t1 > t2) {
+      float t = t1; t1 = t2; t2 = t;
+    }
+    if (t1 > tmin) tmin = t1;
+    if (t2 < tmax) tmax = t2;
+    if (tmin > tmax)
       return 0;
   }
-  *dist = sqrtf(VEC3_DOT(q, q));
+  if (tmax < 0.0f)
+    return 0;
+  *dist = (tmin >= 0.0f) ? tmin : tmax;
   return 1;
 }
+
+
+/// Batched functions
+
+// out[i] = lhs * rhs[i], e.g. projview * model for many objects.
+// NOTE: 'out' must not alias 'rhs'
+INTERNAL void
+Mat4_Mul_Batch(const Mat4* lhs, const Mat4* rhs, Mat4* out, size_t count)
+{
+  const float* l = &lhs->m00;
+#if LIDA_SIMD_AVX
+  __m256 c0 = _mm256_broadcast_ps((const __m128*)(l));
+  __m256 c1 = _mm256_broadcast_ps((const __m128*)(l+4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*)(l+8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*)(l+12));
+  for (size_t i = 0; i < count; i++) {
+    const float* r = &rhs[i].m00;
+    float* o = &out[i].m00;
+    for (int j = 0; j < 16; j += 8) {
+      __m256 rj = _mm256_loadu_ps(r+j);
+      __m256 oj = _mm256_mul_ps(c0, _mm256_permute_ps(rj, 0x00));
+      oj = SIMD_MADD256(c1, _mm256_permute_ps(rj, 0x55), oj);
+      oj = SIMD_MADD256(c2, _mm256_permute_ps(rj, 0xAA), oj);
+      oj = SIMD_MADD256(c3, _mm256_permute_ps(rj, 0xFF), oj);
+      _mm256_storeu_ps(o+j, oj);
+    }
+  }
+#elif LIDA_SIMD_SSE
+  __m128 c0 = _mm_loadu_ps(l);
+  __m128 c1 = _mm_loadu_ps(l+4);
+  __m128 c2 = _mm_loadu_ps(l+8);
+  __m128 c3 = _mm_loadu_ps(l+12);
+  for (size_t i = 0; i < count; i++) {
+    const float* r = &rhs[i].m00;
+    float* o = &out[i].m00;
+    for (int j = 0; j < 16; j += 4) {
+      __m128 oj = _mm_mul_ps(c0, _mm_set1_ps(r[j]));
+      oj = SIMD_MADD(c1, _mm_set1_ps(r[j+1]), oj);
+      oj = SIMD_MADD(c2, _mm_set1_ps(r[j+2]), oj);
+      oj = SIMD_MADD(c3, _mm_set1_ps(r[j+3]), oj);
+      _mm_storeu_ps(o+j, oj);
+    }
+  }
+#else
+  (void)l;
+  for (size_t i = 0; i < count; i++) {
+    Mat4_Mul_Scalar(lhs, &rhs[i], &out[i]);
+  }
+#endif
+}
+
+// out[i] = mat * vec4(points[i], 1.0)
+INTERNAL void
+TransformPoints(const Mat4* mat, const Vec3* points, Vec4* out, size_t count)
+{
+  size_t i = 0;
+#if LIDA_SIMD_SSE
+  const float* m = &mat->m00;
+#if LIDA_SIMD_AVX
+  // 2 points per iteration
+  __m256 m0 = _mm256_broadcast_ps((const __m128*)(m));
+  __m256 m1 = _mm256_broadcast_ps((const __m128*)(m+4));
+  __m256 m2 = _mm256_broadcast_ps((const __m128*)(m+8));
+  __m256 m3 = _mm256_broadcast_ps((const __m128*)(m+12));
+  for (; i + 2 <= count; i += 2) {
+    const Vec3* a = &points[i];
+    const Vec3* b = &points[i+1];
+    __m256 v = SIMD_MADD256(m0, _mm256_setr_ps(a->x, a->x, a->x, a->x, b->x, b->x, b->x, b->x), m3);
+    v = SIMD_MADD256(m1, _mm256_setr_ps(a->y, a->y, a->y, a->y, b->y, b->y, b->y, b->y), v);
+    v = SIMD_MADD256(m2, _mm256_setr_ps(a->z, a->z, a->z, a->z, b->z, b->z, b->z, b->z), v);
+    _mm256_storeu_ps(&out[i].x, v);
+  }
+#endif
+  __m128 c0 = _mm_loadu_ps(m);
+  __m128 c1 = _mm_loadu_ps(m+4);
+  __m128 c2 = _mm_loadu_ps(m+8);
+  __m128 c3 = _mm_loadu_ps(m+12);
+  for (; i < count; i++) {
+    __m128 v = SIMD_MADD(c0, _mm_set1_ps(points[i].x), c3);
+    v = SIMD_MADD(c1, _mm_set1_ps(points[i].y), v);
+    v = SIMD_MADD(c2, _mm_set1_ps(points[i].z), v);
+    _mm_storeu_ps(&out[i].x, v);
+  }
+#else
+  for (; i < count; i++) {
+    Vec4 pos = { points[i].x, points[i].y, points[i].z, 1.0f };
+    Mat4_Mul_Vec4_Scalar(mat, &pos, &out[i]);
+  }
+#endif
+}
+
+// build OBBs for many objects, see CalculateObjectOBB
+INTERNAL void
+CalculateObjectOBBs(const Vec3* half_sizes, const Transform* transforms, OBB* obbs, size_t count)
+{
+  // NOTE: this is just a loop, but it's easy for compiler to
+  // vectorize because there're no calls
+  for (size_t i = 0; i < count; i++) {
+    float scale = transforms[i].scale + 0.01f;
+    obbs[i].rotation = transforms[i].rotation;
+    obbs[i].center = transforms[i].position;
+    obbs[i].half_size.x = half_sizes[i].x * scale;
+    obbs[i].half_size.y = half_sizes[i].y * scale;
+    obbs[i].half_size.z = half_sizes[i].z * scale;
+  }
+}
+
+// results[i] = TestFrustumOBB(projview, &obbs[i])
+INTERNAL void
+TestFrustumOBBs(const Mat4* projview, const OBB* obbs, int* results, size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    results[i] = TestFrustumOBB(projview, &obbs[i]);
+  }
+}
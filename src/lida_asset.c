@@ -8,7 +8,8 @@ typedef void(*Asset_Reload_Func)(void* component, const char* path, void* data);
 
 typedef struct {
 
-  const char* name;
+  // path of the asset
+  String_ID name;
   EID id;
   const Sparse_Set* set;
   Asset_Reload_Func reload_func;
@@ -16,33 +17,34 @@ typedef struct {
 
 } Asset_ID;
 
-// this just maps asset names to entity ids
-typedef struct {
-
-  Fixed_Hash_Table asset_ids;
-  Type_Info asset_id_type_info;
-
-} Asset_Manager;
-
-Asset_Manager* g_asset_manager;
-
-
-/// private functions
-
 INTERNAL uint32_t
 HashAssetID(const void* obj)
 {
   const Asset_ID* asset = obj;
-  return HashString32(asset->name);
+  return asset->name;
 }
 
 INTERNAL int
 CompareAssetID(const void* lhs, const void* rhs)
 {
   const Asset_ID* l = lhs, *r = rhs;
-  return strcmp(l->name, r->name);
+  return COMPARE(l->name, r->name);
 }
 
+DECLARE_HASH_TABLE(Asset_Table, Asset_ID, HashAssetID, CompareAssetID)
+
+// this just maps asset names to entity ids
+typedef struct {
+
+  Asset_Table asset_ids;
+
+} Asset_Manager;
+
+Asset_Manager* g_asset_manager;
+
+
+/// private functions
+
 INTERNAL void
 VoxelGrid_ReloadFunc(void* component, const char* path, void* data)
 {
@@ -109,40 +111,41 @@ INTERNAL void
 InitAssetManager(Asset_Manager* am)
 {
   const size_t num_assets = 256;
-  am->asset_id_type_info = TYPE_INFO(Asset_ID, &HashAssetID, &CompareAssetID);
-  FHT_Init(&am->asset_ids,
-           PersistentAllocate(FHT_CALC_SIZE(&am->asset_id_type_info, num_assets)),
-           num_assets, &am->asset_id_type_info);
+  // grows when more assets are added
+  Asset_Table_Init(&am->asset_ids, NULL, num_assets);
 }
 
 INTERNAL void
-FreeAssetManager(Asset_Manager* am, int free_memory)
+FreeAssetManager(Asset_Manager* am)
 {
-  if (free_memory) {
-    PersistentRelease(am->asset_ids.ptr);
-  }
+  Asset_Table_Free(&am->asset_ids);
 }
 
 // return entity id of asset that has tag 'name'
 // (EID)-1 returned if not found
 INTERNAL EID
-GetAssetByName(Asset_Manager* am, const char* name)
+GetAsset(Asset_Manager* am, String_ID name)
 {
-  Asset_ID* asset = FHT_Search(&am->asset_ids, &am->asset_id_type_info,
-                               &(Asset_ID) { .name = name });
+  Asset_ID* asset = Asset_Table_Search(&am->asset_ids, &(Asset_ID) { .name = name });
   if (asset) {
     return asset->id;
   }
   return ENTITY_NIL;
 }
 
+INTERNAL EID
+GetAssetByName(Asset_Manager* am, const char* name)
+{
+  String_ID id = FindStringID(name);
+  return (id != STRING_ID_NONE) ? GetAsset(am, id) : ENTITY_NIL;
+}
+
 // 0 is returned on success
 INTERNAL int
 AddAsset(Asset_Manager* am, EID entity, const char* name,
          const Sparse_Set* storage, Asset_Reload_Func reload_func, void* udata)
 {
-  Asset_ID* asset = FHT_Insert(&am->asset_ids, &am->asset_id_type_info,
-                               &(Asset_ID) { .name = name });
+  Asset_ID* asset = Asset_Table_Insert(&am->asset_ids, &(Asset_ID) { .name = InternString(name) });
   if (asset) {
     asset->id = entity;
     asset->set = storage;
@@ -160,14 +163,17 @@ UpdateAssets(Asset_Manager* am)
   size_t num_changed = PlatformDataDirectoryModified(changed_files, ARR_SIZE(changed_files));
   for (size_t i = 0; i < num_changed; i++) {
     // TODO: detect if voxel models, fonts or bitmaps are changed and reload them
-    Asset_ID* asset = FHT_Search(&am->asset_ids, &am->asset_id_type_info,
-                                 &(Asset_ID) { .name = changed_files[i] });
+    // files that were never interned can't be assets
+    String_ID name = FindStringID(changed_files[i]);
+    if (name == STRING_ID_NONE)
+      continue;
+    Asset_ID* asset = Asset_Table_Search(&am->asset_ids, &(Asset_ID) { .name = name });
     if (asset && asset->reload_func) {
       // reload asset
       asset->reload_func(SearchSparseSet(asset->set, asset->id),
-                         asset->name,
+                         StringFromID(asset->name),
                          asset->udata);
-      LOG_TRACE("reloaded asset '%s'", asset->name);
+      LOG_TRACE("reloaded asset '%s'", StringFromID(asset->name));
     }
   }
 }
@@ -189,6 +195,8 @@ LoadVoxModel(ECS* ecs, Asset_Manager* am, Allocator* allocator,
              EID entity, const char* name)
 {
   Voxel_View* cached = AddComponent(ecs, Voxel_View, entity);
+  if (cached == NULL)
+    return NULL;
   cached->grid = GetAssetByName(am, name);
   if (cached->grid == ENTITY_NIL) {
     cached->grid = CreateEntity(ecs);
@@ -233,9 +241,14 @@ BatchCreateGraphicsPipelines()
 {
   uint32_t count = ComponentCount(Graphics_Pipeline);
   Graphics_Pipeline* progs = ComponentData(Graphics_Pipeline);
-  Pipeline_Desc* descs = PersistentAllocate(count * sizeof(Pipeline_Desc));
-  VkPipeline* pipelines = PersistentAllocate(count * sizeof(VkPipeline));
-  VkPipelineLayout* layouts = PersistentAllocate(count * sizeof(VkPipelineLayout));
+  void* scratch = ScratchTop();
+  Pipeline_Desc* descs = ScratchAllocate(count * sizeof(Pipeline_Desc));
+  VkPipeline* pipelines = ScratchAllocate(count * sizeof(VkPipeline));
+  VkPipelineLayout* layouts = ScratchAllocate(count * sizeof(VkPipelineLayout));
+  if (!descs || !pipelines || !layouts) {
+    ScratchRelease(scratch);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
   for (uint32_t i = 0; i < count; i++) {
     progs[i].create_func(&descs[i]);
     descs[i].vertex_shader = progs[i].vertex_shader;
@@ -249,9 +262,9 @@ BatchCreateGraphicsPipelines()
     progs[i].pipeline = pipelines[i];
     progs[i].layout = layouts[i];
   }
-  PersistentRelease(layouts);
-  PersistentRelease(pipelines);
-  PersistentRelease(descs);
+  ScratchRelease(layouts);
+  ScratchRelease(pipelines);
+  ScratchRelease(descs);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to batch create graphics pipelines with error %s", ToString_VkResult(err));
     return err;
@@ -264,9 +277,14 @@ BatchCreateComputePipelines()
 {
   uint32_t count = ComponentCount(Compute_Pipeline);
   Compute_Pipeline* progs = ComponentData(Compute_Pipeline);
-  VkPipeline* pipelines = PersistentAllocate(count * sizeof(VkPipeline));
-  VkPipelineLayout* layouts = PersistentAllocate(count * sizeof(VkPipelineLayout));
-  const char** shaders = PersistentAllocate(count * sizeof(const char*));
+  void* scratch = ScratchTop();
+  VkPipeline* pipelines = ScratchAllocate(count * sizeof(VkPipeline));
+  VkPipelineLayout* layouts = ScratchAllocate(count * sizeof(VkPipelineLayout));
+  const char** shaders = ScratchAllocate(count * sizeof(const char*));
+  if (!pipelines || !layouts || !shaders) {
+    ScratchRelease(scratch);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
   for (uint32_t i = 0; i < count; i++) {
     shaders[i] = progs[i].shader;
   }
@@ -278,9 +296,9 @@ BatchCreateComputePipelines()
     progs[i].pipeline = pipelines[i];
     progs[i].layout = layouts[i];
   }
-  PersistentRelease(shaders);
-  PersistentRelease(layouts);
-  PersistentRelease(pipelines);
+  ScratchRelease(shaders);
+  ScratchRelease(layouts);
+  ScratchRelease(pipelines);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to batch create compute pipelines with error %s", ToString_VkResult(err));
     return err;
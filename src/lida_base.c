@@ -46,6 +46,8 @@ typedef struct {
   size_t size;
   size_t left;
   size_t right;
+  // max value of left, for statistics
+  size_t peak;
 } Memory_Chunk;
 
 INTERNAL void
@@ -55,6 +57,7 @@ InitMemoryChunk(Memory_Chunk* chunk, void* ptr, size_t size)
   chunk->size = size;
   chunk->left = 0;
   chunk->right = size;
+  chunk->peak = 0;
 }
 
 // allocate memory from the left of the chunk. Memory adress is aligned to 8 bytes.
@@ -67,6 +70,8 @@ MemoryAllocateLeft(Memory_Chunk* chunk, uint32_t size)
   uint8_t* start = (uint8_t*)chunk->ptr + chunk->left;
   void* ATTRIBUTE_ALIGNED(8) bytes = start + MEM_ALIGN_OFF(start, 8);
   chunk->left += size + MEM_ALIGN_OFF(start, 8);
+  if (chunk->left > chunk->peak)
+    chunk->peak = chunk->left;
   return bytes;
 }
 
@@ -82,7 +87,7 @@ MemoryAllocateRight(Memory_Chunk* chunk, uint32_t size)
 INTERNAL void
 MemoryReleaseLeft(Memory_Chunk* chunk, void* ptr)
 {
-  Assert(ptr > chunk->ptr && (size_t)((uint8_t*)ptr - (uint8_t*)chunk->ptr) <= chunk->size);
+  Assert(ptr >= chunk->ptr && (size_t)((uint8_t*)ptr - (uint8_t*)chunk->ptr) <= chunk->size);
   chunk->left = (uint8_t*)ptr - (uint8_t*)chunk->ptr;
 }
 
@@ -101,9 +106,146 @@ MemoryChunkReset(Memory_Chunk* chunk)
 
 GLOBAL Memory_Chunk g_persistent_memory;
 
+// Reserved memory is committed in steps this big. That's also size of
+// a huge page on x86, so committed regions can be backed by them.
+#define MEMORY_COMMIT_GRANULARITY (2*1024*1024)
+
+GLOBAL int g_memory_huge_pages;
+
+// Address space reserved for whole engine at startup. It's split into
+// regions which are committed on demand, so we still have one big
+// block of memory but don't pay for what we don't use.
+GLOBAL struct {
+  void* handle;
+  size_t handle_size;
+  uint8_t* ptr;
+  size_t size;
+  size_t offset;
+} g_virtual_memory;
+
+INTERNAL int
+ReserveVirtualMemory(size_t size)
+{
+  size = ALIGN_TO(size, MEMORY_COMMIT_GRANULARITY);
+  // reserve a bit more so regions are aligned to huge pages
+  g_virtual_memory.handle_size = size + MEMORY_COMMIT_GRANULARITY;
+  g_virtual_memory.handle = PlatformReserveMemory(g_virtual_memory.handle_size);
+  if (g_virtual_memory.handle == NULL) {
+    LOG_ERROR("failed to reserve %zu bytes of address space with error '%s'",
+              g_virtual_memory.handle_size, PlatformGetError());
+    return -1;
+  }
+  g_virtual_memory.ptr = (uint8_t*)ALIGN_TO((uintptr_t)g_virtual_memory.handle, MEMORY_COMMIT_GRANULARITY);
+  g_virtual_memory.size = size;
+  g_virtual_memory.offset = 0;
+  return 0;
+}
+
+// get a region of reserved memory, it's not committed yet. NULL is
+// returned when out of reserved memory
+INTERNAL void*
+CarveVirtualMemory(size_t size)
+{
+  size = ALIGN_TO(size, MEMORY_COMMIT_GRANULARITY);
+  if (g_virtual_memory.offset + size > g_virtual_memory.size) {
+    LOG_ERROR("out of reserved memory: failed to carve %zu bytes, %zu/%zu bytes used",
+              size, g_virtual_memory.offset, g_virtual_memory.size);
+    return NULL;
+  }
+  void* ret = g_virtual_memory.ptr + g_virtual_memory.offset;
+  g_virtual_memory.offset += size;
+  return ret;
+}
+
+INTERNAL void
+ReleaseVirtualMemory()
+{
+  PlatformReleaseMemory(g_virtual_memory.handle, g_virtual_memory.handle_size);
+  g_virtual_memory.handle = NULL;
+  g_virtual_memory.ptr = NULL;
+}
+
 #define PersistentAllocate(size) MemoryAllocateLeft(&g_persistent_memory, size)
 #define PersistentRelease(size) MemoryReleaseLeft(&g_persistent_memory, size)
 
+#include <stdatomic.h>
+
+// Scratch memory is a per-thread stack for temporary allocations that
+// don't outlive a function. Unlike persistent memory it's safe to use
+// from jobs. Every thread executing jobs gets its own stack, see
+// InitScratchMemory().
+GLOBAL _Thread_local Memory_Chunk* g_scratch_memory;
+
+// set by InitScratchMemory(), other threads are job workers
+GLOBAL Memory_Chunk* g_main_scratch_memory;
+// overflows on worker threads, we can't log from them so the main
+// thread reports these in ResetFrameMemory()
+GLOBAL atomic_uint g_scratch_overflows;
+
+// returns NULL when out of scratch memory
+INTERNAL void*
+ScratchAllocate(uint32_t size)
+{
+  Memory_Chunk* chunk = g_scratch_memory;
+  uint8_t* start = (uint8_t*)chunk->ptr + chunk->left;
+  if (chunk->left + size + MEM_ALIGN_OFF(start, 8) >= chunk->right) {
+    if (chunk == g_main_scratch_memory) {
+      LOG_ERROR("scratch memory overflow: failed to allocate %u bytes, %zu/%zu bytes used",
+                size, chunk->left, chunk->right);
+    } else {
+      atomic_fetch_add_explicit(&g_scratch_overflows, 1, memory_order_relaxed);
+    }
+    return NULL;
+  }
+  return MemoryAllocateLeft(chunk, size);
+}
+
+#define ScratchRelease(ptr) MemoryReleaseLeft(g_scratch_memory, ptr)
+// top of the scratch stack, ScratchRelease() on it frees everything
+// allocated afterwards. Handy for cleanup when one of several
+// allocations fails
+#define ScratchTop() ((void*)((uint8_t*)g_scratch_memory->ptr + g_scratch_memory->left))
+
+// Frame memory is a linear arena which is reset at the start of every
+// frame, so nothing allocated from it has to be released. Main thread only.
+GLOBAL Memory_Chunk g_frame_memory;
+// max number of bytes used during a frame
+GLOBAL size_t g_frame_memory_peak;
+// failed allocations since startup, only first one in a frame is logged
+GLOBAL uint32_t g_frame_memory_overflows;
+GLOBAL int g_frame_memory_overflowed;
+
+// returns NULL when out of frame memory
+INTERNAL void*
+FrameAllocate(uint32_t size)
+{
+  uint8_t* start = (uint8_t*)g_frame_memory.ptr + g_frame_memory.left;
+  if (g_frame_memory.left + size + MEM_ALIGN_OFF(start, 8) >= g_frame_memory.right) {
+    if (!g_frame_memory_overflowed) {
+      LOG_ERROR("frame memory overflow: failed to allocate %u bytes, %zu/%zu bytes used",
+                size, g_frame_memory.left, g_frame_memory.right);
+    }
+    g_frame_memory_overflows++;
+    g_frame_memory_overflowed = 1;
+    return NULL;
+  }
+  return MemoryAllocateLeft(&g_frame_memory, size);
+}
+
+INTERNAL void
+ResetFrameMemory()
+{
+  if (g_frame_memory.left > g_frame_memory_peak) {
+    g_frame_memory_peak = g_frame_memory.left;
+  }
+  g_frame_memory_overflowed = 0;
+  MemoryChunkReset(&g_frame_memory);
+  uint32_t scratch_overflows = atomic_exchange_explicit(&g_scratch_overflows, 0, memory_order_relaxed);
+  if (scratch_overflows > 0) {
+    LOG_ERROR("scratch memory overflowed %u times on job workers", scratch_overflows);
+  }
+}
+
 typedef struct Allocation Allocation;
 
 struct Allocation {
@@ -121,6 +263,15 @@ struct Allocation {
 
 };
 
+enum {
+  // stack-like allocator, relocates memory on FixFragmentation()
+  ALLOCATOR_BUMP = 0,
+  // two-level segregated fit: O(1) allocation and free, memory never moves
+  ALLOCATOR_TLSF = 1,
+};
+
+typedef struct TLSF_Control TLSF_Control;
+
 typedef struct {
 
   // NOTE: you might wonder why we have so many fields for that simple
@@ -132,18 +283,38 @@ typedef struct {
   uint32_t offset;
   uint32_t num_allocations;
   uint32_t alloc_offset;
+  uint32_t type;
+  // [0, committed) and [committed_top, size) are backed by physical
+  // memory, see InitVirtualAllocator()
+  uint32_t committed;
+  uint32_t committed_top;
   Allocation* first_allocation;
   Allocation* last_allocation;
   Allocation* free_allocation;
+  TLSF_Control* tlsf;
+
+  // statistics
+  uint32_t peak_size;
+  uint32_t num_relocations;
+  uint64_t relocated_bytes;
+  uint64_t relocation_ticks;
 
 } Allocator;
 
 INTERNAL void
 InitAllocator(Allocator* allocator, void* ptr, uint32_t size)
 {
+  allocator->type = ALLOCATOR_BUMP;
+  allocator->tlsf = NULL;
   allocator->ptr = ptr;
   allocator->effective_size = 0;
   allocator->size = size;
+  allocator->committed = size;
+  allocator->committed_top = 0;
+  allocator->peak_size = 0;
+  allocator->num_relocations = 0;
+  allocator->relocated_bytes = 0;
+  allocator->relocation_ticks = 0;
   allocator->offset = 0;
   allocator->num_allocations = 0;
   allocator->alloc_offset = size;
@@ -152,6 +323,68 @@ InitAllocator(Allocator* allocator, void* ptr, uint32_t size)
   allocator->free_allocation = NULL;
 }
 
+INTERNAL int
+CommitAllocatorRange(Allocator* allocator, uint32_t begin, uint32_t end)
+{
+  if (PlatformCommitMemory((uint8_t*)allocator->ptr + begin, end - begin, g_memory_huge_pages) != 0) {
+    LOG_ERROR("failed to commit %u bytes with error '%s'", end - begin, PlatformGetError());
+    return -1;
+  }
+  return 0;
+}
+
+// make sure [0, end) is usable, -1 is returned when out of reserved memory
+INTERNAL int
+CommitAllocatorBottom(Allocator* allocator, uint64_t end)
+{
+  if (end <= allocator->committed)
+    return 0;
+  if (end > allocator->size)
+    return -1;
+  uint64_t new_committed = ALIGN_TO(end, MEMORY_COMMIT_GRANULARITY);
+  if (new_committed >= allocator->committed_top) {
+    // met with top part, everything is committed now
+    if (CommitAllocatorRange(allocator, allocator->committed, allocator->committed_top) != 0)
+      return -1;
+    allocator->committed = allocator->size;
+    allocator->committed_top = 0;
+    return 0;
+  }
+  if (CommitAllocatorRange(allocator, allocator->committed, new_committed) != 0)
+    return -1;
+  allocator->committed = new_committed;
+  return 0;
+}
+
+// make sure [begin, size) is usable
+INTERNAL int
+CommitAllocatorTop(Allocator* allocator, uint32_t begin)
+{
+  if (begin >= allocator->committed_top)
+    return 0;
+  uint32_t new_top = begin & ~(MEMORY_COMMIT_GRANULARITY-1);
+  if (new_top <= allocator->committed) {
+    if (CommitAllocatorRange(allocator, allocator->committed, allocator->committed_top) != 0)
+      return -1;
+    allocator->committed = allocator->size;
+    allocator->committed_top = 0;
+    return 0;
+  }
+  if (CommitAllocatorRange(allocator, new_top, allocator->committed_top) != 0)
+    return -1;
+  allocator->committed_top = new_top;
+  return 0;
+}
+
+// number of bytes backed by physical memory
+INTERNAL uint32_t
+AllocatorCommittedSize(const Allocator* allocator)
+{
+  if (allocator->committed >= allocator->committed_top)
+    return allocator->size;
+  return allocator->committed + (allocator->size - allocator->committed_top);
+}
+
 // check if we're not leaking memory.
 // NOTE: this should be called when exiting application
 INTERNAL int
@@ -167,39 +400,459 @@ ReleaseAllocator(Allocator* allocator)
 INTERNAL uint32_t
 FixFragmentation(Allocator* allocator)
 {
+  if (allocator->type == ALLOCATOR_TLSF) {
+    // free blocks are merged on free, there's nothing to shrink
+    return 0;
+  }
+  uint64_t start = PlatformGetPerformanceCounter();
   uint32_t counter = 0;
   for (Allocation* it = allocator->first_allocation; it; it = it->right) {
     uint32_t offset = (uint8_t*)it->ptr - (uint8_t*)allocator->ptr;
     if (offset > counter) {
-      memmove((uint8_t*)allocator->ptr, it->ptr, it->size);
+      void* dst = (uint8_t*)allocator->ptr + counter;
+      memmove(dst, it->ptr, it->size);
+      it->ptr = dst;
+      allocator->relocated_bytes += it->size;
     }
     counter += it->size;
   }
   uint32_t old = allocator->offset - counter;
   allocator->offset = counter;
+  allocator->num_relocations++;
+  allocator->relocation_ticks += PlatformGetPerformanceCounter() - start;
   return old;
 }
 
+INTERNAL void
+UpdatePeakSize(Allocator* allocator)
+{
+  if (allocator->effective_size > allocator->peak_size) {
+    allocator->peak_size = allocator->effective_size;
+  }
+}
+
+// add allocation to the end of allocator's list of allocations
+INTERNAL void
+LinkAllocation(Allocator* allocator, Allocation* allocation)
+{
+  allocation->left = allocator->last_allocation;
+  if (allocation->left) {
+    allocation->left->right = allocation;
+  }
+  allocation->right = NULL;
+  allocator->last_allocation = allocation;
+  if (allocator->first_allocation == NULL) {
+    allocator->first_allocation = allocation;
+  }
+  allocator->num_allocations++;
+  allocator->effective_size += allocation->size;
+  UpdatePeakSize(allocator);
+}
+
+INTERNAL void
+UnlinkAllocation(Allocator* allocator, Allocation* allocation)
+{
+  if (allocation->left) {
+    allocation->left->right = allocation->right;
+  } else {
+    allocator->first_allocation = allocation->right;
+  }
+  if (allocation->right) {
+    allocation->right->left = allocation->left;
+  } else {
+    allocator->last_allocation = allocation->left;
+  }
+  allocator->num_allocations--;
+  allocator->effective_size -= allocation->size;
+}
+
+// Two-Level Segregated Fit allocator.
+// http://www.gii.upv.es/tlsf/files/papers/ecrts04_tlsf.pdf
+// Free blocks are kept in lists bucketed by size: first level is a
+// power of 2, second level splits it linearly into TLSF_SL_COUNT
+// parts. Two bitmaps tell which lists are non-empty, so finding a
+// suitable block is just a couple of bit scans. Neighbour free blocks
+// are merged immediately on free, that's why we never need
+// FixFragmentation() and pointers to allocated memory stay valid.
+//
+// Allocation and free are O(1), but two things still take time
+// proportional to size: ChangeAllocationSize() copies the data when the
+// block can't grow in place, and a virtual allocator commits more
+// memory when it runs out, so the first touch of new pages faults.
+
+#define TLSF_ALIGN_LOG2 4
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_COUNT (32 - TLSF_FL_SHIFT + 1)
+#define TLSF_SMALL_BLOCK_SIZE (1 << TLSF_FL_SHIFT)
+
+#define TLSF_BLOCK_FREE 1
+
+typedef struct TLSF_Block TLSF_Block;
+
+// Used block: header, Allocation, user data.
+// Free block: header, free list links.
+struct TLSF_Block {
+
+  // previous block in memory
+  TLSF_Block* prev_phys;
+  // includes header, lowest bit is TLSF_BLOCK_FREE
+  uint32_t size;
+  uint32_t padding;
+  TLSF_Block* next_free;
+  TLSF_Block* prev_free;
+
+};
+
+#define TLSF_HEADER_SIZE offsetof(TLSF_Block, next_free)
+#define TLSF_USED_OVERHEAD ALIGN_TO(TLSF_HEADER_SIZE + sizeof(Allocation), 1 << TLSF_ALIGN_LOG2)
+// blocks smaller than that can't serve any allocation
+#define TLSF_MIN_BLOCK_SIZE (TLSF_USED_OVERHEAD + (1 << TLSF_ALIGN_LOG2))
+
+#define TLSF_BLOCK_SIZE(block) ((block)->size & ~TLSF_BLOCK_FREE)
+#define TLSF_NEXT_BLOCK(block) ((TLSF_Block*)((uint8_t*)(block) + TLSF_BLOCK_SIZE(block)))
+#define TLSF_BLOCK_ALLOCATION(block) ((Allocation*)((uint8_t*)(block) + TLSF_HEADER_SIZE))
+#define TLSF_ALLOCATION_BLOCK(allocation) ((TLSF_Block*)((uint8_t*)(allocation) - TLSF_HEADER_SIZE))
+// there's a sentinel header at the end of committed memory, it's never
+// free so we don't have to check bounds when merging blocks
+#define TLSF_SENTINEL(allocator) ((TLSF_Block*)(((uintptr_t)(allocator)->ptr + (allocator)->committed - TLSF_HEADER_SIZE) & ~(uintptr_t)((1 << TLSF_ALIGN_LOG2) - 1)))
+
+struct TLSF_Control {
+
+  // sum of sizes of all free blocks
+  uint32_t free_size;
+  uint32_t fl_bitmap;
+  uint32_t sl_bitmap[TLSF_FL_COUNT];
+  TLSF_Block* blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+};
+
+#ifdef __GNUC__
+#define TLSF_FLS(v) (31 - __builtin_clz(v))
+#define TLSF_FFS(v) __builtin_ctz(v)
+#else
+INTERNAL uint32_t
+TLSF_FLS(uint32_t v)
+{
+  uint32_t ret = 0;
+  while (v >>= 1) {
+    ret++;
+  }
+  return ret;
+}
+#define TLSF_FFS(v) TLSF_FLS((v) & (~(v)+1))
+#endif
+
+INTERNAL void
+TLSF_MappingInsert(uint32_t size, uint32_t* fl, uint32_t* sl)
+{
+  if (size < TLSF_SMALL_BLOCK_SIZE) {
+    *fl = 0;
+    *sl = size >> TLSF_ALIGN_LOG2;
+  } else {
+    uint32_t f = TLSF_FLS(size);
+    *sl = (size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+    *fl = f - (TLSF_FL_SHIFT - 1);
+  }
+}
+
+// round size up to next list, so any block from it will fit
+INTERNAL void
+TLSF_MappingSearch(uint32_t size, uint32_t* fl, uint32_t* sl)
+{
+  if (size >= TLSF_SMALL_BLOCK_SIZE) {
+    size += (1 << (TLSF_FLS(size) - TLSF_SL_LOG2)) - 1;
+  }
+  TLSF_MappingInsert(size, fl, sl);
+}
+
+INTERNAL void
+TLSF_InsertBlock(TLSF_Control* control, TLSF_Block* block)
+{
+  uint32_t fl, sl;
+  TLSF_MappingInsert(TLSF_BLOCK_SIZE(block), &fl, &sl);
+  TLSF_Block* head = control->blocks[fl][sl];
+  block->prev_free = NULL;
+  block->next_free = head;
+  if (head) {
+    head->prev_free = block;
+  }
+  control->blocks[fl][sl] = block;
+  control->fl_bitmap |= 1u << fl;
+  control->sl_bitmap[fl] |= 1u << sl;
+  control->free_size += TLSF_BLOCK_SIZE(block);
+}
+
+INTERNAL void
+TLSF_RemoveBlock(TLSF_Control* control, TLSF_Block* block)
+{
+  control->free_size -= TLSF_BLOCK_SIZE(block);
+  if (block->next_free) {
+    block->next_free->prev_free = block->prev_free;
+  }
+  if (block->prev_free) {
+    block->prev_free->next_free = block->next_free;
+    return;
+  }
+  uint32_t fl, sl;
+  TLSF_MappingInsert(TLSF_BLOCK_SIZE(block), &fl, &sl);
+  control->blocks[fl][sl] = block->next_free;
+  if (block->next_free == NULL) {
+    control->sl_bitmap[fl] &= ~(1u << sl);
+    if (control->sl_bitmap[fl] == 0) {
+      control->fl_bitmap &= ~(1u << fl);
+    }
+  }
+}
+
+INTERNAL TLSF_Block*
+TLSF_FindBlock(TLSF_Control* control, uint32_t size)
+{
+  if (size >= (1u << 31)) {
+    return NULL;
+  }
+  uint32_t fl, sl;
+  TLSF_MappingSearch(size, &fl, &sl);
+  if (fl >= TLSF_FL_COUNT) {
+    return NULL;
+  }
+  uint32_t sl_map = control->sl_bitmap[fl] & (~0u << sl);
+  if (sl_map == 0) {
+    // no blocks in this first level list, go to bigger ones
+    uint32_t fl_map = control->fl_bitmap & (~0u << (fl+1));
+    if (fl_map == 0) {
+      // out of space
+      return NULL;
+    }
+    fl = TLSF_FFS(fl_map);
+    sl_map = control->sl_bitmap[fl];
+  }
+  sl = TLSF_FFS(sl_map);
+  return control->blocks[fl][sl];
+}
+
+// mark block as free, merge it with free neighbours and put to free lists
+INTERNAL void
+TLSF_ReleaseBlock(TLSF_Control* control, TLSF_Block* block)
+{
+  TLSF_Block* next = TLSF_NEXT_BLOCK(block);
+  if (next->size & TLSF_BLOCK_FREE) {
+    TLSF_RemoveBlock(control, next);
+    block->size += TLSF_BLOCK_SIZE(next);
+  }
+  TLSF_Block* prev = block->prev_phys;
+  if (prev && (prev->size & TLSF_BLOCK_FREE)) {
+    TLSF_RemoveBlock(control, prev);
+    prev->size += TLSF_BLOCK_SIZE(block);
+    block = prev;
+  }
+  block->size |= TLSF_BLOCK_FREE;
+  TLSF_NEXT_BLOCK(block)->prev_phys = block;
+  TLSF_InsertBlock(control, block);
+}
+
+// cut used block to size, return the rest to free lists
+INTERNAL void
+TLSF_TrimBlock(TLSF_Control* control, TLSF_Block* block, uint32_t size)
+{
+  uint32_t block_size = TLSF_BLOCK_SIZE(block);
+  if (block_size < size + TLSF_MIN_BLOCK_SIZE) {
+    return;
+  }
+  TLSF_Block* rest = (TLSF_Block*)((uint8_t*)block + size);
+  rest->prev_phys = block;
+  rest->size = block_size - size;
+  block->size = size;
+  TLSF_NEXT_BLOCK(rest)->prev_phys = rest;
+  TLSF_ReleaseBlock(control, rest);
+}
+
+// commit more memory and append it to the last block.
+INTERNAL int
+TLSF_Grow(Allocator* allocator, uint32_t block_size)
+{
+  TLSF_Block* sentinel = TLSF_SENTINEL(allocator);
+  // TLSF_FindBlock() only looks at lists which are certainly big enough
+  uint64_t needed = block_size;
+  if (block_size >= TLSF_SMALL_BLOCK_SIZE) {
+    needed += (1 << (TLSF_FLS(block_size) - TLSF_SL_LOG2)) - 1;
+  }
+  // last block will be merged with new memory
+  if (sentinel->prev_phys->size & TLSF_BLOCK_FREE) {
+    uint32_t last_size = TLSF_BLOCK_SIZE(sentinel->prev_phys);
+    needed = (needed > last_size) ? needed - last_size : 0;
+  }
+  uint64_t end = (uint8_t*)sentinel - (uint8_t*)allocator->ptr + needed + 2 * TLSF_HEADER_SIZE;
+  if (CommitAllocatorBottom(allocator, end) != 0) {
+    return -1;
+  }
+  // old sentinel becomes a free block
+  TLSF_Block* new_sentinel = TLSF_SENTINEL(allocator);
+  new_sentinel->prev_phys = sentinel;
+  new_sentinel->size = 0;
+  sentinel->size = (uint8_t*)new_sentinel - (uint8_t*)sentinel;
+  TLSF_ReleaseBlock(allocator->tlsf, sentinel);
+  return 0;
+}
+
+INTERNAL Allocation*
+TLSF_Allocate(Allocator* allocator, uint32_t size, const char* tag)
+{
+  if (size > allocator->size) {
+    return NULL;
+  }
+  uint32_t block_size = ALIGN_TO(size + TLSF_USED_OVERHEAD, 1 << TLSF_ALIGN_LOG2);
+  TLSF_Block* block = TLSF_FindBlock(allocator->tlsf, block_size);
+  if (block == NULL) {
+    if (TLSF_Grow(allocator, block_size) != 0) {
+      // out of space
+      return NULL;
+    }
+    block = TLSF_FindBlock(allocator->tlsf, block_size);
+    if (block == NULL) {
+      return NULL;
+    }
+  }
+  TLSF_RemoveBlock(allocator->tlsf, block);
+  block->size &= ~TLSF_BLOCK_FREE;
+  TLSF_TrimBlock(allocator->tlsf, block, block_size);
+  Allocation* ret = TLSF_BLOCK_ALLOCATION(block);
+  ret->ptr = (uint8_t*)block + TLSF_USED_OVERHEAD;
+  ret->size = size;
+  ret->tag = tag;
+  LinkAllocation(allocator, ret);
+  return ret;
+}
+
+INTERNAL void
+TLSF_Free(Allocator* allocator, Allocation* allocation)
+{
+  UnlinkAllocation(allocator, allocation);
+  TLSF_ReleaseBlock(allocator->tlsf, TLSF_ALLOCATION_BLOCK(allocation));
+}
+
+INTERNAL Allocation*
+TLSF_Reallocate(Allocator* allocator, Allocation* allocation, uint32_t new_size)
+{
+  if (new_size > allocator->size) {
+    return NULL;
+  }
+  TLSF_Block* block = TLSF_ALLOCATION_BLOCK(allocation);
+  uint32_t block_size = ALIGN_TO(new_size + TLSF_USED_OVERHEAD, 1 << TLSF_ALIGN_LOG2);
+  if (block_size > TLSF_BLOCK_SIZE(block)) {
+    TLSF_Block* next = TLSF_NEXT_BLOCK(block);
+    if ((next->size & TLSF_BLOCK_FREE) &&
+        TLSF_BLOCK_SIZE(block) + TLSF_BLOCK_SIZE(next) >= block_size) {
+      // grow in place by eating next free block
+      TLSF_RemoveBlock(allocator->tlsf, next);
+      block->size += TLSF_BLOCK_SIZE(next);
+      TLSF_NEXT_BLOCK(block)->prev_phys = block;
+    } else {
+      Allocation* new_allocation = TLSF_Allocate(allocator, new_size, allocation->tag);
+      if (new_allocation) {
+        memcpy(new_allocation->ptr, allocation->ptr, allocation->size);
+        TLSF_Free(allocator, allocation);
+      }
+      return new_allocation;
+    }
+  }
+  TLSF_TrimBlock(allocator->tlsf, block, block_size);
+  allocator->effective_size -= allocation->size;
+  allocator->effective_size += new_size;
+  allocation->size = new_size;
+  UpdatePeakSize(allocator);
+  return allocation;
+}
+
+// put control structure and one free block to committed memory
+INTERNAL void
+TLSF_InitPool(Allocator* allocator)
+{
+  allocator->type = ALLOCATOR_TLSF;
+  uintptr_t start = ALIGN_TO((uintptr_t)allocator->ptr, 1 << TLSF_ALIGN_LOG2);
+  uintptr_t first = ALIGN_TO(start + sizeof(TLSF_Control), 1 << TLSF_ALIGN_LOG2);
+  TLSF_Block* sentinel = TLSF_SENTINEL(allocator);
+  Assert((uintptr_t)sentinel > first + TLSF_MIN_BLOCK_SIZE);
+  allocator->tlsf = (TLSF_Control*)start;
+  memset(allocator->tlsf, 0, sizeof(TLSF_Control));
+  TLSF_Block* block = (TLSF_Block*)first;
+  block->prev_phys = NULL;
+  block->size = ((uintptr_t)sentinel - first) | TLSF_BLOCK_FREE;
+  sentinel->prev_phys = block;
+  sentinel->size = 0;
+  TLSF_InsertBlock(allocator->tlsf, block);
+}
+
+// Same as InitAllocator(), but allocations never move. Some memory
+// from the beginning is used for free lists.
+INTERNAL void
+InitAllocatorTLSF(Allocator* allocator, void* ptr, uint32_t size)
+{
+  InitAllocator(allocator, ptr, size);
+  TLSF_InitPool(allocator);
+}
+
+/**
+   Initialize allocator over reserved memory, it's committed as
+   allocator grows.
+   @param type ALLOCATOR_BUMP or ALLOCATOR_TLSF
+   @param ptr memory from CarveVirtualMemory()
+   Return 0 on success.
+ */
+INTERNAL int
+InitVirtualAllocator(Allocator* allocator, uint32_t type, void* ptr, uint32_t size)
+{
+  if (ptr == NULL) {
+    LOG_ERROR("no reserved memory for allocator");
+    return -1;
+  }
+  InitAllocator(allocator, ptr, size);
+  allocator->committed = 0;
+  allocator->committed_top = size;
+  if (type == ALLOCATOR_TLSF) {
+    if (CommitAllocatorBottom(allocator, MEMORY_COMMIT_GRANULARITY) != 0)
+      return -1;
+    TLSF_InitPool(allocator);
+  }
+  return 0;
+}
+
 // O(1) best case
 // O(1) common case
 // O(N) worst case, relocation happens
+// NOTE: TLSF allocators are O(1), except when they commit memory
 INTERNAL Allocation*
 DoAllocation(Allocator* allocator, uint32_t size, const char* tag)
 {
   Assert(size > 0);
-  if (allocator->effective_size + size > allocator->alloc_offset) {
+  if (allocator->type == ALLOCATOR_TLSF) {
+    return TLSF_Allocate(allocator, size, tag);
+  }
+  // new allocation record might take space too
+  uint32_t limit = allocator->alloc_offset;
+  if (allocator->free_allocation == NULL) {
+    if (limit < sizeof(Allocation))
+      return NULL;
+    limit -= sizeof(Allocation);
+  }
+  if (allocator->effective_size + size > limit) {
     // out of space
     return NULL;
   }
   void* ptr = (uint8_t*)allocator->ptr + allocator->offset;
-  if (allocator->offset + size > allocator->alloc_offset) {
+  if (allocator->offset + size > limit) {
     FixFragmentation(allocator);
     // allocator->offset certainly changed, need to reassign ptr
     ptr = (uint8_t*)allocator->ptr + allocator->offset;
   }
+  if (CommitAllocatorBottom(allocator, (uint64_t)allocator->offset + size) != 0 ||
+      CommitAllocatorTop(allocator, limit) != 0) {
+    return NULL;
+  }
   Allocation* ret;
   if (allocator->free_allocation == NULL) {
-    ret = (Allocation*)((uint8_t*)allocator->ptr + allocator->alloc_offset - sizeof(Allocation));
+    ret = (Allocation*)((uint8_t*)allocator->ptr + limit);
     allocator->alloc_offset -= sizeof(Allocation);
   } else {
     // pop free allocation list
@@ -208,19 +861,9 @@ DoAllocation(Allocator* allocator, uint32_t size, const char* tag)
   }
   ret->ptr = ptr;
   ret->size = size;
-  ret->left = allocator->last_allocation;
-  if (ret->left) {
-    ret->left->right = ret;
-  }
-  ret->right = NULL;
   ret->tag = tag;
-  allocator->num_allocations++;
-  allocator->effective_size += size;
+  LinkAllocation(allocator, ret);
   allocator->offset += size;
-  allocator->last_allocation = ret;
-  if (allocator->first_allocation == NULL) {
-    allocator->first_allocation = ret;
-  }
   return ret;
 }
 
@@ -229,22 +872,16 @@ INTERNAL void
 FreeAllocation(Allocator* allocator, Allocation* allocation)
 {
   // TODO: various checks that allocation is valid
+  if (allocator->type == ALLOCATOR_TLSF) {
+    TLSF_Free(allocator, allocation);
+    return;
+  }
   // important optimization: if last allocation is freed then we can
   // decrease stack cursor
   if (allocation == allocator->last_allocation) {
     allocator->offset -= allocation->size;
   }
-  // remove from linked list
-  if (allocation->left) {
-    allocation->left->right = allocation->right;
-  } else {
-    allocator->first_allocation = allocation->right;
-  }
-  if (allocation->right) {
-    allocation->right->left = allocation->left;
-  } else {
-    allocator->last_allocation = allocation->left;
-  }
+  UnlinkAllocation(allocator, allocation);
   if ((uint8_t*)allocation == (uint8_t*)allocator->ptr + allocator->alloc_offset) {
     // decrease size of allocation stack
     allocator->alloc_offset += sizeof(Allocation);
@@ -253,8 +890,6 @@ FreeAllocation(Allocator* allocator, Allocation* allocation)
     allocation->ptr = allocator->free_allocation;
     allocator->free_allocation = allocation;
   }
-  allocator->effective_size -= allocation->size;
-  allocator->num_allocations--;
 }
 
 // behaves same as realloc()
@@ -264,7 +899,10 @@ ChangeAllocationSize(Allocator* allocator, Allocation* allocation, uint32_t new_
   Assert(new_size > 0);
   // TODO: checks for failures
   if (allocation == NULL) {
-    return DoAllocation(allocator, new_size, allocation->tag);
+    return DoAllocation(allocator, new_size, NULL);
+  }
+  if (allocator->type == ALLOCATOR_TLSF) {
+    return TLSF_Reallocate(allocator, allocation, new_size);
   }
   if (new_size <= allocation->size) {
     allocator->effective_size -= allocation->size - new_size;
@@ -276,18 +914,32 @@ ChangeAllocationSize(Allocator* allocator, Allocation* allocation, uint32_t new_
     if ((uint8_t*)next->ptr - (uint8_t*)allocation->ptr >= new_size) {
       allocator->effective_size += new_size - allocation->size;
       allocation->size = new_size;
+      UpdatePeakSize(allocator);
       return allocation;
     }
   } else {
     // allocation is at the end, we can grow it easily
     if (allocator->offset + new_size - allocation->size > allocator->alloc_offset) {
       FixFragmentation(allocator);
+      if (allocator->offset + new_size - allocation->size > allocator->alloc_offset) {
+        // out of space
+        return NULL;
+      }
+    }
+    if (CommitAllocatorBottom(allocator, (uint64_t)allocator->offset + new_size - allocation->size) != 0) {
+      return NULL;
     }
+    allocator->offset += new_size - allocation->size;
+    allocator->effective_size += new_size - allocation->size;
     allocation->size = new_size;
+    UpdatePeakSize(allocator);
     return allocation;
   }
   // worst case: make a new allocation
   Allocation* new_allocation = DoAllocation(allocator, new_size, allocation->tag);
+  if (new_allocation == NULL) {
+    return NULL;
+  }
   memcpy(new_allocation->ptr, allocation->ptr, allocation->size);
   FreeAllocation(allocator, allocation);
   return new_allocation;
@@ -302,6 +954,143 @@ DebugListAllocations(Allocator* allocator)
   }
 }
 
+typedef struct {
+
+  uint32_t reserved;
+  uint32_t committed;
+  // bytes taken by allocations, their headers and holes between them
+  uint32_t used;
+  // bytes requested by allocations
+  uint32_t effective;
+  uint32_t peak;
+  // space left including memory that is not committed yet
+  uint32_t total_free;
+  // biggest allocation that can be made without relocation
+  uint32_t largest_free;
+  // 0 when free space is in one piece, goes to 1 when it's scattered
+  float fragmentation;
+  uint32_t num_allocations;
+  uint32_t num_relocations;
+  uint64_t relocated_bytes;
+  uint64_t relocation_ticks;
+
+} Allocator_Stats;
+
+INTERNAL void
+GetAllocatorStats(const Allocator* allocator, Allocator_Stats* stats)
+{
+  stats->reserved = allocator->size;
+  stats->committed = AllocatorCommittedSize(allocator);
+  stats->effective = allocator->effective_size;
+  stats->peak = allocator->peak_size;
+  stats->num_allocations = allocator->num_allocations;
+  stats->num_relocations = allocator->num_relocations;
+  stats->relocated_bytes = allocator->relocated_bytes;
+  stats->relocation_ticks = allocator->relocation_ticks;
+  if (allocator->type == ALLOCATOR_TLSF) {
+    const TLSF_Control* control = allocator->tlsf;
+    uint32_t uncommitted = allocator->size - allocator->committed;
+    stats->used = allocator->committed - control->free_size;
+    stats->total_free = control->free_size + uncommitted;
+    // last block grows when we commit more memory
+    TLSF_Block* last = TLSF_SENTINEL(allocator)->prev_phys;
+    stats->largest_free = uncommitted + ((last->size & TLSF_BLOCK_FREE) ? TLSF_BLOCK_SIZE(last) : 0);
+    if (control->fl_bitmap) {
+      uint32_t fl = TLSF_FLS(control->fl_bitmap);
+      uint32_t sl = TLSF_FLS(control->sl_bitmap[fl]);
+      for (TLSF_Block* it = control->blocks[fl][sl]; it; it = it->next_free) {
+        if (TLSF_BLOCK_SIZE(it) > stats->largest_free)
+          stats->largest_free = TLSF_BLOCK_SIZE(it);
+      }
+    }
+    // block headers are not available for user
+    stats->largest_free = (stats->largest_free > TLSF_USED_OVERHEAD) ? stats->largest_free - TLSF_USED_OVERHEAD : 0;
+  } else {
+    uint32_t records = allocator->size - allocator->alloc_offset;
+    stats->used = allocator->offset + records;
+    stats->total_free = allocator->alloc_offset - allocator->effective_size;
+    stats->largest_free = allocator->alloc_offset - allocator->offset;
+  }
+  if (stats->total_free > 0 && stats->largest_free < stats->total_free) {
+    stats->fragmentation = 1.0f - (float)stats->largest_free / (float)stats->total_free;
+  } else {
+    stats->fragmentation = 0.0f;
+  }
+}
+
+typedef struct {
+  const char* tag;
+  uint32_t count;
+  uint32_t bytes;
+} Allocation_Tag_Stats;
+
+/**
+   Group live allocations by tag, biggest first.
+   @return number of tags written to out
+ */
+INTERNAL uint32_t
+GetAllocationTagStats(const Allocator* allocator, Allocation_Tag_Stats* out, uint32_t max_tags)
+{
+  uint32_t count = 0;
+  for (Allocation* it = allocator->first_allocation; it; it = it->right) {
+    const char* tag = (it->tag) ? it->tag : "(null)";
+    uint32_t i = 0;
+    // tags are usually string literals, so compare pointers first
+    while (i < count && out[i].tag != tag && strcmp(out[i].tag, tag) != 0)
+      i++;
+    if (i == count) {
+      if (count == max_tags)
+        continue;
+      out[count++] = (Allocation_Tag_Stats) { .tag = tag, .count = 0, .bytes = 0 };
+    }
+    out[i].count++;
+    out[i].bytes += it->size;
+  }
+  // insertion sort, there are only few tags
+  for (uint32_t i = 1; i < count; i++) {
+    Allocation_Tag_Stats t = out[i];
+    uint32_t j = i;
+    for (; j > 0 && out[j-1].bytes < t.bytes; j--)
+      out[j] = out[j-1];
+    out[j] = t;
+  }
+  return count;
+}
+
+// Allocators that show up in memory statistics.
+#define MAX_REGISTERED_ALLOCATORS 16
+
+GLOBAL struct {
+  Allocator* allocators[MAX_REGISTERED_ALLOCATORS];
+  const char* names[MAX_REGISTERED_ALLOCATORS];
+  uint32_t count;
+} g_allocator_registry;
+
+INTERNAL void
+RegisterAllocator(Allocator* allocator, const char* name)
+{
+  if (g_allocator_registry.count == MAX_REGISTERED_ALLOCATORS) {
+    LOG_WARN("can't register allocator '%s': too many allocators", name);
+    return;
+  }
+  g_allocator_registry.allocators[g_allocator_registry.count] = allocator;
+  g_allocator_registry.names[g_allocator_registry.count] = name;
+  g_allocator_registry.count++;
+}
+
+INTERNAL void
+UnregisterAllocator(Allocator* allocator)
+{
+  for (uint32_t i = 0; i < g_allocator_registry.count; i++) {
+    if (g_allocator_registry.allocators[i] == allocator) {
+      g_allocator_registry.count--;
+      g_allocator_registry.allocators[i] = g_allocator_registry.allocators[g_allocator_registry.count];
+      g_allocator_registry.names[i] = g_allocator_registry.names[g_allocator_registry.count];
+      return;
+    }
+  }
+}
+
 
 /// Logging
 
@@ -574,47 +1363,144 @@ HashMemory32(const void* key, uint32_t bytes)
   return h;
 }
 
+/*
+  Fast 64-bit hash for large buffers like voxel grids. Inner loop is
+  the same as in XXH3: every 8-byte word is xor'ed with a key and
+  low and high halves of result are multiplied. Unlike XXH3 there's
+  no scrambling between blocks, instead keys depend on position of a
+  word, so hash of a buffer is a plain sum of hashes of its words:
+
+    word_hash(w, j) = lo32(w ^ key(j)) * hi32(w ^ key(j)) + w
+    key(j) = g_hash_keys[j % 8] + (j / 8) * HASH_KEY_STEP
+
+  This lets us update hash of a buffer when only a part of it was
+  changed: subtract HashAccumulate64() of changed words before the
+  edit and add it back after. Don't use it for anything where hash
+  flooding matters.
+ */
+
+#if !defined(LIDA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define HASH_SIMD_SSE2 1
+#ifdef __AVX2__
+#include <immintrin.h>
+#define HASH_SIMD_AVX2 1
+#endif
+#endif
+
+#define HASH_KEY_STEP 0x9E3779B185EBCA87ull
+
+GLOBAL const uint64_t g_hash_keys[8] = {
+  0xbe4ba423396cfeb8, 0x1cad21f72c81017c, 0xdb979083e96dd4de, 0x1f67b3b7a4a44072,
+  0x78e5c0cc4ee679cb, 0x2172ffcc7dd05a82, 0x8e2443f7744608b8, 0x4c263a81e69035e0,
+};
+
 INTERNAL uint64_t
-HashMemory64(const void* key, uint32_t bytes)
+HashWord64(uint64_t word, uint64_t index)
 {
-  // based on MurmurHash2
-  const uint32_t seed = LIDA_ENGINE_VERSION;
-  const uint64_t m = 0xc6a4a7935bd1e995;
-  const int r = 47;
-  uint64_t h = seed ^ (bytes * m);
-  const uint64_t * data = (const uint64_t *)key;
-  const uint64_t * end = data + (bytes/8);
-  while(data != end) {
-    uint64_t k = *(data++);
-
-    k *= m;
-    k ^= k >> r;
-    k *= m;
+  uint64_t k = word ^ (g_hash_keys[index & 7] + (index >> 3) * HASH_KEY_STEP);
+  return (k & 0xFFFFFFFF) * (k >> 32) + word;
+}
 
-    h ^= k;
-    h *= m;
+// Sum of word hashes of 'bytes' bytes of 'data'. 'first_word' is index
+// of data's first word in the whole buffer. Last word is padded with
+// zeros if 'bytes' is not multiple of 8.
+INTERNAL uint64_t
+HashAccumulate64(const void* data, size_t bytes, uint64_t first_word)
+{
+  const uint8_t* ptr = data;
+  uint64_t sum = 0;
+  uint64_t index = first_word;
+  uint64_t word;
+  // go to a stripe boundary so vector lanes always use the same keys
+  while ((index & 7) && bytes >= 8) {
+    memcpy(&word, ptr, 8);
+    sum += HashWord64(word, index);
+    ptr += 8;
+    bytes -= 8;
+    index++;
   }
-  // handle remaining bytes
-  const unsigned char * chars = (const unsigned char*)data;
-  switch(bytes & 7) {
-    case 7: h ^= (uint64_t)chars[6] << 48;
-      ATTRIBUTE_FALLTHROUGH();
-    case 6: h ^= (uint64_t)chars[5] << 40;
-      ATTRIBUTE_FALLTHROUGH();
-    case 5: h ^= (uint64_t)chars[4] << 32;
-      ATTRIBUTE_FALLTHROUGH();
-    case 4: h ^= (uint64_t)chars[3] << 24;
-      ATTRIBUTE_FALLTHROUGH();
-    case 3: h ^= (uint64_t)chars[2] << 16;
-      ATTRIBUTE_FALLTHROUGH();
-    case 2: h ^= (uint64_t)chars[1] << 8;
-      ATTRIBUTE_FALLTHROUGH();
-    case 1: h ^= (uint64_t)chars[0];
-      h *= m;
-  };
-  h ^= h >> r;
-  h *= m;
-  h ^= h >> r;
+#if HASH_SIMD_AVX2
+  if (bytes >= 64) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i step = _mm256_set1_epi64x((int64_t)HASH_KEY_STEP);
+    __m256i offset = _mm256_set1_epi64x((int64_t)((index >> 3) * HASH_KEY_STEP));
+    __m256i key0 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)&g_hash_keys[0]), offset);
+    __m256i key1 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)&g_hash_keys[4]), offset);
+    while (bytes >= 64) {
+      __m256i d0 = _mm256_loadu_si256((const __m256i*)ptr);
+      __m256i d1 = _mm256_loadu_si256((const __m256i*)(ptr + 32));
+      __m256i k0 = _mm256_xor_si256(d0, key0);
+      __m256i k1 = _mm256_xor_si256(d1, key1);
+      // _mm256_mul_epu32 multiplies low halves of 64-bit lanes
+      __m256i p0 = _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32));
+      __m256i p1 = _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32));
+      acc = _mm256_add_epi64(acc, _mm256_add_epi64(p0, d0));
+      acc = _mm256_add_epi64(acc, _mm256_add_epi64(p1, d1));
+      key0 = _mm256_add_epi64(key0, step);
+      key1 = _mm256_add_epi64(key1, step);
+      ptr += 64;
+      bytes -= 64;
+      index += 8;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+#elif HASH_SIMD_SSE2
+  if (bytes >= 64) {
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i step = _mm_set1_epi64x((int64_t)HASH_KEY_STEP);
+    __m128i offset = _mm_set1_epi64x((int64_t)((index >> 3) * HASH_KEY_STEP));
+    __m128i keys[4];
+    for (int i = 0; i < 4; i++)
+      keys[i] = _mm_add_epi64(_mm_loadu_si128((const __m128i*)&g_hash_keys[2*i]), offset);
+    while (bytes >= 64) {
+      for (int i = 0; i < 4; i++) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(ptr + 16*i));
+        __m128i k = _mm_xor_si128(d, keys[i]);
+        __m128i p = _mm_add_epi64(_mm_mul_epu32(k, _mm_srli_epi64(k, 32)), d);
+        if (i & 1) {
+          acc1 = _mm_add_epi64(acc1, p);
+        } else {
+          acc0 = _mm_add_epi64(acc0, p);
+        }
+        keys[i] = _mm_add_epi64(keys[i], step);
+      }
+      ptr += 64;
+      bytes -= 64;
+      index += 8;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    sum += lanes[0] + lanes[1];
+  }
+#endif
+  while (bytes >= 8) {
+    memcpy(&word, ptr, 8);
+    sum += HashWord64(word, index);
+    ptr += 8;
+    bytes -= 8;
+    index++;
+  }
+  if (bytes > 0) {
+    word = 0;
+    memcpy(&word, ptr, bytes);
+    sum += HashWord64(word, index);
+  }
+  return sum;
+}
+
+INTERNAL uint64_t
+HashMemory64(const void* key, uint32_t bytes)
+{
+  const uint32_t seed = LIDA_ENGINE_VERSION;
+  uint64_t h = HashAccumulate64(key, bytes, 0) ^ ((uint64_t)bytes * HASH_KEY_STEP) ^ seed;
+  // avalanche from XXH3
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ull;
+  h ^= h >> 32;
   return h;
 }
 
@@ -824,6 +1710,499 @@ FHT_IteratorGet(FHT_Iterator* it)
 // TODO: see generated assembly and optimise
 #define FHT_FOREACH(ht, type, it) for (FHT_IteratorBegin(ht, type, it); !FHT_IteratorEmpty(it); FHT_IteratorNext(it))
 
+/*
+  Swiss tables.
+
+  Open addressing hash table in the style of Abseil's flat_hash_map.
+  Every slot has a control byte which is either HT_EMPTY, HT_DELETED
+  or 7 bits of element's hash. Lookup loads 16 control bytes at once
+  and compares keys only for slots whose control byte matches, so
+  most of misses don't touch elements at all.
+
+  Unlike Fixed_Hash_Table, element type, hash and compare functions
+  are known at compile time, so they get inlined. A table type is
+  generated with DECLARE_HASH_TABLE():
+
+    DECLARE_HASH_TABLE(Sampler_Cache, Sampler_Info, HashSamplerInfo, CompareSamplerInfo)
+
+    Sampler_Cache cache;
+    // NULL means that table allocates memory by itself and grows when needed
+    Sampler_Cache_Init(&cache, NULL, 8);
+    Sampler_Info* info = Sampler_Cache_Search(&cache, &key);
+    Sampler_Info* it;
+    HT_FOREACH(Sampler_Cache, &cache, it) {
+      ...
+    }
+    Sampler_Cache_Free(&cache);
+
+  Table can also be placed in user memory of HT_CALC_SIZE() bytes,
+  then it never grows and Insert() fails when table is full.
+ */
+
+#if !defined(LIDA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define HT_SIMD_SSE2 1
+#endif
+
+#define HT_GROUP_WIDTH 16
+#define HT_EMPTY ((int8_t)-128)
+#define HT_DELETED ((int8_t)-2)
+
+#ifdef __GNUC__
+#define HT_CTZ(v) __builtin_ctz(v)
+#define HT_CLZ16(v) (__builtin_clz(v) - 16)
+#else
+INTERNAL uint32_t
+HT_CTZ(uint32_t v)
+{
+  uint32_t ret = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    ret++;
+  }
+  return ret;
+}
+
+INTERNAL uint32_t
+HT_CLZ16(uint32_t v)
+{
+  uint32_t ret = 0;
+  while ((v & 0x8000) == 0) {
+    v <<= 1;
+    ret++;
+  }
+  return ret;
+}
+#endif
+
+// bit i is set when ctrl[i] == h2
+INTERNAL uint32_t
+HT_MatchByte(const int8_t* ctrl, int8_t h2)
+{
+#ifdef HT_SIMD_SSE2
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HT_GROUP_WIDTH; i++)
+    mask |= (ctrl[i] == h2) << i;
+  return mask;
+#endif
+}
+
+// bit i is set when ctrl[i] is HT_EMPTY or HT_DELETED
+INTERNAL uint32_t
+HT_MatchFree(const int8_t* ctrl)
+{
+#ifdef HT_SIMD_SSE2
+  // only free slots have the sign bit set
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HT_GROUP_WIDTH; i++)
+    mask |= (ctrl[i] < 0) << i;
+  return mask;
+#endif
+}
+
+// Hash functions in the engine don't mix bits well(HashString32 is
+// modulo 1000009), so scramble them before splitting to H1 and H2.
+INTERNAL uint64_t
+HT_Scramble(uint32_t hash)
+{
+  return (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+}
+
+// position where probing starts
+#define HT_H1(scrambled) (uint32_t)((scrambled) >> 32)
+// 7 bits stored in control byte
+#define HT_H2(scrambled) (int8_t)((scrambled) >> 25 & 0x7F)
+
+// max number of elements in table of given capacity
+#define HT_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+INTERNAL uint32_t
+HT_CapacityFor(uint32_t num_elements)
+{
+  uint32_t capacity = NearestPow2(num_elements + num_elements / 7 + 1);
+  return (capacity < HT_GROUP_WIDTH) ? HT_GROUP_WIDTH : capacity;
+}
+
+// Control bytes follow slots. First HT_GROUP_WIDTH control bytes are
+// cloned at the end, so a group can be loaded at any position.
+#define HT_MEMORY_SIZE(elem_size, capacity) ((size_t)(elem_size) * (capacity) + (capacity) + HT_GROUP_WIDTH)
+#define HT_CALC_SIZE(type, n) HT_MEMORY_SIZE(sizeof(type), HT_CapacityFor(n))
+
+INTERNAL void
+HT_SetCtrl(int8_t* ctrl, uint32_t capacity, uint32_t i, int8_t h)
+{
+  ctrl[i] = h;
+  if (i < HT_GROUP_WIDTH)
+    ctrl[capacity + i] = h;
+}
+
+// find a free slot where element with this hash should go
+INTERNAL uint32_t
+HT_FindFreeSlot(const int8_t* ctrl, uint32_t capacity, uint64_t scrambled)
+{
+  uint32_t mask = capacity - 1;
+  uint32_t pos = HT_H1(scrambled) & mask;
+  uint32_t stride = 0;
+  while (1) {
+    uint32_t free_mask = HT_MatchFree(ctrl + pos);
+    if (free_mask) {
+      return (pos + HT_CTZ(free_mask)) & mask;
+    }
+    // triangular probing visits every group when capacity is a power of 2
+    stride += HT_GROUP_WIDTH;
+    pos = (pos + stride) & mask;
+  }
+}
+
+#define DECLARE_HASH_TABLE(name, type, hash_func, cmp_func)             \
+  typedef struct {                                                      \
+    type* slots;                                                        \
+    int8_t* ctrl;                                                       \
+    uint32_t capacity;                                                  \
+    uint32_t size;                                                      \
+    /* number of insertions left before rehash */                       \
+    uint32_t growth_left;                                               \
+    /* memory was allocated by table, it grows when needed */           \
+    int can_grow;                                                       \
+  } name;                                                               \
+                                                                        \
+  INTERNAL void                                                         \
+  name##_Setup(name* ht, void* ptr, uint32_t capacity)                  \
+  {                                                                     \
+    ht->slots = ptr;                                                    \
+    ht->ctrl = (int8_t*)(ht->slots + capacity);                         \
+    ht->capacity = capacity;                                            \
+    ht->size = 0;                                                       \
+    ht->growth_left = HT_MAX_LOAD(capacity);                            \
+    memset(ht->ctrl, HT_EMPTY, capacity + HT_GROUP_WIDTH);              \
+  }                                                                     \
+                                                                        \
+  /* ptr is either NULL or memory of HT_CALC_SIZE(type, max_elements) */ \
+  INTERNAL int                                                          \
+  name##_Init(name* ht, void* ptr, uint32_t max_elements)               \
+  {                                                                     \
+    uint32_t capacity = HT_CapacityFor(max_elements);                   \
+    ht->can_grow = (ptr == NULL);                                       \
+    if (ptr == NULL) {                                                  \
+      ptr = PlatformAllocateMemory(HT_MEMORY_SIZE(sizeof(type), capacity)); \
+      if (ptr == NULL) {                                                \
+        LOG_ERROR("failed to allocate hash table '" #name "' for %u elements", max_elements); \
+        return -1;                                                      \
+      }                                                                 \
+    }                                                                   \
+    name##_Setup(ht, ptr, capacity);                                    \
+    return 0;                                                           \
+  }                                                                     \
+                                                                        \
+  INTERNAL void                                                         \
+  name##_Free(name* ht)                                                 \
+  {                                                                     \
+    if (ht->can_grow)                                                   \
+      PlatformFreeMemory(ht->slots);                                    \
+    ht->slots = NULL;                                                   \
+    ht->ctrl = NULL;                                                    \
+    ht->capacity = 0;                                                   \
+    ht->size = 0;                                                       \
+    ht->growth_left = 0;                                                \
+  }                                                                     \
+                                                                        \
+  INTERNAL type*                                                        \
+  name##_Search(const name* ht, const type* key)                        \
+  {                                                                     \
+    uint64_t scrambled = HT_Scramble(hash_func(key));                   \
+    int8_t h2 = HT_H2(scrambled);                                       \
+    uint32_t mask = ht->capacity - 1;                                   \
+    uint32_t pos = HT_H1(scrambled) & mask;                             \
+    uint32_t stride = 0;                                                \
+    while (1) {                                                         \
+      const int8_t* group = ht->ctrl + pos;                             \
+      uint32_t match = HT_MatchByte(group, h2);                         \
+      while (match) {                                                   \
+        uint32_t id = (pos + HT_CTZ(match)) & mask;                     \
+        if (cmp_func(&ht->slots[id], key) == 0)                         \
+          return &ht->slots[id];                                        \
+        match &= match - 1;                                             \
+      }                                                                 \
+      /* element would have been put in an empty slot */                \
+      if (HT_MatchByte(group, HT_EMPTY))                                \
+        return NULL;                                                    \
+      stride += HT_GROUP_WIDTH;                                         \
+      pos = (pos + stride) & mask;                                      \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  /* rebuild table to remove tombstones or to change its capacity */    \
+  INTERNAL int                                                          \
+  name##_Rehash(name* ht, uint32_t capacity)                            \
+  {                                                                     \
+    type* old_slots = ht->slots;                                        \
+    const int8_t* old_ctrl = ht->ctrl;                                  \
+    uint32_t old_capacity = ht->capacity;                               \
+    uint32_t size = ht->size;                                           \
+    if (ht->can_grow) {                                                 \
+      void* ptr = PlatformAllocateMemory(HT_MEMORY_SIZE(sizeof(type), capacity)); \
+      if (ptr == NULL) {                                                \
+        LOG_ERROR("failed to grow hash table '" #name "' to %u elements", capacity); \
+        return -1;                                                      \
+      }                                                                 \
+      name##_Setup(ht, ptr, capacity);                                  \
+    } else {                                                            \
+      /* user memory: move elements aside and insert them back */       \
+      Assert(capacity == old_capacity);                                 \
+      type* temp = ScratchAllocate(size * sizeof(type));                \
+      if (temp == NULL)                                                 \
+        return -1;                                                      \
+      uint32_t j = 0;                                                   \
+      for (uint32_t i = 0; i < old_capacity; i++)                       \
+        if (old_ctrl[i] >= 0)                                           \
+          temp[j++] = old_slots[i];                                     \
+      name##_Setup(ht, old_slots, old_capacity);                        \
+      for (uint32_t i = 0; i < size; i++) {                             \
+        uint64_t scrambled = HT_Scramble(hash_func(&temp[i]));          \
+        uint32_t id = HT_FindFreeSlot(ht->ctrl, ht->capacity, scrambled); \
+        HT_SetCtrl(ht->ctrl, ht->capacity, id, HT_H2(scrambled));       \
+        ht->slots[id] = temp[i];                                        \
+      }                                                                 \
+      ScratchRelease(temp);                                             \
+      ht->size = size;                                                  \
+      ht->growth_left -= size;                                          \
+      return 0;                                                         \
+    }                                                                   \
+    for (uint32_t i = 0; i < old_capacity; i++) {                       \
+      if (old_ctrl[i] < 0)                                              \
+        continue;                                                       \
+      uint64_t scrambled = HT_Scramble(hash_func(&old_slots[i]));       \
+      uint32_t id = HT_FindFreeSlot(ht->ctrl, ht->capacity, scrambled); \
+      HT_SetCtrl(ht->ctrl, ht->capacity, id, HT_H2(scrambled));         \
+      ht->slots[id] = old_slots[i];                                     \
+    }                                                                   \
+    PlatformFreeMemory(old_slots);                                      \
+    ht->size = size;                                                    \
+    ht->growth_left -= size;                                            \
+    return 0;                                                           \
+  }                                                                     \
+                                                                        \
+  /* NULL is returned if element is already in table or table is full */ \
+  INTERNAL type*                                                        \
+  name##_Insert(name* ht, const type* elem)                             \
+  {                                                                     \
+    if (name##_Search(ht, elem))                                        \
+      return NULL;                                                      \
+    if (ht->growth_left == 0) {                                         \
+      uint32_t capacity = ht->capacity;                                 \
+      if (!ht->can_grow) {                                              \
+        /* only tombstones can be reclaimed */                          \
+        if (ht->size == HT_MAX_LOAD(capacity))                          \
+          return NULL;                                                  \
+      } else if (ht->size >= HT_MAX_LOAD(capacity) / 2) {               \
+        /* grow only if table is really full, not filled with tombstones */ \
+        capacity *= 2;                                                  \
+      }                                                                 \
+      if (name##_Rehash(ht, capacity) != 0)                             \
+        return NULL;                                                    \
+    }                                                                   \
+    uint64_t scrambled = HT_Scramble(hash_func(elem));                  \
+    uint32_t id = HT_FindFreeSlot(ht->ctrl, ht->capacity, scrambled);   \
+    /* reusing a tombstone doesn't take away from growth */             \
+    if (ht->ctrl[id] == HT_EMPTY)                                       \
+      ht->growth_left--;                                                \
+    HT_SetCtrl(ht->ctrl, ht->capacity, id, HT_H2(scrambled));           \
+    ht->slots[id] = *elem;                                              \
+    ht->size++;                                                         \
+    return &ht->slots[id];                                              \
+  }                                                                     \
+                                                                        \
+  /* returned element stays valid until next insertion */              \
+  INTERNAL type*                                                        \
+  name##_Remove(name* ht, const type* key)                              \
+  {                                                                     \
+    type* elem = name##_Search(ht, key);                                \
+    if (elem == NULL)                                                   \
+      return NULL;                                                      \
+    uint32_t mask = ht->capacity - 1;                                   \
+    uint32_t id = elem - ht->slots;                                     \
+    uint32_t empty_before = HT_MatchByte(ht->ctrl + ((id - HT_GROUP_WIDTH) & mask), HT_EMPTY); \
+    uint32_t empty_after = HT_MatchByte(ht->ctrl + id, HT_EMPTY);       \
+    /* if no group that contains this slot was ever full, no probe      \
+       sequence went past it and slot can become empty again */         \
+    if (empty_before && empty_after &&                                  \
+        HT_CTZ(empty_after) + HT_CLZ16(empty_before) < HT_GROUP_WIDTH) { \
+      HT_SetCtrl(ht->ctrl, ht->capacity, id, HT_EMPTY);                 \
+      ht->growth_left++;                                                \
+    } else {                                                            \
+      HT_SetCtrl(ht->ctrl, ht->capacity, id, HT_DELETED);               \
+    }                                                                   \
+    ht->size--;                                                         \
+    return elem;                                                        \
+  }                                                                     \
+                                                                        \
+  INTERNAL void                                                         \
+  name##_Clear(name* ht)                                                \
+  {                                                                     \
+    name##_Setup(ht, ht->slots, ht->capacity);                          \
+  }                                                                     \
+                                                                        \
+  /* returns next element starting from *index, NULL at the end */      \
+  INTERNAL type*                                                        \
+  name##_Next(const name* ht, uint32_t* index)                          \
+  {                                                                     \
+    while (*index < ht->capacity) {                                     \
+      uint32_t i = (*index)++;                                          \
+      if (ht->ctrl[i] >= 0)                                             \
+        return &ht->slots[i];                                           \
+    }                                                                   \
+    return NULL;                                                        \
+  }
+
+#define HT_FOREACH(name, ht, it) for (uint32_t it##_index = 0; ((it) = name##_Next(ht, &it##_index)) != NULL; )
+
+
+/// String interning
+// Strings are mapped to small integer IDs, so they can be compared
+// and looked up without touching their characters. IDs are given in
+// order starting from 1, 0 is never a valid ID. Interned strings are
+// copied and never move, so pointers from StringFromID() stay valid
+// until FreeStringTable(). Main thread only.
+
+typedef uint32_t String_ID;
+
+#define STRING_ID_NONE 0
+// strings are copied into blocks of this size
+#define STRING_BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+  const char* str;
+  uint32_t hash;
+  String_ID id;
+} Interned_String;
+
+INTERNAL uint32_t
+HashInternedString(const void* obj)
+{
+  return ((const Interned_String*)obj)->hash;
+}
+
+INTERNAL int
+CompareInternedStrings(const void* lhs, const void* rhs)
+{
+  const Interned_String* l = lhs, *r = rhs;
+  if (l->hash != r->hash)
+    return COMPARE(l->hash, r->hash);
+  return strcmp(l->str, r->str);
+}
+
+DECLARE_HASH_TABLE(String_Table, Interned_String, HashInternedString, CompareInternedStrings)
+
+GLOBAL struct {
+  String_Table table;
+  // indexed by String_ID
+  const char** strings;
+  uint32_t num_strings;
+  uint32_t max_strings;
+  // blocks are linked through their first bytes
+  char* block;
+  uint32_t block_offset;
+} g_strings;
+
+INTERNAL Interned_String
+MakeStringKey(const char* str, uint32_t* length)
+{
+  *length = strlen(str);
+  return (Interned_String) { .str = str, .hash = HashMemory32(str, *length), .id = STRING_ID_NONE };
+}
+
+INTERNAL char*
+CopyInternedString(const char* str, uint32_t length)
+{
+  uint32_t needed = length + 1;
+  if (g_strings.block == NULL || g_strings.block_offset + needed > STRING_BLOCK_SIZE) {
+    // long strings get a block of their own
+    uint32_t block_size = (needed + sizeof(char*) > STRING_BLOCK_SIZE) ? needed + sizeof(char*) : STRING_BLOCK_SIZE;
+    char* block = PlatformAllocateMemory(block_size);
+    if (block == NULL)
+      return NULL;
+    *(char**)block = g_strings.block;
+    g_strings.block = block;
+    g_strings.block_offset = sizeof(char*);
+  }
+  char* ret = g_strings.block + g_strings.block_offset;
+  memcpy(ret, str, needed);
+  g_strings.block_offset += needed;
+  return ret;
+}
+
+// returns STRING_ID_NONE if string was never interned
+INTERNAL String_ID
+FindStringID(const char* str)
+{
+  if (g_strings.num_strings == 0)
+    return STRING_ID_NONE;
+  uint32_t length;
+  Interned_String key = MakeStringKey(str, &length);
+  Interned_String* it = String_Table_Search(&g_strings.table, &key);
+  return (it) ? it->id : STRING_ID_NONE;
+}
+
+INTERNAL String_ID
+InternString(const char* str)
+{
+  if (g_strings.strings == NULL) {
+    g_strings.max_strings = 1024;
+    g_strings.strings = PlatformAllocateMemory(g_strings.max_strings * sizeof(const char*));
+    String_Table_Init(&g_strings.table, NULL, g_strings.max_strings);
+    // reserve 0 for STRING_ID_NONE
+    g_strings.strings[0] = "";
+    g_strings.num_strings = 1;
+  }
+  uint32_t length;
+  Interned_String key = MakeStringKey(str, &length);
+  Interned_String* it = String_Table_Search(&g_strings.table, &key);
+  if (it)
+    return it->id;
+  if (g_strings.num_strings == g_strings.max_strings) {
+    const char** strings = PlatformAllocateMemory(2 * g_strings.max_strings * sizeof(const char*));
+    memcpy(strings, g_strings.strings, g_strings.num_strings * sizeof(const char*));
+    PlatformFreeMemory(g_strings.strings);
+    g_strings.strings = strings;
+    g_strings.max_strings *= 2;
+  }
+  key.str = CopyInternedString(str, length);
+  key.id = g_strings.num_strings;
+  if (key.str == NULL || String_Table_Insert(&g_strings.table, &key) == NULL) {
+    LOG_ERROR("failed to intern string '%s'", str);
+    return STRING_ID_NONE;
+  }
+  g_strings.strings[g_strings.num_strings++] = key.str;
+  return key.id;
+}
+
+INTERNAL const char*
+StringFromID(String_ID id)
+{
+  Assert(id < g_strings.num_strings);
+  return g_strings.strings[id];
+}
+
+INTERNAL void
+FreeStringTable()
+{
+  if (g_strings.strings == NULL)
+    return;
+  String_Table_Free(&g_strings.table);
+  PlatformFreeMemory(g_strings.strings);
+  while (g_strings.block) {
+    char* next = *(char**)g_strings.block;
+    PlatformFreeMemory(g_strings.block);
+    g_strings.block = next;
+  }
+  memset(&g_strings, 0, sizeof(g_strings));
+}
+
 
 /// Random number generator
 // based on PCG: https://www.pcg-random.org/download.html
@@ -865,123 +2244,1171 @@ SeedRandom(Random_State* rng, uint64_t initstate, uint64_t initseq)
 
 /// Builtin profiler
 
+/*
+  Every thread that records events gets its own ring buffer. The
+  thread is the only writer of its ring and the background writer
+  thread is the only reader, so submitting an event is just a copy
+  and an atomic store. Writer thread is woken up by ProfilerFlush()
+  (called once per frame) or when a ring gets half full, it drains
+  all rings and streams them to disk in big chunks.
+
+  Trace is stored in a compact binary format (all numbers are little
+  endian):
+
+    header:  "LPRF" | u32 version | u64 performance counter frequency
+    records: u8 type | payload
+      PROFILE_RECORD_NAME:    u32 id | u32 length | char[length]
+      PROFILE_RECORD_THREAD:  u32 index | u64 thread id | u32 name (UINT32_MAX if none)
+      PROFILE_RECORD_SECTION: u32 name | u32 thread | u64 start | u64 duration
+      PROFILE_RECORD_COUNTER: u32 name | u32 thread | u64 timestamp | f64 value
+      PROFILE_RECORD_DROPPED: u32 thread | u32 number of lost events
+
+  Besides CPU threads there are tracks: timelines filled by one thread
+  with events that happened elsewhere, e.g. GPU work.
+
+  Names are written once, when writer sees them for the first time.
+  Writer also sums time spent in each section, twice a second the most
+  expensive ones are published for ProfilerGetTopZones().
+  Use ProfilerConvertTrace() or 'make tools' and bin/lida_trace to
+  get a JSON which can be opened in chrome://tracing or Perfetto.
+ */
+
+#include <stdatomic.h>
+
+#define PROFILE_TRACE_MAGIC "LPRF"
+#define PROFILE_TRACE_VERSION 2
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_TOP_ZONES 8
+
+typedef struct {
+
+  const char* name;
+  // averaged over frames since previous update
+  float milliseconds_per_frame;
+  float calls_per_frame;
+
+} Profile_Zone_Stats;
+
+enum {
+  PROFILE_RECORD_NAME = 1,
+  PROFILE_RECORD_THREAD,
+  PROFILE_RECORD_SECTION,
+  PROFILE_RECORD_COUNTER,
+  PROFILE_RECORD_DROPPED,
+};
+
 #if !defined(PROFILER_DISABLE) && defined(__GNUC__)
 
 #define PROFILE_FUNCTION() Profile_Section profile_section_ __attribute__((cleanup(ProfilerEndSection))); \
   ProfilerBeginSection(&profile_section_, __func__);
 
+// events per thread, must be a power of 2
+#define PROFILER_RING_SIZE (32*1024)
+#define PROFILER_CHUNK_SIZE (256*1024)
+#define PROFILER_SUMMARY_PERIOD_MS 500
+
 typedef struct {
 
   const char* name;
   uint64_t start;
-  uint64_t duration;
-  size_t thread_id;
 
 } Profile_Section;
 
 typedef struct {
 
-  // TODO: number needs tweaking
-  Profile_Section buff[128*1024];
-  uint32_t offset;
-  int enabled;
+  const char* name;
+  uint64_t timestamp;
+  union {
+    uint64_t duration;
+    // for counters
+    double value;
+  };
+  uint32_t type;
 
-} Profiler;
+} Profile_Event;
 
-GLOBAL Profiler g_profiler;
+typedef struct {
 
-INTERNAL void
-ProfilerStart()
+  Profile_Event events[PROFILER_RING_SIZE];
+  // written only by owning thread
+  atomic_uint write;
+  // written only by writer thread
+  atomic_uint read;
+  atomic_uint dropped;
+  size_t thread_id;
+  const char* name;
+  uint32_t index;
+  int is_track;
+  // written only by writer thread, set when thread record is written
+  int announced;
+
+} Profile_Thread;
+
+typedef struct {
+
+  const char* name;
+  uint32_t id;
+  // time spent in sections with this name since last summary
+  uint32_t calls;
+  uint64_t ticks;
+
+} Profile_Name;
+
+INTERNAL uint32_t
+HashProfileName(const void* obj)
 {
-  g_profiler.offset = 0;
-  g_profiler.enabled = 1;
+  uintptr_t ptr = (uintptr_t)((const Profile_Name*)obj)->name;
+  return (uint32_t)(ptr ^ (ptr >> 32));
 }
 
-/**
-   save profile results to a json file.
-   NOTE: use chrome://tracing to view it
-   @param filename
-*/
-INTERNAL void
-ProfilerSaveJSON(const char* filename)
+INTERNAL int
+CompareProfileNames(const void* lhs, const void* rhs)
 {
-  // open file
-  void* file = PlatformOpenFileForWrite(filename);
-  if (file == NULL) {
-    LOG_WARN("failed to open file '%s' for saving profile with error %s",
-             filename, PlatformGetError());
-    return;
-  }
+  const Profile_Name* l = lhs, *r = rhs;
+  return COMPARE((uintptr_t)l->name, (uintptr_t)r->name);
+}
 
-  // we need microseconds, not seconds
-  uint64_t frequency = PlatformGetPerformanceFrequency() / 1000000;
+DECLARE_HASH_TABLE(Profile_Name_Table, Profile_Name, HashProfileName, CompareProfileNames)
 
-  const char* header = "{\"otherData\": {},\"traceEvents\":[{}";
-  PlatformWriteToFile(file, header, strlen(header));
+typedef struct {
 
-  char buff[512];
-  for (uint32_t i = 0; i < g_profiler.offset; i++) {
-    // some metadata
-    size_t bytes = stbsp_snprintf(buff, sizeof(buff), ",\n{\"cat\":\"function\",\n");
-    PlatformWriteToFile(file, buff, bytes);
-    // duration
-    bytes = stbsp_snprintf(buff, sizeof(buff), "\"dur\" : %lu,\n", g_profiler.buff[i].duration / frequency);
-    PlatformWriteToFile(file, buff, bytes);
-    // name
-    bytes = stbsp_snprintf(buff, sizeof(buff), "\"name\" : \"%s\",\n", g_profiler.buff[i].name);
-    PlatformWriteToFile(file, buff, bytes);
-    // pid
-    bytes = stbsp_snprintf(buff, sizeof(buff), "\"ph\":\"X\", \"pid\":0,\n");
-    PlatformWriteToFile(file, buff, bytes);
-    // thread id
-    bytes = stbsp_snprintf(buff, sizeof(buff), "\"tid\": %lu,", g_profiler.buff[i].thread_id);
-    PlatformWriteToFile(file, buff, bytes);
-    // start
-    bytes = stbsp_snprintf(buff, sizeof(buff), "\"ts\": %lu\n}", g_profiler.buff[i].start / frequency);
-    PlatformWriteToFile(file, buff, bytes);
-  }
+  Profile_Thread* _Atomic threads[PROFILER_MAX_THREADS];
+  atomic_uint num_threads;
+  // incremented by ProfilerStop(), so threads know that their rings were freed
+  atomic_uint generation;
+  atomic_int enabled;
+  // incremented by ProfilerFlush()
+  atomic_uint num_frames;
+
+  // semaphore used as a mutex, protects top_zones
+  void* summary_lock;
+  Profile_Zone_Stats top_zones[PROFILER_TOP_ZONES];
+  uint32_t num_top_zones;
+
+  // used only by writer thread
+  void* file;
+  void* writer;
+  void* wake_sem;
+  atomic_int quit;
+  uint8_t* chunk;
+  uint32_t chunk_size;
+  Profile_Name_Table names;
+  uint64_t bytes_written;
+  uint64_t last_summary;
+  uint32_t last_summary_frame;
+  // used when names table fails to grow
+  Profile_Name scratch_name;
 
-  const char* footer = "]}";
-  PlatformWriteToFile(file, footer, strlen(footer));
+} Profiler;
 
-  // close file
-  PlatformCloseFileForWrite(file);
-}
+GLOBAL Profiler g_profiler;
+GLOBAL _Thread_local Profile_Thread* g_profile_thread;
+// generation+1 of the last registration attempt, 0 if there was none
+GLOBAL _Thread_local uint32_t g_profile_thread_generation;
 
 INTERNAL void
-ProfilerBeginSection(Profile_Section* section, const char* name)
+ProfilerWrite(const void* data, uint32_t bytes)
 {
-  if (g_profiler.enabled && g_profiler.offset == ARR_SIZE(g_profiler.buff)) {
-    LOG_WARN("profiler is out of space, disabling it");
-    g_profiler.enabled = 0;
+  if (g_profiler.chunk_size + bytes > PROFILER_CHUNK_SIZE) {
+    PlatformWriteToFile(g_profiler.file, g_profiler.chunk, g_profiler.chunk_size);
+    g_profiler.bytes_written += g_profiler.chunk_size;
+    g_profiler.chunk_size = 0;
   }
-  section->name = name;
-  section->start = PlatformGetPerformanceCounter();
-  section->thread_id = PlatformThreadId();
+  memcpy(g_profiler.chunk + g_profiler.chunk_size, data, bytes);
+  g_profiler.chunk_size += bytes;
 }
 
-INTERNAL void
-ProfilerEndSection(Profile_Section* section)
+#define PROFILER_WRITE(type, value) do { type v_ = value; ProfilerWrite(&v_, sizeof(type)); } while (0)
+
+INTERNAL Profile_Name*
+ProfilerGetName(const char* name)
 {
-  if (!g_profiler.enabled)
-    return;
-  Assert(section->name);
-  section->duration = PlatformGetPerformanceCounter() - section->start;
-  memcpy(&g_profiler.buff[g_profiler.offset], section, sizeof(Profile_Section));
-  g_profiler.offset++;
+  Profile_Name key = { .name = name, .id = g_profiler.names.size };
+  Profile_Name* it = Profile_Name_Table_Search(&g_profiler.names, &key);
+  if (it)
+    return it;
+  it = Profile_Name_Table_Insert(&g_profiler.names, &key);
+  if (it == NULL) {
+    g_profiler.scratch_name = key;
+    it = &g_profiler.scratch_name;
+  }
+  uint32_t length = strlen(name);
+  PROFILER_WRITE(uint8_t, PROFILE_RECORD_NAME);
+  PROFILER_WRITE(uint32_t, key.id);
+  PROFILER_WRITE(uint32_t, length);
+  ProfilerWrite(name, length);
+  return it;
 }
 
-#else
-
-#define PROFILE_FUNCTION()
-
-INTERNAL void ProfilerStart() {}
-
+// move all events from threads' rings to the file
 INTERNAL void
-ProfilerSaveJSON(const char* file)
+ProfilerDrain()
 {
-  (void)file;
-  LOG_WARN("either profiler was disabled at compile time or it is not supported");
+  uint32_t num_threads = atomic_load(&g_profiler.num_threads);
+  if (num_threads > PROFILER_MAX_THREADS)
+    num_threads = PROFILER_MAX_THREADS;
+  for (uint32_t i = 0; i < num_threads; i++) {
+    Profile_Thread* thread = atomic_load_explicit(&g_profiler.threads[i], memory_order_acquire);
+    if (thread == NULL)
+      continue;
+    // NOTE: slots are claimed before threads are stored, so a thread
+    // may appear after threads with bigger indices were announced
+    if (!thread->announced) {
+      uint32_t name = (thread->name) ? ProfilerGetName(thread->name)->id : UINT32_MAX;
+      PROFILER_WRITE(uint8_t, PROFILE_RECORD_THREAD);
+      PROFILER_WRITE(uint32_t, i);
+      PROFILER_WRITE(uint64_t, thread->thread_id);
+      PROFILER_WRITE(uint32_t, name);
+      thread->announced = 1;
+    }
+    uint32_t read = atomic_load_explicit(&thread->read, memory_order_relaxed);
+    uint32_t write = atomic_load_explicit(&thread->write, memory_order_acquire);
+    for (; read != write; read++) {
+      const Profile_Event* event = &thread->events[read & (PROFILER_RING_SIZE-1)];
+      Profile_Name* name = ProfilerGetName(event->name);
+      if (event->type == PROFILE_RECORD_SECTION && !thread->is_track) {
+        name->ticks += event->duration;
+        name->calls++;
+      }
+      PROFILER_WRITE(uint8_t, event->type);
+      PROFILER_WRITE(uint32_t, name->id);
+      PROFILER_WRITE(uint32_t, i);
+      PROFILER_WRITE(uint64_t, event->timestamp);
+      // duration or value
+      PROFILER_WRITE(uint64_t, event->duration);
+    }
+    atomic_store_explicit(&thread->read, read, memory_order_release);
+    uint32_t dropped = atomic_exchange_explicit(&thread->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+      PROFILER_WRITE(uint8_t, PROFILE_RECORD_DROPPED);
+      PROFILER_WRITE(uint32_t, i);
+      PROFILER_WRITE(uint32_t, dropped);
+    }
+  }
 }
 
-#endif
+// publish most expensive sections for ProfilerGetTopZones()
+INTERNAL void
+ProfilerUpdateTopZones()
+{
+  uint64_t now = PlatformGetPerformanceCounter();
+  uint64_t frequency = PlatformGetPerformanceFrequency();
+  if (now - g_profiler.last_summary < frequency * PROFILER_SUMMARY_PERIOD_MS / 1000)
+    return;
+  uint32_t frame = atomic_load_explicit(&g_profiler.num_frames, memory_order_relaxed);
+  uint32_t num_frames = frame - g_profiler.last_summary_frame;
+  if (num_frames == 0)
+    return;
+  // keep zones sorted by time, insertion sort is fine for a handful of them
+  Profile_Name top[PROFILER_TOP_ZONES];
+  uint32_t count = 0;
+  Profile_Name* it;
+  HT_FOREACH(Profile_Name_Table, &g_profiler.names, it) {
+    if (it->calls == 0)
+      continue;
+    uint32_t j = count;
+    if (count < PROFILER_TOP_ZONES) {
+      count++;
+    } else if (it->ticks > top[count-1].ticks) {
+      j = count-1;
+    } else {
+      j = UINT32_MAX;
+    }
+    if (j != UINT32_MAX) {
+      for (; j > 0 && top[j-1].ticks < it->ticks; j--)
+        top[j] = top[j-1];
+      top[j] = *it;
+    }
+    it->ticks = 0;
+    it->calls = 0;
+  }
+  PlatformSemaphoreWait(g_profiler.summary_lock);
+  for (uint32_t i = 0; i < count; i++) {
+    g_profiler.top_zones[i] = (Profile_Zone_Stats) {
+      .name = top[i].name,
+      .milliseconds_per_frame = (float)((double)top[i].ticks * 1000.0 / (double)frequency / (double)num_frames),
+      .calls_per_frame = (float)top[i].calls / (float)num_frames,
+    };
+  }
+  g_profiler.num_top_zones = count;
+  PlatformSemaphorePost(g_profiler.summary_lock);
+  g_profiler.last_summary = now;
+  g_profiler.last_summary_frame = frame;
+}
+
+INTERNAL int
+ProfilerWriterMain(void* udata)
+{
+  (void)udata;
+  for (;;) {
+    PlatformSemaphoreWait(g_profiler.wake_sem);
+    int quit = atomic_load(&g_profiler.quit);
+    ProfilerDrain();
+    if (quit)
+      break;
+    ProfilerUpdateTopZones();
+  }
+  return 0;
+}
+
+INTERNAL Profile_Thread*
+ProfilerAddThread(size_t thread_id, const char* name, int is_track)
+{
+  uint32_t index = atomic_fetch_add(&g_profiler.num_threads, 1);
+  if (index >= PROFILER_MAX_THREADS)
+    return NULL;
+  Profile_Thread* thread = PlatformAllocateMemory(sizeof(Profile_Thread));
+  if (thread == NULL)
+    return NULL;
+  atomic_init(&thread->write, 0);
+  atomic_init(&thread->read, 0);
+  atomic_init(&thread->dropped, 0);
+  thread->thread_id = thread_id;
+  thread->name = name;
+  thread->index = index;
+  thread->is_track = is_track;
+  thread->announced = 0;
+  atomic_store_explicit(&g_profiler.threads[index], thread, memory_order_release);
+  return thread;
+}
+
+INTERNAL Profile_Thread*
+ProfilerGetThread()
+{
+  uint32_t generation = atomic_load_explicit(&g_profiler.generation, memory_order_relaxed);
+  if (g_profile_thread_generation == generation+1)
+    return g_profile_thread;
+  // if registration fails, don't try again until next ProfilerStart()
+  g_profile_thread = ProfilerAddThread(PlatformThreadId(), NULL, 0);
+  g_profile_thread_generation = generation+1;
+  return g_profile_thread;
+}
+
+/**
+   Give a name to calling thread in the trace. Must be called before
+   thread records any events.
+ */
+INTERNAL void
+ProfilerSetThreadName(const char* name)
+{
+  if (!atomic_load(&g_profiler.enabled))
+    return;
+  uint32_t generation = atomic_load_explicit(&g_profiler.generation, memory_order_relaxed);
+  if (g_profile_thread_generation == generation+1)
+    return;
+  g_profile_thread = ProfilerAddThread(PlatformThreadId(), name, 0);
+  g_profile_thread_generation = generation+1;
+}
+
+/**
+   Start recording a trace to a file.
+   @param filename binary trace, see ProfilerConvertTrace()
+ */
+INTERNAL void
+ProfilerStart(const char* filename)
+{
+  atomic_store(&g_profiler.num_threads, 0);
+  atomic_store(&g_profiler.quit, 0);
+  g_profiler.bytes_written = 0;
+  g_profiler.chunk_size = 0;
+  g_profiler.file = PlatformOpenFileForWrite(filename);
+  if (g_profiler.file == NULL) {
+    LOG_WARN("failed to open file '%s' for saving profile with error %s",
+             filename, PlatformGetError());
+    return;
+  }
+  g_profiler.chunk = PlatformAllocateMemory(PROFILER_CHUNK_SIZE);
+  Profile_Name_Table_Init(&g_profiler.names, NULL, 256);
+  ProfilerWrite(PROFILE_TRACE_MAGIC, 4);
+  PROFILER_WRITE(uint32_t, PROFILE_TRACE_VERSION);
+  PROFILER_WRITE(uint64_t, PlatformGetPerformanceFrequency());
+  g_profiler.num_top_zones = 0;
+  g_profiler.last_summary = PlatformGetPerformanceCounter();
+  g_profiler.last_summary_frame = atomic_load(&g_profiler.num_frames);
+  g_profiler.wake_sem = PlatformCreateSemaphore(0);
+  g_profiler.summary_lock = PlatformCreateSemaphore(1);
+  if (g_profiler.wake_sem && g_profiler.summary_lock) {
+    g_profiler.writer = PlatformCreateThread(&ProfilerWriterMain, "lida-profiler", NULL);
+  }
+  if (g_profiler.writer == NULL) {
+    LOG_WARN("failed to create profiler writer thread with error '%s'", PlatformGetError());
+    if (g_profiler.wake_sem)
+      PlatformDestroySemaphore(g_profiler.wake_sem);
+    if (g_profiler.summary_lock)
+      PlatformDestroySemaphore(g_profiler.summary_lock);
+    g_profiler.wake_sem = NULL;
+    g_profiler.summary_lock = NULL;
+    Profile_Name_Table_Free(&g_profiler.names);
+    PlatformFreeMemory(g_profiler.chunk);
+    PlatformCloseFileForWrite(g_profiler.file);
+    g_profiler.file = NULL;
+    return;
+  }
+  atomic_store(&g_profiler.enabled, 1);
+  ProfilerSetThreadName("main");
+}
+
+/**
+   Write remaining events and close the trace. Other threads must not
+   record events after this.
+ */
+INTERNAL void
+ProfilerStop()
+{
+  atomic_store(&g_profiler.enabled, 0);
+  if (g_profiler.writer == NULL)
+    return;
+  atomic_store(&g_profiler.quit, 1);
+  if (g_profiler.wake_sem)
+    PlatformSemaphorePost(g_profiler.wake_sem);
+  PlatformWaitThread(g_profiler.writer);
+  PlatformWriteToFile(g_profiler.file, g_profiler.chunk, g_profiler.chunk_size);
+  g_profiler.bytes_written += g_profiler.chunk_size;
+  PlatformCloseFileForWrite(g_profiler.file);
+  LOG_INFO("profiler: written %.2f MB of trace", (double)g_profiler.bytes_written / (1024.0*1024.0));
+
+  uint32_t num_threads = atomic_load(&g_profiler.num_threads);
+  if (num_threads > PROFILER_MAX_THREADS)
+    num_threads = PROFILER_MAX_THREADS;
+  for (uint32_t i = 0; i < num_threads; i++) {
+    Profile_Thread* thread = atomic_exchange(&g_profiler.threads[i], NULL);
+    if (thread)
+      PlatformFreeMemory(thread);
+  }
+  atomic_fetch_add(&g_profiler.generation, 1);
+  PlatformDestroySemaphore(g_profiler.wake_sem);
+  PlatformDestroySemaphore(g_profiler.summary_lock);
+  Profile_Name_Table_Free(&g_profiler.names);
+  PlatformFreeMemory(g_profiler.chunk);
+  g_profiler.writer = NULL;
+  g_profiler.wake_sem = NULL;
+  g_profiler.summary_lock = NULL;
+  g_profiler.file = NULL;
+  g_profiler.chunk = NULL;
+}
+
+/**
+   Turn recording of events on or off. Recording stays off if
+   ProfilerStart() failed, because nobody would drain threads' rings.
+ */
+INTERNAL void
+ProfilerSetEnabled(int enabled)
+{
+  atomic_store(&g_profiler.enabled, enabled && g_profiler.writer != NULL);
+}
+
+// wake up writer thread, main thread calls this once per frame
+INTERNAL void
+ProfilerFlush()
+{
+  atomic_fetch_add_explicit(&g_profiler.num_frames, 1, memory_order_relaxed);
+  if (g_profiler.wake_sem)
+    PlatformSemaphorePost(g_profiler.wake_sem);
+}
+
+/**
+   Get sections that took most time recently, sorted by time.
+   NOTE: writer thread updates them every PROFILER_SUMMARY_PERIOD_MS
+   @return number of zones written to out
+ */
+INTERNAL uint32_t
+ProfilerGetTopZones(Profile_Zone_Stats* out, uint32_t max_zones)
+{
+  if (g_profiler.summary_lock == NULL)
+    return 0;
+  PlatformSemaphoreWait(g_profiler.summary_lock);
+  uint32_t count = (g_profiler.num_top_zones < max_zones) ? g_profiler.num_top_zones : max_zones;
+  memcpy(out, g_profiler.top_zones, count * sizeof(Profile_Zone_Stats));
+  PlatformSemaphorePost(g_profiler.summary_lock);
+  return count;
+}
+
+/**
+   Create a timeline for events that don't happen on CPU threads, like
+   GPU work. Only one thread may add events to a track.
+   @return track id or UINT32_MAX on failure
+ */
+INTERNAL uint32_t
+ProfilerCreateTrack(const char* name)
+{
+  if (!atomic_load(&g_profiler.enabled))
+    return UINT32_MAX;
+  // tracks don't have OS thread ids, make sure we don't collide with them
+  size_t id = (size_t)0x7FFF0000 + atomic_load(&g_profiler.num_threads);
+  Profile_Thread* thread = ProfilerAddThread(id, name, 1);
+  return (thread) ? thread->index : UINT32_MAX;
+}
+
+INTERNAL void
+ProfilerPushTo(Profile_Thread* thread, const char* name, uint32_t type, uint64_t timestamp, uint64_t payload)
+{
+  uint32_t write = atomic_load_explicit(&thread->write, memory_order_relaxed);
+  uint32_t read = atomic_load_explicit(&thread->read, memory_order_acquire);
+  uint32_t used = write - read;
+  if (used == PROFILER_RING_SIZE) {
+    // writer is too slow, don't block the thread
+    atomic_fetch_add_explicit(&thread->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  Profile_Event* event = &thread->events[write & (PROFILER_RING_SIZE-1)];
+  event->name = name;
+  event->type = type;
+  event->timestamp = timestamp;
+  event->duration = payload;
+  atomic_store_explicit(&thread->write, write+1, memory_order_release);
+  if (used == PROFILER_RING_SIZE/2 && g_profiler.wake_sem)
+    PlatformSemaphorePost(g_profiler.wake_sem);
+}
+
+INTERNAL void
+ProfilerPush(const char* name, uint32_t type, uint64_t timestamp, uint64_t payload)
+{
+  Profile_Thread* thread = ProfilerGetThread();
+  if (thread)
+    ProfilerPushTo(thread, name, type, timestamp, payload);
+}
+
+// record a section which started at 'start' on a track
+INTERNAL void
+ProfilerTrackSection(uint32_t track, const char* name, uint64_t start, uint64_t duration)
+{
+  if (track >= PROFILER_MAX_THREADS || !atomic_load_explicit(&g_profiler.enabled, memory_order_relaxed))
+    return;
+  Profile_Thread* thread = atomic_load_explicit(&g_profiler.threads[track], memory_order_acquire);
+  if (thread)
+    ProfilerPushTo(thread, name, PROFILE_RECORD_SECTION, start, duration);
+}
+
+INTERNAL void
+ProfilerBeginSection(Profile_Section* section, const char* name)
+{
+  section->name = name;
+  section->start = PlatformGetPerformanceCounter();
+}
+
+INTERNAL void
+ProfilerEndSection(Profile_Section* section)
+{
+  if (!atomic_load_explicit(&g_profiler.enabled, memory_order_relaxed))
+    return;
+  Assert(section->name);
+  ProfilerPush(section->name, PROFILE_RECORD_SECTION, section->start,
+               PlatformGetPerformanceCounter() - section->start);
+}
+
+// record value of a counter, name must be a static string
+INTERNAL void
+ProfilerCounter(const char* name, double value)
+{
+  if (!atomic_load_explicit(&g_profiler.enabled, memory_order_relaxed))
+    return;
+  uint64_t payload;
+  memcpy(&payload, &value, sizeof(double));
+  ProfilerPush(name, PROFILE_RECORD_COUNTER, PlatformGetPerformanceCounter(), payload);
+}
+
+#else
+
+#define PROFILE_FUNCTION()
+
+INTERNAL void
+ProfilerStart(const char* filename)
+{
+  (void)filename;
+}
+
+INTERNAL void ProfilerStop() {}
+INTERNAL void ProfilerFlush() {}
+
+INTERNAL void
+ProfilerSetEnabled(int enabled)
+{
+  (void)enabled;
+}
+
+INTERNAL uint32_t
+ProfilerGetTopZones(Profile_Zone_Stats* out, uint32_t max_zones)
+{
+  (void)out;
+  (void)max_zones;
+  return 0;
+}
+
+INTERNAL void
+ProfilerSetThreadName(const char* name)
+{
+  (void)name;
+}
+
+INTERNAL uint32_t
+ProfilerCreateTrack(const char* name)
+{
+  (void)name;
+  return UINT32_MAX;
+}
+
+INTERNAL void
+ProfilerTrackSection(uint32_t track, const char* name, uint64_t start, uint64_t duration)
+{
+  (void)track;
+  (void)name;
+  (void)start;
+  (void)duration;
+}
+
+INTERNAL void
+ProfilerCounter(const char* name, double value)
+{
+  (void)name;
+  (void)value;
+}
+
+#endif
+
+typedef struct {
+
+  void* file;
+  char buff[64*1024];
+  uint32_t size;
+
+} Trace_Writer;
+
+// make sure at least 'bytes' bytes can be written to the buffer
+INTERNAL void
+TraceWriterReserve(Trace_Writer* writer, uint32_t bytes)
+{
+  if (writer->size + bytes > sizeof(writer->buff)) {
+    PlatformWriteToFile(writer->file, writer->buff, writer->size);
+    writer->size = 0;
+  }
+}
+
+// NOTE: output must be shorter than 512 bytes, use
+// TraceWriterString() for strings from the trace
+INTERNAL void
+TraceWriterPrintf(Trace_Writer* writer, const char* fmt, ...)
+{
+  TraceWriterReserve(writer, 512);
+  va_list ap;
+  va_start(ap, fmt);
+  writer->size += stbsp_vsnprintf(writer->buff + writer->size, sizeof(writer->buff) - writer->size, fmt, ap);
+  va_end(ap);
+}
+
+// Chrome trace JSON wants escaped strings
+INTERNAL void
+TraceWriterString(Trace_Writer* writer, const char* str, uint32_t length)
+{
+  if (length > 256)
+    length = 256;
+  // every char may be escaped, plus 2 quotes
+  TraceWriterReserve(writer, 2*length + 2);
+  char* out = writer->buff + writer->size;
+  uint32_t j = 0;
+  out[j++] = '"';
+  for (uint32_t i = 0; i < length; i++) {
+    if (str[i] == '"' || str[i] == '\\')
+      out[j++] = '\\';
+    out[j++] = ((uint8_t)str[i] < 32) ? ' ' : str[i];
+  }
+  out[j++] = '"';
+  writer->size += j;
+}
+
+/**
+   Convert binary trace written by profiler to JSON.
+   NOTE: use chrome://tracing or https://ui.perfetto.dev to view it
+   @return 0 on success
+ */
+INTERNAL int
+ProfilerConvertTrace(const char* input, const char* output)
+{
+  size_t size;
+  const uint8_t* data = PlatformLoadEntireFile(input, &size);
+  if (data == NULL) {
+    LOG_WARN("failed to open trace '%s' with error %s", input, PlatformGetError());
+    return -1;
+  }
+  uint32_t version;
+  uint64_t frequency;
+  if (size < 16 || memcmp(data, PROFILE_TRACE_MAGIC, 4) != 0) {
+    LOG_WARN("'%s' is not a profiler trace", input);
+    PlatformFreeLoadedFile((void*)data);
+    return -1;
+  }
+  memcpy(&version, data + 4, 4);
+  memcpy(&frequency, data + 8, 8);
+  if (version != PROFILE_TRACE_VERSION) {
+    LOG_WARN("trace '%s' has version %u, expected %u", input, version, PROFILE_TRACE_VERSION);
+    PlatformFreeLoadedFile((void*)data);
+    return -1;
+  }
+
+  // names are numbered from 0 in order they appear, find all of them
+  // first. Each name record takes at least 9 bytes.
+  uint32_t max_names = size / 9 + 1;
+  uint32_t* names = PlatformAllocateMemory(max_names * sizeof(uint32_t));
+  uint64_t* thread_ids = PlatformAllocateMemory(PROFILER_MAX_THREADS * sizeof(uint64_t));
+  // events of threads without thread record use their index as tid
+  memset(thread_ids, 0, PROFILER_MAX_THREADS * sizeof(uint64_t));
+  Trace_Writer* writer = PlatformAllocateMemory(sizeof(Trace_Writer));
+  writer->file = PlatformOpenFileForWrite(output);
+  int ret = 0;
+  if (writer->file == NULL) {
+    LOG_WARN("failed to open file '%s' for writing with error %s", output, PlatformGetError());
+    ret = -1;
+    goto end;
+  }
+
+  // microseconds
+  double scale = 1e6 / (double)frequency;
+  TraceWriterPrintf(writer, "{\"otherData\": {},\"traceEvents\":[{}");
+  uint32_t num_names = 0;
+  size_t offset = 16;
+  // trace of a running program usually ends in the middle of a record
+  int truncated = 0;
+  while (offset < size && ret == 0 && !truncated) {
+    uint8_t type = data[offset++];
+    uint32_t a, b;
+    uint64_t c, d;
+    switch (type) {
+    case PROFILE_RECORD_NAME:
+      if (offset + 8 > size) { truncated = 1; break; }
+      memcpy(&a, data + offset, 4);
+      memcpy(&b, data + offset + 4, 4);
+      if (a != num_names) { ret = -1; break; }
+      if (offset + 8 + b > size) { truncated = 1; break; }
+      names[num_names++] = offset;
+      offset += 8 + b;
+      break;
+
+    case PROFILE_RECORD_THREAD:
+      if (offset + 16 > size) { truncated = 1; break; }
+      memcpy(&a, data + offset, 4);
+      memcpy(&c, data + offset + 4, 8);
+      memcpy(&b, data + offset + 12, 4);
+      offset += 16;
+      if (a < PROFILER_MAX_THREADS)
+        thread_ids[a] = c;
+      TraceWriterPrintf(writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%lu,\"args\":{\"name\":",
+                        (unsigned long)c);
+      if (b < num_names) {
+        uint32_t name_length;
+        memcpy(&name_length, data + names[b] + 4, 4);
+        TraceWriterString(writer, (const char*)data + names[b] + 8, name_length);
+      } else {
+        TraceWriterPrintf(writer, "\"thread %u\"", a);
+      }
+      TraceWriterPrintf(writer, "}}");
+      break;
+
+    case PROFILE_RECORD_SECTION:
+    case PROFILE_RECORD_COUNTER:
+      if (offset + 24 > size) { truncated = 1; break; }
+      memcpy(&a, data + offset, 4);
+      memcpy(&b, data + offset + 4, 4);
+      memcpy(&c, data + offset + 8, 8);
+      memcpy(&d, data + offset + 16, 8);
+      offset += 24;
+      if (a >= num_names) { ret = -1; break; }
+      {
+        uint32_t name_length;
+        memcpy(&name_length, data + names[a] + 4, 4);
+        const char* name = (const char*)data + names[a] + 8;
+        uint64_t tid = (b < PROFILER_MAX_THREADS && thread_ids[b]) ? thread_ids[b] : b;
+        if (type == PROFILE_RECORD_SECTION) {
+          TraceWriterPrintf(writer, ",\n{\"cat\":\"function\",\"ph\":\"X\",\"pid\":0,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                            (unsigned long)tid, (double)c * scale, (double)d * scale);
+          TraceWriterString(writer, name, name_length);
+          TraceWriterPrintf(writer, "}");
+        } else {
+          double value;
+          memcpy(&value, &d, sizeof(double));
+          TraceWriterPrintf(writer, ",\n{\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{\"value\":%.3f},\"name\":",
+                            (double)c * scale, value);
+          TraceWriterString(writer, name, name_length);
+          TraceWriterPrintf(writer, "}");
+        }
+      }
+      break;
+
+    case PROFILE_RECORD_DROPPED:
+      if (offset + 8 > size) { truncated = 1; break; }
+      memcpy(&a, data + offset, 4);
+      memcpy(&b, data + offset + 4, 4);
+      offset += 8;
+      LOG_WARN("trace: thread %u lost %u events", a, b);
+      break;
+
+    default:
+      ret = -1;
+      break;
+    }
+  }
+  if (ret != 0) {
+    LOG_WARN("trace '%s' is corrupted at byte %zu", input, offset);
+  } else if (truncated) {
+    LOG_WARN("trace '%s' is truncated, last record is skipped", input);
+  }
+  TraceWriterPrintf(writer, "]}");
+  PlatformWriteToFile(writer->file, writer->buff, writer->size);
+  PlatformCloseFileForWrite(writer->file);
+
+ end:
+  PlatformFreeMemory(writer);
+  PlatformFreeMemory(thread_ids);
+  PlatformFreeMemory(names);
+  PlatformFreeLoadedFile((void*)data);
+  return ret;
+}
+
+
+
+/// Frame statistics
+
+/*
+  Frame counters are quantities summed over one frame: vertices
+  meshed, draws pushed, bytes uploaded etc. Adding to a counter is an
+  atomic add, so jobs can use them too. EndFrameStatistics() writes
+  all counters to the trace, remembers their values and resets them.
+
+  Frame times are kept in a rolling window of last FRAME_TIME_WINDOW
+  frames. Each sample is also counted in a histogram with fixed width
+  buckets, so percentiles are computed without sorting the window.
+ */
+
+#define MAX_FRAME_COUNTERS 32
+#define FRAME_TIME_WINDOW 4096
+// histogram covers [0, 102.4) ms, slower frames go to the last bucket
+#define FRAME_TIME_BUCKET_US 50
+#define FRAME_TIME_NUM_BUCKETS 2048
+
+typedef struct {
+
+  // in microseconds
+  uint32_t samples[FRAME_TIME_WINDOW];
+  uint16_t buckets[FRAME_TIME_NUM_BUCKETS];
+  uint32_t num_samples;
+  uint32_t next_sample;
+
+} Time_Histogram;
+
+typedef struct {
+
+  const char* names[MAX_FRAME_COUNTERS];
+  _Atomic int64_t values[MAX_FRAME_COUNTERS];
+  // values from the previous frame
+  int64_t last[MAX_FRAME_COUNTERS];
+  uint32_t num_counters;
+
+  Time_Histogram frame_times;
+  uint64_t frame_start;
+
+} Frame_Statistics;
+
+GLOBAL Frame_Statistics g_frame_stats;
+
+INTERNAL uint32_t
+TimeHistogramBucket(uint32_t microseconds)
+{
+  uint32_t bucket = microseconds / FRAME_TIME_BUCKET_US;
+  return (bucket < FRAME_TIME_NUM_BUCKETS) ? bucket : FRAME_TIME_NUM_BUCKETS-1;
+}
+
+INTERNAL void
+AddToTimeHistogram(Time_Histogram* hist, uint32_t microseconds)
+{
+  if (hist->num_samples == FRAME_TIME_WINDOW) {
+    // forget the oldest sample
+    hist->buckets[TimeHistogramBucket(hist->samples[hist->next_sample])]--;
+  } else {
+    hist->num_samples++;
+  }
+  hist->samples[hist->next_sample] = microseconds;
+  hist->next_sample = (hist->next_sample + 1) & (FRAME_TIME_WINDOW-1);
+  hist->buckets[TimeHistogramBucket(microseconds)]++;
+}
+
+INTERNAL void
+ClearTimeHistogram(Time_Histogram* hist)
+{
+  memset(hist->buckets, 0, sizeof(hist->buckets));
+  hist->num_samples = 0;
+  hist->next_sample = 0;
+}
+
+INTERNAL uint32_t
+MaxInTimeHistogram(const Time_Histogram* hist)
+{
+  uint32_t ret = 0;
+  for (uint32_t i = 0; i < hist->num_samples; i++) {
+    if (hist->samples[i] > ret)
+      ret = hist->samples[i];
+  }
+  return ret;
+}
+
+/**
+   Get percentile of samples in histogram.
+   NOTE: result is rounded up to bucket width. If percentile falls into
+   the last bucket, the maximum sample is returned.
+   @param percent in range [0, 100]
+   @return time in milliseconds
+ */
+INTERNAL float
+TimeHistogramPercentile(const Time_Histogram* hist, float percent)
+{
+  if (hist->num_samples == 0)
+    return 0.0f;
+  uint32_t rank = (uint32_t)ceilf(percent * 0.01f * (float)hist->num_samples);
+  if (rank == 0)
+    rank = 1;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < FRAME_TIME_NUM_BUCKETS-1; i++) {
+    count += hist->buckets[i];
+    if (count >= rank)
+      return (float)((i+1) * FRAME_TIME_BUCKET_US) * 0.001f;
+  }
+  return (float)MaxInTimeHistogram(hist) * 0.001f;
+}
+
+/**
+   Register a counter that is reset every frame.
+   @param name static string, also used as counter name in trace
+   @return counter ID or UINT32_MAX if there're too many counters
+ */
+INTERNAL uint32_t
+RegisterFrameCounter(const char* name)
+{
+  for (uint32_t i = 0; i < g_frame_stats.num_counters; i++) {
+    if (strcmp(g_frame_stats.names[i], name) == 0)
+      return i;
+  }
+  if (g_frame_stats.num_counters == MAX_FRAME_COUNTERS) {
+    LOG_WARN("failed to register frame counter '%s': max number of counters is %u",
+             name, MAX_FRAME_COUNTERS);
+    return UINT32_MAX;
+  }
+  uint32_t id = g_frame_stats.num_counters++;
+  g_frame_stats.names[id] = name;
+  atomic_store_explicit(&g_frame_stats.values[id], 0, memory_order_relaxed);
+  g_frame_stats.last[id] = 0;
+  return id;
+}
+
+INTERNAL void
+AddFrameCounter(uint32_t id, int64_t value)
+{
+  if (id < g_frame_stats.num_counters)
+    atomic_fetch_add_explicit(&g_frame_stats.values[id], value, memory_order_relaxed);
+}
+
+// for counters that are measured once per frame, like queue lengths
+INTERNAL void
+SetFrameCounter(uint32_t id, int64_t value)
+{
+  if (id < g_frame_stats.num_counters)
+    atomic_store_explicit(&g_frame_stats.values[id], value, memory_order_relaxed);
+}
+
+// get value of counter at the end of previous frame
+INTERNAL int64_t
+GetFrameCounter(uint32_t id)
+{
+  return (id < g_frame_stats.num_counters) ? g_frame_stats.last[id] : 0;
+}
+
+/**
+   Finish frame: record frame time and write counters to trace.
+   Should be called once per frame from main thread, while no jobs are
+   running.
+ */
+INTERNAL void
+EndFrameStatistics()
+{
+  uint64_t now = PlatformGetPerformanceCounter();
+  if (g_frame_stats.frame_start != 0) {
+    uint64_t ticks = now - g_frame_stats.frame_start;
+    uint64_t us = ticks * 1000000 / PlatformGetPerformanceFrequency();
+    AddToTimeHistogram(&g_frame_stats.frame_times, (us < UINT32_MAX) ? (uint32_t)us : UINT32_MAX);
+    ProfilerCounter("frame time (ms)", (double)us * 0.001);
+  }
+  g_frame_stats.frame_start = now;
+  for (uint32_t i = 0; i < g_frame_stats.num_counters; i++) {
+    int64_t value = atomic_exchange_explicit(&g_frame_stats.values[i], 0, memory_order_relaxed);
+    g_frame_stats.last[i] = value;
+    ProfilerCounter(g_frame_stats.names[i], (double)value);
+  }
+}
+
+
+
+/// Job system
+
+// Very simple fork-join job system: ParallelFor() splits a range into
+// chunks which are grabbed by worker threads and the calling thread.
+// Workers sleep on a semaphore between calls. Jobs should take
+// temporary memory from ScratchAllocate().
+// NOTE: logger is not thread safe, don't use it from jobs.
+
+#define MAX_JOB_WORKERS 32
+
+// worker_id is 0 for the calling thread, workers have ids 1..num_workers
+typedef void(*Parallel_For_Func)(uint32_t begin, uint32_t end, uint32_t worker_id, void* udata);
+
+typedef struct {
+
+  void* threads[MAX_JOB_WORKERS];
+  uint32_t worker_ids[MAX_JOB_WORKERS];
+  // number of threads excluding main thread
+  uint32_t num_workers;
+  void* start_sem;
+  void* done_sem;
+  atomic_int quit;
+
+  // current task
+  Parallel_For_Func func;
+  void* udata;
+  uint32_t count;
+  uint32_t chunk_size;
+  atomic_uint next_chunk;
+
+} Job_System;
+
+GLOBAL Job_System g_jobs;
+// indexed by worker_id
+GLOBAL Memory_Chunk g_scratch_arenas[MAX_JOB_WORKERS];
+
+INTERNAL void
+RunParallelForChunks(uint32_t worker_id)
+{
+  uint32_t num_chunks = (g_jobs.count + g_jobs.chunk_size - 1) / g_jobs.chunk_size;
+  for (;;) {
+    uint32_t chunk = atomic_fetch_add_explicit(&g_jobs.next_chunk, 1, memory_order_relaxed);
+    if (chunk >= num_chunks)
+      break;
+    uint32_t begin = chunk * g_jobs.chunk_size;
+    uint32_t end = begin + g_jobs.chunk_size;
+    if (end > g_jobs.count)
+      end = g_jobs.count;
+    g_jobs.func(begin, end, worker_id, g_jobs.udata);
+  }
+}
+
+INTERNAL int
+JobWorkerMain(void* udata)
+{
+  uint32_t worker_id = *(uint32_t*)udata;
+  g_scratch_memory = &g_scratch_arenas[worker_id];
+  ProfilerSetThreadName("worker");
+  for (;;) {
+    PlatformSemaphoreWait(g_jobs.start_sem);
+    if (atomic_load(&g_jobs.quit))
+      break;
+    RunParallelForChunks(worker_id);
+    PlatformSemaphorePost(g_jobs.done_sem);
+  }
+  return 0;
+}
+
+// pass 0 to use all CPU cores
+INTERNAL void
+InitJobSystem(uint32_t num_threads)
+{
+  if (num_threads == 0)
+    num_threads = PlatformNumCPUs();
+  if (num_threads > MAX_JOB_WORKERS)
+    num_threads = MAX_JOB_WORKERS;
+  atomic_store(&g_jobs.quit, 0);
+  g_jobs.num_workers = 0;
+  g_jobs.start_sem = PlatformCreateSemaphore(0);
+  g_jobs.done_sem = PlatformCreateSemaphore(0);
+  if (g_jobs.start_sem == NULL || g_jobs.done_sem == NULL) {
+    LOG_WARN("failed to create semaphores for job system with error '%s', running single threaded",
+             PlatformGetError());
+    return;
+  }
+  // main thread also does work
+  for (uint32_t i = 0; i+1 < num_threads; i++) {
+    g_jobs.worker_ids[i] = i+1;
+    g_jobs.threads[i] = PlatformCreateThread(&JobWorkerMain, "lida-worker", &g_jobs.worker_ids[i]);
+    if (g_jobs.threads[i] == NULL) {
+      LOG_WARN("failed to create worker thread with error '%s'", PlatformGetError());
+      break;
+    }
+    g_jobs.num_workers++;
+  }
+  LOG_INFO("job system: using %u threads", g_jobs.num_workers+1);
+}
+
+INTERNAL void
+FreeJobSystem()
+{
+  atomic_store(&g_jobs.quit, 1);
+  for (uint32_t i = 0; i < g_jobs.num_workers; i++) {
+    PlatformSemaphorePost(g_jobs.start_sem);
+  }
+  for (uint32_t i = 0; i < g_jobs.num_workers; i++) {
+    PlatformWaitThread(g_jobs.threads[i]);
+  }
+  if (g_jobs.start_sem)
+    PlatformDestroySemaphore(g_jobs.start_sem);
+  if (g_jobs.done_sem)
+    PlatformDestroySemaphore(g_jobs.done_sem);
+  g_jobs.num_workers = 0;
+  g_jobs.start_sem = NULL;
+  g_jobs.done_sem = NULL;
+}
+
+// number of threads that can execute jobs, including main thread
+#define NumJobThreads() (g_jobs.num_workers+1)
+
+// Must be called after InitJobSystem(). Scratch memory is taken from
+// persistent memory.
+INTERNAL void
+InitScratchMemory(uint32_t bytes_per_thread)
+{
+  for (uint32_t i = 0; i < NumJobThreads(); i++) {
+    InitMemoryChunk(&g_scratch_arenas[i], MemoryAllocateRight(&g_persistent_memory, bytes_per_thread),
+                    bytes_per_thread);
+  }
+  g_scratch_memory = &g_scratch_arenas[0];
+  g_main_scratch_memory = g_scratch_memory;
+}
+
+/**
+   Call func for chunks of [0, count) in parallel and wait until all
+   chunks are processed. Must be called from main thread only.
+   @param chunk_size pass 0 to pick chunk size automatically
+ */
+INTERNAL void
+ParallelFor(uint32_t count, uint32_t chunk_size, Parallel_For_Func func, void* udata)
+{
+  if (count == 0)
+    return;
+  if (chunk_size == 0) {
+    // few chunks per thread for load balancing
+    chunk_size = count / (NumJobThreads() * 4);
+    if (chunk_size < 64)
+      chunk_size = 64;
+  }
+  if (g_jobs.num_workers == 0 || count <= chunk_size) {
+    func(0, count, 0, udata);
+    return;
+  }
+  g_jobs.func = func;
+  g_jobs.udata = udata;
+  g_jobs.count = count;
+  g_jobs.chunk_size = chunk_size;
+  atomic_store(&g_jobs.next_chunk, 0);
+  // don't wake up more workers than there are chunks
+  uint32_t num_chunks = (count + chunk_size - 1) / chunk_size;
+  uint32_t num_workers = (num_chunks-1 < g_jobs.num_workers) ? num_chunks-1 : g_jobs.num_workers;
+  for (uint32_t i = 0; i < num_workers; i++) {
+    PlatformSemaphorePost(g_jobs.start_sem);
+  }
+  RunParallelForChunks(0);
+  for (uint32_t i = 0; i < num_workers; i++) {
+    PlatformSemaphoreWait(g_jobs.done_sem);
+  }
+}
@@ -44,9 +44,17 @@ struct Traverse_String_Info {
 
 };
 
+// must be a power of 2
+#define CONFIG_MAX_VARS 256
+
 typedef struct {
 
   Ternary_Tree_Node* root;
+  // open addressing table from interned variable names to offsets of
+  // their values in buff
+  String_ID var_names[CONFIG_MAX_VARS];
+  uint32_t var_offsets[CONFIG_MAX_VARS];
+  uint32_t num_vars;
   char buff[10240];
   uint32_t buff_offset;
 
@@ -56,6 +64,30 @@ DECLARE_COMPONENT(Config_File);
 
 GLOBAL Config_File* g_config;
 
+// Variables that are read every frame. Their names are interned once
+// by InternConfigVars(), so reading them doesn't hash strings.
+#define X_ALL_FRAME_VARS()                      \
+  X(Misc, profiling)                            \
+  X(Camera, fovy)                               \
+  X(Camera, rotation_speed)                     \
+  X(Camera, movement_speed)                     \
+  X(Console, pixel_perfect_font_size)           \
+  X(Render, shadow_map_dim)                     \
+  X(Render, shadow_extent)                      \
+  X(Render, shadow_near)                        \
+  X(Render, shadow_far)                         \
+  X(Render, debug_voxel_obb)                    \
+  X(Render, debug_ss_aabb)                      \
+  X(Render, depth_bias_constant)                \
+  X(Render, depth_bias_slope)                   \
+  X(Render, bg_fill_color_r)                    \
+  X(Render, bg_fill_color_g)                    \
+  X(Render, bg_fill_color_b)
+
+#define X(section, name) GLOBAL String_ID g_var_##section##_##name;
+X_ALL_FRAME_VARS()
+#undef X
+
 
 /// private functions
 
@@ -202,6 +234,30 @@ TST_TraversePrefix(Ternary_Tree_Node* root, Traverse_String_Info* info,
     TST_TraversePrefix(root->mid, info, prefix+1, buff+1);
   }
 }
+INTERNAL uint32_t
+ConfigVarSlot(String_ID name)
+{
+  // fibonacci hashing, IDs are sequential
+  return (name * 2654435769u) >> (32 - 8);
+}
+
+INTERNAL void
+AddConfigVar(Config_File* config, String_ID name, const CVar* var)
+{
+  uint32_t i = ConfigVarSlot(name) & (CONFIG_MAX_VARS-1);
+  while (config->var_names[i] != STRING_ID_NONE && config->var_names[i] != name)
+    i = (i+1) & (CONFIG_MAX_VARS-1);
+  if (config->var_names[i] == STRING_ID_NONE) {
+    // keep at least one slot empty so lookups terminate
+    if (config->num_vars == CONFIG_MAX_VARS-1) {
+      LOG_WARN("too many variables in config, '%s' is ignored", StringFromID(name));
+      return;
+    }
+    config->var_names[i] = name;
+    config->num_vars++;
+  }
+  config->var_offsets[i] = (const char*)var - config->buff;
+}
 
 
 /// public functions
@@ -217,6 +273,8 @@ ParseConfig(const char* filename, Config_File* config)
   char* current_section = NULL;
   config->buff_offset = 0;
   config->root = NULL;
+  memset(config->var_names, 0, sizeof(config->var_names));
+  config->num_vars = 0;
   size_t buff_size = sizeof(config->buff);
   // https://stackoverflow.com/questions/17983005/c-how-to-read-a-string-line-by-line
   while (line) {
@@ -296,6 +354,7 @@ ParseConfig(const char* filename, Config_File* config)
           }
           CVar* var = TST_Insert(config, &config->root, name_full);
           memcpy(var, &entry, sizeof(CVar));
+          AddConfigVar(config, InternString(name_full), var);
         }
       }
     }
@@ -325,11 +384,33 @@ CreateConfig(ECS* ecs, Asset_Manager* am, EID entity, const char* name)
   return config;
 }
 
+// intern names of variables from X_ALL_FRAME_VARS()
+INTERNAL void
+InternConfigVars()
+{
+#define X(section, name) g_var_##section##_##name = InternString(#section "." #name);
+  X_ALL_FRAME_VARS()
+#undef X
+}
+
+INTERNAL CVar*
+GetVarByID(Config_File* config, String_ID name)
+{
+  if (name == STRING_ID_NONE)
+    return NULL;
+  uint32_t i = ConfigVarSlot(name) & (CONFIG_MAX_VARS-1);
+  while (config->var_names[i] != STRING_ID_NONE) {
+    if (config->var_names[i] == name)
+      return (CVar*)&config->buff[config->var_offsets[i]];
+    i = (i+1) & (CONFIG_MAX_VARS-1);
+  }
+  return NULL;
+}
+
 INTERNAL int*
-GetVar_Int(Config_File* config, const char* var)
+GetVarID_Int(Config_File* config, String_ID var)
 {
-  // CVar* entry = FHT_Search(&config->vars, GET_TYPE_INFO(CVar), &var);
-  CVar* entry = TST_Search(config, config->root, var);
+  CVar* entry = GetVarByID(config, var);
   if (entry) {
     if (entry->type == CONFIG_INTEGER) {
       return &entry->value.int_;
@@ -340,10 +421,9 @@ GetVar_Int(Config_File* config, const char* var)
 }
 
 INTERNAL float*
-GetVar_Float(Config_File* config, const char* var)
+GetVarID_Float(Config_File* config, String_ID var)
 {
-  // CVar* entry = FHT_Search(&config->vars, GET_TYPE_INFO(CVar), &var);
-  CVar* entry = TST_Search(config, config->root, var);
+  CVar* entry = GetVarByID(config, var);
   if (entry) {
     if (entry->type == CONFIG_FLOAT) {
       return &entry->value.float_;
@@ -354,10 +434,9 @@ GetVar_Float(Config_File* config, const char* var)
 }
 
 INTERNAL const char*
-GetVar_String(Config_File* config, const char* var)
+GetVarID_String(Config_File* config, String_ID var)
 {
-  // CVar* entry = FHT_Search(&config->vars, GET_TYPE_INFO(CVar), &var);
-  CVar* entry = TST_Search(config, config->root, var);
+  CVar* entry = GetVarByID(config, var);
   if (entry) {
     if (entry->type == CONFIG_STRING) {
       return entry->value.str;
@@ -367,6 +446,26 @@ GetVar_String(Config_File* config, const char* var)
   return NULL;
 }
 
+// These look up name in string table first. Prefer GetVarID_* in code
+// that runs every frame.
+INTERNAL int*
+GetVar_Int(Config_File* config, const char* var)
+{
+  return GetVarID_Int(config, FindStringID(var));
+}
+
+INTERNAL float*
+GetVar_Float(Config_File* config, const char* var)
+{
+  return GetVarID_Float(config, FindStringID(var));
+}
+
+INTERNAL const char*
+GetVar_String(Config_File* config, const char* var)
+{
+  return GetVarID_String(config, FindStringID(var));
+}
+
 INTERNAL size_t
 ListVars(Config_File* config, Traverse_String_Func func, void* udata)
 {
@@ -57,6 +57,10 @@ typedef struct {
   uint32_t last_hst;
   char* hst_lines[16];
   uint32_t num_hst_lines;
+  // draw memory usage on top of the scene
+  int memory_overlay;
+  // draw frame times, expensive zones and GPU passes
+  int profiler_overlay;
 
 } Console;
 
@@ -141,7 +145,7 @@ DrawConsole(Quad_Renderer* renderer)
   const float prompt_height = 0.04f;
   Vec2 char_size;
   {
-    int* option = GetVar_Int(g_config, "Console.pixel_perfect_font_size");
+    int* option = GetVarID_Int(g_config, g_var_Console_pixel_perfect_font_size);
     if (option && *option) {
       PixelPerfectCharSize(font->pixel_size, &char_size);
     } else {
@@ -213,6 +217,43 @@ ConsoleAddCompletionCandidate(const Traverse_String_Info* info)
   context->buff_offset += len+1;
 }
 
+// split line into words and run a command. Line is modified.
+INTERNAL void
+ExecuteConsoleCommand(char* line)
+{
+  // collect arguments
+  // NOTE: overflow can't happen because prompt's max size is 256
+  char buff[512];
+  char* words[16];
+  uint32_t offset = 0;
+  uint32_t num_words = 0;
+  char* word = strtok(line, " ");
+  while (word != NULL) {
+    if (num_words == ARR_SIZE(words)) {
+      LOG_WARN("maximum number of arguments is exceeded(which is %lu)", ARR_SIZE(words)-1);
+      break;
+    }
+    size_t len = strlen(word);
+    strcpy(buff+offset, word);
+    words[num_words++] = buff+offset;
+    offset += len+1;
+    word = strtok(NULL, " ");
+  }
+
+  if (num_words == 0) {
+    ConsolePutLine("", 0);
+    return;
+  }
+  // search command
+  Console_Command* command = FHT_Search(&g_console->env,
+                                        GET_TYPE_INFO(Console_Command), &words[0]);
+  if (command == NULL) {
+    LOG_WARN("command '%s' does not exist", words[0]);
+  } else {
+    command->func(num_words-1, (const char**)words+1);
+  }
+}
+
 INTERNAL int
 ConsoleKeymap_Pressed(PlatformKeyCode key, void* udata)
 {
@@ -269,36 +310,7 @@ ConsoleKeymap_Pressed(PlatformKeyCode key, void* udata)
           if (g_console->num_hst_lines < ARR_SIZE(g_console->hst_lines))
             g_console->num_hst_lines++;
         }
-        // collect arguments
-        // NOTE: overflow can't happen because prompt's max size is 256
-        char buff[512];
-        char* words[16];
-        uint32_t offset = 0;
-        uint32_t num_words = 0;
-        char* word = strtok(g_console->prompt, " ");
-        while (word != NULL) {
-          if (num_words == ARR_SIZE(words)) {
-            LOG_WARN("maximum number of arguments is exceeded(which is %lu)", ARR_SIZE(words)-1);
-            break;
-          }
-          size_t len = strlen(word);
-          strcpy(buff+offset, word);
-          words[num_words++] = buff+offset;
-          offset += len+1;
-          word = strtok(NULL, " ");
-        }
-
-        if (num_words == 0) {
-          ConsolePutLine("", 0);
-        }
-        // search command
-        Console_Command* command = FHT_Search(&g_console->env,
-                                              GET_TYPE_INFO(Console_Command), &words[0]);
-        if (command == NULL) {
-          LOG_WARN("command '%s' does not exist", words[0]);
-        } else {
-          command->func(num_words-1, (const char**)words+1);
-        }
+        ExecuteConsoleCommand(g_console->prompt);
         // ConsolePutLine(g_console->prompt, 0);
         // clear prompt
         g_console->prompt[0] = '\0';
@@ -461,6 +473,15 @@ INTERNAL void CMD_remove_voxel(uint32_t num, const char** args);
 INTERNAL void CMD_spawn_random_vox_models(uint32_t num, const char** args);
 INTERNAL void CMD_voxel_buff_statistics(uint32_t num, const char** args);
 INTERNAL void CMD_spawn_melon_floor(uint32_t num, const char** args);
+INTERNAL void CMD_memory_stats(uint32_t num, const char** args);
+INTERNAL void CMD_memory_overlay(uint32_t num, const char** args);
+INTERNAL void CMD_convert_trace(uint32_t num, const char** args);
+INTERNAL void CMD_frame_stats(uint32_t num, const char** args);
+INTERNAL void CMD_profiler_overlay(uint32_t num, const char** args);
+INTERNAL void CMD_record_replay(uint32_t num, const char** args);
+INTERNAL void CMD_play_replay(uint32_t num, const char** args);
+INTERNAL void CMD_cull_stats(uint32_t num, const char** args);
+INTERNAL void CMD_model_costs(uint32_t num, const char** args);
 
 
 /// public functions
@@ -470,6 +491,8 @@ InitConsole()
 {
   g_console = PersistentAllocate(sizeof(Console));
   g_console->open_speed = 6.0f;
+  g_console->memory_overlay = 0;
+  g_console->profiler_overlay = 0;
   g_console->bottom = 0.0f;
   g_console->target_y = 0.0f;
   g_console->last_line = ARR_SIZE(g_console->lines)-1;
@@ -576,6 +599,47 @@ InitConsole()
               "spawn_melon_floor [TYPE]\n"
               " Spawn a floor with melon colors.\n"
               " TYPE is either 'melon'(default) or 'chess'.");
+  ADD_COMMAND(memory_stats,
+              "memory_stats [NUM_TAGS]\n"
+              " Print usage of allocators, video memory, persistent and frame memory.\n"
+              " If NUM_TAGS is specified, also print biggest allocation tags of each allocator.");
+  ADD_COMMAND(memory_overlay,
+              "memory_overlay\n"
+              " Toggle memory usage overlay.");
+  ADD_COMMAND(convert_trace,
+              "convert_trace [INPUT] [OUTPUT]\n"
+              " Convert binary profiler trace to JSON for chrome://tracing.\n"
+              " By default converts 'trace.lprof' to 'trace.json'.");
+  ADD_COMMAND(frame_stats,
+              "frame_stats [reset]\n"
+              " Print frame time percentiles over last frames and\n"
+              " values of frame counters from previous frame.\n"
+              " 'reset' forgets collected frame times.");
+  ADD_COMMAND(profiler_overlay,
+              "profiler_overlay\n"
+              " Toggle overlay with frame time graph, most expensive\n"
+              " profiler zones, GPU pass times and memory usage.\n"
+              " Zones are collected only when Misc.profiling is enabled.");
+  ADD_COMMAND(record_replay,
+              "record_replay [FILE]\n"
+              " Save current scene to FILE.scene and start recording camera\n"
+              " path and input to FILE. Without arguments stop recording.");
+  ADD_COMMAND(play_replay,
+              "play_replay FILE [REPORT]\n"
+              " Replay FILE with fixed timestep and write frame time, GPU pass\n"
+              " times and pipeline statistics to REPORT as JSON. Engine quits\n"
+              " when replay ends.");
+  ADD_COMMAND(cull_stats,
+              "cull_stats\n"
+              " Print how many voxel faces GPU culling tested and rejected\n"
+              " by frustum, occlusion and backface tests for each camera.\n"
+              " Results are 2 frames old. Requires indirect voxel backend.");
+  ADD_COMMAND(model_costs,
+              "model_costs [NUMBER] [FILE]\n"
+              " Print NUMBER(default 10) most expensive voxel grids by vertices,\n"
+              " quads, memory, remesh frequency and remesh time, and voxel views\n"
+              " by GPU draw calls. If FILE is specified, also write report to FILE\n"
+              " as JSON. Costs are counted since grid was first meshed or drawn.");
 }
 
 INTERNAL void
@@ -754,6 +818,7 @@ CMD_clear_scene(uint32_t num, const char** args)
   UNREGISTER_COMPONENT(g_ecs, Transform);
   UNREGISTER_COMPONENT(g_ecs, OBB);
   UNREGISTER_COMPONENT(g_ecs, Voxel_View);
+  UNREGISTER_COMPONENT(g_ecs, Voxel_Cost);
   DestroyEmptyEntities(g_ecs);
   ClearVoxelDrawerCache(g_vox_drawer);
 }
@@ -858,14 +923,16 @@ CMD_spawn_sphere(uint32_t num, const char** args)
   Voxel_Grid* grid = AddComponent(g_ecs, Voxel_Grid, view->grid);
   int radius = atoi(args[0]);
   AllocateVoxelGrid(g_vox_allocator, grid, radius*2+1, radius*2+1, radius*2+1);
+  uint32_t palette[256] = { 0 };
   if (num == 1) {
-    grid->palette[1] = PACK_COLOR(240, 240, 240, 255);
+    palette[1] = PACK_COLOR(240, 240, 240, 255);
   } else {
     int r = atoi(args[1]);
     int g = atoi(args[2]);
     int b = atoi(args[3]);
-    grid->palette[1] = PACK_COLOR(r, g, b, 255);
+    palette[1] = PACK_COLOR(r, g, b, 255);
   }
+  SetVoxelGridPalette(grid, palette);
   GenerateVoxelSphere(grid, radius, 1);
   // don't forget to update hash
   RehashVoxelGrid(grid);
@@ -903,14 +970,16 @@ CMD_spawn_cube(uint32_t num, const char** args)
   view->grid = CreateEntity(g_ecs);
   Voxel_Grid* grid = AddComponent(g_ecs, Voxel_Grid, view->grid);
   AllocateVoxelGrid(g_vox_allocator, grid, width, height, depth);
+  uint32_t palette[256] = { 0 };
   if (num == 3) {
-    grid->palette[1] = PACK_COLOR(240, 240, 240, 255);
+    palette[1] = PACK_COLOR(240, 240, 240, 255);
   } else {
     int r = atoi(args[3]);
     int g = atoi(args[4]);
     int b = atoi(args[5]);
-    grid->palette[1] = PACK_COLOR(r, g, b, 255);
+    palette[1] = PACK_COLOR(r, g, b, 255);
   }
+  SetVoxelGridPalette(grid, palette);
   FillVoxelGrid(grid, 1);
   // don't forget to update hash
   RehashVoxelGrid(grid);
@@ -974,14 +1043,49 @@ CMD_spawn_random_voxels(uint32_t num, const char** args)
     MAX_VOXEL_TYPES,
   };
   int number = atoi(args[0]);
+  if (number <= 0)
+    return;
+  // create all entities and components at once
+  EID* entities = PersistentAllocate(number * sizeof(EID));
+  EID* grids = PersistentAllocate(number * sizeof(EID));
+  if (CreateEntities(g_ecs, entities, number) != 0) {
+    LOG_ERROR("failed to create %d entities", number);
+    PersistentRelease(entities);
+    return;
+  }
+  if (CreateEntities(g_ecs, grids, number) != 0) {
+    LOG_ERROR("failed to create %d entities", number);
+    for (int i = 0; i < number; i++) {
+      DestroyEntity(g_ecs, entities[i]);
+    }
+    PersistentRelease(entities);
+    return;
+  }
+  if (AddComponents(g_ecs, Voxel_Grid, grids, number) != (uint32_t)number ||
+      AddComponents(g_ecs, Voxel_View, entities, number) != (uint32_t)number ||
+      AddComponents(g_ecs, Transform, entities, number) != (uint32_t)number ||
+      AddComponents(g_ecs, OBB, entities, number) != (uint32_t)number) {
+    LOG_ERROR("failed to add components to %d entities", number);
+    for (int i = 0; i < number; i++) {
+      RemoveComponent(g_ecs, Voxel_Grid, grids[i]);
+      RemoveComponent(g_ecs, Voxel_View, entities[i]);
+      RemoveComponent(g_ecs, Transform, entities[i]);
+      RemoveComponent(g_ecs, OBB, entities[i]);
+      DestroyEntity(g_ecs, grids[i]);
+      DestroyEntity(g_ecs, entities[i]);
+    }
+    PersistentRelease(entities);
+    return;
+  }
   for (int i = 0; i < number; i++) {
     enum VOXEL_TYPE type = Random(g_random) % MAX_VOXEL_TYPES;
-    EID entity = CreateEntity(g_ecs);
-    Voxel_View* view = AddComponent(g_ecs, Voxel_View, entity);
-    view->grid = CreateEntity(g_ecs);
-    Voxel_Grid* grid = AddComponent(g_ecs, Voxel_Grid, view->grid);
-    grid->palette[1] = Random(g_random);
-    grid->palette[2] = Random(g_random);
+    EID entity = entities[i];
+    Voxel_View* view = GetComponent(Voxel_View, entity);
+    view->grid = grids[i];
+    Voxel_Grid* grid = GetComponent(Voxel_Grid, view->grid);
+    uint32_t palette[256] = { 0 };
+    palette[1] = Random(g_random);
+    palette[2] = Random(g_random);
     // generate voxel data
     switch (type)
       {
@@ -1028,20 +1132,21 @@ CMD_spawn_random_voxels(uint32_t num, const char** args)
       case VOXEL_TYPE_FRACTAL1:
         {
           for (uint32_t i = 3; i < 64; i++)
-            grid->palette[i] = Random(g_random);
-          GenerateFractal1(entity);
+            palette[i] = Random(g_random);
+          GenerateFractal1(grid);
         }break;
 
       case VOXEL_TYPE_FRACTAL2:
         {
-          GenerateFractal2(entity, (grid->palette[1] & 1) ? 3 : 4);
+          GenerateFractal2(grid, (palette[1] & 1) ? 3 : 4);
         }break;
 
       default: assert(0);
       }
+    SetVoxelGridPalette(grid, palette);
     RehashVoxelGrid(grid);
-    // create transform
-    Transform* transform = AddComponent(g_ecs, Transform, entity);
+    // set transform
+    Transform* transform = GetComponent(Transform, entity);
     transform->scale = (float)(Random(g_random)%5+1);
     transform->position.x = (float)(Random(g_random)%63)-36.0f;
     transform->position.y = (float)(Random(g_random)%10)-0.5f;
@@ -1053,10 +1158,9 @@ CMD_spawn_random_voxels(uint32_t num, const char** args)
     Vec3_Normalize(&axis, &axis);
     float angle = (float)(Random(g_random)%628) / 100.0f;
     QuatFromAxisAngle(&axis, angle, &transform->rotation);
-    // just add OBB
-    AddComponent(g_ecs, OBB, entity);
-    LOG_INFO("spawned at [%.3f %.3f %.3f]", transform->position.x, transform->position.y, transform->position.z);
   }
+  LOG_INFO("spawned %d voxel models", number);
+  PersistentRelease(entities);
 }
 
 void
@@ -1089,6 +1193,8 @@ CMD_remove_voxel(uint32_t num, const char** args)
   EID entity = atoi(args[0]);
   Voxel_View* cached = GetComponent(Voxel_View, entity);
   RemoveComponent(g_ecs, Voxel_Grid, cached->grid);
+  RemoveComponent(g_ecs, Voxel_Cost, cached->grid);
+  RemoveComponent(g_ecs, Voxel_Cost, entity);
   RemoveComponent(g_ecs, Voxel_View, entity);
   RemoveComponent(g_ecs, OBB, entity);
   RemoveComponent(g_ecs, Voxel_View, entity);
@@ -1125,13 +1231,32 @@ CMD_spawn_random_vox_models(uint32_t num, const char** args)
     right++;
   }
   int model_count = atoi(args[0]);
-  while (model_count--) {
+  if (model_count <= 0)
+    return;
+  EID* entities = PersistentAllocate(model_count * sizeof(EID));
+  if (CreateEntities(g_ecs, entities, model_count) != 0) {
+    LOG_ERROR("failed to create %d entities", model_count);
+    PersistentRelease(entities);
+    return;
+  }
+  if (AddComponents(g_ecs, Transform, entities, model_count) != (uint32_t)model_count) {
+    LOG_ERROR("failed to add components to %d entities", model_count);
+    for (int i = 0; i < model_count; i++) {
+      RemoveComponent(g_ecs, Transform, entities[i]);
+      DestroyEntity(g_ecs, entities[i]);
+    }
+    PersistentRelease(entities);
+    return;
+  }
+  for (int i = 0; i < model_count; i++) {
     uint32_t id = Random(g_random) % count;
-    EID entity = CreateEntity(g_ecs);
+    EID entity = entities[i];
     // load model from file
-    LoadVoxModel(g_ecs, g_asset_manager, g_vox_allocator, entity, buff+offsets[id]);
-    // create transform
-    Transform* transform = AddComponent(g_ecs, Transform, entity);
+    if (LoadVoxModel(g_ecs, g_asset_manager, g_vox_allocator, entity, buff+offsets[id]) == NULL) {
+      LOG_WARN("failed to load voxel model '%s'", buff+offsets[id]);
+    }
+    // set transform
+    Transform* transform = GetComponent(Transform, entity);
     transform->scale = (float)(Random(g_random)%5+3);
     transform->position.x = (float)(Random(g_random)%distrib)-distrib*0.5f;
     transform->position.y = (float)(Random(g_random)%(distrib/5))-0.5f;
@@ -1143,10 +1268,20 @@ CMD_spawn_random_vox_models(uint32_t num, const char** args)
     Vec3_Normalize(&axis, &axis);
     float angle = (float)(Random(g_random)%628) / 100.0f;
     QuatFromAxisAngle(&axis, angle, &transform->rotation);
-    // just add OBB
-    AddComponent(g_ecs, OBB, entity);
     // LOG_INFO("spawned '%s' at [%.3f %.3f %.3f]", buff+offsets[id], transform->position.x, transform->position.y, transform->position.z);
   }
+  // add OBBs last, so entities join voxel group in one go
+  if (AddComponents(g_ecs, OBB, entities, model_count) != (uint32_t)model_count) {
+    LOG_ERROR("failed to add components to %d entities", model_count);
+    // voxel grids are cached assets, they stay loaded
+    for (int i = 0; i < model_count; i++) {
+      RemoveComponent(g_ecs, OBB, entities[i]);
+      RemoveComponent(g_ecs, Voxel_View, entities[i]);
+      RemoveComponent(g_ecs, Transform, entities[i]);
+      DestroyEntity(g_ecs, entities[i]);
+    }
+  }
+  PersistentRelease(entities);
 }
 
 void
@@ -1173,6 +1308,7 @@ CMD_voxel_buff_statistics(uint32_t num, const char** args)
     }
   }
   LOG_INFO("total voxels: %lu(unique: %lu)", num_voxels, unique_voxels);
+  LOG_INFO("palettes: %u(grids: %u)", NumUniqueVoxelPalettes(g_vox_palettes), ComponentCount(Voxel_Grid));
 }
 
 void CMD_spawn_melon_floor(uint32_t num, const char** args)
@@ -1187,8 +1323,10 @@ void CMD_spawn_melon_floor(uint32_t num, const char** args)
   Voxel_Grid* vox = AddComponent(g_ecs, Voxel_Grid, view->grid);
   AllocateVoxelGrid(g_vox_allocator, vox, 128, 4, 128);
   // арбузовое счастье
-  vox->palette[1] = 0x00004C00;
-  vox->palette[2] = 0x00003C00;
+  uint32_t palette[256] = { 0 };
+  palette[1] = 0x00004C00;
+  palette[2] = 0x00003C00;
+  SetVoxelGridPalette(vox, palette);
   // NOTE: we can write voxels directly because bounds are divisible by 4
   Voxel* voxels = vox->data->ptr;
   if (num == 0 || strcmp(args[0], "melon") == 0) {
@@ -1238,3 +1376,349 @@ void CMD_spawn_melon_floor(uint32_t num, const char** args)
   // just add OBB
   AddComponent(g_ecs, OBB, melon);
 }
+
+#define MEGABYTES(bytes) ((double)(bytes) / (1024.0 * 1024.0))
+
+void
+CMD_memory_stats(uint32_t num, const char** args)
+{
+  if (num > 1) {
+    CMD_ARG_COUNT_MISMATCH("0 or 1");
+  }
+  uint32_t num_tags = (num == 1) ? atoi(args[0]) : 0;
+  Allocation_Tag_Stats tags[32];
+  if (num_tags > ARR_SIZE(tags))
+    num_tags = ARR_SIZE(tags);
+  for (uint32_t i = 0; i < g_allocator_registry.count; i++) {
+    Allocator_Stats stats;
+    GetAllocatorStats(g_allocator_registry.allocators[i], &stats);
+    LOG_INFO("%s: %.2f/%.2f MB used(committed %.2f MB, peak %.2f MB), %u allocations",
+             g_allocator_registry.names[i],
+             MEGABYTES(stats.effective), MEGABYTES(stats.reserved),
+             MEGABYTES(stats.committed), MEGABYTES(stats.peak), stats.num_allocations);
+    LOG_INFO("  free: %.2f MB(largest %.2f MB), fragmentation: %.1f%%",
+             MEGABYTES(stats.total_free), MEGABYTES(stats.largest_free), stats.fragmentation * 100.0f);
+    if (stats.num_relocations > 0) {
+      LOG_INFO("  relocations: %u(%.2f MB moved in %.3f ms)",
+               stats.num_relocations, MEGABYTES(stats.relocated_bytes),
+               (double)stats.relocation_ticks * 1000.0 / (double)PlatformGetPerformanceFrequency());
+    }
+    if (num_tags > 0) {
+      uint32_t count = GetAllocationTagStats(g_allocator_registry.allocators[i], tags, ARR_SIZE(tags));
+      for (uint32_t j = 0; j < count && j < num_tags; j++) {
+        LOG_INFO("  '%s': %.2f MB in %u allocations", tags[j].tag, MEGABYTES(tags[j].bytes), tags[j].count);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < g_video_memory_registry.count; i++) {
+    const Video_Memory* memory = g_video_memory_registry.pools[i];
+    LOG_INFO("video memory '%s': %.2f/%.2f MB used(peak %.2f MB)",
+             (memory->marker) ? memory->marker : "(null)",
+             MEGABYTES(memory->offset), MEGABYTES(memory->size), MEGABYTES(memory->peak));
+  }
+  LOG_INFO("persistent memory: %.2f/%.2f MB used(left %.2f MB, right %.2f MB)",
+           MEGABYTES(g_persistent_memory.left + g_persistent_memory.size - g_persistent_memory.right),
+           MEGABYTES(g_persistent_memory.size),
+           MEGABYTES(g_persistent_memory.left), MEGABYTES(g_persistent_memory.size - g_persistent_memory.right));
+  LOG_INFO("frame memory: peak %.2f/%.2f MB, %u overflows",
+           MEGABYTES(g_frame_memory_peak), MEGABYTES(g_frame_memory.size), g_frame_memory_overflows);
+}
+
+void
+CMD_memory_overlay(uint32_t num, const char** args)
+{
+  (void)args;
+  if (num != 0) {
+    CMD_ARG_COUNT_MISMATCH("no");
+  }
+  g_console->memory_overlay = !g_console->memory_overlay;
+}
+
+void
+CMD_convert_trace(uint32_t num, const char** args)
+{
+  if (num > 2) {
+    CMD_ARG_COUNT_MISMATCH("0, 1 or 2");
+  }
+  const char* input = (num > 0) ? args[0] : "trace.lprof";
+  const char* output = (num > 1) ? args[1] : "trace.json";
+  if (ProfilerConvertTrace(input, output) == 0) {
+    LOG_INFO("written '%s'", output);
+  }
+}
+
+void
+CMD_frame_stats(uint32_t num, const char** args)
+{
+  if (num > 1) {
+    CMD_ARG_COUNT_MISMATCH("0 or 1");
+  }
+  Time_Histogram* hist = &g_frame_stats.frame_times;
+  if (num == 1) {
+    if (strcmp(args[0], "reset") != 0) {
+      LOG_WARN("frame_stats: unknown argument '%s'", args[0]);
+      return;
+    }
+    ClearTimeHistogram(hist);
+    return;
+  }
+  LOG_INFO("frame time over %u frames: p50=%.2fms p95=%.2fms p99=%.2fms max=%.2fms",
+           hist->num_samples,
+           TimeHistogramPercentile(hist, 50.0f), TimeHistogramPercentile(hist, 95.0f),
+           TimeHistogramPercentile(hist, 99.0f), (float)MaxInTimeHistogram(hist) * 0.001f);
+  for (uint32_t i = 0; i < g_frame_stats.num_counters; i++) {
+    LOG_INFO("%s: %ld", g_frame_stats.names[i], g_frame_stats.last[i]);
+  }
+}
+
+void
+CMD_profiler_overlay(uint32_t num, const char** args)
+{
+  (void)args;
+  if (num != 0) {
+    CMD_ARG_COUNT_MISMATCH("no");
+  }
+  g_console->profiler_overlay = !g_console->profiler_overlay;
+}
+
+void
+CMD_cull_stats(uint32_t num, const char** args)
+{
+  (void)args;
+  if (num != 0) {
+    CMD_ARG_COUNT_MISMATCH("no");
+  }
+  const VX_Cull_Stats* stats = GetVoxelCullStats(g_vox_drawer);
+  if (stats == NULL) {
+    LOG_WARN("cull_stats: GPU culling is only done by indirect voxel backend");
+    return;
+  }
+  for (uint32_t i = 0; i < MAX_ACTIVE_CAMERAS; i++) {
+    const VX_Cull_Stats* s = &stats[i];
+    if (s->tested_faces == 0)
+      continue;
+    float to_percent = 100.0f / (float)s->tested_faces;
+    LOG_INFO("camera %u: tested %u faces, frustum culled %u(%.1f%%), occlusion culled %u(%.1f%%), backface culled %u(%.1f%%), draws %u",
+             i, s->tested_faces,
+             s->frustum_culled_faces,   s->frustum_culled_faces   * to_percent,
+             s->occlusion_culled_faces, s->occlusion_culled_faces * to_percent,
+             s->backface_culled_faces,  s->backface_culled_faces  * to_percent,
+             s->emitted_draws);
+  }
+}
+
+
+
+/// Model cost report
+
+enum {
+  GRID_COST_VERTICES,
+  GRID_COST_QUADS,
+  GRID_COST_MEMORY,
+  GRID_COST_REMESH_FREQUENCY,
+  GRID_COST_REMESH_TIME,
+  GRID_COST_COUNT
+};
+
+GLOBAL const char* const g_grid_cost_names[GRID_COST_COUNT] = {
+  "vertices",
+  "quads",
+  "memory_bytes",
+  "remeshes_per_1000_frames",
+  "remesh_ms",
+};
+
+enum {
+  VIEW_COST_GPU_DRAWS,
+  VIEW_COST_DRAWS_PER_FRAME,
+  VIEW_COST_COUNT
+};
+
+GLOBAL const char* const g_view_cost_names[VIEW_COST_COUNT] = {
+  "gpu_draws",
+  "draws_per_frame",
+};
+
+typedef struct {
+
+  EID entity;
+  // asset name of grid, NULL for procedural grids
+  const char* name;
+  double values[GRID_COST_COUNT];
+
+} Model_Cost;
+
+// voxel grids don't know their names, only asset manager does
+INTERNAL const char*
+GridAssetName(EID grid)
+{
+  Asset_ID* asset;
+  HT_FOREACH(Asset_Table, &g_asset_manager->asset_ids, asset) {
+    if (asset->id == grid && asset->set == ComponentSet(Voxel_Grid))
+      return StringFromID(asset->name);
+  }
+  return NULL;
+}
+
+// return: number of grids or views written to 'costs'
+INTERNAL uint32_t
+CollectModelCosts(Model_Cost* costs, uint32_t max_costs, int views)
+{
+  uint32_t count = 0;
+  FOREACH_COMPONENT(Voxel_Cost) {
+    if (count == max_costs)
+      break;
+    EID entity = entities[i];
+    Model_Cost* cost = &costs[count];
+    memset(cost, 0, sizeof(Model_Cost));
+    cost->entity = entity;
+    if (views) {
+      Voxel_View* view = GetComponent(Voxel_View, entity);
+      if (view == NULL)
+        continue;
+      cost->name = GridAssetName(view->grid);
+      cost->values[VIEW_COST_GPU_DRAWS] = (double)components[i].gpu_draws;
+      if (components[i].frames_drawn > 0)
+        cost->values[VIEW_COST_DRAWS_PER_FRAME] = (double)components[i].gpu_draws / (double)components[i].frames_drawn;
+    } else {
+      Voxel_Grid* grid = GetComponent(Voxel_Grid, entity);
+      if (grid == NULL)
+        continue;
+      cost->name = GridAssetName(entity);
+      uint64_t num_frames = g_window->frame_counter - components[i].first_frame + 1;
+      cost->values[GRID_COST_VERTICES] = (double)components[i].num_vertices;
+      cost->values[GRID_COST_QUADS] = (double)(components[i].num_vertices / 4);
+#if VX_USE_INDICES
+      cost->values[GRID_COST_MEMORY] = (double)(VoxelGridBytes(grid) + components[i].num_vertices * (sizeof(Vertex_X3C) + 3 * sizeof(uint32_t) / 2));
+#else
+      cost->values[GRID_COST_MEMORY] = (double)(VoxelGridBytes(grid) + components[i].num_vertices * sizeof(Vertex_X3C));
+#endif
+      cost->values[GRID_COST_REMESH_FREQUENCY] = (double)components[i].num_remeshes * 1000.0 / (double)num_frames;
+      cost->values[GRID_COST_REMESH_TIME] = (double)components[i].remesh_ticks * 1000.0 / (double)PlatformGetPerformanceFrequency();
+    }
+    count++;
+  }
+  return count;
+}
+
+// write indices of 'top_n' biggest values of 'key' to 'top'
+// return: number of indices written
+INTERNAL uint32_t
+TopModelCosts(const Model_Cost* costs, uint32_t num_costs, uint32_t key, uint32_t* top, uint32_t top_n)
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < num_costs; i++) {
+    double value = costs[i].values[key];
+    if (value <= 0.0)
+      continue;
+    // insertion sort, top_n is small
+    uint32_t j = (count < top_n) ? count++ : top_n;
+    while (j > 0 && costs[top[j-1]].values[key] < value) {
+      if (j < top_n)
+        top[j] = top[j-1];
+      j--;
+    }
+    if (j < top_n)
+      top[j] = i;
+  }
+  return count;
+}
+
+INTERNAL void
+WriteModelCosts(Trace_Writer* writer, const char* section, const Model_Cost* costs, uint32_t num_costs,
+                const char* const* names, uint32_t num_keys, uint32_t* top, uint32_t top_n)
+{
+  TraceWriterPrintf(writer, "  \"%s\": {", section);
+  for (uint32_t key = 0; key < num_keys; key++) {
+    TraceWriterPrintf(writer, "%s\n    \"%s\": [", (key > 0) ? "," : "", names[key]);
+    uint32_t count = TopModelCosts(costs, num_costs, key, top, top_n);
+    for (uint32_t i = 0; i < count; i++) {
+      const Model_Cost* cost = &costs[top[i]];
+      TraceWriterPrintf(writer, "%s\n      {\"entity\": %u, \"name\": ", (i > 0) ? "," : "", cost->entity);
+      if (cost->name)
+        TraceWriterString(writer, cost->name, strlen(cost->name));
+      else
+        TraceWriterPrintf(writer, "null");
+      for (uint32_t j = 0; j < num_keys; j++) {
+        TraceWriterPrintf(writer, ", \"%s\": %.3f", names[j], costs[top[i]].values[j]);
+      }
+      TraceWriterPrintf(writer, "}");
+    }
+    TraceWriterPrintf(writer, "%s]", (count > 0) ? "\n    " : "");
+  }
+  TraceWriterPrintf(writer, "\n  }");
+}
+
+INTERNAL int
+WriteModelCostReport(const char* filename, const Model_Cost* grids, uint32_t num_grids,
+                     const Model_Cost* views, uint32_t num_views, uint32_t* top, uint32_t top_n)
+{
+  Trace_Writer* writer = PlatformAllocateMemory(sizeof(Trace_Writer));
+  writer->size = 0;
+  writer->file = PlatformOpenFileForWrite(filename);
+  if (writer->file == NULL) {
+    LOG_WARN("failed to open file '%s' for writing with error %s", filename, PlatformGetError());
+    PlatformFreeMemory(writer);
+    return -1;
+  }
+  TraceWriterPrintf(writer, "{\n  \"frame\": %lu,\n", g_window->frame_counter);
+  WriteModelCosts(writer, "grids", grids, num_grids, g_grid_cost_names, GRID_COST_COUNT, top, top_n);
+  TraceWriterPrintf(writer, ",\n");
+  WriteModelCosts(writer, "views", views, num_views, g_view_cost_names, VIEW_COST_COUNT, top, top_n);
+  TraceWriterPrintf(writer, "\n}\n");
+  PlatformWriteToFile(writer->file, writer->buff, writer->size);
+  PlatformCloseFileForWrite(writer->file);
+  PlatformFreeMemory(writer);
+  return 0;
+}
+
+void
+CMD_model_costs(uint32_t num, const char** args)
+{
+  if (num > 2) {
+    CMD_ARG_COUNT_MISMATCH("0, 1 or 2");
+  }
+  int number = (num > 0) ? atoi(args[0]) : 10;
+  if (number <= 0) {
+    LOG_WARN("model_costs: NUMBER must be positive");
+    return;
+  }
+  uint32_t max_costs = ComponentCount(Voxel_Cost);
+  if (max_costs == 0) {
+    LOG_INFO("no voxel models were meshed or drawn yet");
+    return;
+  }
+  // can't show more than we have
+  uint32_t top_n = ((uint32_t)number < max_costs) ? (uint32_t)number : max_costs;
+  Model_Cost* grids = PlatformAllocateMemory(2 * max_costs * sizeof(Model_Cost) + top_n * sizeof(uint32_t));
+  if (grids == NULL) {
+    LOG_ERROR("model_costs: failed to allocate memory for %u models", max_costs);
+    return;
+  }
+  Model_Cost* views = grids + max_costs;
+  uint32_t* top = (uint32_t*)(views + max_costs);
+  uint32_t num_grids = CollectModelCosts(grids, max_costs, 0);
+  uint32_t num_views = CollectModelCosts(views, max_costs, 1);
+
+  for (uint32_t key = 0; key < GRID_COST_COUNT; key++) {
+    uint32_t count = TopModelCosts(grids, num_grids, key, top, top_n);
+    LOG_INFO("grids by %s:", g_grid_cost_names[key]);
+    for (uint32_t i = 0; i < count; i++) {
+      const Model_Cost* cost = &grids[top[i]];
+      LOG_INFO("  %u. '%s'(entity %u): %.2f", i+1, cost->name ? cost->name : "procedural",
+               cost->entity, cost->values[key]);
+    }
+  }
+  uint32_t count = TopModelCosts(views, num_views, VIEW_COST_GPU_DRAWS, top, top_n);
+  LOG_INFO("views by GPU draws:");
+  for (uint32_t i = 0; i < count; i++) {
+    const Model_Cost* cost = &views[top[i]];
+    LOG_INFO("  %u. '%s'(entity %u): %lu draws(%.2f per frame)", i+1, cost->name ? cost->name : "procedural",
+             cost->entity, (uint64_t)cost->values[VIEW_COST_GPU_DRAWS], cost->values[VIEW_COST_DRAWS_PER_FRAME]);
+  }
+
+  if (num == 2 && WriteModelCostReport(args[1], grids, num_grids, views, num_views, top, top_n) == 0) {
+    LOG_INFO("written '%s'", args[1]);
+  }
+  PlatformFreeMemory(grids);
+}
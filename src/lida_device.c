@@ -5,57 +5,6 @@
 
 #include "lib/spirv.h" // for runtime SPIR-V reflection
 
-typedef struct {
-
-  VkInstance instance;
-  VkPhysicalDevice physical_device;
-  VkDevice logical_device;
-  uint32_t graphics_queue_family;
-  VkQueue graphics_queue;
-  /* uint32_t present_queue_family; */
-  VkDebugReportCallbackEXT debug_report_callback;
-  VkCommandPool command_pool;
-  // for static resources
-  VkDescriptorPool static_ds_pool;
-  // for dynamic resources
-  VkDescriptorPool dynamic_ds_pool;
-
-  VkExtensionProperties* available_instance_extensions;
-  uint32_t num_available_instance_extensions;
-
-  const char** enabled_instance_extensions;
-  uint32_t num_enabled_instance_extensions;
-
-  VkQueueFamilyProperties* queue_families;
-  uint32_t num_queue_families;
-
-  VkExtensionProperties* available_device_extensions;
-  uint32_t num_available_device_extensions;
-
-  // TODO: store those in hash table of smth
-  const char** enabled_device_extensions;
-  uint32_t num_enabled_device_extensions;
-
-  int debug_marker_enabled;
-
-  Type_Info shader_info_type;
-  Type_Info ds_layout_info_type;
-  Type_Info sampler_info_type;
-  Type_Info pipeline_layout_info_type;
-
-  Fixed_Hash_Table shader_cache;
-  Fixed_Hash_Table ds_layout_cache;
-  Fixed_Hash_Table sampler_cache;
-  Fixed_Hash_Table pipeline_layout_cache;
-
-  VkPhysicalDeviceProperties properties;
-  VkPhysicalDeviceFeatures features;
-  VkPhysicalDeviceMemoryProperties memory_properties;
-
-} Device_Vulkan;
-
-GLOBAL Device_Vulkan* g_device;
-
 typedef struct {
 
   VkDeviceMemory handle;
@@ -64,9 +13,21 @@ typedef struct {
   uint32_t type;
   // maybe NULL
   void* mapped;
+  // statistics
+  VkDeviceSize peak;
+  const char* marker;
 
 } Video_Memory;
 
+// Video memory pools that show up in memory statistics. Pools are
+// registered by AllocateVideoMemory() and removed by FreeVideoMemory().
+#define MAX_VIDEO_MEMORY_POOLS 32
+
+GLOBAL struct {
+  Video_Memory* pools[MAX_VIDEO_MEMORY_POOLS];
+  uint32_t count;
+} g_video_memory_registry;
+
 #define SHADER_REFLECT_MAX_SETS 8
 #define SHADER_REFLECT_MAX_BINDINGS_PER_SET 16
 #define SHADER_REFLECT_MAX_RANGES 4
@@ -160,6 +121,127 @@ typedef struct {
 
 } Pipeline_Desc;
 
+INTERNAL uint32_t
+HashShaderInfo(const void* obj)
+{
+  const Shader_Info* shader = obj;
+  return HashString32(shader->name);
+}
+
+INTERNAL int
+CompareShaderInfo(const void* lhs, const void* rhs)
+{
+  const Shader_Info* l = lhs, *r = rhs;
+  return strcmp(l->name, r->name);
+}
+
+INTERNAL uint32_t
+HashDSL_Info(const void* obj)
+{
+  const DS_Layout_Info* info = obj;
+  return HashMemory32(info->bindings, info->num_bindings * sizeof(VkDescriptorSetLayoutBinding));
+}
+
+INTERNAL int
+CompareDSL_Infos(const void* lhs, const void* rhs)
+{
+  const DS_Layout_Info* l = lhs, *r = rhs;
+  if (COMPARE(l->num_bindings, r->num_bindings) != 0)
+    return COMPARE(l->num_bindings, r->num_bindings);
+  return memcmp(l, r, l->num_bindings * sizeof(VkDescriptorSetLayoutBinding));
+}
+
+INTERNAL uint32_t
+HashSamplerInfo(const void* obj)
+{
+  return HashMemory32(obj, sizeof(Sampler_Info) - sizeof(VkSampler));
+}
+
+INTERNAL int
+CompareSamplerInfo(const void* lhs, const void* rhs)
+{
+  return memcmp(lhs, rhs, sizeof(Sampler_Info) - sizeof(VkSampler));
+}
+
+INTERNAL uint32_t
+HashPipelineLayoutInfo(const void* obj)
+{
+  const Pipeline_Layout_Info* info = obj;
+  uint32_t hashes[2];
+  hashes[0] = HashMemory32(info->set_layouts, info->num_sets * sizeof(VkDescriptorSetLayout));
+  hashes[1] = HashMemory32(info->ranges, info->num_ranges * sizeof(VkPushConstantRange));
+  return HashCombine32(hashes, 2);
+}
+
+INTERNAL int
+ComparePipelineLayoutInfo(const void* lhs, const void* rhs)
+{
+  const Pipeline_Layout_Info* l = lhs, *r = rhs;
+  int ret = COMPARE(l->num_sets, r->num_sets);
+  if (ret != 0) return ret;
+  ret = memcmp(l->set_layouts, r->set_layouts, l->num_sets * sizeof(VkDescriptorSetLayout));
+  if (ret != 0) return ret;
+  ret = COMPARE(l->num_ranges, r->num_ranges);
+  if (ret != 0) return ret;
+  ret = memcmp(l->ranges, r->ranges, l->num_ranges * sizeof(VkPushConstantRange));
+  return ret;
+}
+
+
+
+// caches of Vulkan objects, looked up every time a pipeline is created
+DECLARE_HASH_TABLE(Shader_Cache, Shader_Info, HashShaderInfo, CompareShaderInfo)
+DECLARE_HASH_TABLE(DS_Layout_Cache, DS_Layout_Info, HashDSL_Info, CompareDSL_Infos)
+DECLARE_HASH_TABLE(Sampler_Cache, Sampler_Info, HashSamplerInfo, CompareSamplerInfo)
+DECLARE_HASH_TABLE(Pipeline_Layout_Cache, Pipeline_Layout_Info, HashPipelineLayoutInfo, ComparePipelineLayoutInfo)
+
+typedef struct {
+
+  VkInstance instance;
+  VkPhysicalDevice physical_device;
+  VkDevice logical_device;
+  uint32_t graphics_queue_family;
+  VkQueue graphics_queue;
+  /* uint32_t present_queue_family; */
+  VkDebugReportCallbackEXT debug_report_callback;
+  VkCommandPool command_pool;
+  // for static resources
+  VkDescriptorPool static_ds_pool;
+  // for dynamic resources
+  VkDescriptorPool dynamic_ds_pool;
+
+  VkExtensionProperties* available_instance_extensions;
+  uint32_t num_available_instance_extensions;
+
+  const char** enabled_instance_extensions;
+  uint32_t num_enabled_instance_extensions;
+
+  VkQueueFamilyProperties* queue_families;
+  uint32_t num_queue_families;
+
+  VkExtensionProperties* available_device_extensions;
+  uint32_t num_available_device_extensions;
+
+  // TODO: store those in hash table of smth
+  const char** enabled_device_extensions;
+  uint32_t num_enabled_device_extensions;
+
+  int debug_marker_enabled;
+  // VK_EXT_calibrated_timestamps can read GPU clock from CPU
+  int calibrated_timestamps;
+
+  Shader_Cache shader_cache;
+  DS_Layout_Cache ds_layout_cache;
+  Sampler_Cache sampler_cache;
+  Pipeline_Layout_Cache pipeline_layout_cache;
+
+  VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceFeatures features;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+
+} Device_Vulkan;
+
+GLOBAL Device_Vulkan* g_device;
 
 /// Functions used primarily by this module
 
@@ -568,6 +650,35 @@ CreateLogicalDevice(int enable_debug_layers,
   return vkCreateDevice(g_device->physical_device, &device_info, NULL, &g_device->logical_device);
 }
 
+INTERNAL int
+IsDeviceExtensionEnabled(const char* name)
+{
+  for (uint32_t i = 0; i < g_device->num_enabled_device_extensions; i++) {
+    if (strcmp(g_device->enabled_device_extensions[i], name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// check if we can read device's clock with vkGetCalibratedTimestampsEXT
+INTERNAL int
+CheckCalibratedTimestamps()
+{
+  if (!IsDeviceExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) ||
+      vkGetPhysicalDeviceCalibrateableTimeDomainsEXT == NULL)
+    return 0;
+  VkTimeDomainEXT domains[8];
+  uint32_t count = ARR_SIZE(domains);
+  VkResult err = vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(g_device->physical_device, &count, domains);
+  if (err != VK_SUCCESS && err != VK_INCOMPLETE)
+    return 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (domains[i] == VK_TIME_DOMAIN_DEVICE_EXT)
+      return 1;
+  }
+  return 0;
+}
+
 INTERNAL VkResult
 DebugMarkObject(VkDebugReportObjectTypeEXT type, uint64_t obj, const char* name)
 {
@@ -646,72 +757,6 @@ CreateDeviceDescriptorPools()
   return err;
 }
 
-INTERNAL uint32_t
-HashShaderInfo(const void* obj)
-{
-  const Shader_Info* shader = obj;
-  return HashString32(shader->name);
-}
-
-INTERNAL int
-CompareShaderInfo(const void* lhs, const void* rhs)
-{
-  const Shader_Info* l = lhs, *r = rhs;
-  return strcmp(l->name, r->name);
-}
-
-INTERNAL uint32_t
-HashDSL_Info(const void* obj)
-{
-  const DS_Layout_Info* info = obj;
-  return HashMemory32(info->bindings, info->num_bindings * sizeof(VkDescriptorSetLayoutBinding));
-}
-
-INTERNAL int
-CompareDSL_Infos(const void* lhs, const void* rhs)
-{
-  const DS_Layout_Info* l = lhs, *r = rhs;
-  if (COMPARE(l->num_bindings, r->num_bindings) != 0)
-    return COMPARE(l->num_bindings, r->num_bindings);
-  return memcmp(l, r, l->num_bindings * sizeof(VkDescriptorSetLayoutBinding));
-}
-
-INTERNAL uint32_t
-HashSamplerInfo(const void* obj)
-{
-  return HashMemory32(obj, sizeof(Sampler_Info) - sizeof(VkSampler));
-}
-
-INTERNAL int
-CompareSamplerInfo(const void* lhs, const void* rhs)
-{
-  return memcmp(lhs, rhs, sizeof(Sampler_Info) - sizeof(VkSampler));
-}
-
-INTERNAL uint32_t
-HashPipelineLayoutInfo(const void* obj)
-{
-  const Pipeline_Layout_Info* info = obj;
-  uint32_t hashes[2];
-  hashes[0] = HashMemory32(info->set_layouts, info->num_sets * sizeof(VkDescriptorSetLayout));
-  hashes[1] = HashMemory32(info->ranges, info->num_ranges * sizeof(VkPushConstantRange));
-  return HashCombine32(hashes, 2);
-}
-
-INTERNAL int
-ComparePipelineLayoutInfo(const void* lhs, const void* rhs)
-{
-  const Pipeline_Layout_Info* l = lhs, *r = rhs;
-  int ret = COMPARE(l->num_sets, r->num_sets);
-  if (ret != 0) return ret;
-  ret = memcmp(l->set_layouts, r->set_layouts, l->num_sets * sizeof(VkDescriptorSetLayout));
-  if (ret != 0) return ret;
-  ret = COMPARE(l->num_ranges, r->num_ranges);
-  if (ret != 0) return ret;
-  ret = memcmp(l->ranges, r->ranges, l->num_ranges * sizeof(VkPushConstantRange));
-  return ret;
-}
-
 
 /// Functions used by other modules
 
@@ -750,6 +795,7 @@ CreateDevice(int enable_debug_layers, uint32_t gpu_id,
   }
   DebugMarkObject(VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_EXT, (uint64_t)g_device->logical_device,
                   "lida-engine-device");
+  g_device->calibrated_timestamps = CheckCalibratedTimestamps();
 
   // we use only 1 device in the application
   // so load device-related Vulkan entrypoints directly from the driver
@@ -771,23 +817,18 @@ CreateDevice(int enable_debug_layers, uint32_t gpu_id,
     LOG_ERROR("failed to create descriptor pool with error %s", ToString_VkResult(err));
   }
 
-  g_device->shader_info_type          = TYPE_INFO(Shader_Info, &HashShaderInfo, &CompareShaderInfo);
-  g_device->ds_layout_info_type       = TYPE_INFO(DS_Layout_Info, &HashDSL_Info, &CompareDSL_Infos);
-  g_device->sampler_info_type         = TYPE_INFO(Sampler_Info, &HashSamplerInfo, &CompareSamplerInfo);
-  g_device->pipeline_layout_info_type = TYPE_INFO(Pipeline_Layout_Info, &HashPipelineLayoutInfo, &ComparePipelineLayoutInfo);
   const size_t num_shaders          = 32;
   const size_t num_ds_layouts       = 16;
   const size_t num_samplers         = 8;
   const size_t num_pipeline_layouts = 16;
-  // this just allocates a hash table of needed size
-#define INIT_HT(type)   FHT_Init(&g_device->type##_cache, \
-           PersistentAllocate(FHT_CALC_SIZE(&g_device->type##_info_type, num_##type##s)), \
-           num_##type##s, &g_device->type##_info_type)
-  INIT_HT(shader);
-  INIT_HT(ds_layout);
-  INIT_HT(sampler);
-  INIT_HT(pipeline_layout);
-#undef INIT_HT
+  // LoadShader() gives out pointers to reflection data, so shader cache
+  // must never move its elements. Other caches grow when they run out
+  // of space.
+  Shader_Cache_Init(&g_device->shader_cache,
+                    PersistentAllocate(HT_CALC_SIZE(Shader_Info, num_shaders)), num_shaders);
+  DS_Layout_Cache_Init(&g_device->ds_layout_cache, NULL, num_ds_layouts);
+  Sampler_Cache_Init(&g_device->sampler_cache, NULL, num_samplers);
+  Pipeline_Layout_Cache_Init(&g_device->pipeline_layout_cache, NULL, num_pipeline_layouts);
 
 #if 0
   // print info about available video memory
@@ -801,6 +842,7 @@ CreateDevice(int enable_debug_layers, uint32_t gpu_id,
   return VK_SUCCESS;
  error:
   PersistentRelease(g_device);
+  g_device = NULL;
   return err;
 }
 
@@ -808,28 +850,30 @@ INTERNAL void
 DestroyDevice(int free_memory)
 {
   PROFILE_FUNCTION();
-  FHT_Iterator it;
-
-  FHT_FOREACH(&g_device->pipeline_layout_cache, &g_device->pipeline_layout_info_type, &it) {
-    Pipeline_Layout_Info* layout = FHT_IteratorGet(&it);
+  Pipeline_Layout_Info* layout;
+  HT_FOREACH(Pipeline_Layout_Cache, &g_device->pipeline_layout_cache, layout) {
     vkDestroyPipelineLayout(g_device->logical_device, layout->handle, NULL);
   }
 
-  FHT_FOREACH(&g_device->sampler_cache, &g_device->sampler_info_type, &it) {
-    Sampler_Info* sampler = FHT_IteratorGet(&it);
+  Sampler_Info* sampler;
+  HT_FOREACH(Sampler_Cache, &g_device->sampler_cache, sampler) {
     vkDestroySampler(g_device->logical_device, sampler->handle, NULL);
   }
 
-  FHT_FOREACH(&g_device->ds_layout_cache, &g_device->ds_layout_info_type, &it) {
-    DS_Layout_Info* layout = FHT_IteratorGet(&it);
-    vkDestroyDescriptorSetLayout(g_device->logical_device, layout->layout, NULL);
+  DS_Layout_Info* ds_layout;
+  HT_FOREACH(DS_Layout_Cache, &g_device->ds_layout_cache, ds_layout) {
+    vkDestroyDescriptorSetLayout(g_device->logical_device, ds_layout->layout, NULL);
   }
 
-  FHT_FOREACH(&g_device->shader_cache, &g_device->shader_info_type, &it) {
-    Shader_Info* shader = FHT_IteratorGet(&it);
+  Shader_Info* shader;
+  HT_FOREACH(Shader_Cache, &g_device->shader_cache, shader) {
     vkDestroyShaderModule(g_device->logical_device, shader->module, NULL);
   }
 
+  Pipeline_Layout_Cache_Free(&g_device->pipeline_layout_cache);
+  Sampler_Cache_Free(&g_device->sampler_cache);
+  DS_Layout_Cache_Free(&g_device->ds_layout_cache);
+
   vkDestroyDescriptorPool(g_device->logical_device, g_device->dynamic_ds_pool, NULL);
   vkDestroyDescriptorPool(g_device->logical_device, g_device->static_ds_pool,  NULL);
 
@@ -841,11 +885,7 @@ DestroyDevice(int free_memory)
   vkDestroyInstance(g_device->instance, NULL);
 
   if (free_memory) {
-    PersistentRelease(g_device->shader_cache.ptr);
-    PersistentRelease(g_device->ds_layout_cache.ptr);
-    PersistentRelease(g_device->sampler_cache.ptr);
-    PersistentRelease(g_device->pipeline_layout_cache.ptr);
-
+    PersistentRelease(g_device->shader_cache.slots);
     PersistentRelease(g_device->enabled_device_extensions);
     PersistentRelease(g_device->available_device_extensions);
     PersistentRelease(g_device->queue_families);
@@ -1019,6 +1059,17 @@ AllocateVideoMemory(Video_Memory* memory, VkDeviceSize size,
   memory->offset = 0;
   memory->size = size;
   memory->type = best_type;
+  memory->peak = 0;
+  memory->marker = marker;
+  {
+    uint32_t i = 0;
+    while (i < g_video_memory_registry.count && g_video_memory_registry.pools[i] != memory)
+      i++;
+    if (i == g_video_memory_registry.count && i < MAX_VIDEO_MEMORY_POOLS) {
+      g_video_memory_registry.pools[i] = memory;
+      g_video_memory_registry.count++;
+    }
+  }
   if (GetVideoMemoryFlags(memory) & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
     err = vkMapMemory(g_device->logical_device, memory->handle, 0, VK_WHOLE_SIZE, 0, &memory->mapped);
     if (err != VK_SUCCESS) {
@@ -1043,6 +1094,13 @@ FreeVideoMemory(Video_Memory* memory)
   }
   vkFreeMemory(g_device->logical_device, memory->handle, NULL);
   memory->handle = VK_NULL_HANDLE;
+  for (uint32_t i = 0; i < g_video_memory_registry.count; i++) {
+    if (g_video_memory_registry.pools[i] == memory) {
+      g_video_memory_registry.count--;
+      g_video_memory_registry.pools[i] = g_video_memory_registry.pools[g_video_memory_registry.count];
+      break;
+    }
+  }
 }
 
 INTERNAL void
@@ -1089,6 +1147,8 @@ ImageBindToMemory(Video_Memory* memory, VkImage image, const VkMemoryRequirement
     LOG_ERROR("failed to bind image to memory with error %s", ToString_VkResult(err));
   } else {
     memory->offset += requirements->size;
+    if (memory->offset > memory->peak)
+      memory->peak = memory->offset;
   }
   return err;
 }
@@ -1123,6 +1183,8 @@ BufferBindToMemory(Video_Memory* memory, VkBuffer buffer,
       }
     }
     memory->offset += requirements->size;
+    if (memory->offset > memory->peak)
+      memory->peak = memory->offset;
   }
   return err;
 }
@@ -1235,7 +1297,10 @@ ReflectSPIRV(const uint32_t* code, uint32_t size, Shader_Reflect* shader)
     return -1;
   }
   uint32_t id_bound = code[3];
-  SPIRV_ID* ids = PersistentAllocate(sizeof(SPIRV_ID) * id_bound);
+  SPIRV_ID* ids = ScratchAllocate(sizeof(SPIRV_ID) * id_bound);
+  if (ids == NULL) {
+    return -1;
+  }
   memset(ids, 0, sizeof(SPIRV_ID) * id_bound);
   for (uint32_t i = 0; i < id_bound; i++) {
     ids->data.binding.inputAttachmentIndex = UINT32_MAX;
@@ -1427,7 +1492,7 @@ ReflectSPIRV(const uint32_t* code, uint32_t size, Shader_Reflect* shader)
 
   }
 
-  PersistentRelease(ids);
+  ScratchRelease(ids);
   return 0;
 }
 
@@ -1437,7 +1502,7 @@ INTERNAL VkShaderModule
 LoadShader(const char* path, const Shader_Reflect** reflect)
 {
   // check if we already have loaded this shader
-  Shader_Info* info = FHT_Search(&g_device->shader_cache, &g_device->shader_info_type, &path);
+  Shader_Info* info = Shader_Cache_Search(&g_device->shader_cache, (const Shader_Info*)&path);
   if (info) {
     if (reflect) {
       *reflect = &info->reflect;
@@ -1467,11 +1532,17 @@ LoadShader(const char* path, const Shader_Reflect** reflect)
       LOG_WARN("failed to mark shader module '%s' with error %s", path, ToString_VkResult(err));
     }
     // Insert shader to cache if succeeded
-    Shader_Info* shader_info = FHT_Insert(&g_device->shader_cache, &g_device->shader_info_type,
-                                          &(Shader_Info) { .name = path, .module = ret });
-    ReflectSPIRV(buffer, buffer_size / sizeof(uint32_t), &shader_info->reflect);
-    if (reflect) {
-      *reflect = &shader_info->reflect;
+    Shader_Info* shader_info = Shader_Cache_Insert(&g_device->shader_cache,
+                                                   &(Shader_Info) { .name = path, .module = ret });
+    if (shader_info) {
+      ReflectSPIRV(buffer, buffer_size / sizeof(uint32_t), &shader_info->reflect);
+      if (reflect) {
+        *reflect = &shader_info->reflect;
+      }
+    } else {
+      LOG_ERROR("failed to load shader '%s': shader cache is full", path);
+      vkDestroyShaderModule(g_device->logical_device, ret, NULL);
+      ret = VK_NULL_HANDLE;
     }
   }
   PlatformFreeLoadedFile(buffer);
@@ -1504,8 +1575,8 @@ ForceUpdateShader(const char* path)
     LOG_WARN("failed to mark shader module '%s' with error %s", path, ToString_VkResult(err));
   }
   // Insert shader to cache if succeeded
-  Shader_Info* shader_info = FHT_Search(&g_device->shader_cache, &g_device->shader_info_type,
-                                        &(Shader_Info) { .name = path });
+  Shader_Info* shader_info = Shader_Cache_Search(&g_device->shader_cache,
+                                                 &(Shader_Info) { .name = path });
   if (shader_info == NULL) {
     LOG_ERROR("shader '%s' was not created before", path);
     vkDestroyShaderModule(g_device->logical_device, ret, NULL);
@@ -1533,7 +1604,7 @@ GetDescriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, size_t num_
   Assert(num_bindings <= ARR_SIZE(key.bindings));
   memcpy(key.bindings, bindings, sizeof(VkDescriptorSetLayoutBinding));
   QuickSort(key.bindings, num_bindings, sizeof(VkDescriptorSetLayoutBinding), &Compare_DSLB);
-  DS_Layout_Info* layout = FHT_Search(&g_device->ds_layout_cache, &g_device->ds_layout_info_type, &key);
+  DS_Layout_Info* layout = DS_Layout_Cache_Search(&g_device->ds_layout_cache, &key);
   if (layout) {
     return layout->layout;
   }
@@ -1547,7 +1618,7 @@ GetDescriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, size_t num_
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to create descriptor layout with error %s", ToString_VkResult(err));
   }
-  FHT_Insert(&g_device->ds_layout_cache, &g_device->ds_layout_info_type, &key);
+  DS_Layout_Cache_Insert(&g_device->ds_layout_cache, &key);
   return ret;
 }
 
@@ -1560,7 +1631,7 @@ GetSampler(VkFilter filter, VkSamplerAddressMode mode, VkBorderColor border_colo
   sampler.border_color = border_color;
   sampler.max_lod = max_lod;
   // try to look if have this sampler in cache
-  Sampler_Info* it = FHT_Search(&g_device->sampler_cache, &g_device->sampler_info_type, &sampler);
+  Sampler_Info* it = Sampler_Cache_Search(&g_device->sampler_cache, &sampler);
   if (it) {
     return it->handle;
   }
@@ -1583,7 +1654,7 @@ GetSampler(VkFilter filter, VkSamplerAddressMode mode, VkBorderColor border_colo
     return VK_NULL_HANDLE;
   }
   // add sampler to cache if succeeded
-  FHT_Insert(&g_device->sampler_cache, &g_device->sampler_info_type, &sampler);
+  Sampler_Cache_Insert(&g_device->sampler_cache, &sampler);
   return sampler.handle;
 }
 
@@ -1645,7 +1716,9 @@ MergeShaderReflects(Shader_Reflect* lhs, const Shader_Reflect* rhs)
 INTERNAL Shader_Reflect*
 CollectShaderReflects(const Shader_Reflect** shaders, size_t count)
 {
-  Shader_Reflect* shader = PersistentAllocate(sizeof(Shader_Reflect));
+  Shader_Reflect* shader = ScratchAllocate(sizeof(Shader_Reflect));
+  if (shader == NULL)
+    return NULL;
   memcpy(shader, shaders[0], sizeof(Shader_Reflect));
   for (size_t i = 1; i < count; i++) {
     MergeShaderReflects(shader, shaders[i]);
@@ -1665,6 +1738,8 @@ CreatePipelineLayout(const Shader_Reflect** shader_templates, size_t count)
       shader = shader_templates[0];
     } else {
       shader = CollectShaderReflects(shader_templates, count);
+      if (shader == NULL)
+        return VK_NULL_HANDLE;
     }
     layout_info.num_sets = shader->set_count;
     for (uint32_t i = 0; i < shader->set_count; i++) {
@@ -1676,8 +1751,7 @@ CreatePipelineLayout(const Shader_Reflect** shader_templates, size_t count)
       layout_info.ranges[i] = shader->ranges[i];
     }
   }
-  Pipeline_Layout_Info* it = FHT_Search(&g_device->pipeline_layout_cache,
-                                        &g_device->pipeline_layout_info_type, &layout_info);
+  Pipeline_Layout_Info* it = Pipeline_Layout_Cache_Search(&g_device->pipeline_layout_cache, &layout_info);
   if (it) {
     return it->handle;
   }
@@ -1696,10 +1770,10 @@ CreatePipelineLayout(const Shader_Reflect** shader_templates, size_t count)
     LOG_ERROR("failed to create pipeline layout with error %s", ToString_VkResult(err));
   } else {
     // add pipeline layout to cache if succeeded
-    FHT_Insert(&g_device->pipeline_layout_cache, &g_device->pipeline_layout_info_type, &layout_info);
+    Pipeline_Layout_Cache_Insert(&g_device->pipeline_layout_cache, &layout_info);
   }
   if (count > 1)
-    PersistentRelease((void*)shader);
+    ScratchRelease((void*)shader);
   return ret;
 }
 
@@ -1708,18 +1782,25 @@ CreateGraphicsPipelines(VkPipeline* pipelines, size_t count, const Pipeline_Desc
 {
   PROFILE_FUNCTION();
   // allocate some structures
-  VkGraphicsPipelineCreateInfo* create_infos                    = PersistentAllocate(count * sizeof(VkGraphicsPipelineCreateInfo));
-  VkPipelineShaderStageCreateInfo* stages                       = PersistentAllocate(2 * count * sizeof(VkPipelineShaderStageCreateInfo));
-  VkShaderModule* modules                                       = PersistentAllocate(2 * count * sizeof(VkShaderModule));
-  const Shader_Reflect** reflects                               = PersistentAllocate(2 * count * sizeof(Shader_Reflect*));
-  VkPipelineVertexInputStateCreateInfo* vertex_input_states     = PersistentAllocate(count * sizeof(VkPipelineVertexInputStateCreateInfo));
-  VkPipelineInputAssemblyStateCreateInfo* input_assembly_states = PersistentAllocate(count * sizeof(VkPipelineInputAssemblyStateCreateInfo));
-  VkPipelineViewportStateCreateInfo* viewport_states            = PersistentAllocate(count * sizeof(VkPipelineViewportStateCreateInfo));
-  VkPipelineRasterizationStateCreateInfo* rasterization_states  = PersistentAllocate(count * sizeof(VkPipelineRasterizationStateCreateInfo));
-  VkPipelineMultisampleStateCreateInfo* multisample_states      = PersistentAllocate(count * sizeof(VkPipelineMultisampleStateCreateInfo));
-  VkPipelineDepthStencilStateCreateInfo* depth_stencil_states   = PersistentAllocate(count * sizeof(VkPipelineDepthStencilStateCreateInfo));
-  VkPipelineColorBlendStateCreateInfo* color_blend_states       = PersistentAllocate(count * sizeof(VkPipelineColorBlendStateCreateInfo));
-  VkPipelineDynamicStateCreateInfo* dynamic_states              = PersistentAllocate(count * sizeof(VkPipelineDynamicStateCreateInfo));
+  void* scratch = ScratchTop();
+  VkGraphicsPipelineCreateInfo* create_infos                    = ScratchAllocate(count * sizeof(VkGraphicsPipelineCreateInfo));
+  VkPipelineShaderStageCreateInfo* stages                       = ScratchAllocate(2 * count * sizeof(VkPipelineShaderStageCreateInfo));
+  VkShaderModule* modules                                       = ScratchAllocate(2 * count * sizeof(VkShaderModule));
+  const Shader_Reflect** reflects                               = ScratchAllocate(2 * count * sizeof(Shader_Reflect*));
+  VkPipelineVertexInputStateCreateInfo* vertex_input_states     = ScratchAllocate(count * sizeof(VkPipelineVertexInputStateCreateInfo));
+  VkPipelineInputAssemblyStateCreateInfo* input_assembly_states = ScratchAllocate(count * sizeof(VkPipelineInputAssemblyStateCreateInfo));
+  VkPipelineViewportStateCreateInfo* viewport_states            = ScratchAllocate(count * sizeof(VkPipelineViewportStateCreateInfo));
+  VkPipelineRasterizationStateCreateInfo* rasterization_states  = ScratchAllocate(count * sizeof(VkPipelineRasterizationStateCreateInfo));
+  VkPipelineMultisampleStateCreateInfo* multisample_states      = ScratchAllocate(count * sizeof(VkPipelineMultisampleStateCreateInfo));
+  VkPipelineDepthStencilStateCreateInfo* depth_stencil_states   = ScratchAllocate(count * sizeof(VkPipelineDepthStencilStateCreateInfo));
+  VkPipelineColorBlendStateCreateInfo* color_blend_states       = ScratchAllocate(count * sizeof(VkPipelineColorBlendStateCreateInfo));
+  VkPipelineDynamicStateCreateInfo* dynamic_states              = ScratchAllocate(count * sizeof(VkPipelineDynamicStateCreateInfo));
+  if (!create_infos || !stages || !modules || !reflects || !vertex_input_states ||
+      !input_assembly_states || !viewport_states || !rasterization_states ||
+      !multisample_states || !depth_stencil_states || !color_blend_states || !dynamic_states) {
+    ScratchRelease(scratch);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
   for (size_t i = 0; i < count; i++) {
 
     modules[2*i] = LoadShader(descs[i].vertex_shader, &reflects[2*i]);
@@ -1835,17 +1916,17 @@ CreateGraphicsPipelines(VkPipeline* pipelines, size_t count, const Pipeline_Desc
   VkResult err = vkCreateGraphicsPipelines(g_device->logical_device, VK_NULL_HANDLE,
                                            count, create_infos, VK_NULL_HANDLE, pipelines);
 
-  PersistentRelease(dynamic_states);
-  PersistentRelease(color_blend_states);
-  PersistentRelease(depth_stencil_states);
-  PersistentRelease(multisample_states);
-  PersistentRelease(viewport_states);
-  PersistentRelease(input_assembly_states);
-  PersistentRelease(vertex_input_states);
-  PersistentRelease(reflects);
-  PersistentRelease(modules);
-  PersistentRelease(stages);
-  PersistentRelease(create_infos);
+  ScratchRelease(dynamic_states);
+  ScratchRelease(color_blend_states);
+  ScratchRelease(depth_stencil_states);
+  ScratchRelease(multisample_states);
+  ScratchRelease(viewport_states);
+  ScratchRelease(input_assembly_states);
+  ScratchRelease(vertex_input_states);
+  ScratchRelease(reflects);
+  ScratchRelease(modules);
+  ScratchRelease(stages);
+  ScratchRelease(create_infos);
 
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to create graphics pipelines with error %s", ToString_VkResult(err));
@@ -1867,9 +1948,14 @@ CreateComputePipelines(VkPipeline* pipelines, size_t count, const char* shaders[
 {
   PROFILE_FUNCTION();
   // allocate some structures
-  VkComputePipelineCreateInfo* create_infos = PersistentAllocate(count * sizeof(VkComputePipelineCreateInfo));
-  VkShaderModule* modules = PersistentAllocate(count * sizeof(VkShaderModule));
-  const Shader_Reflect** reflects = PersistentAllocate(count * sizeof(Shader_Reflect*));
+  void* scratch = ScratchTop();
+  VkComputePipelineCreateInfo* create_infos = ScratchAllocate(count * sizeof(VkComputePipelineCreateInfo));
+  VkShaderModule* modules = ScratchAllocate(count * sizeof(VkShaderModule));
+  const Shader_Reflect** reflects = ScratchAllocate(count * sizeof(Shader_Reflect*));
+  if (!create_infos || !modules || !reflects) {
+    ScratchRelease(scratch);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
   for (size_t i = 0; i < count; i++) {
     modules[i] = LoadShader(shaders[i], &reflects[i]);
     layouts[i] = CreatePipelineLayout(&reflects[i], 1);
@@ -1886,9 +1972,9 @@ CreateComputePipelines(VkPipeline* pipelines, size_t count, const char* shaders[
   }
   VkResult err = vkCreateComputePipelines(g_device->logical_device, VK_NULL_HANDLE,
                                           count, create_infos, VK_NULL_HANDLE, pipelines);
-  PersistentRelease(reflects);
-  PersistentRelease(modules);
-  PersistentRelease(create_infos);
+  ScratchRelease(reflects);
+  ScratchRelease(modules);
+  ScratchRelease(create_infos);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to create compute pipelines with error %s", ToString_VkResult(err));
   } else {
@@ -1911,7 +1997,9 @@ AllocateDescriptorSets(const VkDescriptorSetLayoutBinding* bindings, size_t num_
 {
   // find appropriate descriptor layout
   VkDescriptorSetLayout layout = GetDescriptorSetLayout(bindings, num_bindings);
-  VkDescriptorSetLayout* layouts = PersistentAllocate(num_sets * sizeof(VkDescriptorSetLayout));
+  VkDescriptorSetLayout* layouts = ScratchAllocate(num_sets * sizeof(VkDescriptorSetLayout));
+  if (layouts == NULL)
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
   for (size_t i = 0; i < num_sets; i++)
     layouts[i] = layout;
   VkDescriptorSetAllocateInfo allocate_info = {
@@ -1924,7 +2012,7 @@ AllocateDescriptorSets(const VkDescriptorSetLayoutBinding* bindings, size_t num_
   if (err != VK_SUCCESS) {
     LOG_WARN("failed to allocate descriptor sets with error %s", ToString_VkResult(err));
   }
-  PersistentRelease(layouts);
+  ScratchRelease(layouts);
   if (err == VK_SUCCESS) {
     // do naming
     char buff[128];
@@ -10,20 +10,46 @@
 // entity ID
 typedef uint32_t EID;
 
+#define MAX_GROUP_COMPONENTS 4
+
+// Sparse arrays are split into pages, so we only spend memory on
+// ranges of IDs that actually have components.
+#define SPARSE_PAGE_SHIFT 10
+#define SPARSE_PAGE_SIZE (1<<SPARSE_PAGE_SHIFT)
+#define SPARSE_PAGE_MASK (SPARSE_PAGE_SIZE-1)
+
+typedef struct Component_Group Component_Group;
+
 typedef struct {
 
+  // array of pages, each page is an Allocation* with SPARSE_PAGE_SIZE
+  // indices or NULL
   Allocation* sparse;
   // entities
   Allocation* dense;
   // components
   Allocation* packed;
-  EID max_id;
+  uint32_t num_pages;
   uint32_t capacity;
   uint32_t size;
   const Type_Info* type_info;
+  // group that owns this set, NULL if none
+  Component_Group* group;
 
 } Sparse_Set;
 
+// Owning group (like in EnTT). First 'size' elements of every owned
+// set are entities having all components of the group, and they're
+// stored in the same order. So iterating over a group is just a
+// linear walk over packed arrays without any lookups.
+struct Component_Group {
+
+  Sparse_Set* sets[MAX_GROUP_COMPONENTS];
+  uint32_t num_sets;
+  uint32_t size;
+
+};
+
 typedef struct {
 
   Allocator* allocator;
@@ -53,40 +79,82 @@ ClearSparseSet(Allocator* allocator, Sparse_Set* set)
     return;
   FreeAllocation(allocator, set->dense);
   FreeAllocation(allocator, set->packed);
-  FreeAllocation(allocator, set->sparse);
+  if (set->sparse) {
+    Allocation** pages = set->sparse->ptr;
+    for (uint32_t i = 0; i < set->num_pages; i++) {
+      if (pages[i])
+        FreeAllocation(allocator, pages[i]);
+    }
+    FreeAllocation(allocator, set->sparse);
+  }
   set->dense = NULL;
   set->packed = NULL;
   set->sparse = NULL;
-  set->max_id = 0;
+  set->num_pages = 0;
   set->capacity = 0;
   set->size = 0;
+  if (set->group) {
+    // no entity can have all components now
+    set->group->size = 0;
+  }
 }
 
-INTERNAL int
-SetSparseSetMaxID(Allocator* allocator, Sparse_Set* set, EID id)
+// get pointer to entity's index in dense array, NULL is returned if
+// entity's page is not allocated
+INTERNAL uint32_t*
+GetSparseIndex(const Sparse_Set* set, EID entity)
 {
-  if (id <= set->max_id)
-    return 1;
-  Allocation* old = set->sparse;
-  if (old) {
-    set->sparse = ChangeAllocationSize(allocator, set->sparse, sizeof(uint32_t) * id);
-  } else {
-    set->sparse = DoAllocation(allocator, sizeof(uint32_t)*id, set->type_info->name);
+  uint32_t page = entity >> SPARSE_PAGE_SHIFT;
+  if (page >= set->num_pages)
+    return NULL;
+  Allocation* allocation = ((Allocation**)set->sparse->ptr)[page];
+  if (allocation == NULL)
+    return NULL;
+  return (uint32_t*)allocation->ptr + (entity & SPARSE_PAGE_MASK);
+}
+
+// same as GetSparseIndex() but allocates page if needed
+INTERNAL uint32_t*
+AssureSparseIndex(Allocator* allocator, Sparse_Set* set, EID entity)
+{
+  uint32_t page = entity >> SPARSE_PAGE_SHIFT;
+  if (page >= set->num_pages) {
+    uint32_t num_pages = set->num_pages * 2;
+    if (num_pages <= page)
+      num_pages = page + 1;
+    Allocation* old = set->sparse;
+    if (old) {
+      set->sparse = ChangeAllocationSize(allocator, set->sparse, sizeof(Allocation*) * num_pages);
+    } else {
+      set->sparse = DoAllocation(allocator, sizeof(Allocation*) * num_pages, set->type_info->name);
+    }
+    if (set->sparse == NULL) {
+      set->sparse = old;
+      LOG_WARN("entity component system: out of memory");
+      return NULL;
+    }
+    Allocation** pages = set->sparse->ptr;
+    for (uint32_t i = set->num_pages; i < num_pages; i++) {
+      pages[i] = NULL;
+    }
+    set->num_pages = num_pages;
   }
-  // LOG_TRACE("%s: sparse=%p", set->type_info->name, set->sparse->ptr);
-  if (set->sparse == NULL) {
-    set->sparse = old;
-    LOG_WARN("entity component system: out of memory");
-    return -1;
+  if (((Allocation**)set->sparse->ptr)[page] == NULL) {
+    // NOTE: allocation might move page table, so don't hold pointer to it
+    Allocation* allocation = DoAllocation(allocator, sizeof(uint32_t) * SPARSE_PAGE_SIZE, set->type_info->name);
+    if (allocation == NULL) {
+      LOG_WARN("entity component system: out of memory");
+      return NULL;
+    }
+    ((Allocation**)set->sparse->ptr)[page] = allocation;
   }
-  set->max_id = id;
-  return 0;
+  return GetSparseIndex(set, entity);
 }
 
 INTERNAL int
 ReserveSparseSet(Allocator* allocator, Sparse_Set* set, uint32_t capacity)
 {
-  if (capacity <= set->size)
+  if (capacity <= set->capacity)
     return 1;
   Allocation* old = set->packed;
   if (old) {
@@ -118,13 +186,13 @@ SearchSparseSet(const Sparse_Set* set, EID entity)
 {
   if (set->size == 0)
     return NULL;
-  uint32_t* sparse = set->sparse->ptr;
+  const uint32_t* index = GetSparseIndex(set, entity);
   EID* dense = set->dense->ptr;
-  if (entity < set->max_id &&
-      sparse[entity] < set->size &&
-      dense[sparse[entity]] == entity) {
+  if (index &&
+      *index < set->size &&
+      dense[*index] == entity) {
     uint8_t* packed = set->packed->ptr;
-    return packed + sparse[entity] * set->type_info->size;
+    return packed + *index * set->type_info->size;
   }
   return NULL;
 }
@@ -132,26 +200,54 @@ SearchSparseSet(const Sparse_Set* set, EID entity)
 INTERNAL void*
 InsertToSparseSet(Allocator* allocator, Sparse_Set* set, EID entity)
 {
-  if (entity >= set->max_id) {
-    SetSparseSetMaxID(allocator, set, entity+8);
-  } else if (SearchSparseSet(set, entity)) {
+  if (SearchSparseSet(set, entity)) {
     // sparse set already has this entity
     return NULL;
   }
   if (set->size == set->capacity) {
-    // TODO: pick a better grow policy
-    ReserveSparseSet(allocator, set, set->capacity+8);
+    uint32_t capacity = (set->capacity > 0) ? set->capacity * 2 : 8;
+    if (ReserveSparseSet(allocator, set, capacity) < 0)
+      return NULL;
   }
-  uint32_t* sparse = set->sparse->ptr;
+  uint32_t* index = AssureSparseIndex(allocator, set, entity);
+  if (index == NULL)
+    return NULL;
   EID* dense = set->dense->ptr;
   uint8_t* packed = set->packed->ptr;
   void* component = packed + set->size * set->type_info->size;
   dense[set->size] = entity;
-  sparse[entity] = set->size;
+  *index = set->size;
   set->size++;
   return component;
 }
 
+/**
+   Append 'count' entities to the end of sparse set. Entities must not
+   be in the set already. Components are stored contiguously, pointer
+   to the first one is returned so they can be filled with one copy.
+ */
+INTERNAL void*
+AppendToSparseSet(Allocator* allocator, Sparse_Set* set, const EID* entities, uint32_t count)
+{
+  if (ReserveSparseSet(allocator, set, set->size + count) < 0) {
+    LOG_WARN("entity component system: out of memory");
+    return NULL;
+  }
+  // allocate all sparse pages before touching the set, so it stays
+  // unchanged if we run out of memory midway
+  for (uint32_t i = 0; i < count; i++) {
+    if (AssureSparseIndex(allocator, set, entities[i]) == NULL)
+      return NULL;
+  }
+  uint32_t first = set->size;
+  for (uint32_t i = 0; i < count; i++) {
+    ((EID*)set->dense->ptr)[set->size] = entities[i];
+    *GetSparseIndex(set, entities[i]) = set->size;
+    set->size++;
+  }
+  return (uint8_t*)set->packed->ptr + first * set->type_info->size;
+}
+
 INTERNAL int
 EraseFromSparseSet(Sparse_Set* set, EID entity)
 {
@@ -159,24 +255,86 @@ EraseFromSparseSet(Sparse_Set* set, EID entity)
     return -1;
   }
   uint16_t component_size = set->type_info->size;
-  uint32_t* sparse = set->sparse->ptr;
+  uint32_t index = *GetSparseIndex(set, entity);
   EID* dense = set->dense->ptr;
   uint8_t* packed = set->packed->ptr;
 
   // move last element to this position
-  void* dst = packed + sparse[entity] * component_size;
+  void* dst = packed + index * component_size;
   void* src = packed + (set->size - 1) * component_size;
   EID end = dense[set->size - 1];
-  dense[sparse[entity]] = end;
-  sparse[end] = sparse[entity];
+  dense[index] = end;
+  *GetSparseIndex(set, end) = index;
   memcpy(dst, src, component_size);
   set->size--;
 
   return 0;
 }
 
+// swap 2 elements of sparse set, indices must be less than set's size
+INTERNAL void
+SwapInSparseSet(Sparse_Set* set, uint32_t a, uint32_t b)
+{
+  if (a == b)
+    return;
+  uint32_t component_size = set->type_info->size;
+  EID* dense = set->dense->ptr;
+  uint8_t* pa = (uint8_t*)set->packed->ptr + a * component_size;
+  uint8_t* pb = (uint8_t*)set->packed->ptr + b * component_size;
+  EID ea = dense[a];
+  EID eb = dense[b];
+  dense[a] = eb;
+  dense[b] = ea;
+  *GetSparseIndex(set, ea) = b;
+  *GetSparseIndex(set, eb) = a;
+  // components might be big, so we don't use temporary buffer
+  for (uint32_t i = 0; i < component_size; i++) {
+    uint8_t t = pa[i];
+    pa[i] = pb[i];
+    pb[i] = t;
+  }
+}
+
 // TODO: component sort
 
+
+/// groups
+
+// move entity to group if it has all group's components
+INTERNAL void
+AddToGroup(Component_Group* group, EID entity)
+{
+  for (uint32_t i = 0; i < group->num_sets; i++) {
+    if (SearchSparseSet(group->sets[i], entity) == NULL)
+      return;
+  }
+  if (*GetSparseIndex(group->sets[0], entity) < group->size) {
+    // already in group
+    return;
+  }
+  for (uint32_t i = 0; i < group->num_sets; i++) {
+    SwapInSparseSet(group->sets[i], *GetSparseIndex(group->sets[i], entity), group->size);
+  }
+  group->size++;
+}
+
+// move entity out of group, should be called before removing
+// component from an owned set
+INTERNAL void
+RemoveFromGroup(Component_Group* group, EID entity)
+{
+  if (SearchSparseSet(group->sets[0], entity) == NULL)
+    return;
+  uint32_t index = *GetSparseIndex(group->sets[0], entity);
+  if (index >= group->size)
+    return;
+  group->size--;
+  // entity has the same index in all sets
+  for (uint32_t i = 0; i < group->num_sets; i++) {
+    SwapInSparseSet(group->sets[i], index, group->size);
+  }
+}
+
 
 /// public functions
 
@@ -184,6 +342,7 @@ INTERNAL void
 CreateECS(Allocator* allocator, ECS* ecs, uint32_t init_num_entities)
 {
   Assert(init_num_entities > 0);
+  ecs->allocator = allocator;
   ecs->num_dead = 0;
   ecs->num_entities = 0;
   ecs->max_entities = init_num_entities;
@@ -192,7 +351,6 @@ CreateECS(Allocator* allocator, ECS* ecs, uint32_t init_num_entities)
     LOG_FATAL("entity component system: out of memory at initialization");
     return;
   }
-  ecs->allocator = allocator;
 }
 
 INTERNAL void
@@ -207,7 +365,12 @@ CreateEntity(ECS* ecs)
   if (ecs->num_dead == 0) {
     if (ecs->num_entities == ecs->max_entities) {
       // TODO: pick a better grow policy
-      ecs->entities = ChangeAllocationSize(ecs->allocator, ecs->entities, ecs->max_entities * 2 * sizeof(uint32_t));
+      Allocation* allocation = ChangeAllocationSize(ecs->allocator, ecs->entities, ecs->max_entities * 2 * sizeof(uint32_t));
+      if (allocation == NULL) {
+        LOG_WARN("entity component system: out of memory");
+        return ENTITY_NIL;
+      }
+      ecs->entities = allocation;
       ecs->max_entities *= 2;
     }
     uint32_t* entities = ecs->entities->ptr;
@@ -224,10 +387,55 @@ CreateEntity(ECS* ecs)
   return entity;
 }
 
+/**
+   Create 'count' entities at once and write their IDs to 'entities'.
+   Entity array is grown at most once.
+   Return 0 on success, on failure no entities are created.
+ */
+INTERNAL int
+CreateEntities(ECS* ecs, EID* entities, uint32_t count)
+{
+  // grow before reusing dead entities, so nothing is created on failure
+  uint32_t remaining = (count > ecs->num_dead) ? count - ecs->num_dead : 0;
+  if (ecs->num_entities + remaining > ecs->max_entities) {
+    uint32_t max_entities = ecs->max_entities * 2;
+    if (max_entities < ecs->num_entities + remaining)
+      max_entities = ecs->num_entities + remaining;
+    Allocation* allocation = ChangeAllocationSize(ecs->allocator, ecs->entities, max_entities * sizeof(uint32_t));
+    if (allocation == NULL) {
+      LOG_WARN("entity component system: out of memory");
+      return -1;
+    }
+    ecs->entities = allocation;
+    ecs->max_entities = max_entities;
+  }
+  uint32_t i = 0;
+  // reuse dead entities first
+  for (; i < count && ecs->num_dead > 0; i++) {
+    entities[i] = CreateEntity(ecs);
+  }
+  uint32_t* counts = ecs->entities->ptr;
+  for (; i < count; i++) {
+    EID entity = ecs->num_entities++;
+    counts[entity] = 0;
+    entities[i] = entity;
+  }
+  return 0;
+}
+
+INTERNAL int
+IsEntityValid(ECS* ecs, EID entity)
+{
+  uint32_t* entities = ecs->entities->ptr;
+  return
+    (entity < ecs->num_entities) &&
+    ((entities[entity] & ENTITY_DEAD_MASK) == 0);
+}
+
 INTERNAL void
 DestroyEntity(ECS* ecs, EID entity)
 {
-  if (entity < ecs->max_entities) {
+  if (!IsEntityValid(ecs, entity)) {
     LOG_WARN("entity component system: invalid entity");
     return;
   }
@@ -236,27 +444,18 @@ DestroyEntity(ECS* ecs, EID entity)
     LOG_WARN("entity %u still has %u components, this is a memory leak",
              entity, entities[entity]);
   }
-  entities[entity] = ecs->next_dead;
+  entities[entity] = ecs->next_dead | ENTITY_DEAD_MASK;
   ecs->next_dead = entity | ENTITY_DEAD_MASK;
   ecs->num_dead++;
 }
 
-INTERNAL int
-IsEntityValid(ECS* ecs, EID entity)
-{
-  uint32_t* entities = ecs->entities->ptr;
-  return
-    (entity < ecs->num_entities) &&
-    ((entities[entity] & ENTITY_DEAD_MASK) == 0);
-}
-
 INTERNAL void
 DestroyEmptyEntities(ECS* ecs)
 {
   uint32_t* entities = ecs->entities->ptr;
   for (uint32_t i = 0; i < ecs->num_entities; i++) {
     if (entities[i] == 0) {
-      entities[i] = ecs->next_dead;
+      entities[i] = ecs->next_dead | ENTITY_DEAD_MASK;
       ecs->next_dead = i | ENTITY_DEAD_MASK;
       ecs->num_dead++;
     }
@@ -266,10 +465,66 @@ DestroyEmptyEntities(ECS* ecs)
 INTERNAL void*
 AddComponent_ECS(ECS* ecs, Sparse_Set* set, EID entity)
 {
+  if (!IsEntityValid(ecs, entity)) {
+    LOG_WARN("entity component system: can't add component to invalid entity %u", entity);
+    return NULL;
+  }
   void* ret = InsertToSparseSet(ecs->allocator, set, entity);
   if (ret) {
     uint32_t* entities = ecs->entities->ptr;
     entities[entity]++;
+    if (set->group) {
+      AddToGroup(set->group, entity);
+      // component might have been moved
+      ret = SearchSparseSet(set, entity);
+    }
+  }
+  return ret;
+}
+
+/**
+   Add a component to each of 'count' entities, memory for components
+   is reserved up front. Entities that already have this component
+   are skipped. Use GetComponent() to initialize added components.
+   Return number of added components.
+ */
+INTERNAL uint32_t
+AddComponents_ECS(ECS* ecs, Sparse_Set* set, const EID* entities, uint32_t count)
+{
+  if (ReserveSparseSet(ecs->allocator, set, set->size + count) < 0) {
+    LOG_WARN("entity component system: out of memory");
+    return 0;
+  }
+  uint32_t added = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (InsertToSparseSet(ecs->allocator, set, entities[i])) {
+      ((uint32_t*)ecs->entities->ptr)[entities[i]]++;
+      added++;
+    }
+  }
+  if (set->group) {
+    for (uint32_t i = 0; i < count; i++) {
+      AddToGroup(set->group, entities[i]);
+    }
+  }
+  return added;
+}
+
+/**
+   Same as AddComponents_ECS() but entities must not have this
+   component, in return all components are stored contiguously and
+   pointer to the first one is returned. Entities are not added to
+   owning group, call UpdateGroup() after all components are added.
+ */
+INTERNAL void*
+AppendComponents_ECS(ECS* ecs, Sparse_Set* set, const EID* entities, uint32_t count)
+{
+  void* ret = AppendToSparseSet(ecs->allocator, set, entities, count);
+  if (ret) {
+    uint32_t* counts = ecs->entities->ptr;
+    for (uint32_t i = 0; i < count; i++) {
+      counts[entities[i]]++;
+    }
   }
   return ret;
 }
@@ -280,6 +535,9 @@ AddComponent_ECS(ECS* ecs, Sparse_Set* set, EID entity)
 INTERNAL int
 RemoveComponent_ECS(ECS* ecs, Sparse_Set* set, EID entity)
 {
+  if (set->group) {
+    RemoveFromGroup(set->group, entity);
+  }
   if (EraseFromSparseSet(set, entity) == 0) {
     uint32_t* entities = ecs->entities->ptr;
     entities[entity]--;
@@ -305,6 +563,262 @@ DestroyAllComponents_ECS(ECS* ecs, Sparse_Set* set)
   ClearSparseSet((ecs)->allocator, set);
 }
 
+/**
+   Create an owning group of components. A component can be owned
+   only by one group. Entities that already have all components are
+   added to group immediately.
+   Return 0 on success.
+ */
+INTERNAL int
+CreateOwningGroup(Component_Group* group, Sparse_Set** sets, uint32_t num_sets)
+{
+  if (num_sets < 2 || num_sets > MAX_GROUP_COMPONENTS) {
+    LOG_WARN("entity component system: group must have from 2 to %d components",
+             MAX_GROUP_COMPONENTS);
+    return -1;
+  }
+  for (uint32_t i = 0; i < num_sets; i++) {
+    if (sets[i]->group) {
+      LOG_WARN("entity component system: component '%s' is already owned by a group",
+               sets[i]->type_info->name);
+      return -1;
+    }
+  }
+  group->num_sets = num_sets;
+  group->size = 0;
+  for (uint32_t i = 0; i < num_sets; i++) {
+    group->sets[i] = sets[i];
+    sets[i]->group = group;
+  }
+  // NOTE: AddToGroup only swaps current element with one that was
+  // already visited, so this loop is correct
+  for (uint32_t i = 0; i < sets[0]->size; i++) {
+    AddToGroup(group, ((EID*)sets[0]->dense->ptr)[i]);
+  }
+  return 0;
+}
+
+// add entities that have all components to group
+INTERNAL void
+UpdateGroup(Component_Group* group, const EID* entities, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++) {
+    AddToGroup(group, entities[i]);
+  }
+}
+
+INTERNAL void
+DestroyOwningGroup(Component_Group* group)
+{
+  for (uint32_t i = 0; i < group->num_sets; i++) {
+    group->sets[i]->group = NULL;
+  }
+  group->num_sets = 0;
+  group->size = 0;
+}
+
+
+/// deferred commands
+
+// Structural changes (creating entities, adding or removing
+// components) can't be done while sparse sets are iterated from
+// multiple threads. Instead each thread records them into its own
+// command buffer and buffers are played back on main thread.
+
+enum {
+  ECS_COMMAND_CREATE_ENTITY,
+  ECS_COMMAND_DESTROY_ENTITY,
+  ECS_COMMAND_ADD_COMPONENT,
+  ECS_COMMAND_REMOVE_COMPONENT,
+};
+
+// entities created with DeferCreateEntity() have this bit set until
+// command buffer is played back
+#define ENTITY_DEFERRED_MASK (1<<30)
+
+typedef struct {
+
+  uint32_t type;
+  // for ECS_COMMAND_CREATE_ENTITY real ID is written here on playback
+  EID entity;
+  Sparse_Set* set;
+  // component data follows for ECS_COMMAND_ADD_COMPONENT
+
+} ECS_Command;
+
+typedef struct {
+
+  uint8_t* data;
+  uint32_t offset;
+  uint32_t capacity;
+  uint32_t num_dropped;
+
+} ECS_Command_Buffer;
+
+INTERNAL void
+InitCommandBuffer(ECS_Command_Buffer* cmd, void* memory, uint32_t size)
+{
+  cmd->data = memory;
+  cmd->offset = 0;
+  cmd->capacity = size;
+  cmd->num_dropped = 0;
+}
+
+INTERNAL ECS_Command*
+PushCommand(ECS_Command_Buffer* cmd, uint32_t type, EID entity, Sparse_Set* set, uint32_t data_size)
+{
+  uint32_t size = ALIGN_TO(sizeof(ECS_Command) + data_size, 16);
+  if (cmd->offset + size > cmd->capacity) {
+    // NOTE: we can't log from worker threads, warning is issued on playback
+    cmd->num_dropped++;
+    return NULL;
+  }
+  ECS_Command* command = (ECS_Command*)(cmd->data + cmd->offset);
+  command->type = type;
+  command->entity = entity;
+  command->set = set;
+  cmd->offset += size;
+  return command;
+}
+
+// returned ID is only valid for other commands in the same buffer
+INTERNAL EID
+DeferCreateEntity(ECS_Command_Buffer* cmd)
+{
+  uint32_t offset = cmd->offset;
+  if (PushCommand(cmd, ECS_COMMAND_CREATE_ENTITY, ENTITY_NIL, NULL, 0) == NULL)
+    return ENTITY_NIL;
+  return offset | ENTITY_DEFERRED_MASK;
+}
+
+INTERNAL void
+DeferDestroyEntity(ECS_Command_Buffer* cmd, EID entity)
+{
+  PushCommand(cmd, ECS_COMMAND_DESTROY_ENTITY, entity, NULL, 0);
+}
+
+// returns pointer to component that will be copied on playback
+INTERNAL void*
+DeferAddComponent_ECS(ECS_Command_Buffer* cmd, Sparse_Set* set, EID entity)
+{
+  ECS_Command* command = PushCommand(cmd, ECS_COMMAND_ADD_COMPONENT, entity, set, set->type_info->size);
+  if (command == NULL)
+    return NULL;
+  return command + 1;
+}
+
+INTERNAL void
+DeferRemoveComponent_ECS(ECS_Command_Buffer* cmd, Sparse_Set* set, EID entity)
+{
+  PushCommand(cmd, ECS_COMMAND_REMOVE_COMPONENT, entity, set, 0);
+}
+
+/**
+   Execute all commands in order they were recorded and reset command
+   buffer. Must be called from main thread.
+ */
+INTERNAL void
+PlaybackCommandBuffer(ECS* ecs, ECS_Command_Buffer* cmd)
+{
+  if (cmd->num_dropped > 0) {
+    LOG_WARN("entity component system: command buffer is out of space, %u commands were dropped",
+             cmd->num_dropped);
+  }
+  uint32_t offset = 0;
+  uint32_t num_skipped = 0;
+  while (offset < cmd->offset) {
+    ECS_Command* command = (ECS_Command*)(cmd->data + offset);
+    uint32_t data_size = (command->type == ECS_COMMAND_ADD_COMPONENT) ? command->set->type_info->size : 0;
+    EID entity = command->entity;
+    if (entity != ENTITY_NIL && (entity & ENTITY_DEFERRED_MASK)) {
+      // resolve ID of entity created by this buffer
+      ECS_Command* create = (ECS_Command*)(cmd->data + (entity & ~ENTITY_DEFERRED_MASK));
+      entity = create->entity;
+    }
+    if (command->type != ECS_COMMAND_CREATE_ENTITY && !IsEntityValid(ecs, entity)) {
+      // entity was never created(dropped command or out of memory) or is already dead
+      num_skipped++;
+      offset += ALIGN_TO(sizeof(ECS_Command) + data_size, 16);
+      continue;
+    }
+    switch (command->type) {
+    case ECS_COMMAND_CREATE_ENTITY:
+      command->entity = CreateEntity(ecs);
+      break;
+    case ECS_COMMAND_DESTROY_ENTITY:
+      DestroyEntity(ecs, entity);
+      break;
+    case ECS_COMMAND_ADD_COMPONENT: {
+      void* component = AddComponent_ECS(ecs, command->set, entity);
+      if (component) {
+        memcpy(component, command + 1, data_size);
+      }
+    } break;
+    case ECS_COMMAND_REMOVE_COMPONENT:
+      RemoveComponent_ECS(ecs, command->set, entity);
+      break;
+    }
+    offset += ALIGN_TO(sizeof(ECS_Command) + data_size, 16);
+  }
+  if (num_skipped > 0) {
+    LOG_WARN("entity component system: %u commands refer to invalid entities and were skipped",
+             num_skipped);
+  }
+  cmd->offset = 0;
+  cmd->num_dropped = 0;
+}
+
+
+/// parallel iteration
+
+// begin and end are indices into packed arrays of iterated set or group
+typedef void(*ECS_Job_Func)(uint32_t begin, uint32_t end, ECS_Command_Buffer* cmd, void* udata);
+
+typedef struct {
+
+  ECS_Command_Buffer buffers[MAX_JOB_WORKERS];
+  ECS_Job_Func func;
+  void* udata;
+
+} ECS_Jobs;
+
+GLOBAL ECS_Jobs g_ecs_jobs;
+
+// allocate a command buffer for each thread from persistent memory
+INTERNAL void
+InitECSJobs(uint32_t bytes_per_thread)
+{
+  for (uint32_t i = 0; i < NumJobThreads(); i++) {
+    InitCommandBuffer(&g_ecs_jobs.buffers[i], PersistentAllocate(bytes_per_thread), bytes_per_thread);
+  }
+}
+
+INTERNAL void
+ECSJobTrampoline(uint32_t begin, uint32_t end, uint32_t worker_id, void* udata)
+{
+  (void)udata;
+  g_ecs_jobs.func(begin, end, &g_ecs_jobs.buffers[worker_id], g_ecs_jobs.udata);
+}
+
+/**
+   Call func for chunks of [0, count) on all threads, then play back
+   structural changes recorded by jobs. Jobs may read and modify any
+   components, but must not add or remove them directly.
+ */
+INTERNAL void
+ParallelForECS(ECS* ecs, uint32_t count, ECS_Job_Func func, void* udata)
+{
+  g_ecs_jobs.func = func;
+  g_ecs_jobs.udata = udata;
+  ParallelFor(count, 0, &ECSJobTrampoline, NULL);
+  // play back in thread order, this keeps order of commands
+  // deterministic within each thread
+  for (uint32_t i = 0; i < NumJobThreads(); i++) {
+    if (g_ecs_jobs.buffers[i].offset > 0 || g_ecs_jobs.buffers[i].num_dropped > 0)
+      PlaybackCommandBuffer(ecs, &g_ecs_jobs.buffers[i]);
+  }
+}
+
 #define DECLARE_COMPONENT(type) DECLARE_TYPE(type); \
   GLOBAL Sparse_Set g_sparse_set_##type
 #define REGISTER_COMPONENT(type) REGISTER_TYPE(type, NULL, NULL);    \
@@ -315,9 +829,12 @@ DestroyAllComponents_ECS(ECS* ecs, Sparse_Set* set)
 // NULL is returned if entity already has this component
 #define AddComponent(ecs, type, entity) (type*)AddComponent_ECS(ecs, &g_sparse_set_##type, entity)
 #define RemoveComponent(ecs, type, entity) RemoveComponent_ECS(ecs, &g_sparse_set_##type, entity)
+#define AddComponents(ecs, type, entities, count) AddComponents_ECS(ecs, &g_sparse_set_##type, entities, count)
+#define AppendComponents(ecs, type, entities, count) (type*)AppendComponents_ECS(ecs, &g_sparse_set_##type, entities, count)
 #define ComponentCount(type) (g_sparse_set_##type .size)
 #define ComponentData(type) (type*)(g_sparse_set_##type .packed->ptr)
 #define ComponentIDs(type) (EID*)(g_sparse_set_##type .dense->ptr)
+#define ComponentSet(type) (&g_sparse_set_##type)
 
 // TODO: figure out how we can append __LINE__ to set's name so we can
 // call multiple FOREACH_COMPONENT()s in 1 scope
@@ -329,3 +846,21 @@ DestroyAllComponents_ECS(ECS* ecs, Sparse_Set* set)
     entities = ComponentIDs(type);                      \
   }                                                     \
   for (uint32_t i = 0; i < ComponentCount(type); i++)
+
+// Iterate over entities in group. Components of the group are
+// accessed by index, e.g. GroupData(Transform)[i]. First component of
+// group determines 'entities'.
+#define GroupData(type) ((type*)(g_sparse_set_##type .packed->ptr))
+#define FOREACH_IN_GROUP(group) EID* entities = NULL;   \
+  (void)entities;                                       \
+  if ((group)->size)                                    \
+    entities = (group)->sets[0]->dense->ptr;            \
+  for (uint32_t i = 0; i < (group)->size; i++)
+
+#define DeferAddComponent(cmd, type, entity) (type*)DeferAddComponent_ECS(cmd, &g_sparse_set_##type, entity)
+#define DeferRemoveComponent(cmd, type, entity) DeferRemoveComponent_ECS(cmd, &g_sparse_set_##type, entity)
+
+// func is called with index ranges into ComponentData(type)
+#define PARALLEL_FOREACH_COMPONENT(ecs, type, func, udata) ParallelForECS(ecs, ComponentCount(type), func, udata)
+// func is called with index ranges into GroupData() of group's components
+#define PARALLEL_FOREACH_IN_GROUP(ecs, group, func, udata) ParallelForECS(ecs, (group)->size, func, udata)
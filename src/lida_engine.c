@@ -25,6 +25,7 @@
 #include "lida_window.c"
 #include "lida_ecs.c"
 #include "lida_algebra.c"
+#include "lida_voxel_grid.c"
 #include "lida_render.c"
 #include "lida_voxel.c"
 #include "lida_ui.c"
@@ -35,6 +36,7 @@
 #include "lida_package.c"
 #include "lida_gen.c"
 #include "lida_console.c"
+#include "lida_replay.c"
 
 typedef struct {
 
@@ -65,6 +67,9 @@ typedef struct {
   uint32_t debug_depth_pyramid;
   EID visible_entity;
 
+  // owns Voxel_View, Transform and OBB
+  Component_Group voxel_group;
+
 } Engine_Context;
 
 enum {
@@ -81,6 +86,7 @@ GLOBAL Engine_Context* g_context;
   X(Voxel_Grid);                                \
   X(Transform);                                 \
   X(Voxel_View);                                \
+  X(Voxel_Cost);                                \
   X(OBB);                                       \
   X(Camera);                                    \
   X(Graphics_Pipeline);                         \
@@ -101,29 +107,106 @@ INTERNAL void CreateRectPipeline(Pipeline_Desc* description);
 INTERNAL void CreateTrianglePipeline(Pipeline_Desc* description);
 INTERNAL void CreateDebugDrawPipeline(Pipeline_Desc* description);
 
-void
+INTERNAL void UpdateVoxelViews_Job(uint32_t begin, uint32_t end, ECS_Command_Buffer* cmd, void* udata);
+
+// read memory size in megabytes from config
+INTERNAL uint32_t
+GetMemorySize(Config_File* config, const char* var, uint32_t default_mb)
+{
+  // allocators use 32-bit sizes
+  const uint32_t max_mb = 4094;
+  int* value = GetVar_Int(config, var);
+  uint32_t mb = (value && *value > 0) ? (uint32_t)*value : default_mb;
+  if (mb > max_mb) {
+    LOG_WARN("%s=%u is too big, using %u", var, mb, max_mb);
+    mb = max_mb;
+  }
+  return mb * 1024 * 1024;
+}
+
+int
 EngineInit(const Engine_Startup_Info* info)
 {
-  const size_t total_memory = 128 * 1024 * 1024;
-  InitMemoryChunk(&g_persistent_memory, PlatformAllocateMemory(total_memory), total_memory);
+  // Memory layout is configured from [Memory] section of variables.ini:
+  // persistent_mb, entities_mb, voxels_mb and huge_pages. Entities and
+  // voxels are only reserved and committed as they grow. We need these
+  // values before anything else exists, so parse config separately.
+  Config_File* boot_config = PlatformAllocateMemory(sizeof(Config_File));
+  ParseConfig("variables.ini", boot_config);
+  uint32_t persistent_size = GetMemorySize(boot_config, "Memory.persistent_mb", 64);
+  uint32_t entities_size = GetMemorySize(boot_config, "Memory.entities_mb", 512);
+  uint32_t voxels_size = GetMemorySize(boot_config, "Memory.voxels_mb", 4094);
+  int* huge_pages = GetVar_Int(boot_config, "Memory.huge_pages");
+  g_memory_huge_pages = (huge_pages) ? *huge_pages : 1;
+  PlatformFreeMemory(boot_config);
+
+  if (ReserveVirtualMemory((size_t)persistent_size + entities_size + voxels_size) != 0) {
+    LOG_FATAL("failed to reserve memory");
+    return -1;
+  }
+  void* persistent = CarveVirtualMemory(persistent_size);
+  void* entities = CarveVirtualMemory(entities_size);
+  void* voxels = CarveVirtualMemory(voxels_size);
+  if (persistent == NULL || entities == NULL || voxels == NULL) {
+    LOG_FATAL("failed to carve engine memory regions");
+    ReleaseVirtualMemory();
+    return -1;
+  }
+  if (PlatformCommitMemory(persistent, persistent_size, g_memory_huge_pages) != 0) {
+    LOG_FATAL("failed to commit persistent memory with error '%s'", PlatformGetError());
+    ReleaseVirtualMemory();
+    return -1;
+  }
+  InitMemoryChunk(&g_persistent_memory, persistent, persistent_size);
 
-  ProfilerStart();
+  // set up allocators before anything else, so failing here doesn't
+  // leave a half-initialized device behind
+  g_context = PersistentAllocate(sizeof(Engine_Context));
+  // voxel grids get edited and reloaded all the time, TLSF never moves
+  // them and has no FixFragmentation() stalls
+  g_vox_allocator = PersistentAllocate(sizeof(Allocator));
+  if (InitVirtualAllocator(&g_context->entity_allocator, ALLOCATOR_BUMP, entities, entities_size) != 0 ||
+      InitVirtualAllocator(g_vox_allocator, ALLOCATOR_TLSF, voxels, voxels_size) != 0) {
+    LOG_FATAL("failed to initialize engine allocators");
+    ReleaseVirtualMemory();
+    return -1;
+  }
+  RegisterAllocator(&g_context->entity_allocator, "entity allocator");
+  RegisterAllocator(g_vox_allocator, "voxel allocator");
+
+  ProfilerStart("trace.lprof");
   PROFILE_FUNCTION();
 
-  const char* device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME };
-  CreateDevice(info->enable_debug_layers,
-               info->gpu_id,
-               info->app_name, info->app_version,
-               device_extensions, ARR_SIZE(device_extensions));
-  CreateWindow(info->window_vsync);
+  // temporary memory is needed by almost everything, so set it up first
+  InitJobSystem(0);
+  InitScratchMemory(1024 * 1024);
+  InitMemoryChunk(&g_frame_memory, MemoryAllocateRight(&g_persistent_memory, 4 * 1024 * 1024), 4 * 1024 * 1024);
 
-  g_context = PersistentAllocate(sizeof(Engine_Context));
-#define INIT_ALLOCATOR(alloc, mb) InitAllocator(alloc, MemoryAllocateRight(&g_persistent_memory, mb * 1024 * 1024), 1024*1024*mb)
-  INIT_ALLOCATOR(&g_context->entity_allocator, 20);
+  const char* device_extensions[] = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+    // optional, used to put GPU zones on CPU timeline
+    VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+  };
+  if (CreateDevice(info->enable_debug_layers,
+                   info->gpu_id,
+                   info->app_name, info->app_version,
+                   device_extensions, ARR_SIZE(device_extensions)) != VK_SUCCESS) {
+    goto error;
+  }
+  VkResult err;
+  if (info->headless) {
+    err = CreateOffscreenWindow(info->offscreen_width, info->offscreen_height);
+  } else {
+    err = CreateWindow(info->window_vsync);
+  }
+  if (err != VK_SUCCESS) {
+    DestroyDevice(0);
+    goto error;
+  }
 
-  // 96 Mb for voxels
-  g_vox_allocator = PersistentAllocate(sizeof(Allocator));
-  INIT_ALLOCATOR(g_vox_allocator, 96);
+  g_vox_palettes = PersistentAllocate(sizeof(Voxel_Palette_Table));
+  InitVoxelPalettes(g_vox_palettes);
 
   g_ecs = PersistentAllocate(sizeof(ECS));
   CreateECS(&g_context->entity_allocator, g_ecs, 8);
@@ -132,13 +215,20 @@ EngineInit(const Engine_Startup_Info* info)
 #define X(a) REGISTER_COMPONENT(a)
   X_ALL_COMPONENTS();
 #undef X
+  // entities with all of these are iterated together every frame
+  {
+    Sparse_Set* sets[] = { ComponentSet(Voxel_View), ComponentSet(Transform), ComponentSet(OBB) };
+    CreateOwningGroup(&g_context->voxel_group, sets, ARR_SIZE(sets));
+  }
+  InitECSJobs(64 * 1024);
 
   g_asset_manager = PersistentAllocate(sizeof(Asset_Manager));
   InitAssetManager(g_asset_manager);
 
+  InternConfigVars();
   g_config = CreateConfig(g_ecs, g_asset_manager,
                           CreateEntity(g_ecs), "variables.ini");
-  g_profiler.enabled = *GetVar_Int(g_config, "Misc.profiling");
+  ProfilerSetEnabled(*GetVarID_Int(g_config, g_var_Misc_profiling));
 
   g_forward_pass = PersistentAllocate(sizeof(Forward_Pass));
   CreateForwardPass(g_forward_pass,
@@ -146,7 +236,7 @@ EngineInit(const Engine_Startup_Info* info)
 
   {
     // TODO: check for null
-    int dim = *GetVar_Int(g_config, "Render.shadow_map_dim");
+    int dim = *GetVarID_Int(g_config, g_var_Render_shadow_map_dim);
     g_shadow_pass = PersistentAllocate(sizeof(Shadow_Pass));
     CreateShadowPass(g_shadow_pass, g_forward_pass,
                      dim, dim);
@@ -218,9 +308,9 @@ EngineInit(const Engine_Startup_Info* info)
     camera->position = VEC3_CREATE(0.0f, 0.0f, -2.0f);
     camera->rotation = VEC3_CREATE(0.0f, 3.141f, 0.0f);
     camera->up = VEC3_CREATE(0.0f, 1.0f, 0.0f);
-    camera->fovy = RADIANS(*GetVar_Float(g_config, "Camera.fovy"));
-    camera->rotation_speed = *GetVar_Float(g_config, "Camera.rotation_speed");
-    camera->movement_speed = *GetVar_Float(g_config, "Camera.movement_speed");
+    camera->fovy = RADIANS(*GetVarID_Float(g_config, g_var_Camera_fovy));
+    camera->rotation_speed = *GetVarID_Float(g_config, g_var_Camera_rotation_speed);
+    camera->movement_speed = *GetVarID_Float(g_config, g_var_Camera_movement_speed);
 
     g_context->camera_keymap = (Keymap) { &CameraKeymap_Pressed, &CameraKeymap_Released,
                                           &CameraKeymap_Mouse, NULL, camera };
@@ -232,6 +322,7 @@ EngineInit(const Engine_Startup_Info* info)
 
   InitConsole();
   g_console->font = g_context->pixel_font;
+  InitReplay();
 
   if (1) {
     // run CMD by hand. I know this looks ugly but it gets job done.
@@ -240,18 +331,34 @@ EngineInit(const Engine_Startup_Info* info)
       CMD_load_scene(1, args);
   }
 
+  if (info->replay) {
+    StartReplay(info->replay, info->replay_report);
+  }
+
   // TODO: for some reason this line of code causes our app to crash
   // FixFragmentation(&g_context->entity_allocator);
 
   // create pipelines
   BatchCreateGraphicsPipelines();
   BatchCreateComputePipelines();
+  return 0;
+
+ error:
+  LOG_FATAL("failed to initialize engine");
+  FreeJobSystem();
+  ProfilerStop();
+  UnregisterAllocator(g_vox_allocator);
+  UnregisterAllocator(&g_context->entity_allocator);
+  ReleaseVirtualMemory();
+  return -1;
 }
 
 void
 EngineFree()
 {
   PROFILE_FUNCTION();
+  StopReplay();
+  StopRecordingReplay();
   {
     FOREACH_COMPONENT(Voxel_Grid) {
       FreeVoxelGrid(g_vox_allocator, &components[i]);
@@ -283,8 +390,10 @@ EngineFree()
 #define X(a) UNREGISTER_COMPONENT(g_ecs, a)
   X_ALL_COMPONENTS();
 #undef X
+  DestroyOwningGroup(&g_context->voxel_group);
 
   DestroyECS(g_ecs);
+  FreeJobSystem();
 
   if (ReleaseAllocator(g_vox_allocator)) {
     LOG_WARN("vox: memory leak detected");
@@ -295,7 +404,7 @@ EngineFree()
     DebugListAllocations(&g_context->entity_allocator);
   }
 
-  // FreeAssetManager(g_asset_manager);
+  FreeAssetManager(g_asset_manager);
 
   DestroyShadowPass(g_shadow_pass);
 
@@ -306,34 +415,208 @@ EngineFree()
   DestroyWindow(0);
   DestroyDevice(0);
 
-  ProfilerSaveJSON("trace.json");
+  ProfilerStop();
+
+  UnregisterAllocator(g_vox_allocator);
+  UnregisterAllocator(&g_context->entity_allocator);
+  ReleaseVirtualMemory();
+  FreeStringTable();
+}
+
+// Write memory usage to profiler trace, so it can be seen next to
+// the sections that caused it.
+INTERNAL void
+RecordMemoryCounters()
+{
+  for (uint32_t i = 0; i < g_allocator_registry.count; i++) {
+    ProfilerCounter(g_allocator_registry.names[i], g_allocator_registry.allocators[i]->effective_size);
+  }
+  for (uint32_t i = 0; i < g_video_memory_registry.count; i++) {
+    const Video_Memory* memory = g_video_memory_registry.pools[i];
+    if (memory->marker)
+      ProfilerCounter(memory->marker, memory->offset);
+  }
+  ProfilerCounter("persistent memory", g_persistent_memory.left + g_persistent_memory.size - g_persistent_memory.right);
+  ProfilerCounter("frame memory", g_frame_memory.left);
+}
+
+INTERNAL void
+DrawMemoryOverlay(Font* font)
+{
+  Vec2 pos = { 0.005f, 0.05f };
+  Vec2 text_size = { 0.02f, 0.02f };
+  uint32_t color = PACK_COLOR(255, 255, 255, 160);
+  char buff[128];
+  for (uint32_t i = 0; i < g_allocator_registry.count; i++) {
+    Allocator_Stats stats;
+    GetAllocatorStats(g_allocator_registry.allocators[i], &stats);
+    stbsp_snprintf(buff, sizeof(buff), "%s: %.1f/%.1f MB, frag %.0f%%",
+                   g_allocator_registry.names[i],
+                   MEGABYTES(stats.effective), MEGABYTES(stats.committed),
+                   stats.fragmentation * 100.0f);
+    DrawText(&g_context->quad_renderer, font, buff, &text_size, color, &pos);
+    pos.y += 0.03f;
+  }
+  for (uint32_t i = 0; i < g_video_memory_registry.count; i++) {
+    const Video_Memory* memory = g_video_memory_registry.pools[i];
+    stbsp_snprintf(buff, sizeof(buff), "%s: %.1f/%.1f MB",
+                   (memory->marker) ? memory->marker : "video memory",
+                   MEGABYTES(memory->offset), MEGABYTES(memory->size));
+    DrawText(&g_context->quad_renderer, font, buff, &text_size, color, &pos);
+    pos.y += 0.03f;
+  }
+  stbsp_snprintf(buff, sizeof(buff), "frame memory: %.2f/%.2f MB",
+                 MEGABYTES(g_frame_memory_peak), MEGABYTES(g_frame_memory.size));
+  DrawText(&g_context->quad_renderer, font, buff, &text_size, color, &pos);
+}
+
+#define OVERLAY_GRAPH_FRAMES 128
+
+// Frame time graph, most expensive profiler zones, GPU pass times and
+// memory usage in the right part of the screen.
+INTERNAL void
+DrawProfilerOverlay(Font* font)
+{
+  Quad_Renderer* renderer = &g_context->quad_renderer;
+  const Time_Histogram* hist = &g_frame_stats.frame_times;
+  const float left = 0.6f;
+  const float width = 0.39f;
+  const float graph_top = 0.05f;
+  const float graph_height = 0.15f;
+  const float line_height = 0.025f;
+  Vec2 text_size = { 0.018f, 0.018f };
+  uint32_t text_color = PACK_COLOR(255, 255, 255, 200);
+  char buff[128];
+
+  Profile_Zone_Stats* zones = FrameAllocate(PROFILER_TOP_ZONES * sizeof(Profile_Zone_Stats));
+  uint32_t num_zones = (zones) ? ProfilerGetTopZones(zones, PROFILER_TOP_ZONES) : 0;
+  uint32_t num_lines = 6 + g_window->num_gpu_zone_times + num_zones + g_allocator_registry.count + 2;
+  Vec2 pos = { left - 0.005f, graph_top - 0.005f };
+  Vec2 size = { width + 0.01f, graph_height + 0.02f + num_lines * line_height };
+  DrawQuad(renderer, &pos, &size, PACK_COLOR(0, 0, 0, 150), 0);
+
+  // frame time graph: newest frame is on the right, 30 FPS always fits
+  uint32_t num_frames = (hist->num_samples < OVERLAY_GRAPH_FRAMES) ? hist->num_samples : OVERLAY_GRAPH_FRAMES;
+  uint32_t max_us = 33333;
+  for (uint32_t i = 0; i < num_frames; i++) {
+    uint32_t us = hist->samples[(hist->next_sample - 1 - i) & (FRAME_TIME_WINDOW-1)];
+    if (us > max_us)
+      max_us = us;
+  }
+  const float bar_width = width / OVERLAY_GRAPH_FRAMES;
+  for (uint32_t i = 0; i < num_frames; i++) {
+    uint32_t us = hist->samples[(hist->next_sample - 1 - i) & (FRAME_TIME_WINDOW-1)];
+    float height = graph_height * (float)us / (float)max_us;
+    uint32_t color;
+    if (us <= 16667) {
+      color = PACK_COLOR(80, 220, 80, 200);
+    } else if (us <= 33333) {
+      color = PACK_COLOR(230, 200, 60, 200);
+    } else {
+      color = PACK_COLOR(230, 60, 60, 200);
+    }
+    pos = VEC2_CREATE(left + width - (i+1) * bar_width, graph_top + graph_height - height);
+    size = VEC2_CREATE(bar_width * 0.8f, height);
+    DrawQuad(renderer, &pos, &size, color, i > 0);
+  }
+  // 60 FPS line
+  pos = VEC2_CREATE(left, graph_top + graph_height - graph_height * 16667.0f / (float)max_us);
+  size = VEC2_CREATE(width, 0.002f);
+  DrawQuad(renderer, &pos, &size, PACK_COLOR(255, 255, 255, 120), 0);
+
+  pos = VEC2_CREATE(left, graph_top + graph_height + 0.03f);
+  uint32_t last_us = (hist->num_samples > 0) ? hist->samples[(hist->next_sample - 1) & (FRAME_TIME_WINDOW-1)] : 0;
+  stbsp_snprintf(buff, sizeof(buff), "frame: %.2fms p50=%.2f p95=%.2f p99=%.2f max=%.2f",
+                 (float)last_us * 0.001f,
+                 TimeHistogramPercentile(hist, 50.0f), TimeHistogramPercentile(hist, 95.0f),
+                 TimeHistogramPercentile(hist, 99.0f), (float)MaxInTimeHistogram(hist) * 0.001f);
+  DrawText(renderer, font, buff, &text_size, text_color, &pos);
+  pos.y += line_height;
+
+  // CPU phases of previous frame, the rest is spent outside of engine
+  float other = (float)last_us * 0.001f;
+  uint32_t length = 0;
+  for (uint32_t i = 0; i < FRAME_PHASE_COUNT; i++) {
+    float ms = GetFramePhaseMilliseconds(i);
+    other -= ms;
+    length += stbsp_snprintf(buff + length, sizeof(buff) - length, "%s %.2f ", g_frame_phase_names[i], ms);
+    if (i == FRAME_PHASE_ACQUIRE) {
+      // doesn't fit in one line
+      DrawText(renderer, font, buff, &text_size, PACK_COLOR(150, 200, 255, 200), &pos);
+      pos.y += line_height;
+      length = 0;
+    }
+  }
+  stbsp_snprintf(buff + length, sizeof(buff) - length, "other %.2f", (other > 0.0f) ? other : 0.0f);
+  DrawText(renderer, font, buff, &text_size, PACK_COLOR(150, 200, 255, 200), &pos);
+  pos.y += line_height;
+
+  for (uint32_t i = 0; i < g_window->num_gpu_zone_times; i++) {
+    stbsp_snprintf(buff, sizeof(buff), "GPU %s: %.3fms",
+                   g_window->gpu_zone_times[i].name, g_window->gpu_zone_times[i].milliseconds);
+    DrawText(renderer, font, buff, &text_size, PACK_COLOR(170, 255, 210, 200), &pos);
+    pos.y += line_height;
+  }
+
+  DrawText(renderer, font, (num_zones > 0) ? "top zones (ms/frame):" : "top zones: enable Misc.profiling",
+           &text_size, text_color, &pos);
+  pos.y += line_height;
+  for (uint32_t i = 0; i < num_zones; i++) {
+    stbsp_snprintf(buff, sizeof(buff), "  %s: %.3f (%.1f calls)",
+                   zones[i].name, zones[i].milliseconds_per_frame, zones[i].calls_per_frame);
+    DrawText(renderer, font, buff, &text_size, PACK_COLOR(255, 220, 150, 200), &pos);
+    pos.y += line_height;
+  }
 
-  PlatformFreeMemory(g_persistent_memory.ptr);
+  for (uint32_t i = 0; i < g_allocator_registry.count; i++) {
+    Allocator* allocator = g_allocator_registry.allocators[i];
+    stbsp_snprintf(buff, sizeof(buff), "%s: %.1f/%.1f MB",
+                   g_allocator_registry.names[i],
+                   MEGABYTES(allocator->effective_size), MEGABYTES(AllocatorCommittedSize(allocator)));
+    DrawText(renderer, font, buff, &text_size, text_color, &pos);
+    pos.y += line_height;
+  }
+  size_t video_memory = 0;
+  for (uint32_t i = 0; i < g_video_memory_registry.count; i++) {
+    video_memory += g_video_memory_registry.pools[i]->offset;
+  }
+  stbsp_snprintf(buff, sizeof(buff), "video memory: %.1f MB, frame memory: %.2f MB",
+                 MEGABYTES(video_memory), MEGABYTES(g_frame_memory.left));
+  DrawText(renderer, font, buff, &text_size, text_color, &pos);
 }
 
 void
 EngineUpdateAndRender()
 {
   PROFILE_FUNCTION();
+  EndFrameStatistics();
+  RecordMemoryCounters();
+  ProfilerFlush();
+  BeginFramePhase(FRAME_PHASE_UPDATE);
+  ResetFrameMemory();
   // calculate time difference
   g_context->prev_time = g_context->curr_time;
   g_context->curr_time = PlatformGetTicks();
-  const float dt = (g_context->curr_time - g_context->prev_time) / 1000.0f;
+  float dt = (g_context->curr_time - g_context->prev_time) / 1000.0f;
+  if (g_replay->playing) {
+    // fixed timestep and camera from recorded path
+    dt = ReplayFrame(GetComponent(Camera, g_context->main_camera));
+  }
 
   switch (g_window->frame_counter & 31)
     {
     case 31:
       // get file notifications every 32 frame
       UpdateAssets(g_asset_manager);
-      g_profiler.enabled               = *GetVar_Int(g_config, "Misc.profiling");
+      ProfilerSetEnabled(*GetVarID_Int(g_config, g_var_Misc_profiling));
       {
         Camera* camera         = GetComponent(Camera, g_context->main_camera);
-        camera->fovy           = RADIANS(*GetVar_Float(g_config, "Camera.fovy"));
-        camera->rotation_speed = *GetVar_Float(g_config, "Camera.rotation_speed");
-        camera->movement_speed = *GetVar_Float(g_config, "Camera.movement_speed");
+        camera->fovy           = RADIANS(*GetVarID_Float(g_config, g_var_Camera_fovy));
+        camera->rotation_speed = *GetVarID_Float(g_config, g_var_Camera_rotation_speed);
+        camera->movement_speed = *GetVarID_Float(g_config, g_var_Camera_movement_speed);
       }
 
-      uint32_t new_shadow_map_dim = *GetVar_Int(g_config, "Render.shadow_map_dim");
+      uint32_t new_shadow_map_dim = *GetVarID_Int(g_config, g_var_Render_shadow_map_dim);
       if (new_shadow_map_dim != g_shadow_pass->extent.width) {
         // recreate shadow map if extent is changed
         RecreateShadowPass(g_shadow_pass, g_deletion_queue, new_shadow_map_dim);
@@ -360,6 +643,7 @@ EngineUpdateAndRender()
   CameraUpdateProjection(camera);
   CameraUpdateView(camera);
   Mat4_Mul(&camera->projection_matrix, &camera->view_matrix, &camera->projview_matrix);
+  RecordReplayFrame(camera, dt);
 
   Scene_Data_Struct* sc_data = g_forward_pass->uniform_buffer_mapped;
   memcpy(&sc_data->camera_projection, &camera->projection_matrix, sizeof(Mat4));
@@ -372,9 +656,9 @@ EngineUpdateAndRender()
 
   {
     Mat4 light_proj, light_view;
-    float extent = *GetVar_Float(g_config, "Render.shadow_extent");
-    float near   = *GetVar_Float(g_config, "Render.shadow_near");
-    float far    = *GetVar_Float(g_config, "Render.shadow_far");
+    float extent = *GetVarID_Float(g_config, g_var_Render_shadow_extent);
+    float near   = *GetVarID_Float(g_config, g_var_Render_shadow_near);
+    float far    = *GetVarID_Float(g_config, g_var_Render_shadow_far);
     OrthographicMatrix(-extent, extent, -extent, extent, near, far, &light_proj);
     // Vec3 light_pos = { 0.0f, 10.0f, 0.0f };
     // Vec3 light_target = { 0.05f, 11.0f, 0.1f };
@@ -409,31 +693,21 @@ EngineUpdateAndRender()
   NewVoxelDrawerFrame(g_vox_drawer);
   NewDebugDrawerFrame(&g_context->debug_drawer);
 
-  FOREACH_COMPONENT(Voxel_View) {
-    Transform* transform = GetComponent(Transform, entities[i]);
-    OBB* obb = GetComponent(OBB, entities[i]);
-    Voxel_Grid* grid = GetComponent(Voxel_Grid, components[i].grid);
-    // update OBB
-    CalculateVoxelGridOBB(grid, transform, obb);
-    // frustum culling
-    int cull_mask = 0;
-    {
-      FOREACH_COMPONENT(Camera) {
-        cull_mask |= TestFrustumOBB(&components[i].projview_matrix, obb) * components[i].cull_mask;
+  // update OBBs and do frustum culling on all threads
+  BeginFramePhase(FRAME_PHASE_CULL);
+  PARALLEL_FOREACH_IN_GROUP(g_ecs, &g_context->voxel_group, &UpdateVoxelViews_Job, NULL);
+  {
+    int* opt = GetVarID_Int(g_config, g_var_Render_debug_voxel_obb);
+    FOREACH_IN_GROUP(&g_context->voxel_group) {
+      if (GroupData(Voxel_View)[i].cull_mask == 0)
+        continue;
+      // draw
+      PushMeshToVoxelDrawer(g_vox_drawer, entities[i]);
+      // draw wireframe
+      if (opt && *opt) {
+        DebugDrawOBB(&g_context->debug_drawer, &GroupData(OBB)[i]);
       }
     }
-    if (cull_mask == 0)
-      continue;
-    // draw
-    PushMeshToVoxelDrawer(g_vox_drawer, entities[i]);
-    Voxel_View* cached = GetComponent(Voxel_View, entities[i]);
-    cached->cull_mask = cull_mask;
-    // draw wireframe
-    int* opt = GetVar_Int(g_config, "Render.debug_voxel_obb");
-    if (opt && *opt) {
-      DebugDrawOBB(&g_context->debug_drawer, obb);
-      /* DebugDrawVoxelBlocks(&g_context->debug_drawer, grid, obb); */
-    }
   }
 
   {
@@ -456,18 +730,10 @@ EngineUpdateAndRender()
   AddDebugLine(&g_context->debug_drawer, &VEC3_CREATE(0.0, 0.0, 0.0), &VEC3_CREATE(0.0, 3.0, 0.0), PACK_COLOR(0, 255, 0, 255));
   AddDebugLine(&g_context->debug_drawer, &VEC3_CREATE(0.0, 0.0, 0.0), &VEC3_CREATE(0.0, 0.0, 3.0), PACK_COLOR(0, 0, 255, 255));
 
-  enum {
-    TIMESTAMP_SHADOW_PASS_BEGIN = 0,
-    // TIMESTAMP_CULL_PASS_BEGIN, // TODO: measure culling time
-    TIMESTAMP_FORWARD_PASS_BEGIN,
-    TIMESTAMP_MAIN_PASS_BEGIN,
-    TIMESTAMP_FRAME_END,
-    TIMESTAMP_COUNT
-  };
-
+  BeginFramePhase(FRAME_PHASE_RECORD);
   VkCommandBuffer cmd = BeginCommands();
-  uint64_t timestamps[TIMESTAMP_COUNT];
-  VkQueryPool query_pool = GetTimestampsGPU(TIMESTAMP_COUNT, timestamps);
+  cmdBeginGPUFrame(cmd);
+  uint32_t gpu_zone;
 
   cmdResetPipelineStats(&g_vox_drawer->pipeline_stats_fragment, cmd);
   cmdResetPipelineStats(&g_vox_drawer->pipeline_stats_shadow,   cmd);
@@ -494,58 +760,65 @@ EngineUpdateAndRender()
       stbsp_sprintf(buff, "draw calls: %u", g_context->voxel_draw_calls);
       DrawText(&g_context->quad_renderer, font, buff, &text_size, color, &pos);
     }
+    if (g_console->memory_overlay) {
+      DrawMemoryOverlay(font);
+    }
+    if (g_console->profiler_overlay) {
+      DrawProfilerOverlay(font);
+    }
     // draw rects for debugging occlusion culling
-    if (*GetVar_Int(g_config, "Render.debug_ss_aabb") == 1) {
-      FOREACH_COMPONENT(Voxel_View) {
-        if ((components[i].cull_mask & 2) == 0)
-          continue;
-        Transform* transform = GetComponent(Transform, entities[i]);
-        OBB* obb = GetComponent(OBB, entities[i]);
-        float radius2 = 0.0f;
-        for (int i = 0; i < 8; i++) {
-          Vec3 diff = VEC3_SUB(obb->corners[i], transform->position);
-          float d = VEC3_DOT(diff, diff);
-          if (d > radius2) {
-            radius2 = d;
-          }
+    if (*GetVarID_Int(g_config, g_var_Render_debug_ss_aabb) == 1) {
+      uint32_t max_boxes = ComponentCount(Voxel_View);
+      if (max_boxes > 201)
+        max_boxes = 201;
+      uint32_t num_boxes = 0;
+      Vec3* corners = FrameAllocate(max_boxes * 8 * sizeof(Vec3));
+      Vec4* clip_corners = FrameAllocate(max_boxes * 8 * sizeof(Vec4));
+      if (corners && clip_corners) {
+        FOREACH_COMPONENT(Voxel_View) {
+          if (i == max_boxes)
+            break;
+          if ((components[i].cull_mask & 2) == 0)
+            continue;
+          Transform* transform = GetComponent(Transform, entities[i]);
+          OBB* obb = GetComponent(OBB, entities[i]);
+          // all corners are at the same distance from center
+          float radius2 = VEC3_DOT(obb->half_size, obb->half_size);
+          Vec3 dist = VEC3_SUB(transform->position, camera->position);
+          float tsquared = VEC3_DOT(dist, dist);
+          if (tsquared <= radius2)
+            continue;
+          GetCornersOBB(obb, &corners[8*num_boxes]);
+          num_boxes++;
         }
-        Vec3 dist = VEC3_SUB(transform->position, camera->position);
-        float tsquared = VEC3_DOT(dist, dist);
-        if (tsquared <= radius2)
-          continue;
+        // project corners of all boxes at once
+        TransformPoints(&camera->projview_matrix, corners, clip_corners, 8*num_boxes);
+      }
+      for (uint32_t i = 0; i < num_boxes; i++) {
         Vec4 rect = { 1.0f, 1.0f, -1.0f, -1.0f };
-        for (int i = 0; i < 8; i++) {
-          Vec4 pos = { obb->corners[i].x, obb->corners[i].y, obb->corners[i].z, 1.0f };
-          Mat4_Mul_Vec4(&camera->projview_matrix, &pos, &pos);
-          pos.x /= pos.w;
-          pos.y /= pos.w;
-          if (pos.x < rect.x) rect.x = pos.x;
-          if (pos.y < rect.y) rect.y = pos.y;
-          if (pos.x > rect.z) rect.z = pos.x;
-          if (pos.y > rect.w) rect.w = pos.y;
+        for (int j = 0; j < 8; j++) {
+          const Vec4* pos = &clip_corners[8*i + j];
+          float x = pos->x / pos->w;
+          float y = pos->y / pos->w;
+          if (x < rect.x) rect.x = x;
+          if (y < rect.y) rect.y = y;
+          if (x > rect.z) rect.z = x;
+          if (y > rect.w) rect.w = y;
         }
         DrawQuad(&g_context->quad_renderer,
                  &VEC2_CREATE(rect.x*0.5+0.5, rect.y*0.5+0.5),
                  &VEC2_CREATE(0.5*(rect.z-rect.x), 0.5*(rect.w-rect.y)),
                  PACK_COLOR(120, 180, 120, 50), 1);
-        if (i == 200)
-          break;
       }
     }
 
     // GPU timestamps
-    if (g_window->frame_counter > 2) {
+    if (g_window->num_gpu_zone_times > 0) {
       char buffer[256];
-      char* buff = buffer;
-      float period = g_device->properties.limits.timestampPeriod;
-      const char* passes[] = {
-        "shadow",
-        "forward",
-        "main"
-      };
-      for (uint32_t i = 0; i < ARR_SIZE(passes); i++) {
-        float time = (timestamps[i+1] - timestamps[i]) * period / 1000000.0f;
-        buff += stbsp_sprintf(buff, "%s=%.3fms ", passes[i], time);
+      uint32_t length = 0;
+      for (uint32_t i = 0; i < g_window->num_gpu_zone_times && length < sizeof(buffer); i++) {
+        length += stbsp_snprintf(buffer + length, sizeof(buffer) - length, "%s=%.3fms ",
+                                 g_window->gpu_zone_times[i].name, g_window->gpu_zone_times[i].milliseconds);
       }
       pos = VEC2_CREATE(0.005f, 0.95f);
       text_size = (Vec2) { 0.025f, 0.025f };
@@ -567,36 +840,39 @@ EngineUpdateAndRender()
   VkDescriptorSet ds_set;
   g_context->voxel_draw_calls = 0;
 
+  gpu_zone = cmdBeginGPUZone(cmd, "depth_reduce");
   {
     Compute_Pipeline* pip = GetComponent(Compute_Pipeline, g_context->depth_reduce_pipeline);
     DepthReductionPass(&g_forward_pass->depth_pyramid, cmd, pip,
                        g_forward_pass->render_extent.width, g_forward_pass->render_extent.height);
   }
+  cmdEndGPUZone(cmd, gpu_zone);
 
+  gpu_zone = cmdBeginGPUZone(cmd, "cull");
   CullPass(cmd, g_vox_drawer, ComponentData(Camera), ComponentCount(Camera));
+  cmdEndGPUZone(cmd, gpu_zone);
 
-  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
-                      TIMESTAMP_SHADOW_PASS_BEGIN);
+  gpu_zone = cmdBeginGPUZone(cmd, "shadow");
   // render to shadow map
   BeginShadowPass(g_shadow_pass, cmd);
   {
     cmdBeginPipelineStats(&g_vox_drawer->pipeline_stats_shadow, cmd);
-    float depth_bias_constant = *GetVar_Float(g_config, "Render.depth_bias_constant");
-    float depth_bias_slope = *GetVar_Float(g_config, "Render.depth_bias_slope");
+    float depth_bias_constant = *GetVarID_Float(g_config, g_var_Render_depth_bias_constant);
+    float depth_bias_slope = *GetVarID_Float(g_config, g_var_Render_depth_bias_slope);
     vkCmdSetDepthBias(cmd, depth_bias_constant, 0.0f, depth_bias_slope);
     g_context->voxel_draw_calls += DrawVoxels(g_vox_drawer, cmd, GetComponent(Camera, g_context->shadow_camera),
                                               1, &g_shadow_pass->scene_data_set);
     cmdEndPipelineStats(&g_vox_drawer->pipeline_stats_shadow, cmd);
   }
   vkCmdEndRenderPass(cmd);
+  cmdEndGPUZone(cmd, gpu_zone);
 
-  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
-                      TIMESTAMP_FORWARD_PASS_BEGIN);
+  gpu_zone = cmdBeginGPUZone(cmd, "forward");
   // render scene to offscreen framebuffer
   float clear_color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-  clear_color[0] = *GetVar_Float(g_config, "Render.bg_fill_color_r");
-  clear_color[1] = *GetVar_Float(g_config, "Render.bg_fill_color_g");
-  clear_color[2] = *GetVar_Float(g_config, "Render.bg_fill_color_b");
+  clear_color[0] = *GetVarID_Float(g_config, g_var_Render_bg_fill_color_r);
+  clear_color[1] = *GetVarID_Float(g_config, g_var_Render_bg_fill_color_g);
+  clear_color[2] = *GetVarID_Float(g_config, g_var_Render_bg_fill_color_b);
   BeginForwardPass(g_forward_pass, cmd, clear_color);
   {
     // draw triangles
@@ -634,9 +910,9 @@ EngineUpdateAndRender()
     RenderDebugLines(&g_context->debug_drawer, cmd);
   }
   vkCmdEndRenderPass(cmd);
+  cmdEndGPUZone(cmd, gpu_zone);
 
-  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
-                      TIMESTAMP_MAIN_PASS_BEGIN);
+  gpu_zone = cmdBeginGPUZone(cmd, "main");
   // render to screen
   BeginRenderingToWindow();
   {
@@ -661,9 +937,7 @@ EngineUpdateAndRender()
     RenderQuads(&g_context->quad_renderer, cmd);
   }
   vkCmdEndRenderPass(cmd);
-
-  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
-                      TIMESTAMP_FRAME_END);
+  cmdEndGPUZone(cmd, gpu_zone);
 
   // end of frame
   vkEndCommandBuffer(cmd);
@@ -684,12 +958,14 @@ EngineUpdateAndRender()
 void
 EngineKeyPressed(PlatformKeyCode key)
 {
+  RecordReplayKey(key, 1);
   KeyPressed(key);
 }
 
 void
 EngineKeyReleased(PlatformKeyCode key)
 {
+  RecordReplayKey(key, 0);
   KeyReleased(key);
 }
 
@@ -704,9 +980,42 @@ EngineMouseMotion(int x, int y, int xrel, int yrel)
 void
 EngineTextInput(const char* text)
 {
+  RecordReplayText(text);
   TextInput(text);
 }
 
+int
+EngineSaveFrame(const char* path)
+{
+  return SaveWindowImage(path);
+}
+
+
+/// jobs
+
+void
+UpdateVoxelViews_Job(uint32_t begin, uint32_t end, ECS_Command_Buffer* cmd, void* udata)
+{
+  (void)cmd;
+  (void)udata;
+  Voxel_View* views = GroupData(Voxel_View);
+  Transform* transforms = GroupData(Transform);
+  OBB* obbs = GroupData(OBB);
+  uint32_t num_cameras = ComponentCount(Camera);
+  Camera* cameras = (num_cameras > 0) ? ComponentData(Camera) : NULL;
+  for (uint32_t i = begin; i < end; i++) {
+    Voxel_Grid* grid = GetComponent(Voxel_Grid, views[i].grid);
+    // update OBB
+    CalculateVoxelGridOBB(grid, &transforms[i], &obbs[i]);
+    // frustum culling
+    int cull_mask = 0;
+    for (uint32_t j = 0; j < num_cameras; j++) {
+      cull_mask |= TestFrustumOBB(&cameras[j].projview_matrix, &obbs[i]) * cameras[j].cull_mask;
+    }
+    views[i].cull_mask = cull_mask;
+  }
+}
+
 
 /// keymaps
 
@@ -881,7 +1190,7 @@ CMD_save_scene(uint32_t num, const char** args)
     return;
   }
   Camera* camera = GetComponent(Camera, g_context->main_camera);
-  SaveScene(camera, args[0]);
+  SaveScene(g_ecs, camera, args[0]);
 }
 
 void
@@ -895,6 +1204,35 @@ CMD_load_scene(uint32_t num, const char** args)
   LoadScene(g_ecs, g_vox_allocator, camera, g_script_manager, args[0]);
 }
 
+void
+CMD_record_replay(uint32_t num, const char** args)
+{
+  if (num > 1) {
+    LOG_WARN("command 'record_replay' accepts 0 or 1 arguments; see 'info record_replay'");
+    return;
+  }
+  if (num == 0) {
+    StopRecordingReplay();
+    return;
+  }
+  // replay starts from exactly this scene
+  char scene[128];
+  stbsp_snprintf(scene, sizeof(scene), "%s.scene", args[0]);
+  Camera* camera = GetComponent(Camera, g_context->main_camera);
+  SaveScene(g_ecs, camera, scene);
+  StartRecordingReplay(args[0], scene);
+}
+
+void
+CMD_play_replay(uint32_t num, const char** args)
+{
+  if (num != 1 && num != 2) {
+    LOG_WARN("command 'play_replay' accepts 1 or 2 arguments; see 'info play_replay'");
+    return;
+  }
+  StartReplay(args[0], (num == 2) ? args[1] : NULL);
+}
+
 
 /// pipeline creation
 
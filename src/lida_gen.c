@@ -8,9 +8,8 @@
 /// Some silly shape
 
 INTERNAL void
-GenerateFractal1(EID entity)
+GenerateFractal1(Voxel_Grid* grid)
 {
-  Voxel_Grid* grid = GetComponent(Voxel_Grid, entity);
   const uint32_t size = 64;
   AllocateVoxelGrid(g_vox_allocator, grid, size, size, size);
   for (uint32_t offset = 0; offset < 20; offset += 2) {
@@ -73,9 +72,8 @@ Fractal2_Helper(Voxel_Grid* grid, uVec3 pos, uint32_t size)
 
 // NOTE: don't pass level > 5 or your computer will die
 INTERNAL void
-GenerateFractal2(EID entity, uint32_t level)
+GenerateFractal2(Voxel_Grid* grid, uint32_t level)
 {
-   Voxel_Grid* grid = GetComponent(Voxel_Grid, entity);
    uint32_t size = 1;
    while (level--) {
      size *= 3;
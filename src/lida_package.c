@@ -4,9 +4,34 @@
 
  */
 
-#define PACKAGE_MAGIC 22813376969420
-
-// TODO: find a way to store entity relationships
+#define PACKAGE_MAGIC 22813376969422
+
+// Scene is stored as a snapshot of component sparse sets: for each
+// component we write its dense and packed arrays as is, so saving and
+// loading is mostly a few big memory copies. Only fields that
+// contain pointers need fixups, see SaveComponentExtra() and
+// FixupLoadedComponents().
+//
+// Layout:
+//  uint64_t       magic
+//  Scene_Info
+//  Voxel_Palette  palettes[num_palettes]
+//  for each component:
+//   Component_Chunk
+//   EID           entities[count]       (padded to 8 bytes)
+//   uint8_t       components[count*size] (padded to 8 bytes)
+//   uint8_t       extra[extra_size]
+
+// engine owned components (cameras, pipelines, fonts etc.) are not
+// part of a scene
+#define X_SCENE_COMPONENTS()                    \
+  X(Voxel_Grid);                                \
+  X(Voxel_View);                                \
+  X(Transform);                                 \
+  X(OBB);                                       \
+  X(Script)
+
+#define MAX_SCENE_COMPONENTS 16
 
 typedef struct {
 
@@ -14,116 +39,256 @@ typedef struct {
   Vec3 camera_up;
   Vec3 camera_rotation;
 
-  uint32_t vox_grids_offset;
-  uint32_t num_vox_grids;
-  uint32_t vox_models_offset;
-  uint32_t num_vox_models;
+  // number of distinct entities in this package
+  uint32_t num_entities;
+  // all saved entity IDs are less than this
+  uint32_t max_entity;
+  uint32_t num_chunks;
+  // palettes are shared between grids, Voxel_Grid.palette is index
+  // into this array
+  uint32_t num_palettes;
+  uint32_t padding;
 
 } Scene_Info;
 
 typedef struct {
 
-  Transform transform;
-  uint32_t grid_id;
-  int has_script;
+  uint64_t type_hash;
+  uint32_t count;
+  uint32_t component_size;
+  // size of data following packed array
+  uint32_t extra_size;
+  uint32_t padding;
 
-} Vox_Model_Serialized;
+} Component_Chunk;
 
 typedef struct {
 
   char name[32];
-  Script_Arg arg0;
-  Script_Arg arg1;
-  Script_Arg arg2;
-  Script_Arg arg3;
-  int frequency;
 
 } Script_Serialized;
 
+INTERNAL uint32_t
+GetSceneComponentSets(Sparse_Set** sets)
+{
+  uint32_t count = 0;
+#define X(a) sets[count++] = ComponentSet(a)
+  X_SCENE_COMPONENTS();
+#undef X
+  return count;
+}
+
+// buffer small writes, voxel grids are written one by one
 typedef struct {
 
-  uint32_t palette[256];
-  uint32_t w, h, d;
+  void* file;
+  uint32_t offset;
+  uint8_t buff[64*1024];
+
+} Package_Writer;
+
+INTERNAL void
+FlushPackage(Package_Writer* writer)
+{
+  if (writer->offset > 0) {
+    PlatformWriteToFile(writer->file, writer->buff, writer->offset);
+    writer->offset = 0;
+  }
+}
+
+INTERNAL void
+WriteToPackage(Package_Writer* writer, const void* bytes, size_t size)
+{
+  if (writer->offset + size > sizeof(writer->buff)) {
+    FlushPackage(writer);
+    if (size >= sizeof(writer->buff)) {
+      // big arrays are written directly
+      PlatformWriteToFile(writer->file, bytes, size);
+      return;
+    }
+  }
+  memcpy(writer->buff + writer->offset, bytes, size);
+  writer->offset += size;
+}
+
+INTERNAL void
+PadPackage(Package_Writer* writer, size_t size)
+{
+  const uint64_t zero = 0;
+  if (size % 8)
+    WriteToPackage(writer, &zero, 8 - size % 8);
+}
 
-} Vox_Grid_Serialized;
+// calculate size of data that is not stored in packed array
+INTERNAL uint32_t
+ComponentExtraSize(const Sparse_Set* set)
+{
+  uint32_t ret = 0;
+  if (set == ComponentSet(Voxel_Grid)) {
+    FOREACH_COMPONENT(Voxel_Grid) {
+      ret += ALIGN_TO(VoxelGridBytes(&components[i]), 8);
+    }
+  } else if (set == ComponentSet(Script)) {
+    ret = ComponentCount(Script) * sizeof(Script_Serialized);
+  }
+  return ret;
+}
 
 INTERNAL void
-SaveScene(const Camera* camera, const char* filename)
+SaveComponentExtra(Package_Writer* writer, const Sparse_Set* set)
 {
-  void* file = PlatformOpenFileForWrite(filename);
+  if (set == ComponentSet(Voxel_Grid)) {
+    FOREACH_COMPONENT(Voxel_Grid) {
+      uint32_t bytes = VoxelGridBytes(&components[i]);
+      WriteToPackage(writer, components[i].data->ptr, bytes);
+      PadPackage(writer, bytes);
+    }
+  } else if (set == ComponentSet(Script)) {
+    FOREACH_COMPONENT(Script) {
+      Script_Serialized ss = { 0 };
+      strncpy(ss.name, components[i].name, sizeof(ss.name)-1);
+      WriteToPackage(writer, &ss, sizeof(Script_Serialized));
+    }
+  }
+}
+
+INTERNAL void
+SaveScene(ECS* ecs, const Camera* camera, const char* filename)
+{
+  PROFILE_FUNCTION();
+  Package_Writer* writer = PersistentAllocate(sizeof(Package_Writer));
+  writer->offset = 0;
+  writer->file = PlatformOpenFileForWrite(filename);
+  if (writer->file == NULL) {
+    LOG_WARN("failed to open file '%s' for writing with error '%s'", filename, PlatformGetError());
+    PersistentRelease(writer);
+    return;
+  }
+  Sparse_Set* sets[MAX_SCENE_COMPONENTS];
+  uint32_t num_sets = GetSceneComponentSets(sets);
 
   // write header
   const uint64_t header = PACKAGE_MAGIC;
-  PlatformWriteToFile(file, &header, sizeof(header));
+  WriteToPackage(writer, &header, sizeof(header));
 
   Scene_Info info = {
     .camera_position = camera->position,
     .camera_up       = camera->up,
     .camera_rotation = camera->rotation,
-    .num_vox_models = ComponentCount(Voxel_View),
-    .vox_models_offset = sizeof(Scene_Info) + sizeof(uint64_t),
-    .num_vox_grids = ComponentCount(Voxel_Grid),
-    .vox_grids_offset = sizeof(Scene_Info) + sizeof(uint64_t)
+    .max_entity = ecs->num_entities,
+    .num_chunks = num_sets,
+    .num_palettes = g_vox_palettes->count,
   };
-  FOREACH_COMPONENT(Voxel_View) {
-    (void)components[i]; // HACK: avoid compiler warning
-    Script* script = GetComponent(Script, entities[i]);
-    info.vox_grids_offset += sizeof(Vox_Model_Serialized);
-    if (script) {
-      info.vox_grids_offset += sizeof(Script_Serialized);
+  // count entities that have at least one scene component
+  uint8_t* used = PersistentAllocate(ecs->num_entities);
+  memset(used, 0, ecs->num_entities);
+  for (uint32_t i = 0; i < num_sets; i++) {
+    const EID* ids = (sets[i]->size > 0) ? sets[i]->dense->ptr : NULL;
+    for (uint32_t j = 0; j < sets[i]->size; j++) {
+      info.num_entities += 1 - used[ids[j]];
+      used[ids[j]] = 1;
     }
   }
-  PlatformWriteToFile(file, &info, sizeof(Scene_Info));
-
-  EID* ids = ComponentIDs(Voxel_View);
-  for (uint32_t i = 0; i < info.num_vox_models; i++) {
-    EID entity = ids[i];
-    Voxel_View* vox = GetComponent(Voxel_View, entity);
-    Transform* transform = GetComponent(Transform, entity);
-    Script* script = GetComponent(Script, entity);
-    int has_script = script ? 1 : 0;
-    Voxel_Grid* grid = GetComponent(Voxel_Grid, vox->grid);
-    Vox_Model_Serialized model = {
-      .grid_id = grid - ComponentData(Voxel_Grid),
-      .has_script = has_script
+  PersistentRelease(used);
+  WriteToPackage(writer, &info, sizeof(Scene_Info));
+  // palette indices are saved as is, so we write whole table
+  WriteToPackage(writer, g_vox_palettes->palettes, info.num_palettes * sizeof(Voxel_Palette));
+
+  for (uint32_t i = 0; i < num_sets; i++) {
+    Sparse_Set* set = sets[i];
+    Component_Chunk chunk = {
+      .type_hash = set->type_info->type_hash,
+      .count = set->size,
+      .component_size = set->type_info->size,
+      .extra_size = ComponentExtraSize(set),
     };
-    memcpy(&model.transform, transform, sizeof(Transform));
-    PlatformWriteToFile(file, &model, sizeof(Vox_Model_Serialized));
-
-    if (has_script) {
-      Script_Serialized ss = {
-        .arg0 = script->arg0,
-        .arg1 = script->arg1,
-        .arg2 = script->arg2,
-        .arg3 = script->arg3,
-        .frequency = script->frequency
-      };
-      strncpy(ss.name, script->name, sizeof(ss.name)-1);
-      PlatformWriteToFile(file, &ss, sizeof(Script_Serialized));
-    }
-  }
-  ids = ComponentIDs(Voxel_Grid);
-  for (uint32_t i = 0; i < info.num_vox_grids; i++) {
-    EID entity = ids[i];
-    Voxel_Grid* grid = GetComponent(Voxel_Grid, entity);
-    Vox_Grid_Serialized grid_info = {
-      .w = grid->width,
-      .h = grid->height,
-      .d = grid->depth,
-    };
-    memcpy(grid_info.palette, grid->palette, sizeof(uint32_t)*256);
-    PlatformWriteToFile(file, &grid_info, sizeof(Vox_Grid_Serialized));
-    PlatformWriteToFile(file, grid->data->ptr, VoxelGridBytes(grid));
-    // TODO: pad to 8 or 16 bytes
+    WriteToPackage(writer, &chunk, sizeof(Component_Chunk));
+    if (chunk.count == 0)
+      continue;
+    WriteToPackage(writer, set->dense->ptr, chunk.count * sizeof(EID));
+    PadPackage(writer, chunk.count * sizeof(EID));
+    WriteToPackage(writer, set->packed->ptr, chunk.count * chunk.component_size);
+    PadPackage(writer, chunk.count * chunk.component_size);
+    SaveComponentExtra(writer, set);
   }
 
-  PlatformCloseFileForWrite(file);
+  FlushPackage(writer);
+  PlatformCloseFileForWrite(writer->file);
+  PersistentRelease(writer);
   LOG_INFO("Saved current scene to file '%s'", filename);
 }
 
+// restore pointers and entity references of components
+// [first, first+count) which were just copied from package
+INTERNAL void
+FixupLoadedComponents(Allocator* va, Script_Manager* sm, Sparse_Set* set, uint32_t first, uint32_t count,
+                      const uint8_t* extra, const EID* remap, uint32_t max_entity,
+                      const Voxel_Palette* palettes, uint32_t num_palettes, uint32_t* palette_map)
+{
+  if (set == ComponentSet(Voxel_Grid)) {
+    Voxel_Grid* grids = ComponentData(Voxel_Grid);
+    for (uint32_t i = first; i < first + count; i++) {
+      Voxel_Grid* grid = &grids[i];
+      uint32_t palette = grid->palette;
+      uint64_t hash = grid->hash;
+      uint32_t bytes = VoxelGridBytes(grid);
+      if (AllocateVoxelGrid(va, grid, grid->width, grid->height, grid->depth) != 0) {
+        // NOTE: grid will be empty, we can't just skip it because
+        // it's already in the sparse set
+        grid->width = grid->height = grid->depth = 0;
+        grid->data = NULL;
+        grid->palette = 0;
+        extra += ALIGN_TO(bytes, 8);
+        continue;
+      }
+      memcpy(grid->data->ptr, extra, bytes);
+      extra += ALIGN_TO(bytes, 8);
+      grid->hash = hash;
+      // palettes are deduplicated by palette table
+      if (palette > 0 && palette < num_palettes) {
+        if (palette_map[palette] == 0)
+          palette_map[palette] = AddVoxelPalette(g_vox_palettes, palettes[palette].colors);
+        else
+          g_vox_palettes->ref_counts[palette_map[palette]]++;
+        grid->palette = palette_map[palette];
+      } else if (palette != 0) {
+        LOG_WARN("voxel grid has invalid palette %u(package has %u), using default palette",
+                 palette, num_palettes);
+        grid->palette = 0;
+      }
+    }
+  } else if (set == ComponentSet(Voxel_View)) {
+    Voxel_View* views = ComponentData(Voxel_View);
+    for (uint32_t i = first; i < first + count; i++) {
+      views[i].grid = (views[i].grid < max_entity) ? remap[views[i].grid] : ENTITY_NIL;
+      views[i].cull_mask = 0;
+    }
+  } else if (set == ComponentSet(Script)) {
+    // NOTE: we already have script in memory because 'scripts'
+    // are functions in C. We just do a hash table lookup to
+    // retrieve needed function pointers.
+    const Script_Serialized* names = (const Script_Serialized*)extra;
+    Script* scripts = ComponentData(Script);
+    for (uint32_t i = first; i < first + count; i++) {
+      Script_Entry* entry = Script_Table_Search(&sm->scripts,
+                                                &(Script_Entry) { .name = FindStringID(names[i-first].name) });
+      if (entry) {
+        scripts[i].name = StringFromID(entry->name);
+        scripts[i].func = entry->func;
+      } else {
+        LOG_WARN("script '%s' not found", names[i-first].name);
+        scripts[i].name = "";
+        scripts[i].func = NULL;
+      }
+      scripts[i].udata = NULL;
+    }
+  }
+}
+
 INTERNAL void
 LoadScene(ECS* ecs, Allocator* va, Camera* camera, Script_Manager* sm, const char* filename)
 {
+  PROFILE_FUNCTION();
   size_t buffer_size;
   // TODO: packages might become very big, we should read directly
   // from file, i.e. without any buffers.
@@ -132,68 +297,121 @@ LoadScene(ECS* ecs, Allocator* va, Camera* camera, Script_Manager* sm, const cha
     LOG_ERROR("failed to load package '%s'", filename);
     return;
   }
+  if (buffer_size < sizeof(uint64_t) + sizeof(Scene_Info) ||
+      *(uint64_t*)buffer != PACKAGE_MAGIC) {
+    LOG_ERROR("package '%s' has wrong magic number, it might be saved by older version of engine", filename);
+    PlatformFreeLoadedFile(buffer);
+    return;
+  }
 
-  if (*(uint64_t*)buffer == PACKAGE_MAGIC) {
-
-    Scene_Info* info = (void*)((uint64_t*)buffer + 1);
-    camera->position = info->camera_position;
-    camera->up       = info->camera_up;
-    camera->rotation = info->camera_rotation;
-
-    EID* grid_ids = PersistentAllocate(sizeof(EID) * info->num_vox_grids);
-
-    Vox_Model_Serialized* model = (void*)((uint8_t*)buffer + info->vox_models_offset);
-    Vox_Grid_Serialized* grid = (void*)((uint8_t*)buffer + info->vox_grids_offset);
-
-    // create entities for grids
-    for (uint32_t i = 0; i < info->num_vox_grids; i++)
-      grid_ids[i] = CreateEntity(ecs);
-    // create Voxel_View's
-    for (uint32_t i = 0; i < info->num_vox_models; i++) {
-      EID entity = CreateEntity(ecs);
-
-      Voxel_View* vox = AddComponent(ecs, Voxel_View, entity);
-      vox->grid = grid_ids[model->grid_id];
-
-      // load transform
-      Transform* transform = AddComponent(ecs, Transform, entity);
-      memcpy(transform, &model->transform, sizeof(Transform));
-      AddComponent(ecs, OBB, entity);
-
-      if (model->has_script) {
-        // NOTE: we already have script in memory because 'scripts'
-        // are functions in C. We just do a hash table lookup to
-        // retrieve needed function pointers.
-        Script_Serialized* info = (void*)((uint8_t*)(model + 1));
-        Script* script = AddComponent(ecs, Script, entity);
-        Script_Entry* entry = FHT_Search(&sm->scripts, GET_TYPE_INFO(Script_Entry),
-                                         &(Script_Entry) { .name = info->name } );
-        script->name = entry->name;
-        script->func = entry->func;
-        script->arg0 = info->arg0;
-        script->arg1 = info->arg1;
-        script->arg2 = info->arg2;
-        script->arg3 = info->arg3;
-        script->frequency = info->frequency;
-        model = (void*)((uint8_t*)model + sizeof(Vox_Model_Serialized) + sizeof(Script));
-      } else {
-        model = (void*)((uint8_t*)model + sizeof(Vox_Model_Serialized));
+  const Scene_Info* info = (void*)((uint64_t*)buffer + 1);
+  camera->position = info->camera_position;
+  camera->up       = info->camera_up;
+  camera->rotation = info->camera_rotation;
+
+  const Voxel_Palette* palettes = (const void*)(info + 1);
+  const uint8_t* chunks = (const uint8_t*)(palettes + info->num_palettes);
+  const uint8_t* end = (const uint8_t*)buffer + buffer_size;
+  if (chunks > end) {
+    LOG_ERROR("package '%s' is corrupted", filename);
+    PlatformFreeLoadedFile(buffer);
+    return;
+  }
+
+  // map saved entity IDs to new ones
+  EID* remap = PersistentAllocate(sizeof(EID) * info->max_entity);
+  EID* new_ids = PersistentAllocate(sizeof(EID) * info->num_entities);
+  EID* ids = PersistentAllocate(sizeof(EID) * info->num_entities);
+  uint32_t* palette_map = PersistentAllocate(sizeof(uint32_t) * info->num_palettes);
+  // index of last chunk where saved ID was seen plus 1, catches duplicates
+  uint32_t* seen_in_chunk = PersistentAllocate(sizeof(uint32_t) * info->max_entity);
+  memset(remap, 0xFF, sizeof(EID) * info->max_entity);
+  memset(palette_map, 0, sizeof(uint32_t) * info->num_palettes);
+  memset(seen_in_chunk, 0, sizeof(uint32_t) * info->max_entity);
+  if (CreateEntities(ecs, new_ids, info->num_entities) != 0) {
+    LOG_ERROR("failed to create %u entities for package '%s'", info->num_entities, filename);
+    PersistentRelease(remap);
+    PlatformFreeLoadedFile(buffer);
+    return;
+  }
+  uint32_t num_mapped = 0;
+  int corrupted = 0;
+
+  Sparse_Set* sets[MAX_SCENE_COMPONENTS];
+  uint32_t num_sets = GetSceneComponentSets(sets);
+  const uint8_t* it = chunks;
+  for (uint32_t c = 0; c < info->num_chunks; c++) {
+    const Component_Chunk* chunk = (const void*)it;
+    if (it + sizeof(Component_Chunk) > end || chunk->count > info->num_entities) {
+      corrupted = 1;
+      break;
+    }
+    const EID* saved_ids = (const void*)(chunk + 1);
+    const uint8_t* packed = (const uint8_t*)saved_ids + ALIGN_TO(chunk->count * sizeof(EID), 8);
+    const uint8_t* extra = packed + ALIGN_TO((size_t)chunk->count * chunk->component_size, 8);
+    it = (chunk->count > 0) ? extra + chunk->extra_size : (const uint8_t*)(chunk + 1);
+    if (it > end) {
+      corrupted = 1;
+      break;
+    }
+    if (chunk->count == 0)
+      continue;
+    Sparse_Set* set = NULL;
+    for (uint32_t i = 0; i < num_sets; i++) {
+      if (sets[i]->type_info->type_hash == chunk->type_hash &&
+          sets[i]->type_info->size == chunk->component_size) {
+        set = sets[i];
+        break;
       }
     }
-    // load voxels
-    for (uint32_t i = 0; i < info->num_vox_grids; i++) {
-      Voxel_Grid* vox = AddComponent(ecs, Voxel_Grid, grid_ids[i]);
-      // load palette
-      memcpy(vox->palette, grid->palette, sizeof(uint32_t)*256);
-      AllocateVoxelGrid(va, vox, grid->w, grid->h, grid->d);
-
-      memcpy(vox->data->ptr, grid+1, VoxelGridBytes(vox));
-      RehashVoxelGrid(vox);
-      grid = (void*)((uint8_t*)(grid +1) + VoxelGridBytes(vox));
+    if (set == NULL) {
+      LOG_WARN("package '%s' has unknown component, skipping it", filename);
+      continue;
     }
-
-    PersistentRelease(grid_ids);
+    for (uint32_t i = 0; i < chunk->count; i++) {
+      EID id = saved_ids[i];
+      if (id >= info->max_entity || seen_in_chunk[id] == c + 1 ||
+          (remap[id] == ENTITY_NIL && num_mapped == info->num_entities)) {
+        corrupted = 1;
+        break;
+      }
+      seen_in_chunk[id] = c + 1;
+      if (remap[id] == ENTITY_NIL) {
+        remap[id] = new_ids[num_mapped++];
+      } else if (SearchSparseSet(set, remap[id])) {
+        // same component is in another chunk
+        corrupted = 1;
+        break;
+      }
+      ids[i] = remap[id];
+    }
+    if (corrupted)
+      break;
+    uint32_t first = set->size;
+    void* components = AppendComponents_ECS(ecs, set, ids, chunk->count);
+    if (components == NULL) {
+      corrupted = 1;
+      break;
+    }
+    memcpy(components, packed, (size_t)chunk->count * chunk->component_size);
+    FixupLoadedComponents(va, sm, set, first, chunk->count, extra, remap, info->max_entity,
+                          palettes, info->num_palettes, palette_map);
   }
+  // entities didn't go to groups when we appended components
+  for (uint32_t i = 0; i < num_sets; i++) {
+    if (sets[i]->group)
+      UpdateGroup(sets[i]->group, new_ids, num_mapped);
+  }
+  // entities that we created but didn't use
+  for (uint32_t i = num_mapped; i < info->num_entities; i++) {
+    DestroyEntity(ecs, new_ids[i]);
+  }
+  if (corrupted) {
+    LOG_ERROR("package '%s' is corrupted, scene is loaded partially", filename);
+  } else {
+    LOG_INFO("Loaded scene from file '%s'", filename);
+  }
+
+  PersistentRelease(remap);
   PlatformFreeLoadedFile(buffer);
-  LOG_INFO("Loaded scene from file '%s'", filename);
 }
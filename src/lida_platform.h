@@ -109,12 +109,33 @@ typedef enum {
 void* PlatformAllocateMemory(size_t bytes);
 // free a memory chunk
 void PlatformFreeMemory(void* bytes);
+// reserve address space, it doesn't use physical memory until committed.
+// NULL is returned on failure
+void* PlatformReserveMemory(size_t bytes);
+// make reserved memory usable. ptr and bytes must be multiples of page
+// size. huge_pages is a hint. Returns 0 on success
+int PlatformCommitMemory(void* ptr, size_t bytes, int huge_pages);
+// release memory returned by PlatformReserveMemory()
+void PlatformReleaseMemory(void* ptr, size_t bytes);
 
 uint32_t PlatformGetTicks();
 uint64_t PlatformGetPerformanceCounter();
 uint64_t PlatformGetPerformanceFrequency();
 size_t PlatformThreadId();
 
+// threads and synchronization
+typedef int(*Platform_Thread_Func)(void* udata);
+// create a thread running func(udata), NULL is returned on failure
+void* PlatformCreateThread(Platform_Thread_Func func, const char* name, void* udata);
+// wait for thread to finish
+void PlatformWaitThread(void* thread);
+// number of logical CPU cores
+uint32_t PlatformNumCPUs();
+void* PlatformCreateSemaphore(uint32_t initial_value);
+void PlatformDestroySemaphore(void* sem);
+void PlatformSemaphoreWait(void* sem);
+void PlatformSemaphorePost(void* sem);
+
 void PlatformHideCursor();
 void PlatformShowCursor();
 
@@ -169,6 +190,15 @@ typedef struct {
   int window_vsync;
   // value should be a power of 2 < 32
   int msaa_samples;
+  // render to offscreen images of given size instead of a window,
+  // platform window and surface are never created
+  int headless;
+  uint32_t offscreen_width;
+  uint32_t offscreen_height;
+  // play this replay from data directory and exit, see lida_replay.c
+  const char* replay;
+  // where to write JSON report of replay, can be NULL
+  const char* replay_report;
 
 } Engine_Startup_Info;
 
@@ -188,8 +218,9 @@ void EngineLog(int level, const char* file, int line, const char* fmt, ...);
 void EngineAddLogger(Log_Function logger, int level, void* udata);
 
 // Initialize engine. This function should be called at startup before
-// main loop.
-void EngineInit(const Engine_Startup_Info* info);
+// main loop. Returns 0 on success, on failure platform should exit
+// without calling EngineFree().
+int EngineInit(const Engine_Startup_Info* info);
 
 // Free resources used by engine. This function should be called after
 // main loop.
@@ -209,6 +240,10 @@ void EngineMouseMotion(int x, int y, int xrel, int yrel);
 
 void EngineTextInput(const char* text);
 
+// write last rendered frame to a file in data directory as PPM. Only
+// works when engine was started in headless mode. Returns 0 on success.
+int EngineSaveFrame(const char* path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,10 @@
 
 #include "lib/stb_sprintf.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
 #ifdef __linux__
 #include <unistd.h>
 // for command line argument parsing
@@ -57,6 +61,8 @@ static argp_option arg_options[] = {
   { "vsync", 'v', "BOOLEAN", 0, "Whether vsync is enabled", 0 },
   { "resizable", 'r', "BOOLEAN", 0, "Whether window is resizable", 0 },
   { "gpu", 'g', "INDEX", 0, "Index of GPU to use", 0 },
+  { "replay", 'p', "FILE", 0, "Play replay from data directory and exit when it ends", 0 },
+  { "report", 'j', "FILE", 0, "Write JSON report of replay to this file in data directory", 0 },
   { },
 };
 static error_t parse_opt(int key, char* arg, struct argp_state* state);
@@ -94,7 +100,10 @@ main(int argc, char** argv)
     LOG_ERROR("inotify_add_watch() returned %d", data_dir.fd);
   }
 
-  EngineInit(&engine_info);
+  if (EngineInit(&engine_info) != 0) {
+    close(data_dir.fd);
+    return 1;
+  }
 
   SDL_Event event;
   while (running) {
@@ -217,6 +226,13 @@ parse_opt(int key, char* arg, struct argp_state* state)
       info->gpu_id = atoi(arg);
       break;
 
+    case 'p':
+      info->replay = arg;
+      break;
+    case 'j':
+      info->replay_report = arg;
+      break;
+
     case ARGP_KEY_ARG:
     case ARGP_KEY_END:
       // nothing for now
@@ -243,6 +259,42 @@ PlatformFreeMemory(void* ptr)
   SDL_free(ptr);
 }
 
+void*
+PlatformReserveMemory(size_t bytes)
+{
+  // no access and no swap reservation until memory is committed
+  void* ptr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (ptr == MAP_FAILED) {
+    SDL_SetError("mmap: %s", strerror(errno));
+    return NULL;
+  }
+  return ptr;
+}
+
+int
+PlatformCommitMemory(void* ptr, size_t bytes, int huge_pages)
+{
+  if (mprotect(ptr, bytes, PROT_READ|PROT_WRITE) != 0) {
+    SDL_SetError("mprotect: %s", strerror(errno));
+    return -1;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    // not an error if transparent huge pages are disabled
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+#else
+  (void)huge_pages;
+#endif
+  return 0;
+}
+
+void
+PlatformReleaseMemory(void* ptr, size_t bytes)
+{
+  munmap(ptr, bytes);
+}
+
 uint32_t
 PlatformGetTicks()
 {
@@ -267,6 +319,48 @@ PlatformThreadId()
   return SDL_ThreadID();
 }
 
+void*
+PlatformCreateThread(Platform_Thread_Func func, const char* name, void* udata)
+{
+  return SDL_CreateThread(func, name, udata);
+}
+
+void
+PlatformWaitThread(void* thread)
+{
+  SDL_WaitThread((SDL_Thread*)thread, NULL);
+}
+
+uint32_t
+PlatformNumCPUs()
+{
+  return SDL_GetCPUCount();
+}
+
+void*
+PlatformCreateSemaphore(uint32_t initial_value)
+{
+  return SDL_CreateSemaphore(initial_value);
+}
+
+void
+PlatformDestroySemaphore(void* sem)
+{
+  SDL_DestroySemaphore((SDL_sem*)sem);
+}
+
+void
+PlatformSemaphoreWait(void* sem)
+{
+  SDL_SemWait((SDL_sem*)sem);
+}
+
+void
+PlatformSemaphorePost(void* sem)
+{
+  SDL_SemPost((SDL_sem*)sem);
+}
+
 void
 PlatformHideCursor()
 {
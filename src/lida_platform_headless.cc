@@ -0,0 +1,487 @@
+/* -*- mode: c++ -*-
+   lida_platform_headless.cc
+   Platform functions implementation without a window. Frames are
+   rendered to offscreen images for a fixed number of frames, so this
+   works on build machines without display, e.g. with lavapipe.
+
+ */
+#include "lib/volk.h"
+
+#include "lida_platform.h"
+
+#define OGT_VOX_IMPLEMENTATION
+#include "lib/ogt_vox.h"
+
+#include "lib/stb_sprintf.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+// for command line argument parsing
+#include <argp.h>
+
+/// Global variables
+
+static int running = 1;
+
+static struct {
+  uint32_t w;
+  uint32_t h;
+  // 0 means run until engine calls PlatformWantToQuit()
+  uint32_t num_frames;
+  int num_frames_set;
+  const char* output;
+} headless;
+
+static struct {
+  char path[64];
+} data_dir;
+
+static char error_message[256];
+
+// PlatformGetTicks() counts from here
+static uint64_t start_time;
+
+
+/// Entrypoint
+
+static void headless_logger(const Log_Event* ev);
+
+// argument parsing stuff
+static char doc[] = "lida engine (headless)";
+static char args_doc[] = "";
+
+static argp_option arg_options[] = {
+  { "data", 'd', "DIRECTORY", 0, "Data directory where all assets are stored. This must come without '/' at the end.", 0 },
+  { "debug-layers", 'l', "BOOLEAN", 0, "Enable vulkan validation layers", 0 },
+  { "msaa", 's', "INTEGER", 0, "Number of MSAA samples", 0 },
+  { "width", 'w', "INTEGER", 0, "Image width in pixels", 0 },
+  { "height", 'h', "INTEGER", 0, "Image height in pixels", 0 },
+  { "gpu", 'g', "INDEX", 0, "Index of GPU to use", 0 },
+  { "frames", 'f', "INTEGER", 0, "Number of frames to render", 0 },
+  { "output", 'o', "FILE", 0, "Save last frame as PPM to this file in data directory", 0 },
+  { "replay", 'p', "FILE", 0, "Play replay from data directory and exit when it ends", 0 },
+  { "report", 'j', "FILE", 0, "Write JSON report of replay to this file in data directory", 0 },
+  { },
+};
+static error_t parse_opt(int key, char* arg, struct argp_state* state);
+
+extern "C" int
+main(int argc, char** argv)
+{
+  stbsp_sprintf(data_dir.path, "../data");
+  start_time = PlatformGetPerformanceCounter();
+
+  EngineAddLogger(headless_logger, 0, NULL);
+
+  headless.w = 1080;
+  headless.h = 720;
+  headless.num_frames = 100;
+
+  Engine_Startup_Info engine_info = {};
+  engine_info.enable_debug_layers = 0;
+  engine_info.gpu_id = 0;
+  engine_info.app_name = "test";
+  engine_info.window_vsync = 0;
+  engine_info.msaa_samples = 4;
+  engine_info.headless = 1;
+
+  argp argp = {};
+  argp.options = arg_options;
+  argp.parser = parse_opt;
+  argp.args_doc = args_doc;
+  argp.doc = doc;
+  argp_parse(&argp, argc, argv, 0, 0, &engine_info);
+
+  if (engine_info.replay && !headless.num_frames_set) {
+    // replay decides when to stop
+    headless.num_frames = 0;
+  }
+  engine_info.offscreen_width = headless.w;
+  engine_info.offscreen_height = headless.h;
+  if (EngineInit(&engine_info) != 0) {
+    return 1;
+  }
+
+  for (uint32_t frame = 0; running; frame++) {
+    if (headless.num_frames && frame >= headless.num_frames)
+      break;
+    EngineUpdateAndRender();
+  }
+
+  int ret = 0;
+  if (headless.output) {
+    ret = EngineSaveFrame(headless.output);
+  }
+
+  EngineFree();
+
+  return ret;
+}
+
+void
+headless_logger(const Log_Event* ev)
+{
+  const char* const levels[] = {
+    "TRACE",
+    "DEBUG",
+    "INFO",
+    "WARN",
+    "ERROR",
+    "FATAL"
+  };
+  // output usually goes to CI logs, so no colors
+  fprintf((ev->level >= 3) ? stderr : stdout, "[%s] %s:%d %s\n",
+          levels[ev->level], ev->file, ev->line, ev->str);
+}
+
+static error_t
+parse_opt(int key, char* arg, struct argp_state* state)
+{
+  auto info = (Engine_Startup_Info*)state->input;
+  switch (key)
+    {
+    case 'd':
+      stbsp_sprintf(data_dir.path, "%s", arg);
+      break;
+
+    case 'l':
+      info->enable_debug_layers = atoi(arg);
+      break;
+
+    case 's':
+      {
+        int options[] = { 1, 2, 4, 8, 16, 32 };
+        int s = atoi(arg);
+        for (size_t i = 0; i < sizeof(options) / sizeof(int); i++) {
+          if (s == options[i]) {
+            info->msaa_samples = options[i];
+            return 0;
+          }
+        }
+        LOG_FATAL("unknown sample count %d", s);
+        argp_usage(state);
+      }
+      break;
+
+    case 'w':
+      headless.w = atoi(arg);
+      break;
+    case 'h':
+      headless.h = atoi(arg);
+      break;
+
+    case 'g':
+      info->gpu_id = atoi(arg);
+      break;
+
+    case 'f':
+      headless.num_frames = atoi(arg);
+      headless.num_frames_set = 1;
+      break;
+
+    case 'o':
+      headless.output = arg;
+      break;
+
+    case 'p':
+      info->replay = arg;
+      break;
+    case 'j':
+      info->replay_report = arg;
+      break;
+
+    case ARGP_KEY_ARG:
+    case ARGP_KEY_END:
+      // nothing for now
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+static void
+set_error(const char* func)
+{
+  stbsp_snprintf(error_message, sizeof(error_message), "%s: %s", func, strerror(errno));
+}
+
+
+/// implementation of platform abstraction layer
+
+void*
+PlatformAllocateMemory(size_t bytes)
+{
+  return malloc(bytes);
+}
+
+void
+PlatformFreeMemory(void* ptr)
+{
+  free(ptr);
+}
+
+void*
+PlatformReserveMemory(size_t bytes)
+{
+  // no access and no swap reservation until memory is committed
+  void* ptr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (ptr == MAP_FAILED) {
+    set_error("mmap");
+    return NULL;
+  }
+  return ptr;
+}
+
+int
+PlatformCommitMemory(void* ptr, size_t bytes, int huge_pages)
+{
+  if (mprotect(ptr, bytes, PROT_READ|PROT_WRITE) != 0) {
+    set_error("mprotect");
+    return -1;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    // not an error if transparent huge pages are disabled
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+#else
+  (void)huge_pages;
+#endif
+  return 0;
+}
+
+void
+PlatformReleaseMemory(void* ptr, size_t bytes)
+{
+  munmap(ptr, bytes);
+}
+
+uint64_t
+PlatformGetPerformanceCounter()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t
+PlatformGetPerformanceFrequency()
+{
+  return 1000000000ull;
+}
+
+uint32_t
+PlatformGetTicks()
+{
+  return (uint32_t)((PlatformGetPerformanceCounter() - start_time) / 1000000);
+}
+
+size_t
+PlatformThreadId()
+{
+  return (size_t)pthread_self();
+}
+
+struct Thread_Start {
+  Platform_Thread_Func func;
+  void* udata;
+};
+
+static void*
+thread_start(void* arg)
+{
+  Thread_Start start = *(Thread_Start*)arg;
+  free(arg);
+  start.func(start.udata);
+  return NULL;
+}
+
+void*
+PlatformCreateThread(Platform_Thread_Func func, const char* name, void* udata)
+{
+  pthread_t* thread = (pthread_t*)malloc(sizeof(pthread_t));
+  Thread_Start* start = (Thread_Start*)malloc(sizeof(Thread_Start));
+  start->func = func;
+  start->udata = udata;
+  int err = pthread_create(thread, NULL, thread_start, start);
+  if (err != 0) {
+    errno = err;
+    set_error("pthread_create");
+    free(start);
+    free(thread);
+    return NULL;
+  }
+#ifdef __linux__
+  // names longer than 15 characters are rejected
+  char short_name[16];
+  stbsp_snprintf(short_name, sizeof(short_name), "%s", name);
+  pthread_setname_np(*thread, short_name);
+#else
+  (void)name;
+#endif
+  return thread;
+}
+
+void
+PlatformWaitThread(void* thread)
+{
+  pthread_join(*(pthread_t*)thread, NULL);
+  free(thread);
+}
+
+uint32_t
+PlatformNumCPUs()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (uint32_t)count : 1;
+}
+
+void*
+PlatformCreateSemaphore(uint32_t initial_value)
+{
+  sem_t* sem = (sem_t*)malloc(sizeof(sem_t));
+  if (sem_init(sem, 0, initial_value) != 0) {
+    set_error("sem_init");
+    free(sem);
+    return NULL;
+  }
+  return sem;
+}
+
+void
+PlatformDestroySemaphore(void* sem)
+{
+  sem_destroy((sem_t*)sem);
+  free(sem);
+}
+
+void
+PlatformSemaphoreWait(void* sem)
+{
+  while (sem_wait((sem_t*)sem) != 0 && errno == EINTR);
+}
+
+void
+PlatformSemaphorePost(void* sem)
+{
+  sem_post((sem_t*)sem);
+}
+
+void
+PlatformHideCursor()
+{
+  // no cursor
+}
+
+void
+PlatformShowCursor()
+{
+  // no cursor
+}
+
+void*
+PlatformLoadEntireFile(const char* path, size_t* buff_size)
+{
+  char real_path[128];
+  stbsp_snprintf(real_path, sizeof(real_path), "%s/%s", data_dir.path, path);
+  FILE* file = fopen(real_path, "rb");
+  if (file == NULL) {
+    set_error("fopen");
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  // null terminate like SDL_LoadFile() does, text files rely on it
+  char* data = (char*)malloc(size + 1);
+  if (fread(data, 1, size, file) != (size_t)size) {
+    set_error("fread");
+    free(data);
+    fclose(file);
+    return NULL;
+  }
+  data[size] = '\0';
+  fclose(file);
+  if (buff_size)
+    *buff_size = size;
+  return data;
+}
+
+void
+PlatformFreeLoadedFile(void* data)
+{
+  free(data);
+}
+
+void*
+PlatformOpenFileForWrite(const char* path)
+{
+  char real_path[128];
+  stbsp_snprintf(real_path, sizeof(real_path), "%s/%s", data_dir.path, path);
+  FILE* file = fopen(real_path, "wb");
+  if (file == NULL) {
+    set_error("fopen");
+  }
+  return file;
+}
+
+void
+PlatformWriteToFile(void* file, const void* bytes, size_t sz)
+{
+  fwrite(bytes, sz, 1, (FILE*)file);
+}
+
+void
+PlatformCloseFileForWrite(void* file)
+{
+  fclose((FILE*)file);
+}
+
+int
+PlatformCreateWindow()
+{
+  // nothing to create
+  return 0;
+}
+
+void
+PlatformDestroyWindow()
+{
+}
+
+VkSurfaceKHR
+PlatformCreateVkSurface(VkInstance instance)
+{
+  (void)instance;
+  return VK_NULL_HANDLE;
+}
+
+void
+PlatformWantToQuit()
+{
+  running = 0;
+}
+
+const char*
+PlatformGetError()
+{
+  return error_message;
+}
+
+size_t
+PlatformDataDirectoryModified(const char** filenames, size_t buff_size)
+{
+  // data doesn't change during automated runs
+  (void)filenames;
+  (void)buff_size;
+  return 0;
+}
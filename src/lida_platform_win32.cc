@@ -6,6 +6,10 @@
 #include <SDL.h>
 #include <SDL_vulkan.h>
 
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
 #include "lida_platform.h"
 
 #define OGT_VOX_IMPLEMENTATION
@@ -53,7 +57,9 @@ main(int argc, char** argv)
   engine_info.window_vsync = 0;
   engine_info.msaa_samples = 4;
 
-  EngineInit(&engine_info);
+  if (EngineInit(&engine_info) != 0) {
+    return 1;
+  }
 
   SDL_Event event;
   while (running) {
@@ -124,6 +130,35 @@ PlatformFreeMemory(void* ptr)
   SDL_free(ptr);
 }
 
+void*
+PlatformReserveMemory(size_t bytes)
+{
+  void* ptr = VirtualAlloc(NULL, bytes, MEM_RESERVE, PAGE_NOACCESS);
+  if (ptr == NULL) {
+    SDL_SetError("VirtualAlloc failed with error %lu", GetLastError());
+  }
+  return ptr;
+}
+
+int
+PlatformCommitMemory(void* ptr, size_t bytes, int huge_pages)
+{
+  // large pages on Windows need special privileges, ignore the hint
+  (void)huge_pages;
+  if (VirtualAlloc(ptr, bytes, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+    SDL_SetError("VirtualAlloc failed with error %lu", GetLastError());
+    return -1;
+  }
+  return 0;
+}
+
+void
+PlatformReleaseMemory(void* ptr, size_t bytes)
+{
+  (void)bytes;
+  VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
 uint32_t
 PlatformGetTicks()
 {
@@ -148,6 +183,48 @@ PlatformThreadId()
   return SDL_ThreadID();
 }
 
+void*
+PlatformCreateThread(Platform_Thread_Func func, const char* name, void* udata)
+{
+  return SDL_CreateThread(func, name, udata);
+}
+
+void
+PlatformWaitThread(void* thread)
+{
+  SDL_WaitThread((SDL_Thread*)thread, NULL);
+}
+
+uint32_t
+PlatformNumCPUs()
+{
+  return SDL_GetCPUCount();
+}
+
+void*
+PlatformCreateSemaphore(uint32_t initial_value)
+{
+  return SDL_CreateSemaphore(initial_value);
+}
+
+void
+PlatformDestroySemaphore(void* sem)
+{
+  SDL_DestroySemaphore((SDL_sem*)sem);
+}
+
+void
+PlatformSemaphoreWait(void* sem)
+{
+  SDL_SemWait((SDL_sem*)sem);
+}
+
+void
+PlatformSemaphorePost(void* sem)
+{
+  SDL_SemPost((SDL_sem*)sem);
+}
+
 void
 PlatformHideCursor()
 {
@@ -102,14 +102,6 @@ typedef struct {
 } Compute_Pipeline;
 DECLARE_COMPONENT(Compute_Pipeline);
 
-// 16 bytes
-typedef struct {
-
-  Vec3 position;
-  uint32_t color;
-
-} Vertex_X3C;
-
 // this just draws lines
 typedef struct {
 
@@ -1230,9 +1222,11 @@ DebugDrawOBB(Debug_Drawer* debug_drawer, const OBB* obb)
     2, 6,
     3, 7
   };
+  Vec3 corners[8];
+  GetCornersOBB(obb, corners);
   for (size_t i = 0; i < ARR_SIZE(indices); i += 2) {
     AddDebugLine(debug_drawer,
-                 &obb->corners[indices[i]], &obb->corners[indices[i+1]],
+                 &corners[indices[i]], &corners[indices[i+1]],
                  PACK_COLOR(255, 0, 0, 255));
   }
 }
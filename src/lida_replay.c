@@ -0,0 +1,589 @@
+/*
+  Camera path and input recording and deterministic replay.
+
+  Replay is a text file in data directory, one entry per line:
+
+    # comment
+    seed A B              reseed g_random when replay starts
+    dt SECONDS            fixed timestep used during replay (default 1/60)
+    warmup N              frames rendered before timeline starts (default 30)
+    command T LINE        run console command LINE at time T
+    camera T PX PY PZ RX RY RZ
+                          camera position and euler angles at time T
+    key T PRESSED CODE    key event, PRESSED is 0 or 1
+    text T TEXT           text input, everything after one space
+
+  Command, key and text entries go to one event list, which must be in
+  timestamp order as a whole, not just per kind. Camera keyframes must
+  be sorted by time too, out of order entries are rejected. A scene
+  is usually set up with 'command 0 load_scene FILE' or with spawn
+  commands after a 'seed' line. Camera is linearly interpolated
+  between keyframes, mouse motion is not replayed: it's already baked
+  into the camera path.
+
+  During replay dt is fixed and frame time, GPU pass times, pipeline
+  statistics and frame counters are collected. When path ends, report
+  is written as JSON and engine asks platform to quit.
+
+ */
+
+#define REPLAY_DEFAULT_DT (1.0f / 60.0f)
+#define REPLAY_DEFAULT_WARMUP 30
+#define REPLAY_MAX_GPU_ZONES 16
+
+typedef struct {
+
+  float time;
+  Vec3 position;
+  Vec3 rotation;
+
+} Replay_Keyframe;
+
+enum {
+  REPLAY_EVENT_COMMAND,
+  REPLAY_EVENT_KEY_PRESSED,
+  REPLAY_EVENT_KEY_RELEASED,
+  REPLAY_EVENT_TEXT,
+};
+
+typedef struct {
+
+  float time;
+  uint32_t type;
+  PlatformKeyCode key;
+  // points into loaded file
+  const char* text;
+
+} Replay_Event;
+
+typedef struct {
+
+  const char* name;
+  double sum_ms;
+  float max_ms;
+  uint32_t count;
+
+} Replay_GPU_Zone;
+
+typedef struct {
+
+  // playback
+  int playing;
+  char* file_data;
+  Replay_Keyframe* keyframes;
+  uint32_t num_keyframes;
+  Replay_Event* events;
+  uint32_t num_events;
+  uint32_t next_event;
+  uint32_t current_keyframe;
+  float dt;
+  // applied by StartReplay() once whole file is parsed
+  int has_seed;
+  uint64_t seed[2];
+  uint32_t frame;
+  uint32_t warmup_frames;
+  uint32_t num_frames;
+  char path[128];
+  char report_path[128];
+
+  // results, collected from frames after warmup
+  uint32_t num_measured;
+  uint64_t frame_time_sum;
+  Time_Histogram frame_times;
+  Replay_GPU_Zone gpu_zones[REPLAY_MAX_GPU_ZONES];
+  uint32_t num_gpu_zones;
+  uint64_t pipeline_stats_fragment[6];
+  uint64_t pipeline_stats_shadow[6];
+  int64_t counters[MAX_FRAME_COUNTERS];
+
+  // recording
+  void* record_file;
+  float record_time;
+
+} Replay;
+
+GLOBAL Replay* g_replay;
+
+GLOBAL const char* g_pipeline_stat_names[6] = {
+  "input_assembly_vertices",
+  "input_assembly_primitives",
+  "vertex_shader_invocations",
+  "clipping_invocations",
+  "clipping_primitives",
+  "fragment_shader_invocations",
+};
+
+
+/// private functions
+
+// split "word rest" into word and rest, returns NULL at end of line
+INTERNAL char*
+ReplayNextWord(char** line)
+{
+  char* begin = *line;
+  while (*begin == ' ' || *begin == '\t')
+    begin++;
+  if (*begin == '\0')
+    return NULL;
+  char* end = begin;
+  while (*end != '\0' && *end != ' ' && *end != '\t')
+    end++;
+  if (*end != '\0') {
+    *end = '\0';
+    *line = end + 1;
+  } else {
+    *line = end;
+  }
+  return begin;
+}
+
+INTERNAL int
+ParseReplay(Replay* replay, char* data)
+{
+  // number of lines is upper bound for both keyframes and events
+  uint32_t num_lines = 1;
+  for (const char* c = data; *c; c++) {
+    num_lines += (*c == '\n');
+  }
+  // replay may outlive anything allocated after it, so don't use persistent memory
+  replay->keyframes = PlatformAllocateMemory(num_lines * sizeof(Replay_Keyframe));
+  replay->events = PlatformAllocateMemory(num_lines * sizeof(Replay_Event));
+  replay->num_keyframes = 0;
+  replay->num_events = 0;
+  replay->dt = REPLAY_DEFAULT_DT;
+  replay->warmup_frames = REPLAY_DEFAULT_WARMUP;
+  replay->has_seed = 0;
+
+  uint32_t line_number = 0;
+  char* word = NULL;
+  float t = 0.0f;
+  char* next_line = data;
+  while (next_line) {
+    char* line = next_line;
+    line_number++;
+    next_line = strchr(line, '\n');
+    if (next_line) {
+      *next_line = '\0';
+      next_line++;
+    }
+    size_t len = strlen(line);
+    if (len > 0 && line[len-1] == '\r')
+      line[len-1] = '\0';
+    word = ReplayNextWord(&line);
+    if (word == NULL || word[0] == '#')
+      continue;
+    if (strcmp(word, "seed") == 0) {
+      char* a = ReplayNextWord(&line);
+      char* b = ReplayNextWord(&line);
+      if (a == NULL || b == NULL)
+        goto error;
+      replay->seed[0] = strtoull(a, NULL, 10);
+      replay->seed[1] = strtoull(b, NULL, 10);
+      replay->has_seed = 1;
+      continue;
+    }
+    if (strcmp(word, "dt") == 0) {
+      char* value = ReplayNextWord(&line);
+      if (value == NULL || (replay->dt = strtof(value, NULL)) <= 0.0f)
+        goto error;
+      continue;
+    }
+    if (strcmp(word, "warmup") == 0) {
+      char* value = ReplayNextWord(&line);
+      if (value == NULL)
+        goto error;
+      replay->warmup_frames = atoi(value);
+      continue;
+    }
+    char* time = ReplayNextWord(&line);
+    if (time == NULL)
+      goto error;
+    t = strtof(time, NULL);
+    if (strcmp(word, "camera") == 0) {
+      float values[6];
+      for (int i = 0; i < 6; i++) {
+        char* value = ReplayNextWord(&line);
+        if (value == NULL)
+          goto error;
+        values[i] = strtof(value, NULL);
+      }
+      replay->keyframes[replay->num_keyframes++] = (Replay_Keyframe) {
+        .time     = t,
+        .position = VEC3_CREATE(values[0], values[1], values[2]),
+        .rotation = VEC3_CREATE(values[3], values[4], values[5]),
+      };
+    } else if (strcmp(word, "key") == 0) {
+      char* pressed = ReplayNextWord(&line);
+      char* key = ReplayNextWord(&line);
+      if (pressed == NULL || key == NULL)
+        goto error;
+      replay->events[replay->num_events++] = (Replay_Event) {
+        .time = t,
+        .type = atoi(pressed) ? REPLAY_EVENT_KEY_PRESSED : REPLAY_EVENT_KEY_RELEASED,
+        .key  = (PlatformKeyCode)strtoul(key, NULL, 10),
+      };
+    } else if (strcmp(word, "text") == 0 || strcmp(word, "command") == 0) {
+      if (strlen(line) >= sizeof(g_console->prompt))
+        goto error;
+      replay->events[replay->num_events++] = (Replay_Event) {
+        .time = t,
+        .type = (word[0] == 't') ? REPLAY_EVENT_TEXT : REPLAY_EVENT_COMMAND,
+        .text = line,
+      };
+    } else {
+      goto error;
+    }
+    // earlier entries are already checked, so only the new one can be out of order
+    if ((replay->num_keyframes > 1 &&
+         replay->keyframes[replay->num_keyframes-1].time < replay->keyframes[replay->num_keyframes-2].time) ||
+        (replay->num_events > 1 &&
+         replay->events[replay->num_events-1].time < replay->events[replay->num_events-2].time))
+      goto out_of_order;
+  }
+
+  // replay lasts until the last entry
+  float duration = 0.0f;
+  if (replay->num_keyframes > 0)
+    duration = replay->keyframes[replay->num_keyframes-1].time;
+  if (replay->num_events > 0 && replay->events[replay->num_events-1].time > duration)
+    duration = replay->events[replay->num_events-1].time;
+  replay->num_frames = replay->warmup_frames + (uint32_t)ceilf(duration / replay->dt) + 1;
+  return 0;
+ error:
+  LOG_ERROR("%s:%u: failed to parse replay entry '%s'", replay->path, line_number, (word) ? word : "");
+  return -1;
+ out_of_order:
+  LOG_ERROR("%s:%u: '%s' entry at time %g is earlier than the previous one",
+            replay->path, line_number, word, (double)t);
+  return -1;
+}
+
+// get camera position and rotation at time t
+INTERNAL void
+SampleReplayCamera(Replay* replay, float t, Camera* camera)
+{
+  if (replay->num_keyframes == 0)
+    return;
+  while (replay->current_keyframe + 1 < replay->num_keyframes &&
+         replay->keyframes[replay->current_keyframe+1].time <= t) {
+    replay->current_keyframe++;
+  }
+  const Replay_Keyframe* a = &replay->keyframes[replay->current_keyframe];
+  if (replay->current_keyframe + 1 == replay->num_keyframes || t <= a->time) {
+    camera->position = a->position;
+    camera->rotation = a->rotation;
+    return;
+  }
+  const Replay_Keyframe* b = a + 1;
+  float k = (t - a->time) / (b->time - a->time);
+  camera->position = VEC3_ADD(VEC3_MUL(a->position, 1.0f - k), VEC3_MUL(b->position, k));
+  camera->rotation = VEC3_ADD(VEC3_MUL(a->rotation, 1.0f - k), VEC3_MUL(b->rotation, k));
+}
+
+// collect stats of previous frame
+INTERNAL void
+MeasureReplayFrame(Replay* replay)
+{
+  const Time_Histogram* hist = &g_frame_stats.frame_times;
+  if (hist->num_samples == 0)
+    return;
+  uint32_t us = hist->samples[(hist->next_sample - 1) & (FRAME_TIME_WINDOW-1)];
+  AddToTimeHistogram(&replay->frame_times, us);
+  replay->frame_time_sum += us;
+  replay->num_measured++;
+
+  for (uint32_t i = 0; i < g_window->num_gpu_zone_times; i++) {
+    const GPU_Zone_Time* time = &g_window->gpu_zone_times[i];
+    uint32_t j = 0;
+    while (j < replay->num_gpu_zones && strcmp(replay->gpu_zones[j].name, time->name) != 0)
+      j++;
+    if (j == REPLAY_MAX_GPU_ZONES)
+      continue;
+    if (j == replay->num_gpu_zones) {
+      replay->gpu_zones[j] = (Replay_GPU_Zone) { .name = time->name };
+      replay->num_gpu_zones++;
+    }
+    replay->gpu_zones[j].sum_ms += time->milliseconds;
+    if (time->milliseconds > replay->gpu_zones[j].max_ms)
+      replay->gpu_zones[j].max_ms = time->milliseconds;
+    replay->gpu_zones[j].count++;
+  }
+
+  for (uint32_t i = 0; i < 6; i++) {
+    replay->pipeline_stats_fragment[i] += g_vox_drawer->pipeline_stats_fragment.results[i];
+    replay->pipeline_stats_shadow[i] += g_vox_drawer->pipeline_stats_shadow.results[i];
+  }
+  for (uint32_t i = 0; i < g_frame_stats.num_counters; i++) {
+    replay->counters[i] += GetFrameCounter(i);
+  }
+}
+
+INTERNAL void
+WriteReplayPipelineStats(Trace_Writer* writer, const char* name, const uint64_t* stats, uint32_t num_frames)
+{
+  TraceWriterPrintf(writer, "    \"%s\": {", name);
+  for (uint32_t i = 0; i < 6; i++) {
+    TraceWriterPrintf(writer, "%s\"%s\": %.1f", (i > 0) ? ", " : "",
+                      g_pipeline_stat_names[i], (double)stats[i] / (double)num_frames);
+  }
+  TraceWriterPrintf(writer, "}");
+}
+
+INTERNAL int
+WriteReplayReport(Replay* replay, const char* filename)
+{
+  Trace_Writer* writer = PlatformAllocateMemory(sizeof(Trace_Writer));
+  writer->size = 0;
+  writer->file = PlatformOpenFileForWrite(filename);
+  if (writer->file == NULL) {
+    LOG_WARN("failed to open file '%s' for writing with error %s", filename, PlatformGetError());
+    PlatformFreeMemory(writer);
+    return -1;
+  }
+  uint32_t n = (replay->num_measured > 0) ? replay->num_measured : 1;
+  const Time_Histogram* hist = &replay->frame_times;
+
+  TraceWriterPrintf(writer, "{\n  \"replay\": ");
+  TraceWriterString(writer, replay->path, strlen(replay->path));
+  TraceWriterPrintf(writer, ",\n  \"gpu\": ");
+  TraceWriterString(writer, g_device->properties.deviceName, strlen(g_device->properties.deviceName));
+  TraceWriterPrintf(writer, ",\n  \"resolution\": [%u, %u],\n",
+                    g_window->swapchain_extent.width, g_window->swapchain_extent.height);
+  TraceWriterPrintf(writer, "  \"dt\": %.6f,\n  \"warmup_frames\": %u,\n  \"frames\": %u,\n",
+                    replay->dt, replay->warmup_frames, replay->num_measured);
+  TraceWriterPrintf(writer, "  \"frame_time_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+                    (double)replay->frame_time_sum * 0.001 / (double)n,
+                    TimeHistogramPercentile(hist, 50.0f), TimeHistogramPercentile(hist, 95.0f),
+                    TimeHistogramPercentile(hist, 99.0f), (float)MaxInTimeHistogram(hist) * 0.001f);
+
+  TraceWriterPrintf(writer, "  \"gpu_passes_ms\": {");
+  for (uint32_t i = 0; i < replay->num_gpu_zones; i++) {
+    const Replay_GPU_Zone* zone = &replay->gpu_zones[i];
+    TraceWriterPrintf(writer, "%s\n    ", (i > 0) ? "," : "");
+    TraceWriterString(writer, zone->name, strlen(zone->name));
+    TraceWriterPrintf(writer, ": {\"mean\": %.4f, \"max\": %.4f}",
+                      zone->sum_ms / (double)zone->count, zone->max_ms);
+  }
+  TraceWriterPrintf(writer, "\n  },\n");
+
+  // per frame averages
+  TraceWriterPrintf(writer, "  \"pipeline_stats\": {\n");
+  WriteReplayPipelineStats(writer, "forward", replay->pipeline_stats_fragment, n);
+  TraceWriterPrintf(writer, ",\n");
+  WriteReplayPipelineStats(writer, "shadow", replay->pipeline_stats_shadow, n);
+  TraceWriterPrintf(writer, "\n  },\n");
+
+  TraceWriterPrintf(writer, "  \"counters\": {");
+  for (uint32_t i = 0; i < g_frame_stats.num_counters; i++) {
+    TraceWriterPrintf(writer, "%s\n    ", (i > 0) ? "," : "");
+    TraceWriterString(writer, g_frame_stats.names[i], strlen(g_frame_stats.names[i]));
+    TraceWriterPrintf(writer, ": %.2f", (double)replay->counters[i] / (double)n);
+  }
+  TraceWriterPrintf(writer, "\n  }\n}\n");
+
+  PlatformWriteToFile(writer->file, writer->buff, writer->size);
+  PlatformCloseFileForWrite(writer->file);
+  PlatformFreeMemory(writer);
+  return 0;
+}
+
+
+/// public functions
+
+INTERNAL void
+InitReplay()
+{
+  g_replay = PersistentAllocate(sizeof(Replay));
+  memset(g_replay, 0, sizeof(Replay));
+}
+
+/**
+   Load replay and start playing it from next frame.
+   @param report JSON file where results are written, can be NULL
+   @return 0 on success
+ */
+INTERNAL int
+StartReplay(const char* filename, const char* report)
+{
+  Replay* replay = g_replay;
+  if (replay->playing || replay->record_file) {
+    LOG_WARN("replay is already playing or recording");
+    return -1;
+  }
+  size_t size;
+  char* data = PlatformLoadEntireFile(filename, &size);
+  if (data == NULL) {
+    LOG_ERROR("failed to load replay '%s' with error %s", filename, PlatformGetError());
+    return -1;
+  }
+  stbsp_snprintf(replay->path, sizeof(replay->path), "%s", filename);
+  stbsp_snprintf(replay->report_path, sizeof(replay->report_path), "%s", (report) ? report : "");
+  if (ParseReplay(replay, data) != 0) {
+    PlatformFreeMemory(replay->events);
+    PlatformFreeMemory(replay->keyframes);
+    PlatformFreeLoadedFile(data);
+    return -1;
+  }
+  if (replay->has_seed) {
+    SeedRandom(g_random, replay->seed[0], replay->seed[1]);
+  }
+  replay->file_data = data;
+  replay->playing = 1;
+  replay->frame = 0;
+  replay->next_event = 0;
+  replay->current_keyframe = 0;
+  replay->num_measured = 0;
+  replay->frame_time_sum = 0;
+  replay->num_gpu_zones = 0;
+  ClearTimeHistogram(&replay->frame_times);
+  memset(replay->pipeline_stats_fragment, 0, sizeof(replay->pipeline_stats_fragment));
+  memset(replay->pipeline_stats_shadow, 0, sizeof(replay->pipeline_stats_shadow));
+  memset(replay->counters, 0, sizeof(replay->counters));
+  LOG_INFO("playing replay '%s': %u keyframes, %u events, %u frames",
+           filename, replay->num_keyframes, replay->num_events, replay->num_frames);
+  return 0;
+}
+
+INTERNAL void
+StopReplay()
+{
+  Replay* replay = g_replay;
+  if (!replay->playing)
+    return;
+  replay->playing = 0;
+  PlatformFreeMemory(replay->events);
+  PlatformFreeMemory(replay->keyframes);
+  PlatformFreeLoadedFile(replay->file_data);
+  replay->file_data = NULL;
+}
+
+/**
+   Advance replay by one frame: run events, move camera and collect
+   stats of previous frame. Call once per frame before camera update.
+   @return fixed timestep in seconds
+ */
+INTERNAL float
+ReplayFrame(Camera* camera)
+{
+  PROFILE_FUNCTION();
+  Replay* replay = g_replay;
+  if (replay->frame > replay->warmup_frames) {
+    MeasureReplayFrame(replay);
+  }
+  if (replay->frame == replay->num_frames) {
+    LOG_INFO("replay '%s' finished: %u frames, p50=%.2fms p99=%.2fms",
+             replay->path, replay->num_measured,
+             TimeHistogramPercentile(&replay->frame_times, 50.0f),
+             TimeHistogramPercentile(&replay->frame_times, 99.0f));
+    if (replay->report_path[0] && WriteReplayReport(replay, replay->report_path) == 0) {
+      LOG_INFO("written '%s'", replay->report_path);
+    }
+    StopReplay();
+    PlatformWantToQuit();
+    return replay->dt;
+  }
+
+  float t = (replay->frame > replay->warmup_frames) ? (replay->frame - replay->warmup_frames) * replay->dt : 0.0f;
+  while (replay->next_event < replay->num_events && replay->events[replay->next_event].time <= t) {
+    const Replay_Event* event = &replay->events[replay->next_event++];
+    switch (event->type) {
+    case REPLAY_EVENT_COMMAND:
+      {
+        char line[sizeof(g_console->prompt)];
+        strcpy(line, event->text);
+        ExecuteConsoleCommand(line);
+      } break;
+    case REPLAY_EVENT_KEY_PRESSED:
+      KeyPressed(event->key);
+      break;
+    case REPLAY_EVENT_KEY_RELEASED:
+      KeyReleased(event->key);
+      break;
+    case REPLAY_EVENT_TEXT:
+      TextInput(event->text);
+      break;
+    }
+  }
+  // camera path already contains movement, don't let replayed keys move camera
+  camera->pressed = 0;
+  SampleReplayCamera(replay, t, camera);
+  replay->frame++;
+  return replay->dt;
+}
+
+/**
+   Start writing camera path and input to a replay file.
+   @param scene scene that was saved before recording, can be NULL
+   @return 0 on success
+ */
+INTERNAL int
+StartRecordingReplay(const char* filename, const char* scene)
+{
+  Replay* replay = g_replay;
+  if (replay->playing || replay->record_file) {
+    LOG_WARN("replay is already playing or recording");
+    return -1;
+  }
+  replay->record_file = PlatformOpenFileForWrite(filename);
+  if (replay->record_file == NULL) {
+    LOG_WARN("failed to open file '%s' for writing with error %s", filename, PlatformGetError());
+    return -1;
+  }
+  replay->record_time = 0.0f;
+  char buff[256];
+  int length = stbsp_snprintf(buff, sizeof(buff), "# lida replay\ndt %f\nwarmup %u\n",
+                              REPLAY_DEFAULT_DT, REPLAY_DEFAULT_WARMUP);
+  PlatformWriteToFile(replay->record_file, buff, length);
+  if (scene) {
+    length = stbsp_snprintf(buff, sizeof(buff), "command 0 clear_scene\ncommand 0 load_scene %s\n", scene);
+    PlatformWriteToFile(replay->record_file, buff, length);
+  }
+  LOG_INFO("recording replay to '%s'", filename);
+  return 0;
+}
+
+INTERNAL void
+StopRecordingReplay()
+{
+  if (g_replay->record_file) {
+    PlatformCloseFileForWrite(g_replay->record_file);
+    g_replay->record_file = NULL;
+    LOG_INFO("stopped recording replay");
+  }
+}
+
+// write camera keyframe, should be called once per frame
+INTERNAL void
+RecordReplayFrame(const Camera* camera, float dt)
+{
+  if (g_replay->record_file == NULL)
+    return;
+  char buff[256];
+  int length = stbsp_snprintf(buff, sizeof(buff), "camera %.4f %f %f %f %f %f %f\n",
+                              g_replay->record_time,
+                              camera->position.x, camera->position.y, camera->position.z,
+                              camera->rotation.x, camera->rotation.y, camera->rotation.z);
+  PlatformWriteToFile(g_replay->record_file, buff, length);
+  g_replay->record_time += dt;
+}
+
+INTERNAL void
+RecordReplayKey(PlatformKeyCode key, int pressed)
+{
+  if (g_replay->record_file == NULL)
+    return;
+  char buff[64];
+  int length = stbsp_snprintf(buff, sizeof(buff), "key %.4f %d %u\n",
+                              g_replay->record_time, pressed, (uint32_t)key);
+  PlatformWriteToFile(g_replay->record_file, buff, length);
+}
+
+INTERNAL void
+RecordReplayText(const char* text)
+{
+  if (g_replay->record_file == NULL || strchr(text, '\n'))
+    return;
+  char buff[256];
+  int length = stbsp_snprintf(buff, sizeof(buff), "text %.4f %s\n", g_replay->record_time, text);
+  PlatformWriteToFile(g_replay->record_file, buff, length);
+}
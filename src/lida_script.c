@@ -40,49 +40,50 @@ DECLARE_COMPONENT(Script);
 
 typedef struct {
 
-  const char* name;
+  String_ID name;
   Script_Func func;
 
 } Script_Entry;
-DECLARE_TYPE(Script_Entry);
-
-typedef struct {
-
-  Fixed_Hash_Table scripts;
-
-} Script_Manager;
-
-Script_Manager* g_script_manager;
-
-
-/// private functions
 
 INTERNAL uint32_t
 HashScriptEntry(const void* obj)
 {
   const Script_Entry* script = obj;
-  return HashString32(script->name);
+  return script->name;
 }
 
 INTERNAL int
 CompareScriptEntries(const void* lhs, const void* rhs)
 {
   const Script_Entry* l = lhs, *r = rhs;
-  return strcmp(l->name, r->name);
+  return COMPARE(l->name, r->name);
 }
 
+DECLARE_HASH_TABLE(Script_Table, Script_Entry, HashScriptEntry, CompareScriptEntries)
+
+typedef struct {
+
+  Script_Table scripts;
+
+} Script_Manager;
+
+Script_Manager* g_script_manager;
+
+
+/// private functions
+
 INTERNAL void
 RegisterScript(Script_Manager* sm, const char* name, Script_Func func)
 {
-  Script_Entry entry = { .name = name, .func = func };
-  FHT_Insert(&sm->scripts, GET_TYPE_INFO(Script_Entry), &entry);
+  Script_Entry entry = { .name = InternString(name), .func = func };
+  Script_Table_Insert(&sm->scripts, &entry);
 }
 
 INTERNAL Script_Func
 GetScript(Script_Manager* sm, const char* name)
 {
-  Script_Entry entry = { .name = name };
-  Script_Entry* it = FHT_Search(&sm->scripts, GET_TYPE_INFO(Script_Entry), &entry);
+  Script_Entry entry = { .name = FindStringID(name) };
+  Script_Entry* it = Script_Table_Search(&sm->scripts, &entry);
   if (it)
     return it->func;
   return NULL;
@@ -124,10 +125,7 @@ INTERNAL void
 InitScripts(Script_Manager* sm)
 {
   const uint32_t size = 16;
-  REGISTER_TYPE(Script_Entry, &HashScriptEntry, &CompareScriptEntries);
-  FHT_Init(&sm->scripts,
-           PersistentAllocate(FHT_CALC_SIZE(GET_TYPE_INFO(Script_Entry), size)),
-           size, GET_TYPE_INFO(Script_Entry));
+  Script_Table_Init(&sm->scripts, PersistentAllocate(HT_CALC_SIZE(Script_Entry, size)), size);
   // insert all scripts to hash table
 #define REGISTER_SCRIPT(sm, name) RegisterScript(sm, #name, SCRIPT_##name)
   REGISTER_SCRIPT(sm, rotate_voxel);
@@ -1,36 +1,15 @@
 /*
   lida_voxel.c
 
-  Voxel loading, creation, rendering etc.
+  Voxel rendering etc. Grids, palettes and meshing live in
+  lida_voxel_grid.c.
   https://www.youtube.com/watch?v=dQw4w9WgXcQ
  */
 
-#define VX_USE_INDICES 1
 #define VX_USE_CULLING 1
-#define VX_USE_BLOCKS 0
 #define MAX_ACTIVE_CAMERAS 8
 #define VOXEL_VERTEX_THRESHOLD 8*1024
 
-typedef uint8_t Voxel;
-
-typedef Voxel Voxel_Block[64];
-
-// stores voxels as plain 3D array
-typedef struct {
-
-  Allocation* data;
-  uint32_t width;
-  uint32_t height;
-  uint32_t depth;
-  uint64_t hash;
-  uint32_t palette[256];
-  uint64_t last_hash;
-  uint32_t first_vertex;
-  uint32_t offsets[6];
-
-} Voxel_Grid;
-DECLARE_COMPONENT(Voxel_Grid);
-
 typedef struct {
 
   EID grid;
@@ -39,6 +18,25 @@ typedef struct {
 } Voxel_View;
 DECLARE_COMPONENT(Voxel_View);
 
+// What a model costs us, see CMD_model_costs. Grid entities track
+// meshing and view entities track drawing. Entities get this
+// component when they're first meshed or drawn, it's not saved in
+// scenes.
+typedef struct {
+
+  // Voxel_Grid
+  uint32_t num_vertices;  // of last mesh
+  uint32_t num_remeshes;
+  uint64_t remesh_ticks;  // total, see PlatformGetPerformanceCounter()
+  // Voxel_View
+  uint64_t gpu_draws;     // draw calls summed over all cameras and frames
+  uint32_t frames_drawn;
+  // frame when tracking started, remesh frequency is relative to it
+  uint64_t first_frame;
+
+} Voxel_Cost;
+DECLARE_COMPONENT(Voxel_Cost);
+
 typedef struct {
 
   Vec3 half_size;
@@ -72,6 +70,21 @@ typedef struct {
 
 } VX_Draw_Command;
 
+// Cull shaders accumulate these with atomics, one per camera, see
+// Cull_Stats in shaders/culling.h. Faces are quads of voxel meshes.
+// Sums live in device local memory and are copied to host visible
+// memory at the end of cull pass.
+typedef struct {
+
+  uint32_t tested_faces;
+  uint32_t frustum_culled_faces;
+  uint32_t occlusion_culled_faces;
+  uint32_t backface_culled_faces;
+  uint32_t emitted_draws;
+  uint32_t padding[3];
+
+} VX_Cull_Stats;
+
 typedef struct {
 
   VkBuffer vertex_buffer;
@@ -105,6 +118,11 @@ typedef struct {
   VkBuffer storage_buffer;
   VkBuffer indirect_buffer;
   VkBuffer vertex_count_buffer;
+  // host visible copies of gpu_cull_stats_buffer and gpu_draw_stats_buffer
+  VkBuffer cull_stats_buffer;
+  VkBuffer draw_stats_buffer;
+  VkBuffer gpu_cull_stats_buffer;
+  VkBuffer gpu_draw_stats_buffer;
   // used for compute preprocessing
   VkDescriptorSet ds_set;
 
@@ -112,6 +130,19 @@ typedef struct {
   Vertex_X3C* pVertices;
   Transform* pTransforms;
   uint32_t* pIndices;
+  // 2 frames of MAX_ACTIVE_CAMERAS stats, camera's index is Log2_u32(cull_mask)
+  VX_Cull_Stats* pCullStats;
+
+  // what cull shaders counted 2 frames ago
+  VX_Cull_Stats cull_stats[MAX_ACTIVE_CAMERAS];
+  // Draw calls emitted for each slot of pDraws and entity pushed to
+  // that slot. Both have 2 frames of max_draws.
+  uint32_t* pDrawStats;
+  EID* draw_entities;
+  uint32_t max_draws;
+  // slots culled by frame
+  uint32_t stats_first_draw[2];
+  uint32_t stats_num_draws[2];
 
   // reset each frame
   size_t vertex_offset;
@@ -156,34 +187,18 @@ typedef struct {
 
 Voxel_Drawer* g_vox_drawer;
 
-#define VOX_BLOCK_DIM(x) ((x)>>2)
-#define VOX_DIM_IN_VOXEL(x) ((x)&3)
-#define GetVoxelBlock(grid, x, y, z) ((Voxel_Block*)(grid)->data->ptr)[VOX_BLOCK_DIM(x) + VOX_BLOCK_DIM(y)*VOX_BLOCK_DIM((grid)->width) + VOX_BLOCK_DIM(z)*VOX_BLOCK_DIM((grid)->width)*VOX_BLOCK_DIM((grid)->height)]
-
-#if VX_USE_BLOCKS
-// #define GetInVoxelGrid(grid, x, y, z) (GetVoxelBlock(grid, x, y, z))[VOX_DIM_IN_VOXEL(x) + (VOX_DIM_IN_VOXEL(y)<<2) + (VOX_DIM_IN_VOXEL(z)<<4)]
-
-INTERNAL Voxel*
-GetInVoxelGridImpl(const Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z)
-{
-  Voxel* start = grid->data->ptr;
-  uint32_t dimw = ALIGN_TO(grid->width, 4);
-  dimw = VOX_BLOCK_DIM(dimw);
-  uint32_t dimh = ALIGN_TO(grid->height, 4);
-  dimh = VOX_BLOCK_DIM(dimh);
-  Voxel* block = start + (VOX_BLOCK_DIM(x) + VOX_BLOCK_DIM(y)*dimw + dimw*dimh*VOX_BLOCK_DIM(z))*64;
-  return block + (VOX_DIM_IN_VOXEL(x) + VOX_DIM_IN_VOXEL(y)*4 + VOX_DIM_IN_VOXEL(z)*16);
-}
-#define GetInVoxelGrid(grid, x, y, z) (*GetInVoxelGridImpl(grid, x, y, z))
-
-#else
-// NOTE: this doesn't do bounds checking
-// NOTE: setting a voxel value with this macro is unsafe, hash won't be correct,
-// consider using SetInVoxelGrid
-#define GetInVoxelGrid(grid, x, y, z) ((Voxel*)(grid)->data->ptr)[(x) + (y)*(grid)->width + (z)*(grid)->width*(grid)->height]
-#endif
-
-Allocator* g_vox_allocator;
+// frame counters, see RegisterFrameCounter()
+GLOBAL uint32_t g_counter_voxel_vertices;
+GLOBAL uint32_t g_counter_voxel_remeshes;
+GLOBAL uint32_t g_counter_voxel_remesh_queue;
+GLOBAL uint32_t g_counter_voxel_draws;
+GLOBAL uint32_t g_counter_voxel_upload_bytes;
+GLOBAL uint32_t g_counter_voxel_draw_calls;
+GLOBAL uint32_t g_counter_gpu_tested_faces;
+GLOBAL uint32_t g_counter_gpu_frustum_culled_faces;
+GLOBAL uint32_t g_counter_gpu_occlusion_culled_faces;
+GLOBAL uint32_t g_counter_gpu_backface_culled_faces;
+GLOBAL uint32_t g_counter_gpu_emitted_draws;
 
 EID g_voxel_pipeline_colored;
 EID g_voxel_pipeline_shadow;
@@ -192,525 +207,44 @@ EID g_voxel_pipeline_compute_persp;
 EID g_voxel_pipeline_compute_ext_ortho;
 EID g_voxel_pipeline_compute_ext_persp;
 
-// TODO: compress voxels on disk using RLE(Run length Encoding)
 
 
-/// Voxel grid
+/// Model costs
 
-// CLEANUP: do we really need this function? I think it's better to
-// just recreate voxel grids when needed.
-INTERNAL int
-AllocateVoxelGrid(Allocator* allocator, Voxel_Grid* grid, uint32_t w, uint32_t h, uint32_t d)
+// returns NULL if component can't be added, costs are just not
+// accounted then
+INTERNAL Voxel_Cost*
+GetVoxelCost(EID entity)
 {
-#if VX_USE_BLOCKS
-  uint32_t wa = ALIGN_TO(w, 4);
-  uint32_t ha = ALIGN_TO(h, 4);
-  uint32_t da = ALIGN_TO(d, 4);
-  grid->data = DoAllocation(allocator, wa*ha*da, "voxel-grid");
-  if (grid->data == NULL) {
-    LOG_WARN("out of memory");
-    return -1;
-  }
-  memset(grid->data->ptr, 0, wa*ha*da);
-  grid->width = w;
-  grid->height = h;
-  grid->depth = d;
-  grid->first_vertex = UINT32_MAX;
-  return 0;
-#else
-  grid->data = DoAllocation(allocator, w*h*d, "voxel-grid");
-  if (grid->data == NULL) {
-    LOG_WARN("out of memory");
-    return -1;
+  Voxel_Cost* cost = GetComponent(Voxel_Cost, entity);
+  if (cost == NULL) {
+    cost = AddComponent(g_ecs, Voxel_Cost, entity);
+    if (cost == NULL)
+      return NULL;
+    memset(cost, 0, sizeof(Voxel_Cost));
+    cost->first_frame = g_window->frame_counter;
   }
-  // In some cases this memset may be redundant.
-  // Do we need to introduce some kind of boolean argument for this function?
-  memset(grid->data->ptr, 0, w*h*d);
-  grid->width = w;
-  grid->height = h;
-  grid->depth = d;
-  grid->first_vertex = UINT32_MAX;
-  return 0;
-#endif
-}
-
-INTERNAL void
-FreeVoxelGrid(Allocator* allocator, Voxel_Grid* grid)
-{
-  if (grid->data) {
-    FreeAllocation(allocator, grid->data);
-    grid->data = NULL;
-  }
-}
-
-/**
-   Get number of bytes occupied by a voxel grid's data.
- */
-INTERNAL uint32_t
-VoxelGridBytes(const Voxel_Grid* grid)
-{
-#if VX_USE_BLOCKS
-  uint32_t wa = ALIGN_TO(grid->width, 4);
-  uint32_t ha = ALIGN_TO(grid->height, 4);
-  uint32_t da = ALIGN_TO(grid->depth, 4);
-  return wa*ha*da;
-#else
-  return grid->width * grid->height * grid->depth;
-#endif
-}
-
-INTERNAL void
-RehashVoxelGrid(Voxel_Grid* grid)
-{
-  grid->hash = HashMemory64(grid->data->ptr, VoxelGridBytes(grid));
+  return cost;
 }
 
 INTERNAL void
-SetInVoxelGrid(Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z, Voxel vox)
-{
-  GetInVoxelGrid(grid, x, y, z) = vox;
-  uint64_t hashes[2] = { grid->hash, (uint64_t)vox };
-  grid->hash = HashCombine64(hashes, 2);
-}
-
-GLOBAL const Vec3 vox_positions[] = {
-#if VX_USE_INDICES
-  // -x
-  {0.0f, 1.0f, 1.0f},
-  {0.0f, 1.0f, 0.0f},
-  {0.0f, 0.0f, 0.0f},
-  {0.0f, 0.0f, 1.0f},
-  // +x
-  {1.0f, 1.0f, 0.0f},
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 0.0f, 1.0f},
-  {1.0f, 0.0f, 0.0f},
-  // -y
-  {1.0f, 0.0f, 0.0f},
-  {1.0f, 0.0f, 1.0f},
-  {0.0f, 0.0f, 1.0f},
-  {0.0f, 0.0f, 0.0f},
-  // +y
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 1.0f, 0.0f},
-  {0.0f, 1.0f, 0.0f},
-  {0.0f, 1.0f, 1.0f},
-  // -z
-  {1.0f, 1.0f, 0.0f},
-  {1.0f, 0.0f, 0.0f},
-  {0.0f, 0.0f, 0.0f},
-  {0.0f, 1.0f, 0.0f},
-  // +z
-  {1.0f, 0.0f, 1.0f},
-  {1.0f, 1.0f, 1.0f},
-  {0.0f, 1.0f, 1.0f},
-  {0.0f, 0.0f, 1.0f},
-#else
-  // -x
-  {0.0f, 1.0f, 1.0f},
-  {0.0f, 1.0f, 0.0f},
-  {0.0f, 0.0f, 0.0f},
-  {0.0f, 0.0f, 0.0f},
-  {0.0f, 0.0f, 1.0f},
-  {0.0f, 1.0f, 1.0f},
-  // +x
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 0.0f, 0.0f},
-  {1.0f, 1.0f, 0.0f},
-  {1.0f, 0.0f, 0.0f},
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 0.0f, 1.0f},
-  // -y
-  {0.0f, 0.0f, 0.0f},
-  {1.0f, 0.0f, 0.0f},
-  {1.0f, 0.0f, 1.0f},
-  {1.0f, 0.0f, 1.0f},
-  {0.0f, 0.0f, 1.0f},
-  {0.0f, 0.0f, 0.0f},
-  // +y
-  {0.0f, 1.0f, 0.0f},
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 1.0f, 0.0f},
-  {1.0f, 1.0f, 1.0f},
-  {0.0f, 1.0f, 0.0f},
-  {0.0f, 1.0f, 1.0f},
-  // -z
-  {0.0f, 0.0f, 0.0f},
-  {1.0f, 1.0f, 0.0f},
-  {1.0f, 0.0f, 0.0f},
-  {1.0f, 1.0f, 0.0f},
-  {0.0f, 0.0f, 0.0f},
-  {0.0f, 1.0f, 0.0f},
-  // +z
-  {0.0f, 0.0f, 1.0f},
-  {1.0f, 0.0f, 1.0f},
-  {1.0f, 1.0f, 1.0f},
-  {1.0f, 1.0f, 1.0f},
-  {0.0f, 1.0f, 1.0f},
-  {0.0f, 0.0f, 1.0f}
-#endif
-};
-
-GLOBAL const uint32_t vox_indices[6] = { 0, 1, 2, 2, 3, 0 };
-
-GLOBAL const iVec3 vox_normals[6] = {
-  {-1, 0, 0},
-  {1, 0, 0},
-  {0, -1, 0},
-  {0, 1, 0},
-  {0, 0, -1},
-  {0, 0, 1}
-};
-
-GLOBAL const Vec3 f_vox_normals[6] = {
-  {-1.0f, 0.0f, 0.0f},
-  {1.0f, 0.0f, 0.0f},
-  {0.0f, -1.0f, 0.0f},
-  {0.0f, 1.0f, 0.0f},
-  {0.0f, 0.0f, -1.0f},
-  {0.0f, 0.0f, 1.0f}
-};
-
-// return: inv_size
-INTERNAL float
-CalculateVoxelGridSize(const Voxel_Grid* grid, Vec3* half_size)
-{
-  float inv_size;
-  // TODO: we currently have no Min() function defined... shame
-  if (grid->width <= grid->height && grid->height <= grid->depth) {
-    inv_size = 1.0f / (float)grid->width;
-  } else if (grid->height <= grid->width && grid->width <= grid->depth) {
-    inv_size = 1.0f / (float)grid->height;
-  } else {
-    inv_size = 1.0f / (float)grid->depth;
-  }
-  half_size->x = inv_size * 0.5f * (float)grid->width;
-  half_size->y = inv_size * 0.5f * (float)grid->height;
-  half_size->z = inv_size * 0.5f * (float)grid->depth;
-  return inv_size;
-}
-
-INTERNAL uint32_t
-GenerateVoxelGridMeshNaive(const Voxel_Grid* grid, Vertex_X3C* vertices, int face
-#if VX_USE_INDICES
-                           , uint32_t base_index, uint32_t* indices
-#endif
-                           )
+CountRemeshedVertices(EID grid, size_t num_vertices, uint64_t start_time)
 {
-  Vertex_X3C* const first_vertex = vertices;
-  Vec3 half_size;
-  float inv_size = CalculateVoxelGridSize(grid, &half_size);
-  int offsetX = vox_normals[face].x;
-  int offsetY = vox_normals[face].y;
-  int offsetZ = vox_normals[face].z;
-  // yes, we just loop over all voxels
-  // note how we first iterate over x for better cache locality
-  for (uint32_t z = 0; z < grid->depth; z++)
-    for (uint32_t y = 0; y < grid->height; y++)
-      for (uint32_t x = 0; x < grid->width; x++) {
-        Voxel voxel = GetInVoxelGrid(grid, x, y, z);
-        Voxel near_voxel;
-        if (x+offsetX < grid->width &&
-            y+offsetY < grid->height &&
-            z+offsetZ < grid->depth) {
-          near_voxel = GetInVoxelGrid(grid, x+offsetX, y+offsetY, z+offsetZ);
-        } else {
-          near_voxel = 0;
-        }
-        if (// check if voxel is not air
-            voxel &&
-            // check if near voxel is air
-            near_voxel == 0) {
-          Vec3 pos = VEC3_CREATE((float)x, (float)y, (float)z);
+  AddFrameCounter(g_counter_voxel_vertices, num_vertices);
+  AddFrameCounter(g_counter_voxel_remeshes, 1);
 #if VX_USE_INDICES
-           // write 4 vertices and 6 indices for this quad
-          for (uint32_t i = 0; i < 6; i++) {
-            *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
-          }
-          for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
-            *(vertices++) = (Vertex_X3C) {
-              .position.x = (pos.x + vox_positions[face*4+vert_index].x) * inv_size - half_size.x,
-              .position.y = (pos.y + vox_positions[face*4+vert_index].y) * inv_size - half_size.y,
-              .position.z = (pos.z + vox_positions[face*4+vert_index].z) * inv_size - half_size.z,
-              .color = grid->palette[voxel],
-            };
-          }
+  AddFrameCounter(g_counter_voxel_upload_bytes, num_vertices * (sizeof(Vertex_X3C) + 3 * sizeof(uint32_t) / 2));
 #else
-          for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
-            *(vertices++) = (Vertex_X3C) {
-              .position.x = (pos.x + vox_positions[face*6 + vert_index].x) * inv_size - half_size.x,
-              .position.y = (pos.y + vox_positions[face*6 + vert_index].y) * inv_size - half_size.y,
-              .position.z = (pos.z + vox_positions[face*6 + vert_index].z) * inv_size - half_size.z,
-              .color = grid->palette[voxel],
-            };
-          }
+  AddFrameCounter(g_counter_voxel_upload_bytes, num_vertices * sizeof(Vertex_X3C));
 #endif
-        }
-      }
-  LOG_DEBUG("wrote %u vertices", (uint32_t)(vertices - first_vertex));
-  return vertices - first_vertex;
-}
-
-INTERNAL Voxel
-GetInVoxelGridChecked(const Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z)
-{
-  if (x < grid->width &&
-      y < grid->height &&
-      z < grid->depth) {
-    return GetInVoxelGrid(grid, x, y, z);
+  Voxel_Cost* cost = GetVoxelCost(grid);
+  if (cost) {
+    cost->num_vertices = num_vertices;
+    cost->num_remeshes++;
+    cost->remesh_ticks += PlatformGetPerformanceCounter() - start_time;
   }
-  return 0;
 }
 
-INTERNAL uint32_t
-GenerateVoxelGridMeshGreedy(const Voxel_Grid* grid, Vertex_X3C* vertices, int face
-#if VX_USE_INDICES
-                            , uint32_t base_index, uint32_t* indices
-#endif
-                            )
-{
-  PROFILE_FUNCTION();
-  // uint32_t start_time = PlatformGetTicks();
-  // TODO: my dream is to make this function execute fast, processing
-  // 4 or 8 voxels at same time
-  Vertex_X3C* const first_vertex = vertices;
-  Vec3 half_size;
-  float inv_size = CalculateVoxelGridSize(grid, &half_size);
-  const uint32_t dims[3] = { grid->width, grid->height, grid->depth };
-  const int d = face >> 1;
-  const int u = (d+1)%3, v = (d+2)%3;
-#if 0
-  // iterate each block
-  Voxel* block = (Voxel*)grid->data->ptr;
-  for (uint32_t gz = 0; gz < grid->depth; gz += 4)
-    for (uint32_t gy = 0; gy < grid->height; gy += 4)
-      for (uint32_t gx = 0; gx < grid->width; gx += 4) {
-        for (uint32_t layer = 0; layer < 4; layer++) {
-          uint16_t merged_mask = 0;
-          // try to merge voxels in block
-          for (uint32_t j = 0; j < 4; j++)
-            for (uint32_t i = 0; i < 4; i++) {
-              if (merged_mask & (1 << (i + j*4)))
-                continue;
-              int pos[3];
-              pos[d] = layer;
-              pos[u] = i;
-              pos[v] = j;
-              Voxel start_voxel = block[pos[0] + (pos[1] << 2) + (pos[2] << 4)];
-              if (start_voxel == 0) {
-                // skip air
-                continue;
-              }
-              const int start_pos[3] = { pos[0], pos[1], pos[2] };
-              int min_i = 4;
-              while (pos[v] < 4) {
-                pos[u] = i;
-                // TODO: try to use local adressation
-                if (block[pos[0] + (pos[1]<<2) + (pos[2]<<4)] != start_voxel ||
-                    GetInVoxelGridChecked(grid,
-                                          pos[0] + gx + vox_normals[face].x,
-                                          pos[1] + gy + vox_normals[face].y,
-                                          pos[2] + gz + vox_normals[face].z) != 0)
-                  break;
-                pos[u]++;
-                while (pos[u] < min_i &&
-                       block[pos[0] + (pos[1]<<2) + (pos[2]<<4)] == start_voxel &&
-                       GetInVoxelGridChecked(grid,
-                                             pos[0] + gx + vox_normals[face].x,
-                                             pos[1] + gy + vox_normals[face].y,
-                                             pos[2] + gz + vox_normals[face].z) == 0) {
-                  pos[u]++;
-                }
-                if (pos[u] < min_i) min_i = pos[u];
-                pos[v]++;
-              }
-              if (min_i == start_pos[u] ||
-                  pos[v] == start_pos[v]) {
-                continue;
-              }
-              int offset[3] = { 0 };
-              offset[u] = min_i - start_pos[u];
-              offset[v] = pos[v] - start_pos[v];
-#if VX_USE_INDICES
-              // write 4 vertices and 6 indices for this quad
-              for (uint32_t i = 0; i < 6; i++) {
-                *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
-              }
-              for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
-                int vert_pos[3] = { gz + start_pos[0] + offset[0] * (int)vox_positions[face*4 + vert_index].x,
-                                    gy + start_pos[1] + offset[1] * (int)vox_positions[face*4 + vert_index].y,
-                                    gx + start_pos[2] + offset[2] * (int)vox_positions[face*4 + vert_index].z };
-                vert_pos[d] += face & 1;
-                *(vertices++) = (Vertex_X3C) {
-                  .position.x = vert_pos[0] * inv_size - half_size.x,
-                  .position.y = vert_pos[1] * inv_size - half_size.y,
-                  .position.z = vert_pos[2] * inv_size - half_size.z,
-                  .color = grid->palette[start_voxel]
-                };
-              }
-#else
-              // write 6 vertices for this quad
-              for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
-                int vert_pos[3] = { gz + (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*6 + vert_index].x,
-                                    gy + (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*6 + vert_index].y,
-                                    gx + (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*6 + vert_index].z };
-                vert_pos[d] += face & 1;
-                vertices[vert_index].position.x = vert_pos[0] * inv_size - half_size.x;
-                vertices[vert_index].position.y = vert_pos[1] * inv_size - half_size.y;
-                vertices[vert_index].position.z = vert_pos[2] * inv_size - half_size.z;
-                vertices[vert_index].color = grid->palette[start_voxel];
-              }
-              vertices += 6;
-#endif
-              // mark merged voxels
-              for (int jj = j; jj < pos[v]; jj++)
-                for (int ii = i; ii < min_i; ii++)
-                  merged_mask |= (1 << (ii + jj*4));
-            }
-        }
-
-        block += 64;
-      }
-#else
-  char* merged_mask = (char*)PersistentAllocate(dims[u]*dims[v]);
-  // on each layer we try to merge voxels as much as possible
-  for (uint32_t layer = 0; layer < dims[d]; layer++) {
-    // zero out mask
-    memset(merged_mask, 0, dims[u]*dims[v]);
-    for (uint32_t j = 0; j < dims[v]; j++)
-      for (uint32_t i = 0; i < dims[u]; i++) {
-        // if this voxel was already written then skip it.
-        // this skip helps us to keep algorithm complexity at O(w*h*d).
-        if (merged_mask[i + j*dims[u]])
-          continue;
-        uint32_t pos[3];
-        pos[d] = layer;
-        pos[u] = i;
-        pos[v] = j;
-        Voxel start_voxel = GetInVoxelGrid(grid, pos[0], pos[1], pos[2]);
-        if (start_voxel == 0) {
-          // we don't generate vertices for air
-          continue;
-        }
-        const uint32_t start_pos[3] = { pos[0], pos[1], pos[2] };
-        uint32_t min_i = dims[u];
-
-        // grow quad while all voxels in that quad are the same and visible
-        while (pos[v] < dims[v]) {
-          pos[u] = i;
-          if (GetInVoxelGrid(grid, pos[0], pos[1], pos[2]) != start_voxel ||
-              GetInVoxelGridChecked(grid,
-                                    pos[0] + vox_normals[face].x,
-                                    pos[1] + vox_normals[face].y,
-                                    pos[2] + vox_normals[face].z) != 0)
-            break;
-          pos[u]++;
-          while (pos[u] < min_i &&
-                 GetInVoxelGrid(grid, pos[0], pos[1], pos[2]) == start_voxel &&
-                 GetInVoxelGridChecked(grid,
-                                       pos[0] + vox_normals[face].x,
-                                       pos[1] + vox_normals[face].y,
-                                       pos[2] + vox_normals[face].z) == 0) {
-            pos[u]++;
-          }
-          if (pos[u] < min_i) min_i = pos[u];
-          pos[v]++;
-        }
-        if (min_i == start_pos[u] ||
-            pos[v] == start_pos[v]) {
-          continue;
-        }
-        uint32_t offset[3] = { 0 };
-        offset[u] = min_i - start_pos[u]; // width of quad
-        offset[v] = pos[v] - start_pos[v]; // height of quad
-#if VX_USE_INDICES
-        // write 4 vertices and 6 indices for this quad
-        for (uint32_t i = 0; i < 6; i++) {
-          *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
-        }
-        for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
-          int vert_pos[3] = { (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*4 + vert_index].x,
-                              (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*4 + vert_index].y,
-                              (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*4 + vert_index].z };
-          vert_pos[d] += face & 1;
-          *(vertices++) = (Vertex_X3C) {
-            .position.x = vert_pos[0] * inv_size - half_size.x,
-            .position.y = vert_pos[1] * inv_size - half_size.y,
-            .position.z = vert_pos[2] * inv_size - half_size.z,
-            .color = grid->palette[start_voxel]
-          };
-        }
-#else
-        // write 6 vertices for this quad
-        for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
-          int vert_pos[3] = { (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*6 + vert_index].x,
-                              (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*6 + vert_index].y,
-                              (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*6 + vert_index].z };
-          vert_pos[d] += face & 1;
-          vertices[vert_index].position.x = vert_pos[0] * inv_size - half_size.x;
-          vertices[vert_index].position.y = vert_pos[1] * inv_size - half_size.y;
-          vertices[vert_index].position.z = vert_pos[2] * inv_size - half_size.z;
-          vertices[vert_index].color = grid->palette[start_voxel];
-        }
-        vertices += 6;
-#endif
-        // mark merged voxels
-        for (uint32_t jj = j; jj < pos[v]; jj++)
-          for (uint32_t ii = i; ii < min_i; ii++) {
-            merged_mask[ii + jj * dims[u]] = 1;
-          }
-      }
-  }
-  PersistentRelease(merged_mask);
-#endif
-  // LOG_DEBUG("took %u ms to generate %u vertices", PlatformGetTicks() - start_time, (uint32_t)(vertices - first_vertex));
-  return vertices - first_vertex;
-}
-
-INTERNAL int
-LoadVoxelGrid(Allocator* allocator, Voxel_Grid* grid, const uint8_t* buffer, uint32_t size)
-{
-  PROFILE_FUNCTION();
-  const ogt_vox_scene* scene = ogt_vox_read_scene(buffer, size);
-  if (scene == NULL) {
-    LOG_WARN("failed to parse voxel model");
-    return -1;
-  }
-  const ogt_vox_model* model = scene->models[0];
-  if (AllocateVoxelGrid(allocator, grid, model->size_x, model->size_z, model->size_y)) {
-    // if out of memory
-    return -1;
-  }
-  memcpy(grid->palette, scene->palette.color, 256 * sizeof(ogt_vox_rgba));
-  for (uint32_t x = 0; x < grid->width; x++) {
-    for (uint32_t y = 0; y < grid->height; y++) {
-      for (uint32_t z = 0; z < grid->depth; z++) {
-        uint32_t index = x + z*grid->width + y*grid->width*grid->depth;
-        Voxel voxel = model->voxel_data[index];
-        if (voxel)
-          GetInVoxelGrid(grid, x, y, z) = voxel;
-      }
-    }
-  }
-  ogt_vox_destroy_scene(scene);
-  RehashVoxelGrid(grid);
-  return 0;
-}
-
-INTERNAL int
-LoadVoxelGridFromFile(Allocator* allocator, Voxel_Grid* grid, const char* filename)
-{
-  PROFILE_FUNCTION();
-  size_t buff_size;
-  uint8_t* buffer = (uint8_t*)PlatformLoadEntireFile(filename, &buff_size);
-  if (buffer == NULL) {
-    LOG_WARN("failed to open file '%s' for voxel model loading", filename);
-    return -1;
-  }
-  int ret = LoadVoxelGrid(allocator, grid, buffer, buff_size);
-  PlatformFreeLoadedFile(buffer);
-  return ret;
-}
 
 
 /// 'Slow' backend
@@ -827,12 +361,15 @@ INTERNAL void
 RegenerateVoxel_Slow(void* backend, Voxel_View* cached, Voxel_Grid* grid)
 {
   Voxel_Backend_Slow* drawer = backend;
-  (void)cached;
   grid->last_hash = grid->hash;
 
   // skip this vertex if we're exceeding threshold...
-  if (drawer->num_vertices >= VOXEL_VERTEX_THRESHOLD)
+  if (drawer->num_vertices >= VOXEL_VERTEX_THRESHOLD) {
+    AddFrameCounter(g_counter_voxel_remesh_queue, 1);
     return;
+  }
+  uint64_t start_time = PlatformGetPerformanceCounter();
+  size_t first_vertex = drawer->vertex_offset;
 
   VX_Draw_Command* current_draws = drawer->draws->ptr;
 #if VX_USE_INDICES
@@ -874,6 +411,7 @@ RegenerateVoxel_Slow(void* backend, Voxel_View* cached, Voxel_Grid* grid)
     grid->offsets[i] = command->vertexCount;
     drawer->num_vertices += command->vertexCount;
   }
+  CountRemeshedVertices(cached->grid, drawer->vertex_offset - first_vertex, start_time);
 }
 
 INTERNAL void
@@ -915,6 +453,10 @@ PushMeshVoxel_Slow(void* backend, EID entity)
 
   drawer->transform_offset++;
   meshes[drawer->num_meshes++] = entity;
+  Voxel_Cost* cost = GetVoxelCost(entity);
+  if (cost)
+    cost->frames_drawn++;
+  AddFrameCounter(g_counter_voxel_upload_bytes, sizeof(Transform) + sizeof(VX_Vertex_Count));
 }
 
 INTERNAL uint32_t
@@ -955,14 +497,8 @@ RenderVoxels_Slow(void* backend, VkCommandBuffer cmd, const Camera* camera, uint
     }
     Transform* transform = GetComponent(Transform, mesh);
     OBB* obb = GetComponent(OBB, mesh);
-    const uint32_t points[24] = {
-      4, 5, 6, 7, // -X
-      0, 1, 2, 3, // +X
-      2, 3, 6, 7, // -Y
-      0, 1, 4, 5, // +Y
-      1, 3, 5, 7, // -Z
-      0, 2, 4, 6, // +Z
-    };
+    Vec3 axes[3];
+    GetAxesOBB(obb, axes);
     uint32_t last_written_vertex = UINT32_MAX;
     uint32_t draw_count = 0;
     for (uint32_t normal_id = 0; normal_id < 6; normal_id++) {
@@ -972,10 +508,10 @@ RenderVoxels_Slow(void* backend, VkCommandBuffer cmd, const Camera* camera, uint
       Vec3 dist;
       // Hoping that compiler will optimize this check out of loop
       if (camera->type & CAMERA_TYPE_PERSP) {
-        Vec3 point;
-        point.x = 0.25f * (obb->corners[points[normal_id*4]].x + obb->corners[points[normal_id*4+1]].x + obb->corners[points[normal_id*4+2]].x + obb->corners[points[normal_id*4+3]].x);
-        point.y = 0.25f * (obb->corners[points[normal_id*4]].y + obb->corners[points[normal_id*4+1]].y + obb->corners[points[normal_id*4+2]].y + obb->corners[points[normal_id*4+3]].y);
-        point.z = 0.25f * (obb->corners[points[normal_id*4]].z + obb->corners[points[normal_id*4+1]].z + obb->corners[points[normal_id*4+2]].z + obb->corners[points[normal_id*4+3]].z);
+        // center of face: -X,-Y,-Z faces lie on positive side of
+        // the box's axes and +X,+Y,+Z on negative side
+        Vec3 offset = VEC3_MUL(axes[normal_id/2], (normal_id & 1) ? -1.0f : 1.0f);
+        Vec3 point = VEC3_ADD(obb->center, offset);
         dist = VEC3_SUB(point, camera->position);
       } else {
         dist = camera->front;
@@ -1008,6 +544,9 @@ RenderVoxels_Slow(void* backend, VkCommandBuffer cmd, const Camera* camera, uint
 #endif
       draw_calls++;
     }
+    Voxel_Cost* cost = GetVoxelCost(mesh);
+    if (cost)
+      cost->gpu_draws += draw_count;
   }
 
   return draw_calls;
@@ -1076,6 +615,7 @@ CreateVoxelBackend_Indirect(void* backend, Video_Memory* cpu_memory, Video_Memor
 
   // we occupy 2*max_draws in buffers
   max_draws *= 2;
+  drawer->max_draws = max_draws;
 
 #if !VX_USE_INDICES
   Assert(0 && "Indirect drawing without index buffers is not implemented.");
@@ -1108,9 +648,22 @@ CreateVoxelBackend_Indirect(void* backend, Video_Memory* cpu_memory, Video_Memor
   CREATE_BUFFER(vertex_count_buffer, MAX_ACTIVE_CAMERAS * max_draws * sizeof(VX_Vertex_Count),
                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                 "voxel-drawer/vertex-count-buffer");
+  // shaders sum statistics in device local memory, host visible
+  // buffers only receive a copy at the end of cull pass
+  CREATE_BUFFER(gpu_cull_stats_buffer, 2 * MAX_ACTIVE_CAMERAS * sizeof(VX_Cull_Stats),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                "voxel-drawer/gpu-cull-stats-buffer");
+  // slots of both frames fit into max_draws, see NewFrameVoxel_Indirect()
+  CREATE_BUFFER(gpu_draw_stats_buffer, max_draws * sizeof(uint32_t),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                "voxel-drawer/gpu-draw-stats-buffer");
+  CREATE_BUFFER(cull_stats_buffer, 2 * MAX_ACTIVE_CAMERAS * sizeof(VX_Cull_Stats),
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT, "voxel-drawer/cull-stats-buffer");
+  CREATE_BUFFER(draw_stats_buffer, 2 * max_draws * sizeof(uint32_t),
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT, "voxel-drawer/draw-stats-buffer");
 #undef CREATE_BUFFER
 
-  VkMemoryRequirements cpu_requirements[4];
+  VkMemoryRequirements cpu_requirements[6];
   vkGetBufferMemoryRequirements(g_device->logical_device,
                                 drawer->vertex_buffer, &cpu_requirements[0]);
   vkGetBufferMemoryRequirements(g_device->logical_device,
@@ -1119,6 +672,10 @@ CreateVoxelBackend_Indirect(void* backend, Video_Memory* cpu_memory, Video_Memor
                                 drawer->index_buffer, &cpu_requirements[2]);
   vkGetBufferMemoryRequirements(g_device->logical_device,
                                 drawer->storage_buffer, &cpu_requirements[3]);
+  vkGetBufferMemoryRequirements(g_device->logical_device,
+                                drawer->cull_stats_buffer, &cpu_requirements[4]);
+  vkGetBufferMemoryRequirements(g_device->logical_device,
+                                drawer->draw_stats_buffer, &cpu_requirements[5]);
   VkMemoryRequirements requirements;
   MergeMemoryRequirements(cpu_requirements, ARR_SIZE(cpu_requirements), &requirements);
   const VkMemoryPropertyFlags required_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
@@ -1134,13 +691,17 @@ CreateVoxelBackend_Indirect(void* backend, Video_Memory* cpu_memory, Video_Memor
     }
   }
 
-  VkMemoryRequirements gpu_requirements[2];
+  VkMemoryRequirements gpu_requirements[4];
   // allocate device local memory for buffers that we will not be accessing from CPU
   vkGetBufferMemoryRequirements(g_device->logical_device,
                                 drawer->indirect_buffer, &gpu_requirements[0]);
   vkGetBufferMemoryRequirements(g_device->logical_device,
                                 drawer->vertex_count_buffer, &gpu_requirements[1]);
-  MergeMemoryRequirements(gpu_requirements, 2, &requirements);
+  vkGetBufferMemoryRequirements(g_device->logical_device,
+                                drawer->gpu_cull_stats_buffer, &gpu_requirements[2]);
+  vkGetBufferMemoryRequirements(g_device->logical_device,
+                                drawer->gpu_draw_stats_buffer, &gpu_requirements[3]);
+  MergeMemoryRequirements(gpu_requirements, ARR_SIZE(gpu_requirements), &requirements);
   err = ReallocateMemoryIfNeeded(gpu_memory, g_deletion_queue, &requirements,
                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                  "voxel-drawer/fast-memory");
@@ -1161,39 +722,56 @@ CreateVoxelBackend_Indirect(void* backend, Video_Memory* cpu_memory, Video_Memor
   BIND_BUFFER(cpu_memory, transform_buffer, cpu_requirements[1], (void**)&drawer->pTransforms);
   BIND_BUFFER(cpu_memory, index_buffer, cpu_requirements[2], (void**)&drawer->pIndices);
   BIND_BUFFER(cpu_memory, storage_buffer, cpu_requirements[3], (void**)&drawer->pDraws);
+  BIND_BUFFER(cpu_memory, cull_stats_buffer, cpu_requirements[4], (void**)&drawer->pCullStats);
+  BIND_BUFFER(cpu_memory, draw_stats_buffer, cpu_requirements[5], (void**)&drawer->pDrawStats);
   BIND_BUFFER(gpu_memory, indirect_buffer, gpu_requirements[0], NULL);
   BIND_BUFFER(gpu_memory, vertex_count_buffer, gpu_requirements[1], NULL);
+  BIND_BUFFER(gpu_memory, gpu_cull_stats_buffer, gpu_requirements[2], NULL);
+  BIND_BUFFER(gpu_memory, gpu_draw_stats_buffer, gpu_requirements[3], NULL);
 #undef BIND_BUFFER
+  memset(drawer->pCullStats, 0, 2 * MAX_ACTIVE_CAMERAS * sizeof(VX_Cull_Stats));
+  memset(drawer->cull_stats, 0, sizeof(drawer->cull_stats));
+  memset(drawer->pDrawStats, 0, 2 * max_draws * sizeof(uint32_t));
+  drawer->draw_entities = PlatformAllocateMemory(2 * max_draws * sizeof(EID));
+  if (drawer->draw_entities == NULL) {
+    LOG_ERROR("indirect backend: failed to allocate %u draw entities", 2 * max_draws);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  drawer->stats_num_draws[0] = drawer->stats_num_draws[1] = 0;
 
   // create descriptor set
-  VkDescriptorSetLayoutBinding bindings[5];
-  const uint32_t count = (drawer->enabled_KHR_draw_indirect_count) ? 5 : 4;
-  for (uint32_t i = 0; i < count; i++)
-    bindings[i] = (VkDescriptorSetLayoutBinding) {
+  VkBuffer buffers[] = { drawer->storage_buffer, drawer->transform_buffer, drawer->indirect_buffer, drawer->vertex_count_buffer, drawer->indirect_buffer, drawer->gpu_cull_stats_buffer, drawer->gpu_draw_stats_buffer };
+  VkDescriptorSetLayoutBinding bindings[ARR_SIZE(buffers)];
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < ARR_SIZE(buffers); i++) {
+    // binding 4 is for draw counts, only shaders using KHR_draw_indirect_count have it
+    if (i == 4 && !drawer->enabled_KHR_draw_indirect_count)
+      continue;
+    bindings[count++] = (VkDescriptorSetLayoutBinding) {
       .binding = i,
       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
       .descriptorCount = 1,
       .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
     };
+  }
   err = AllocateDescriptorSets(bindings, count, &drawer->ds_set, 1, 0, "voxel/cull-set");
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to allocate descriptor set with error %s", ToString_VkResult(err));
     return err;
   }
   // update descriptor set
-  VkWriteDescriptorSet write_sets[5];
-  VkDescriptorBufferInfo buffer_infos[5];
-  VkBuffer buffers[] = { drawer->storage_buffer, drawer->transform_buffer, drawer->indirect_buffer, drawer->vertex_count_buffer, drawer->indirect_buffer };
+  VkWriteDescriptorSet write_sets[ARR_SIZE(buffers)];
+  VkDescriptorBufferInfo buffer_infos[ARR_SIZE(buffers)];
   for (size_t i = 0; i < count; i++) {
     buffer_infos[i] = (VkDescriptorBufferInfo) {
-      .buffer = buffers[i],
+      .buffer = buffers[bindings[i].binding],
       .offset = 0,
       .range  = VK_WHOLE_SIZE
     };
     write_sets[i] = (VkWriteDescriptorSet) {
       .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
       .dstSet          = drawer->ds_set,
-      .dstBinding      = i,
+      .dstBinding      = bindings[i].binding,
       .descriptorCount = 1,
       .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
       .pBufferInfo     = &buffer_infos[i]
@@ -1214,6 +792,35 @@ NewFrameVoxel_Indirect(void* backend)
   }
   drawer->start_transform_offset = drawer->transform_offset;
   drawer->num_vertices = 0;
+
+  // Frame that used this half of the buffer 2 frames ago has finished
+  // executing, see PresentToScreen(). So we read its results without
+  // waiting and reset them for this frame.
+  VX_Cull_Stats* stats = drawer->pCullStats + (g_window->frame_counter & 1) * MAX_ACTIVE_CAMERAS;
+  memcpy(drawer->cull_stats, stats, sizeof(drawer->cull_stats));
+  memset(stats, 0, sizeof(drawer->cull_stats));
+  for (uint32_t i = 0; i < MAX_ACTIVE_CAMERAS; i++) {
+    AddFrameCounter(g_counter_gpu_tested_faces,           drawer->cull_stats[i].tested_faces);
+    AddFrameCounter(g_counter_gpu_frustum_culled_faces,   drawer->cull_stats[i].frustum_culled_faces);
+    AddFrameCounter(g_counter_gpu_occlusion_culled_faces, drawer->cull_stats[i].occlusion_culled_faces);
+    AddFrameCounter(g_counter_gpu_backface_culled_faces,  drawer->cull_stats[i].backface_culled_faces);
+    AddFrameCounter(g_counter_gpu_emitted_draws,          drawer->cull_stats[i].emitted_draws);
+  }
+  // same for draw calls of each view
+  const uint32_t parity = g_window->frame_counter & 1;
+  uint32_t* draw_stats = drawer->pDrawStats + parity * drawer->max_draws;
+  const EID* entities = drawer->draw_entities + parity * drawer->max_draws;
+  uint32_t first = drawer->stats_first_draw[parity];
+  for (uint32_t i = first; i < first + drawer->stats_num_draws[parity]; i++) {
+    // entity might be removed during last 2 frames
+    if (draw_stats[i] > 0 && GetComponent(Voxel_View, entities[i])) {
+      Voxel_Cost* cost = GetVoxelCost(entities[i]);
+      if (cost)
+        cost->gpu_draws += draw_stats[i];
+    }
+    draw_stats[i] = 0;
+  }
+  drawer->stats_num_draws[parity] = 0;
 }
 
 INTERNAL void
@@ -1229,10 +836,14 @@ RegenerateVoxel_Indirect(void* backend, Voxel_View* cached, Voxel_Grid* grid)
   Voxel_Backend_Indirect* drawer = backend;
 
   // skip this vertex if we're exceeding threshold...
-  if (drawer->num_vertices >= VOXEL_VERTEX_THRESHOLD)
+  if (drawer->num_vertices >= VOXEL_VERTEX_THRESHOLD) {
+    AddFrameCounter(g_counter_voxel_remesh_queue, 1);
     return;
+  }
 
+  uint64_t start_time = PlatformGetPerformanceCounter();
   grid->last_hash = grid->hash;
+  size_t first_vertex = drawer->vertex_offset;
   uint32_t base_index = 0;
   VX_Draw_Data* draw = &drawer->pDraws[drawer->draw_offset++];
   CalculateVoxelGridSize(grid, &draw->half_size);
@@ -1256,6 +867,7 @@ RegenerateVoxel_Indirect(void* backend, Voxel_View* cached, Voxel_Grid* grid)
     grid->offsets[i] = draw->vertex_count[i];
     drawer->num_vertices += draw->vertex_count[i];
   }
+  CountRemeshedVertices(cached->grid, drawer->vertex_offset - first_vertex, start_time);
 }
 
 INTERNAL void
@@ -1286,7 +898,13 @@ PushMeshVoxel_Indirect(void* backend, EID entity)
       draw->vertex_count[i] = grid->offsets[i];
     }
   }
+  uint32_t parity = g_window->frame_counter & 1;
+  drawer->draw_entities[parity * drawer->max_draws + drawer->draw_offset-1] = entity;
+  Voxel_Cost* cost = GetVoxelCost(entity);
+  if (cost)
+    cost->frames_drawn++;
   drawer->transform_offset++;
+  AddFrameCounter(g_counter_voxel_upload_bytes, sizeof(Transform) + sizeof(VX_Draw_Data));
 }
 
 INTERNAL uint32_t
@@ -1350,15 +968,33 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
 {
   Voxel_Backend_Indirect* drawer = backend;
   Compute_Pipeline* prog = NULL;
+  const uint32_t parity = g_window->frame_counter & 1;
+  const uint32_t stats_offset = parity * MAX_ACTIVE_CAMERAS;
+  // remember which slots we cull, so NewFrameVoxel_Indirect() knows what to read
+  const uint32_t first_draw = drawer->draw_offset - num_draws;
+  drawer->stats_first_draw[parity] = first_draw;
+  drawer->stats_num_draws[parity] = num_draws;
+  // statistics are summed up from 0
+  vkCmdFillBuffer(cmd, drawer->gpu_cull_stats_buffer, stats_offset * sizeof(VX_Cull_Stats),
+                  MAX_ACTIVE_CAMERAS * sizeof(VX_Cull_Stats), 0);
+  if (num_draws > 0) {
+    vkCmdFillBuffer(cmd, drawer->gpu_draw_stats_buffer, first_draw * sizeof(uint32_t),
+                    num_draws * sizeof(uint32_t), 0);
+  }
+  // fill draw counts with 0
+  const uint32_t dst_offset = MAX_ACTIVE_CAMERAS * num_draws * 3 * 32;
+  const uint32_t uint_stride = 16;
   if (drawer->enabled_KHR_draw_indirect_count) {
-    // fill draw counts with 0
-    uint32_t dst_offset = MAX_ACTIVE_CAMERAS * num_draws * 3 * 32;
-    const uint32_t uint_stride = 16;
     vkCmdFillBuffer(cmd, drawer->indirect_buffer, dst_offset, MAX_ACTIVE_CAMERAS * uint_stride, 0);
-    cmdExecutionBarrier(cmd,
-                        VK_PIPELINE_STAGE_TRANSFER_BIT,
-                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
+  }
+  VkMemoryBarrier fill_barrier = {
+    .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT,
+  };
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &fill_barrier, 0, NULL, 0, NULL);
+  if (drawer->enabled_KHR_draw_indirect_count) {
     struct {
       Mat4 projview_matrix;
       Vec3 camera_front;
@@ -1368,6 +1004,7 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
       uint32_t out_offset;
       uint32_t in_offset;
       uint32_t num_draws;
+      uint32_t stats_index;
     } push_constant;
 
     EID last = ENTITY_NIL;
@@ -1389,8 +1026,9 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
       push_constant.camera_position = cameras[i].position;
       push_constant.pass_id = dst_offset / uint_stride + Log2_u32(cameras[i].cull_mask);
       push_constant.out_offset = Log2_u32(cameras[i].cull_mask) * num_draws;
-      push_constant.in_offset = drawer->draw_offset - num_draws;
+      push_constant.in_offset = first_draw;
       push_constant.num_draws = num_draws;
+      push_constant.stats_index = stats_offset + Log2_u32(cameras[i].cull_mask);
       vkCmdPushConstants(cmd, prog->layout, VK_SHADER_STAGE_COMPUTE_BIT,
                          0, sizeof(push_constant), &push_constant);
       vkCmdDispatch(cmd, (num_draws+63) / 64, 1, 1);
@@ -1404,6 +1042,7 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
       uint32_t out_offset;
       uint32_t in_offset;
       uint32_t num_draws;
+      uint32_t stats_index;
     } push_constant;
     EID last = ENTITY_NIL;
     for (uint32_t i = 0; i < num_cameras; i++) {
@@ -1423,8 +1062,9 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
       push_constant.camera_front = cameras[i].front;
       push_constant.camera_position = cameras[i].position;
       push_constant.out_offset = Log2_u32(cameras[i].cull_mask) * num_draws;
-      push_constant.in_offset = drawer->draw_offset - num_draws;
+      push_constant.in_offset = first_draw;
       push_constant.num_draws = num_draws;
+      push_constant.stats_index = stats_offset + Log2_u32(cameras[i].cull_mask);
       vkCmdPushConstants(cmd, prog->layout, VK_SHADER_STAGE_COMPUTE_BIT,
                          0, sizeof(push_constant), &push_constant);
       vkCmdDispatch(cmd, (num_draws+63) / 64, 1, 1);
@@ -1433,13 +1073,58 @@ CullPass_Indirect(void* backend, VkCommandBuffer cmd, const Camera* cameras, uin
   cmdExecutionBarrier(cmd,
                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+  // copy statistics to host visible memory, CPU reads them once
+  // frame's fence is signaled
+  VkMemoryBarrier stats_barrier = {
+    .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+  };
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0, 1, &stats_barrier, 0, NULL, 0, NULL);
+  VkBufferCopy cull_stats_region = {
+    .srcOffset = stats_offset * sizeof(VX_Cull_Stats),
+    .dstOffset = stats_offset * sizeof(VX_Cull_Stats),
+    .size      = MAX_ACTIVE_CAMERAS * sizeof(VX_Cull_Stats),
+  };
+  vkCmdCopyBuffer(cmd, drawer->gpu_cull_stats_buffer, drawer->cull_stats_buffer, 1, &cull_stats_region);
+  if (num_draws > 0) {
+    VkBufferCopy draw_stats_region = {
+      .srcOffset = first_draw * sizeof(uint32_t),
+      .dstOffset = (parity * drawer->max_draws + first_draw) * sizeof(uint32_t),
+      .size      = num_draws * sizeof(uint32_t),
+    };
+    vkCmdCopyBuffer(cmd, drawer->gpu_draw_stats_buffer, drawer->draw_stats_buffer, 1, &draw_stats_region);
+  }
+  VkBufferMemoryBarrier host_barriers[2];
+  host_barriers[0] = (VkBufferMemoryBarrier) {
+    .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer              = drawer->cull_stats_buffer,
+    .offset              = cull_stats_region.dstOffset,
+    .size                = cull_stats_region.size,
+  };
+  host_barriers[1] = host_barriers[0];
+  host_barriers[1].buffer = drawer->draw_stats_buffer;
+  host_barriers[1].offset = parity * drawer->max_draws * sizeof(uint32_t);
+  host_barriers[1].size   = drawer->max_draws * sizeof(uint32_t);
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 0, NULL, ARR_SIZE(host_barriers), host_barriers, 0, NULL);
 }
 
 INTERNAL void
 DestroyVoxel_Indirect(void* backend, Deletion_Queue* dq)
 {
   Voxel_Backend_Indirect* drawer = backend;
+  PlatformFreeMemory(drawer->draw_entities);
   if (dq == NULL) {
+    vkDestroyBuffer(g_device->logical_device, drawer->gpu_draw_stats_buffer, NULL);
+    vkDestroyBuffer(g_device->logical_device, drawer->gpu_cull_stats_buffer, NULL);
+    vkDestroyBuffer(g_device->logical_device, drawer->draw_stats_buffer, NULL);
+    vkDestroyBuffer(g_device->logical_device, drawer->cull_stats_buffer, NULL);
     vkDestroyBuffer(g_device->logical_device, drawer->vertex_count_buffer, NULL);
     vkDestroyBuffer(g_device->logical_device, drawer->indirect_buffer, NULL);
     vkDestroyBuffer(g_device->logical_device, drawer->storage_buffer, NULL);
@@ -1447,6 +1132,10 @@ DestroyVoxel_Indirect(void* backend, Deletion_Queue* dq)
     vkDestroyBuffer(g_device->logical_device, drawer->transform_buffer, NULL);
     vkDestroyBuffer(g_device->logical_device, drawer->vertex_buffer, NULL);
   } else {
+    AddForDeletion(dq, (uint64_t)drawer->gpu_draw_stats_buffer, VK_OBJECT_TYPE_BUFFER);
+    AddForDeletion(dq, (uint64_t)drawer->gpu_cull_stats_buffer, VK_OBJECT_TYPE_BUFFER);
+    AddForDeletion(dq, (uint64_t)drawer->draw_stats_buffer, VK_OBJECT_TYPE_BUFFER);
+    AddForDeletion(dq, (uint64_t)drawer->cull_stats_buffer, VK_OBJECT_TYPE_BUFFER);
     AddForDeletion(dq, (uint64_t)drawer->vertex_count_buffer, VK_OBJECT_TYPE_BUFFER);
     AddForDeletion(dq, (uint64_t)drawer->indirect_buffer, VK_OBJECT_TYPE_BUFFER);
     AddForDeletion(dq, (uint64_t)drawer->storage_buffer, VK_OBJECT_TYPE_BUFFER);
@@ -1560,6 +1249,19 @@ CreateVoxelDrawer(Voxel_Drawer* drawer, uint32_t max_vertices, uint32_t max_draw
     memset(&drawer->pipeline_stats_shadow,   0, sizeof(Pipeline_Stats));
   }
 
+  g_counter_voxel_vertices     = RegisterFrameCounter("vertices meshed");
+  g_counter_voxel_remeshes     = RegisterFrameCounter("grids remeshed");
+  g_counter_voxel_remesh_queue = RegisterFrameCounter("remesh queue");
+  g_counter_voxel_draws        = RegisterFrameCounter("draws pushed");
+  g_counter_voxel_upload_bytes = RegisterFrameCounter("bytes uploaded");
+  g_counter_voxel_draw_calls   = RegisterFrameCounter("voxel draw calls");
+  // filled by GPU culling and arrive 2 frames late
+  g_counter_gpu_tested_faces           = RegisterFrameCounter("gpu faces tested");
+  g_counter_gpu_frustum_culled_faces   = RegisterFrameCounter("gpu faces frustum culled");
+  g_counter_gpu_occlusion_culled_faces = RegisterFrameCounter("gpu faces occlusion culled");
+  g_counter_gpu_backface_culled_faces  = RegisterFrameCounter("gpu faces backface culled");
+  g_counter_gpu_emitted_draws          = RegisterFrameCounter("gpu draws emitted");
+
   g_voxel_pipeline_colored           = CreateEntity(g_ecs);
   g_voxel_pipeline_shadow            = CreateEntity(g_ecs);
   g_voxel_pipeline_compute_ortho     = CreateEntity(g_ecs);
@@ -1594,6 +1296,16 @@ NewVoxelDrawerFrame(Voxel_Drawer* drawer)
   }
 }
 
+// return: per camera culling statistics from 2 frames ago, indexed by
+// Log2_u32(cull_mask). NULL if backend doesn't cull on GPU.
+INTERNAL const VX_Cull_Stats*
+GetVoxelCullStats(Voxel_Drawer* drawer)
+{
+  if (drawer->cull_pass_func != CullPass_Indirect)
+    return NULL;
+  return drawer->backend.indirect.cull_stats;
+}
+
 INTERNAL void
 ClearVoxelDrawerCache(Voxel_Drawer* drawer)
 {
@@ -1605,14 +1317,17 @@ PushMeshToVoxelDrawer(Voxel_Drawer* drawer, EID entity)
 {
   drawer->push_mesh_func(&drawer->backend, entity);
   drawer->num_draws++;
+  AddFrameCounter(g_counter_voxel_draws, 1);
 }
 
 INTERNAL uint32_t
 DrawVoxels(Voxel_Drawer* drawer, VkCommandBuffer cmd, const Camera* mesh_pass,
            uint32_t num_sets, VkDescriptorSet* sets)
 {
-  return drawer->render_voxels_func(&drawer->backend, cmd, mesh_pass,
-                                    num_sets, sets, drawer->num_draws);
+  uint32_t draw_calls = drawer->render_voxels_func(&drawer->backend, cmd, mesh_pass,
+                                                   num_sets, sets, drawer->num_draws);
+  AddFrameCounter(g_counter_voxel_draw_calls, draw_calls);
+  return draw_calls;
 }
 
 INTERNAL uint32_t
@@ -1702,7 +1417,7 @@ PipelineVoxelVertices2(const VkVertexInputAttributeDescription** attributes, uin
   *num_bindings = (using_colors ? 3 : 2);
 }
 
-// calculate oriented bounding box's corners
+// calculate oriented bounding box
 INTERNAL void
 CalculateVoxelGridOBB(const Voxel_Grid* grid, const Transform* transform, OBB* obb)
 {
@@ -1810,41 +1525,6 @@ CreateVoxelPipelineShadow(Pipeline_Desc* description)
 }
 
 
-/// Voxel generation (procedural or not)
-
-INTERNAL void
-GenerateVoxelSphere(Voxel_Grid* grid, int radius, Voxel fill)
-{
-  if ((int)grid->width != radius*2+1 ||
-      (int)grid->depth != radius*2+1 ||
-      (int)grid->height != radius*2+1) {
-    LOG_WARN("radius doesn't match grid's extents");
-    return;
-  }
-  for (int z = 0; z < radius*2+1; z++)
-    for (int y = 0; y < radius*2+1; y++)
-      for (int x = 0; x < radius*2+1; x++) {
-        int xr = abs(x-radius);
-        int yr = abs(y-radius);
-        int zr = abs(z-radius);
-        if (xr*xr + yr*yr + zr*zr <= radius*radius) {
-          GetInVoxelGrid(grid, x, y, z) = fill;
-        }
-      }
-}
-
-INTERNAL void
-FillVoxelGrid(Voxel_Grid* grid, Voxel fill)
-{
-#if VX_USE_BLOCKS
-  // NOTE: this may be wrong as padding in blocks get filled too
-  // this would produce incorrect hashes. But I literally don't care😎
-  memset(grid->data->ptr, fill, VoxelGridBytes(grid));
-#else
-  memset(grid->data->ptr, fill, VoxelGridBytes(grid));
-#endif
-}
-
 /**
    This should not be used.
    I made this for debugging voxel blocks.
@@ -1875,9 +1555,11 @@ DebugDrawVoxelBlocks(Debug_Drawer* debug_drawer, const Voxel_Grid* grid, const O
   float sx = 4.0f / grid->width;
   float sy = 4.0f / grid->height;
   float sz = 4.0f / grid->depth;
+  Vec3 corners[8];
+  GetCornersOBB(obb, corners);
   for (size_t i = 0; i < ARR_SIZE(indices); i += 2) {
-    Vec3 a = obb->corners[indices[i]];
-    Vec3 d = VEC3_SUB(obb->corners[indices[i+1]], obb->corners[indices[i]]);
+    Vec3 a = corners[indices[i]];
+    Vec3 d = VEC3_SUB(corners[indices[i+1]], corners[indices[i]]);
     d.x *= sx;
     d.y *= sy;
     d.z *= sz;
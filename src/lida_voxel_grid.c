@@ -0,0 +1,785 @@
+/*
+  lida_voxel_grid.c
+
+  CPU side of voxels: grids, palettes, mesh generation and loading.
+  Nothing here touches Vulkan, so benchmarks and tools can include
+  this file too. Rendering lives in lida_voxel.c.
+ */
+
+#define VX_USE_INDICES 1
+#define VX_USE_BLOCKS 0
+#define MAX_VOXEL_PALETTES 1024
+
+// 16 bytes
+typedef struct {
+
+  Vec3 position;
+  uint32_t color;
+
+} Vertex_X3C;
+
+typedef uint8_t Voxel;
+
+typedef Voxel Voxel_Block[64];
+
+// stores voxels as plain 3D array
+typedef struct {
+
+  Allocation* data;
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  uint64_t hash;
+  // index in palette table, see Voxel_Palette_Table
+  uint32_t palette;
+  uint64_t last_hash;
+  uint32_t first_vertex;
+  uint32_t offsets[6];
+
+} Voxel_Grid;
+DECLARE_COMPONENT(Voxel_Grid);
+
+// 1 Kb
+typedef struct {
+
+  uint32_t colors[256];
+
+} Voxel_Palette;
+
+// Palettes are shared between voxel grids, identical palettes are
+// stored only once. Palettes are stored contiguously so the whole
+// table can be copied to a GPU buffer in one go.
+typedef struct {
+
+  Voxel_Palette palettes[MAX_VOXEL_PALETTES];
+  uint64_t hashes[MAX_VOXEL_PALETTES];
+  uint32_t ref_counts[MAX_VOXEL_PALETTES];
+  // number of used slots, including free ones
+  uint32_t count;
+  // incremented on every change, useful for detecting when we need
+  // to upload table again
+  uint32_t version;
+
+} Voxel_Palette_Table;
+
+
+#define VOX_BLOCK_DIM(x) ((x)>>2)
+#define VOX_DIM_IN_VOXEL(x) ((x)&3)
+#define GetVoxelBlock(grid, x, y, z) ((Voxel_Block*)(grid)->data->ptr)[VOX_BLOCK_DIM(x) + VOX_BLOCK_DIM(y)*VOX_BLOCK_DIM((grid)->width) + VOX_BLOCK_DIM(z)*VOX_BLOCK_DIM((grid)->width)*VOX_BLOCK_DIM((grid)->height)]
+
+#if VX_USE_BLOCKS
+// #define GetInVoxelGrid(grid, x, y, z) (GetVoxelBlock(grid, x, y, z))[VOX_DIM_IN_VOXEL(x) + (VOX_DIM_IN_VOXEL(y)<<2) + (VOX_DIM_IN_VOXEL(z)<<4)]
+
+INTERNAL Voxel*
+GetInVoxelGridImpl(const Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z)
+{
+  Voxel* start = grid->data->ptr;
+  uint32_t dimw = ALIGN_TO(grid->width, 4);
+  dimw = VOX_BLOCK_DIM(dimw);
+  uint32_t dimh = ALIGN_TO(grid->height, 4);
+  dimh = VOX_BLOCK_DIM(dimh);
+  Voxel* block = start + (VOX_BLOCK_DIM(x) + VOX_BLOCK_DIM(y)*dimw + dimw*dimh*VOX_BLOCK_DIM(z))*64;
+  return block + (VOX_DIM_IN_VOXEL(x) + VOX_DIM_IN_VOXEL(y)*4 + VOX_DIM_IN_VOXEL(z)*16);
+}
+#define GetInVoxelGrid(grid, x, y, z) (*GetInVoxelGridImpl(grid, x, y, z))
+
+#else
+// NOTE: this doesn't do bounds checking
+// NOTE: setting a voxel value with this macro is unsafe, hash won't be correct,
+// consider using SetInVoxelGrid
+#define GetInVoxelGrid(grid, x, y, z) ((Voxel*)(grid)->data->ptr)[(x) + (y)*(grid)->width + (z)*(grid)->width*(grid)->height]
+#endif
+
+Allocator* g_vox_allocator;
+Voxel_Palette_Table* g_vox_palettes;
+
+// TODO: compress voxels on disk using RLE(Run length Encoding)
+
+
+
+/// Voxel palettes
+
+// palette with index 0 is the default one, it's never freed
+INTERNAL void
+InitVoxelPalettes(Voxel_Palette_Table* table)
+{
+  memset(table->palettes[0].colors, 0, sizeof(Voxel_Palette));
+  table->hashes[0] = HashMemory64(table->palettes[0].colors, sizeof(Voxel_Palette));
+  table->ref_counts[0] = 1;
+  table->count = 1;
+  table->version = 0;
+}
+
+// return: index of palette in table. If there's an identical palette
+// then it's index is returned. 0 is returned if out of space.
+INTERNAL uint32_t
+AddVoxelPalette(Voxel_Palette_Table* table, const uint32_t* colors)
+{
+  uint64_t hash = HashMemory64(colors, sizeof(Voxel_Palette));
+  uint32_t free_slot = UINT32_MAX;
+  for (uint32_t i = 0; i < table->count; i++) {
+    if (table->ref_counts[i] == 0) {
+      if (free_slot == UINT32_MAX)
+        free_slot = i;
+      continue;
+    }
+    if (table->hashes[i] == hash &&
+        memcmp(table->palettes[i].colors, colors, sizeof(Voxel_Palette)) == 0) {
+      if (i > 0)
+        table->ref_counts[i]++;
+      return i;
+    }
+  }
+  if (free_slot == UINT32_MAX) {
+    if (table->count == MAX_VOXEL_PALETTES) {
+      LOG_WARN("out of voxel palettes, using default one");
+      return 0;
+    }
+    free_slot = table->count++;
+  }
+  memcpy(table->palettes[free_slot].colors, colors, sizeof(Voxel_Palette));
+  table->hashes[free_slot] = hash;
+  table->ref_counts[free_slot] = 1;
+  table->version++;
+  return free_slot;
+}
+
+INTERNAL void
+ReleaseVoxelPalette(Voxel_Palette_Table* table, uint32_t palette)
+{
+  if (palette == 0 || palette >= table->count)
+    return;
+  Assert(table->ref_counts[palette] > 0);
+  table->ref_counts[palette]--;
+  // shrink table if free slots are at the end
+  while (table->count > 1 && table->ref_counts[table->count-1] == 0) {
+    table->count--;
+  }
+}
+
+INTERNAL const uint32_t*
+GetVoxelPalette(const Voxel_Palette_Table* table, uint32_t palette)
+{
+  return table->palettes[palette].colors;
+}
+
+INTERNAL uint32_t
+NumUniqueVoxelPalettes(const Voxel_Palette_Table* table)
+{
+  uint32_t ret = 0;
+  for (uint32_t i = 0; i < table->count; i++)
+    if (table->ref_counts[i])
+      ret++;
+  return ret;
+}
+
+#define GetVoxelGridPalette(grid) GetVoxelPalette(g_vox_palettes, (grid)->palette)
+
+
+/// Voxel grid
+
+// CLEANUP: do we really need this function? I think it's better to
+// just recreate voxel grids when needed.
+INTERNAL int
+AllocateVoxelGrid(Allocator* allocator, Voxel_Grid* grid, uint32_t w, uint32_t h, uint32_t d)
+{
+#if VX_USE_BLOCKS
+  uint32_t wa = ALIGN_TO(w, 4);
+  uint32_t ha = ALIGN_TO(h, 4);
+  uint32_t da = ALIGN_TO(d, 4);
+  grid->data = DoAllocation(allocator, wa*ha*da, "voxel-grid");
+  if (grid->data == NULL) {
+    LOG_WARN("out of memory");
+    return -1;
+  }
+  memset(grid->data->ptr, 0, wa*ha*da);
+  grid->width = w;
+  grid->height = h;
+  grid->depth = d;
+  grid->palette = 0;
+  grid->first_vertex = UINT32_MAX;
+  return 0;
+#else
+  grid->data = DoAllocation(allocator, w*h*d, "voxel-grid");
+  if (grid->data == NULL) {
+    LOG_WARN("out of memory");
+    return -1;
+  }
+  // In some cases this memset may be redundant.
+  // Do we need to introduce some kind of boolean argument for this function?
+  memset(grid->data->ptr, 0, w*h*d);
+  grid->width = w;
+  grid->height = h;
+  grid->depth = d;
+  grid->palette = 0;
+  grid->first_vertex = UINT32_MAX;
+  return 0;
+#endif
+}
+
+INTERNAL void
+FreeVoxelGrid(Allocator* allocator, Voxel_Grid* grid)
+{
+  if (grid->data) {
+    FreeAllocation(allocator, grid->data);
+    grid->data = NULL;
+    ReleaseVoxelPalette(g_vox_palettes, grid->palette);
+    grid->palette = 0;
+  }
+}
+
+// copy on write: other grids sharing old palette are not affected
+INTERNAL void
+SetVoxelGridPalette(Voxel_Grid* grid, const uint32_t* colors)
+{
+  uint32_t old = grid->palette;
+  grid->palette = AddVoxelPalette(g_vox_palettes, colors);
+  ReleaseVoxelPalette(g_vox_palettes, old);
+}
+
+/**
+   Get number of bytes occupied by a voxel grid's data.
+ */
+INTERNAL uint32_t
+VoxelGridBytes(const Voxel_Grid* grid)
+{
+#if VX_USE_BLOCKS
+  uint32_t wa = ALIGN_TO(grid->width, 4);
+  uint32_t ha = ALIGN_TO(grid->height, 4);
+  uint32_t da = ALIGN_TO(grid->depth, 4);
+  return wa*ha*da;
+#else
+  return grid->width * grid->height * grid->depth;
+#endif
+}
+
+/**
+   Voxel grid's hash is a sum of hashes of its 8-byte words (see
+   HashAccumulate64), so it only depends on grid's contents.
+ */
+INTERNAL void
+RehashVoxelGrid(Voxel_Grid* grid)
+{
+  grid->hash = HashAccumulate64(grid->data->ptr, VoxelGridBytes(grid), 0);
+}
+
+INTERNAL uint64_t
+VoxelGridRangeHash(const Voxel_Grid* grid, uint32_t offset, uint32_t bytes)
+{
+  uint32_t total = VoxelGridBytes(grid);
+  uint32_t first = offset & ~7u;
+  uint32_t last = ALIGN_TO(offset + bytes, 8);
+  if (last > total)
+    last = total;
+  return HashAccumulate64((const uint8_t*)grid->data->ptr + first, last - first, first / 8);
+}
+
+/**
+   Update hash after modifying bytes [offset, offset+bytes) of grid's
+   data without rehashing whole grid: call BeginVoxelGridEdit() before
+   the edit and EndVoxelGridEdit() with the same range after it.
+ */
+INTERNAL void
+BeginVoxelGridEdit(Voxel_Grid* grid, uint32_t offset, uint32_t bytes)
+{
+  grid->hash -= VoxelGridRangeHash(grid, offset, bytes);
+}
+
+INTERNAL void
+EndVoxelGridEdit(Voxel_Grid* grid, uint32_t offset, uint32_t bytes)
+{
+  grid->hash += VoxelGridRangeHash(grid, offset, bytes);
+}
+
+INTERNAL void
+SetInVoxelGrid(Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z, Voxel vox)
+{
+  Voxel* voxel = &GetInVoxelGrid(grid, x, y, z);
+  uint32_t offset = (uint32_t)(voxel - (Voxel*)grid->data->ptr);
+  BeginVoxelGridEdit(grid, offset, 1);
+  *voxel = vox;
+  EndVoxelGridEdit(grid, offset, 1);
+}
+
+GLOBAL const Vec3 vox_positions[] = {
+#if VX_USE_INDICES
+  // -x
+  {0.0f, 1.0f, 1.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f},
+  {0.0f, 0.0f, 1.0f},
+  // +x
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 0.0f, 1.0f},
+  {1.0f, 0.0f, 0.0f},
+  // -y
+  {1.0f, 0.0f, 0.0f},
+  {1.0f, 0.0f, 1.0f},
+  {0.0f, 0.0f, 1.0f},
+  {0.0f, 0.0f, 0.0f},
+  // +y
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 1.0f, 0.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 1.0f, 1.0f},
+  // -z
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f},
+  {0.0f, 1.0f, 0.0f},
+  // +z
+  {1.0f, 0.0f, 1.0f},
+  {1.0f, 1.0f, 1.0f},
+  {0.0f, 1.0f, 1.0f},
+  {0.0f, 0.0f, 1.0f},
+#else
+  // -x
+  {0.0f, 1.0f, 1.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f},
+  {0.0f, 0.0f, 1.0f},
+  {0.0f, 1.0f, 1.0f},
+  // +x
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 0.0f, 0.0f},
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 0.0f, 1.0f},
+  // -y
+  {0.0f, 0.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {1.0f, 0.0f, 1.0f},
+  {1.0f, 0.0f, 1.0f},
+  {0.0f, 0.0f, 1.0f},
+  {0.0f, 0.0f, 0.0f},
+  // +y
+  {0.0f, 1.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 1.0f, 1.0f},
+  // -z
+  {0.0f, 0.0f, 0.0f},
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {1.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f},
+  {0.0f, 1.0f, 0.0f},
+  // +z
+  {0.0f, 0.0f, 1.0f},
+  {1.0f, 0.0f, 1.0f},
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 1.0f, 1.0f},
+  {0.0f, 1.0f, 1.0f},
+  {0.0f, 0.0f, 1.0f}
+#endif
+};
+
+GLOBAL const uint32_t vox_indices[6] = { 0, 1, 2, 2, 3, 0 };
+
+GLOBAL const iVec3 vox_normals[6] = {
+  {-1, 0, 0},
+  {1, 0, 0},
+  {0, -1, 0},
+  {0, 1, 0},
+  {0, 0, -1},
+  {0, 0, 1}
+};
+
+GLOBAL const Vec3 f_vox_normals[6] = {
+  {-1.0f, 0.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {0.0f, -1.0f, 0.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, -1.0f},
+  {0.0f, 0.0f, 1.0f}
+};
+
+// return: inv_size
+INTERNAL float
+CalculateVoxelGridSize(const Voxel_Grid* grid, Vec3* half_size)
+{
+  float inv_size;
+  // TODO: we currently have no Min() function defined... shame
+  if (grid->width <= grid->height && grid->height <= grid->depth) {
+    inv_size = 1.0f / (float)grid->width;
+  } else if (grid->height <= grid->width && grid->width <= grid->depth) {
+    inv_size = 1.0f / (float)grid->height;
+  } else {
+    inv_size = 1.0f / (float)grid->depth;
+  }
+  half_size->x = inv_size * 0.5f * (float)grid->width;
+  half_size->y = inv_size * 0.5f * (float)grid->height;
+  half_size->z = inv_size * 0.5f * (float)grid->depth;
+  return inv_size;
+}
+
+INTERNAL uint32_t
+GenerateVoxelGridMeshNaive(const Voxel_Grid* grid, Vertex_X3C* vertices, int face
+#if VX_USE_INDICES
+                           , uint32_t base_index, uint32_t* indices
+#endif
+                           )
+{
+  Vertex_X3C* const first_vertex = vertices;
+  const uint32_t* palette = GetVoxelGridPalette(grid);
+  Vec3 half_size;
+  float inv_size = CalculateVoxelGridSize(grid, &half_size);
+  int offsetX = vox_normals[face].x;
+  int offsetY = vox_normals[face].y;
+  int offsetZ = vox_normals[face].z;
+  // yes, we just loop over all voxels
+  // note how we first iterate over x for better cache locality
+  for (uint32_t z = 0; z < grid->depth; z++)
+    for (uint32_t y = 0; y < grid->height; y++)
+      for (uint32_t x = 0; x < grid->width; x++) {
+        Voxel voxel = GetInVoxelGrid(grid, x, y, z);
+        Voxel near_voxel;
+        if (x+offsetX < grid->width &&
+            y+offsetY < grid->height &&
+            z+offsetZ < grid->depth) {
+          near_voxel = GetInVoxelGrid(grid, x+offsetX, y+offsetY, z+offsetZ);
+        } else {
+          near_voxel = 0;
+        }
+        if (// check if voxel is not air
+            voxel &&
+            // check if near voxel is air
+            near_voxel == 0) {
+          Vec3 pos = VEC3_CREATE((float)x, (float)y, (float)z);
+#if VX_USE_INDICES
+           // write 4 vertices and 6 indices for this quad
+          for (uint32_t i = 0; i < 6; i++) {
+            *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
+          }
+          for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
+            *(vertices++) = (Vertex_X3C) {
+              .position.x = (pos.x + vox_positions[face*4+vert_index].x) * inv_size - half_size.x,
+              .position.y = (pos.y + vox_positions[face*4+vert_index].y) * inv_size - half_size.y,
+              .position.z = (pos.z + vox_positions[face*4+vert_index].z) * inv_size - half_size.z,
+              .color = palette[voxel],
+            };
+          }
+#else
+          for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
+            *(vertices++) = (Vertex_X3C) {
+              .position.x = (pos.x + vox_positions[face*6 + vert_index].x) * inv_size - half_size.x,
+              .position.y = (pos.y + vox_positions[face*6 + vert_index].y) * inv_size - half_size.y,
+              .position.z = (pos.z + vox_positions[face*6 + vert_index].z) * inv_size - half_size.z,
+              .color = palette[voxel],
+            };
+          }
+#endif
+        }
+      }
+  LOG_DEBUG("wrote %u vertices", (uint32_t)(vertices - first_vertex));
+  return vertices - first_vertex;
+}
+
+INTERNAL Voxel
+GetInVoxelGridChecked(const Voxel_Grid* grid, uint32_t x, uint32_t y, uint32_t z)
+{
+  if (x < grid->width &&
+      y < grid->height &&
+      z < grid->depth) {
+    return GetInVoxelGrid(grid, x, y, z);
+  }
+  return 0;
+}
+
+INTERNAL uint32_t
+GenerateVoxelGridMeshGreedy(const Voxel_Grid* grid, Vertex_X3C* vertices, int face
+#if VX_USE_INDICES
+                            , uint32_t base_index, uint32_t* indices
+#endif
+                            )
+{
+  PROFILE_FUNCTION();
+  // uint32_t start_time = PlatformGetTicks();
+  // TODO: my dream is to make this function execute fast, processing
+  // 4 or 8 voxels at same time
+  Vertex_X3C* const first_vertex = vertices;
+  const uint32_t* palette = GetVoxelGridPalette(grid);
+  Vec3 half_size;
+  float inv_size = CalculateVoxelGridSize(grid, &half_size);
+  const uint32_t dims[3] = { grid->width, grid->height, grid->depth };
+  const int d = face >> 1;
+  const int u = (d+1)%3, v = (d+2)%3;
+#if 0
+  // iterate each block
+  Voxel* block = (Voxel*)grid->data->ptr;
+  for (uint32_t gz = 0; gz < grid->depth; gz += 4)
+    for (uint32_t gy = 0; gy < grid->height; gy += 4)
+      for (uint32_t gx = 0; gx < grid->width; gx += 4) {
+        for (uint32_t layer = 0; layer < 4; layer++) {
+          uint16_t merged_mask = 0;
+          // try to merge voxels in block
+          for (uint32_t j = 0; j < 4; j++)
+            for (uint32_t i = 0; i < 4; i++) {
+              if (merged_mask & (1 << (i + j*4)))
+                continue;
+              int pos[3];
+              pos[d] = layer;
+              pos[u] = i;
+              pos[v] = j;
+              Voxel start_voxel = block[pos[0] + (pos[1] << 2) + (pos[2] << 4)];
+              if (start_voxel == 0) {
+                // skip air
+                continue;
+              }
+              const int start_pos[3] = { pos[0], pos[1], pos[2] };
+              int min_i = 4;
+              while (pos[v] < 4) {
+                pos[u] = i;
+                // TODO: try to use local adressation
+                if (block[pos[0] + (pos[1]<<2) + (pos[2]<<4)] != start_voxel ||
+                    GetInVoxelGridChecked(grid,
+                                          pos[0] + gx + vox_normals[face].x,
+                                          pos[1] + gy + vox_normals[face].y,
+                                          pos[2] + gz + vox_normals[face].z) != 0)
+                  break;
+                pos[u]++;
+                while (pos[u] < min_i &&
+                       block[pos[0] + (pos[1]<<2) + (pos[2]<<4)] == start_voxel &&
+                       GetInVoxelGridChecked(grid,
+                                             pos[0] + gx + vox_normals[face].x,
+                                             pos[1] + gy + vox_normals[face].y,
+                                             pos[2] + gz + vox_normals[face].z) == 0) {
+                  pos[u]++;
+                }
+                if (pos[u] < min_i) min_i = pos[u];
+                pos[v]++;
+              }
+              if (min_i == start_pos[u] ||
+                  pos[v] == start_pos[v]) {
+                continue;
+              }
+              int offset[3] = { 0 };
+              offset[u] = min_i - start_pos[u];
+              offset[v] = pos[v] - start_pos[v];
+#if VX_USE_INDICES
+              // write 4 vertices and 6 indices for this quad
+              for (uint32_t i = 0; i < 6; i++) {
+                *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
+              }
+              for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
+                int vert_pos[3] = { gz + start_pos[0] + offset[0] * (int)vox_positions[face*4 + vert_index].x,
+                                    gy + start_pos[1] + offset[1] * (int)vox_positions[face*4 + vert_index].y,
+                                    gx + start_pos[2] + offset[2] * (int)vox_positions[face*4 + vert_index].z };
+                vert_pos[d] += face & 1;
+                *(vertices++) = (Vertex_X3C) {
+                  .position.x = vert_pos[0] * inv_size - half_size.x,
+                  .position.y = vert_pos[1] * inv_size - half_size.y,
+                  .position.z = vert_pos[2] * inv_size - half_size.z,
+                  .color = palette[start_voxel]
+                };
+              }
+#else
+              // write 6 vertices for this quad
+              for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
+                int vert_pos[3] = { gz + (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*6 + vert_index].x,
+                                    gy + (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*6 + vert_index].y,
+                                    gx + (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*6 + vert_index].z };
+                vert_pos[d] += face & 1;
+                vertices[vert_index].position.x = vert_pos[0] * inv_size - half_size.x;
+                vertices[vert_index].position.y = vert_pos[1] * inv_size - half_size.y;
+                vertices[vert_index].position.z = vert_pos[2] * inv_size - half_size.z;
+                vertices[vert_index].color = palette[start_voxel];
+              }
+              vertices += 6;
+#endif
+              // mark merged voxels
+              for (int jj = j; jj < pos[v]; jj++)
+                for (int ii = i; ii < min_i; ii++)
+                  merged_mask |= (1 << (ii + jj*4));
+            }
+        }
+
+        block += 64;
+      }
+#else
+  char* merged_mask = (char*)ScratchAllocate(dims[u]*dims[v]);
+  if (merged_mask == NULL)
+    return 0;
+  // on each layer we try to merge voxels as much as possible
+  for (uint32_t layer = 0; layer < dims[d]; layer++) {
+    // zero out mask
+    memset(merged_mask, 0, dims[u]*dims[v]);
+    for (uint32_t j = 0; j < dims[v]; j++)
+      for (uint32_t i = 0; i < dims[u]; i++) {
+        // if this voxel was already written then skip it.
+        // this skip helps us to keep algorithm complexity at O(w*h*d).
+        if (merged_mask[i + j*dims[u]])
+          continue;
+        uint32_t pos[3];
+        pos[d] = layer;
+        pos[u] = i;
+        pos[v] = j;
+        Voxel start_voxel = GetInVoxelGrid(grid, pos[0], pos[1], pos[2]);
+        if (start_voxel == 0) {
+          // we don't generate vertices for air
+          continue;
+        }
+        const uint32_t start_pos[3] = { pos[0], pos[1], pos[2] };
+        uint32_t min_i = dims[u];
+
+        // grow quad while all voxels in that quad are the same, visible
+        // and not covered by other quads
+        while (pos[v] < dims[v]) {
+          pos[u] = i;
+          if (merged_mask[pos[u] + pos[v]*dims[u]] ||
+              GetInVoxelGrid(grid, pos[0], pos[1], pos[2]) != start_voxel ||
+              GetInVoxelGridChecked(grid,
+                                    pos[0] + vox_normals[face].x,
+                                    pos[1] + vox_normals[face].y,
+                                    pos[2] + vox_normals[face].z) != 0)
+            break;
+          pos[u]++;
+          while (pos[u] < min_i &&
+                 !merged_mask[pos[u] + pos[v]*dims[u]] &&
+                 GetInVoxelGrid(grid, pos[0], pos[1], pos[2]) == start_voxel &&
+                 GetInVoxelGridChecked(grid,
+                                       pos[0] + vox_normals[face].x,
+                                       pos[1] + vox_normals[face].y,
+                                       pos[2] + vox_normals[face].z) == 0) {
+            pos[u]++;
+          }
+          if (pos[u] < min_i) min_i = pos[u];
+          pos[v]++;
+        }
+        if (min_i == start_pos[u] ||
+            pos[v] == start_pos[v]) {
+          continue;
+        }
+        uint32_t offset[3] = { 0 };
+        offset[u] = min_i - start_pos[u]; // width of quad
+        offset[v] = pos[v] - start_pos[v]; // height of quad
+#if VX_USE_INDICES
+        // write 4 vertices and 6 indices for this quad
+        for (uint32_t i = 0; i < 6; i++) {
+          *(indices++) = base_index + (vertices - first_vertex) + vox_indices[i];
+        }
+        for (uint32_t vert_index = 0; vert_index < 4; vert_index++) {
+          int vert_pos[3] = { (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*4 + vert_index].x,
+                              (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*4 + vert_index].y,
+                              (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*4 + vert_index].z };
+          vert_pos[d] += face & 1;
+          *(vertices++) = (Vertex_X3C) {
+            .position.x = vert_pos[0] * inv_size - half_size.x,
+            .position.y = vert_pos[1] * inv_size - half_size.y,
+            .position.z = vert_pos[2] * inv_size - half_size.z,
+            .color = palette[start_voxel]
+          };
+        }
+#else
+        // write 6 vertices for this quad
+        for (uint32_t vert_index = 0; vert_index < 6; vert_index++) {
+          int vert_pos[3] = { (int)start_pos[0] + (int)offset[0] * (int)vox_positions[face*6 + vert_index].x,
+                              (int)start_pos[1] + (int)offset[1] * (int)vox_positions[face*6 + vert_index].y,
+                              (int)start_pos[2] + (int)offset[2] * (int)vox_positions[face*6 + vert_index].z };
+          vert_pos[d] += face & 1;
+          vertices[vert_index].position.x = vert_pos[0] * inv_size - half_size.x;
+          vertices[vert_index].position.y = vert_pos[1] * inv_size - half_size.y;
+          vertices[vert_index].position.z = vert_pos[2] * inv_size - half_size.z;
+          vertices[vert_index].color = palette[start_voxel];
+        }
+        vertices += 6;
+#endif
+        // mark merged voxels
+        for (uint32_t jj = j; jj < pos[v]; jj++)
+          for (uint32_t ii = i; ii < min_i; ii++) {
+            merged_mask[ii + jj * dims[u]] = 1;
+          }
+      }
+  }
+  ScratchRelease(merged_mask);
+#endif
+  // LOG_DEBUG("took %u ms to generate %u vertices", PlatformGetTicks() - start_time, (uint32_t)(vertices - first_vertex));
+  return vertices - first_vertex;
+}
+
+INTERNAL int
+LoadVoxelGrid(Allocator* allocator, Voxel_Grid* grid, const uint8_t* buffer, uint32_t size)
+{
+  PROFILE_FUNCTION();
+  const ogt_vox_scene* scene = ogt_vox_read_scene(buffer, size);
+  if (scene == NULL) {
+    LOG_WARN("failed to parse voxel model");
+    return -1;
+  }
+  const ogt_vox_model* model = scene->models[0];
+  if (AllocateVoxelGrid(allocator, grid, model->size_x, model->size_z, model->size_y)) {
+    // if out of memory
+    return -1;
+  }
+  SetVoxelGridPalette(grid, (const uint32_t*)scene->palette.color);
+  for (uint32_t x = 0; x < grid->width; x++) {
+    for (uint32_t y = 0; y < grid->height; y++) {
+      for (uint32_t z = 0; z < grid->depth; z++) {
+        uint32_t index = x + z*grid->width + y*grid->width*grid->depth;
+        Voxel voxel = model->voxel_data[index];
+        if (voxel)
+          GetInVoxelGrid(grid, x, y, z) = voxel;
+      }
+    }
+  }
+  ogt_vox_destroy_scene(scene);
+  RehashVoxelGrid(grid);
+  return 0;
+}
+
+INTERNAL int
+LoadVoxelGridFromFile(Allocator* allocator, Voxel_Grid* grid, const char* filename)
+{
+  PROFILE_FUNCTION();
+  size_t buff_size;
+  uint8_t* buffer = (uint8_t*)PlatformLoadEntireFile(filename, &buff_size);
+  if (buffer == NULL) {
+    LOG_WARN("failed to open file '%s' for voxel model loading", filename);
+    return -1;
+  }
+  int ret = LoadVoxelGrid(allocator, grid, buffer, buff_size);
+  PlatformFreeLoadedFile(buffer);
+  return ret;
+}
+
+
+/// Voxel generation (procedural or not)
+
+INTERNAL void
+GenerateVoxelSphere(Voxel_Grid* grid, int radius, Voxel fill)
+{
+  if ((int)grid->width != radius*2+1 ||
+      (int)grid->depth != radius*2+1 ||
+      (int)grid->height != radius*2+1) {
+    LOG_WARN("radius doesn't match grid's extents");
+    return;
+  }
+  for (int z = 0; z < radius*2+1; z++)
+    for (int y = 0; y < radius*2+1; y++)
+      for (int x = 0; x < radius*2+1; x++) {
+        int xr = abs(x-radius);
+        int yr = abs(y-radius);
+        int zr = abs(z-radius);
+        if (xr*xr + yr*yr + zr*zr <= radius*radius) {
+          GetInVoxelGrid(grid, x, y, z) = fill;
+        }
+      }
+}
+
+INTERNAL void
+FillVoxelGrid(Voxel_Grid* grid, Voxel fill)
+{
+#if VX_USE_BLOCKS
+  // NOTE: this may be wrong as padding in blocks get filled too
+  // this would produce incorrect hashes. But I literally don't care😎
+  memset(grid->data->ptr, fill, VoxelGridBytes(grid));
+#else
+  memset(grid->data->ptr, fill, VoxelGridBytes(grid));
+#endif
+}
+
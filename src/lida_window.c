@@ -15,14 +15,41 @@ typedef struct {
   VkFramebuffer framebuffer;
 } Window_Image;
 
+// max number of GPU zones per frame, see cmdBeginGPUZone()
+#define GPU_MAX_ZONES 32
+
 typedef struct {
   VkCommandBuffer cmd;
   VkSemaphore     image_available;
-  // measures time spent on GPU
+  // measures time spent on GPU, 2 timestamps per zone
   VkQueryPool     query_pool;
+  const char*     zone_names[GPU_MAX_ZONES];
+  uint32_t        num_zones;
   uint64_t        submit_time;
 } Window_Frame;
 
+typedef struct {
+  const char* name;
+  float       milliseconds;
+} GPU_Zone_Time;
+
+// sequential parts of a frame on CPU, see BeginFramePhase()
+enum {
+  FRAME_PHASE_UPDATE,
+  FRAME_PHASE_CULL,
+  FRAME_PHASE_RECORD,
+  FRAME_PHASE_ACQUIRE,
+  FRAME_PHASE_FENCE_WAIT,
+  FRAME_PHASE_SUBMIT,
+  FRAME_PHASE_PRESENT,
+  FRAME_PHASE_COUNT,
+  FRAME_PHASE_NONE = FRAME_PHASE_COUNT
+};
+
+GLOBAL const char* g_frame_phase_names[FRAME_PHASE_COUNT] = {
+  "update", "cull", "record", "acquire", "fence wait", "submit", "present"
+};
+
 typedef struct {
 
   VkSurfaceKHR                surface;
@@ -41,6 +68,21 @@ typedef struct {
   VkSurfaceFormatKHR          format;
   VkPresentModeKHR            present_mode;
   VkCompositeAlphaFlagBitsKHR composite_alpha;
+  // render to our own images instead of swapchain, see CreateOffscreenWindow()
+  int                         headless;
+  Video_Memory                offscreen_memory;
+  // GPU and CPU clocks at the same moment, see CalibrateGPUClock()
+  uint64_t                    gpu_clock_ref;
+  uint64_t                    cpu_clock_ref;
+  // profiler track for GPU zones
+  uint32_t                    gpu_track;
+  // zone timings of the last frame with available results
+  GPU_Zone_Time               gpu_zone_times[GPU_MAX_ZONES];
+  uint32_t                    num_gpu_zone_times;
+  // frame counters with microseconds spent in each phase
+  uint32_t                    phase_counters[FRAME_PHASE_COUNT];
+  uint32_t                    phase;
+  uint64_t                    phase_start;
 
 } Vulkan_Window;
 
@@ -58,7 +100,8 @@ CreateMainPass()
     .loadOp        = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
     .storeOp       = VK_ATTACHMENT_STORE_OP_STORE,
     .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-    .finalLayout   = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+    // offscreen images are only copied from
+    .finalLayout   = (g_window->headless) ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
   };
   VkAttachmentReference reference = {
     .attachment = 0,
@@ -100,6 +143,51 @@ CreateMainPass()
   return CreateRenderPass(&g_window->render_pass, &render_pass_info, "main-render-pass");
 }
 
+// create image views and framebuffers for g_window->images
+INTERNAL VkResult
+CreateWindowFramebuffers()
+{
+  VkResult err = VK_SUCCESS;
+  VkImageViewCreateInfo image_view_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = g_window->format.format,
+    .components = { .r = VK_COMPONENT_SWIZZLE_R,
+                    .g = VK_COMPONENT_SWIZZLE_G,
+                    .b = VK_COMPONENT_SWIZZLE_B,
+                    .a = VK_COMPONENT_SWIZZLE_A,},
+    .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                          .baseMipLevel = 0,
+                          .levelCount = 1,
+                          .baseArrayLayer = 0,
+                          .layerCount = 1 },
+  };
+  VkFramebufferCreateInfo framebuffer_info = {
+    .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+    .renderPass = g_window->render_pass,
+    .attachmentCount = 1,
+    .width = g_window->swapchain_extent.width,
+    .height = g_window->swapchain_extent.height,
+    .layers = 1,
+  };
+  for (uint32_t i = 0; i < g_window->num_images; i++) {
+    char buff[64];
+    image_view_info.image = g_window->images[i].image;
+    stbsp_sprintf(buff, "window-image-view[%u]", i);
+    err = CreateImageView(&g_window->images[i].image_view, &image_view_info, buff);
+    if (err != VK_SUCCESS) {
+      LOG_ERROR("failed to create image view no. %u with error %s", i, ToString_VkResult(err));
+    }
+    framebuffer_info.pAttachments = &g_window->images[i].image_view;
+    stbsp_sprintf(buff, "window-framebuffer[%u]", i);
+    err = CreateFramebuffer(&g_window->images[i].framebuffer, &framebuffer_info, buff);
+    if (err != VK_SUCCESS) {
+      LOG_ERROR("failed to create framebuffer no. %u with error %s", i, ToString_VkResult(err));
+    }
+  }
+  return err;
+}
+
 INTERNAL VkResult
 CreateSwapchain(VkPresentModeKHR present_mode)
 {
@@ -233,45 +321,10 @@ CreateSwapchain(VkPresentModeKHR present_mode)
   // NOTE: we hope that no device creates more than 8 swapchain images
   VkImage swapchain_images[8];
   vkGetSwapchainImagesKHR(g_device->logical_device, g_window->swapchain, &g_window->num_images, swapchain_images);
-  // create attachments
-  VkImageViewCreateInfo image_view_info = {
-    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-    .viewType = VK_IMAGE_VIEW_TYPE_2D,
-    .format = g_window->format.format,
-    .components = { .r = VK_COMPONENT_SWIZZLE_R,
-                    .g = VK_COMPONENT_SWIZZLE_G,
-                    .b = VK_COMPONENT_SWIZZLE_B,
-                    .a = VK_COMPONENT_SWIZZLE_A,},
-    .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                          .baseMipLevel = 0,
-                          .levelCount = 1,
-                          .baseArrayLayer = 0,
-                          .layerCount = 1 },
-  };
-  VkFramebufferCreateInfo framebuffer_info = {
-    .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-    .renderPass = g_window->render_pass,
-    .attachmentCount = 1,
-    .width = g_window->swapchain_extent.width,
-    .height = g_window->swapchain_extent.height,
-    .layers = 1,
-  };
   for (uint32_t i = 0; i < g_window->num_images; i++) {
-    char buff[64];
     g_window->images[i].image = swapchain_images[i];
-    image_view_info.image = swapchain_images[i];
-    stbsp_sprintf(buff, "swapchain-image-view[%u]", i);
-    err = CreateImageView(&g_window->images[i].image_view, &image_view_info, buff);
-    if (err != VK_SUCCESS) {
-      LOG_ERROR("failed to create image view no. %u with error %s", i, ToString_VkResult(err));
-    }
-    framebuffer_info.pAttachments = &g_window->images[i].image_view;
-    stbsp_sprintf(buff, "swapchain-framebuffer[%u]", i);
-    err = CreateFramebuffer(&g_window->images[i].framebuffer, &framebuffer_info, buff);
-    if (err != VK_SUCCESS) {
-      LOG_ERROR("failed to create framebuffer no. %u with error %s", i, ToString_VkResult(err));
-    }
   }
+  err = CreateWindowFramebuffers();
 
   // TODO: manage preTransform
   // This is crucial for devices you can flip
@@ -279,6 +332,53 @@ CreateSwapchain(VkPresentModeKHR present_mode)
   return err;
 }
 
+// create images that replace swapchain images when there's no surface
+INTERNAL VkResult
+CreateOffscreenImages()
+{
+  VkImageCreateInfo image_info = {
+    .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType     = VK_IMAGE_TYPE_2D,
+    .format        = g_window->format.format,
+    .extent        = { g_window->swapchain_extent.width, g_window->swapchain_extent.height, 1 },
+    .mipLevels     = 1,
+    .arrayLayers   = 1,
+    .samples       = VK_SAMPLE_COUNT_1_BIT,
+    .tiling        = VK_IMAGE_TILING_OPTIMAL,
+    .usage         = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  VkResult err;
+  VkMemoryRequirements image_requirements[2];
+  // 2 images are enough, we never have more than 2 frames in flight
+  g_window->num_images = ARR_SIZE(image_requirements);
+  for (uint32_t i = 0; i < g_window->num_images; i++) {
+    char buff[64];
+    stbsp_sprintf(buff, "offscreen-image[%u]", i);
+    err = CreateImage(&g_window->images[i].image, &image_info, buff);
+    if (err != VK_SUCCESS) {
+      LOG_ERROR("failed to create offscreen image with error %s", ToString_VkResult(err));
+      return err;
+    }
+    vkGetImageMemoryRequirements(g_device->logical_device, g_window->images[i].image, &image_requirements[i]);
+  }
+  VkMemoryRequirements requirements;
+  MergeMemoryRequirements(image_requirements, g_window->num_images, &requirements);
+  err = AllocateVideoMemory(&g_window->offscreen_memory, requirements.size,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, requirements.memoryTypeBits,
+                            "window/offscreen-memory");
+  if (err != VK_SUCCESS) {
+    LOG_ERROR("failed to allocate memory for offscreen images with error %s", ToString_VkResult(err));
+    return err;
+  }
+  for (uint32_t i = 0; i < g_window->num_images; i++) {
+    err = ImageBindToMemory(&g_window->offscreen_memory, g_window->images[i].image, &image_requirements[i]);
+    if (err != VK_SUCCESS)
+      return err;
+  }
+  return CreateWindowFramebuffers();
+}
+
 INTERNAL VkResult
 CreateWindowFrames()
 {
@@ -318,6 +418,252 @@ CreateWindowFrames()
   return err;
 }
 
+
+/// GPU zones
+
+/*
+  GPU zones measure how long GPU spends on a range of commands:
+
+    uint32_t zone = cmdBeginGPUZone(cmd, "CullPass");
+    CullPass(cmd, ...);
+    cmdEndGPUZone(cmd, zone);
+
+  Timestamps are read back two frames later, when the frame's command
+  buffer is reused. They're converted to CPU clock and sent to
+  profiler's "GPU" track, so they are on the same timeline as
+  PROFILE_FUNCTION() sections.
+ */
+
+INTERNAL int
+GPUTimestampsSupported()
+{
+  return g_device->queue_families[g_device->graphics_queue_family].timestampValidBits != 0;
+}
+
+// find GPU and CPU timestamps that were taken at the same moment
+INTERNAL void
+CalibrateGPUClock()
+{
+  PROFILE_FUNCTION();
+  uint64_t gpu_time = 0;
+  uint64_t cpu_before, cpu_after;
+  VkResult err;
+  if (g_device->calibrated_timestamps) {
+    VkCalibratedTimestampInfoEXT info = {
+      .sType      = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+      .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT,
+    };
+    uint64_t deviation;
+    cpu_before = PlatformGetPerformanceCounter();
+    err = vkGetCalibratedTimestampsEXT(g_device->logical_device, 1, &info, &gpu_time, &deviation);
+    cpu_after = PlatformGetPerformanceCounter();
+    if (err != VK_SUCCESS) {
+      LOG_WARN("failed to get calibrated timestamps with error %s", ToString_VkResult(err));
+      return;
+    }
+  } else {
+    // write a timestamp on idle queue and wait for it. It is taken
+    // somewhere between submit and end of the wait.
+    VkQueryPoolCreateInfo query_pool_info = {
+      .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 1,
+    };
+    VkQueryPool query_pool;
+    err = vkCreateQueryPool(g_device->logical_device, &query_pool_info, NULL, &query_pool);
+    if (err != VK_SUCCESS) {
+      LOG_WARN("failed to create query pool for clock calibration with error %s", ToString_VkResult(err));
+      return;
+    }
+    VkCommandBuffer cmd;
+    err = AllocateCommandBuffers(&cmd, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, "calibration-command-buffer");
+    if (err != VK_SUCCESS) {
+      LOG_WARN("failed to allocate command buffer for clock calibration with error %s", ToString_VkResult(err));
+      vkDestroyQueryPool(g_device->logical_device, query_pool, NULL);
+      return;
+    }
+    VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkBeginCommandBuffer(cmd, &begin_info);
+    vkCmdResetQueryPool(cmd, query_pool, 0, 1);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+    vkEndCommandBuffer(cmd);
+    VkSubmitInfo submit_info = {
+      .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers    = &cmd,
+    };
+    vkQueueWaitIdle(g_device->graphics_queue);
+    cpu_before = PlatformGetPerformanceCounter();
+    err = QueueSubmit(&submit_info, 1, VK_NULL_HANDLE);
+    if (err == VK_SUCCESS) {
+      vkQueueWaitIdle(g_device->graphics_queue);
+      cpu_after = PlatformGetPerformanceCounter();
+      err = vkGetQueryPoolResults(g_device->logical_device, query_pool, 0, 1, sizeof(uint64_t),
+                                  &gpu_time, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    }
+    vkFreeCommandBuffers(g_device->logical_device, g_device->command_pool, 1, &cmd);
+    vkDestroyQueryPool(g_device->logical_device, query_pool, NULL);
+    if (err != VK_SUCCESS) {
+      LOG_WARN("failed to calibrate GPU clock with error %s", ToString_VkResult(err));
+      return;
+    }
+  }
+  g_window->gpu_clock_ref = gpu_time;
+  g_window->cpu_clock_ref = cpu_before + (cpu_after - cpu_before) / 2;
+}
+
+// convert GPU timestamp to PlatformGetPerformanceCounter() units
+INTERNAL uint64_t
+GPUToCPUTime(uint64_t gpu_time)
+{
+  uint32_t valid_bits = g_device->queue_families[g_device->graphics_queue_family].timestampValidBits;
+  uint64_t delta = gpu_time - g_window->gpu_clock_ref;
+  if (valid_bits < 64) {
+    // timestamp might have wrapped around, sign extend the difference
+    uint32_t shift = 64 - valid_bits;
+    delta = (uint64_t)((int64_t)(delta << shift) >> shift);
+  }
+  double ticks = (double)(int64_t)delta * (double)g_device->properties.limits.timestampPeriod * 1e-9 *
+    (double)PlatformGetPerformanceFrequency();
+  return g_window->cpu_clock_ref + (int64_t)ticks;
+}
+
+/**
+   Read back zones recorded in this frame's command buffer last time
+   and prepare query pool for new zones. Call right after
+   BeginCommands().
+ */
+INTERNAL void
+cmdBeginGPUFrame(VkCommandBuffer cmd)
+{
+  PROFILE_FUNCTION();
+  if (!GPUTimestampsSupported())
+    return;
+  Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
+  if (frame->query_pool == VK_NULL_HANDLE) {
+    VkQueryPoolCreateInfo query_pool_info = {
+      .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 2 * GPU_MAX_ZONES,
+    };
+    VkResult err = vkCreateQueryPool(g_device->logical_device, &query_pool_info, NULL,
+                                     &frame->query_pool);
+    if (err != VK_SUCCESS) {
+      LOG_ERROR("failed to create query pool for timestamps with error %s",
+                ToString_VkResult(err));
+      frame->query_pool = VK_NULL_HANDLE;
+      return;
+    }
+  } else if (frame->num_zones > 0) {
+    uint32_t timestamps_size = 2 * frame->num_zones * sizeof(uint64_t);
+    // if we're out of frame memory results of this frame are dropped
+    uint64_t* timestamps = FrameAllocate(timestamps_size);
+    VkResult err = VK_NOT_READY;
+    if (timestamps) {
+      err = vkGetQueryPoolResults(g_device->logical_device, frame->query_pool,
+                                  0,
+                                  2 * frame->num_zones,
+                                  timestamps_size,
+                                  timestamps,
+                                  sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT);
+    }
+    if (err == VK_SUCCESS) {
+      // GPU clock drifts away from CPU clock, recalibrate when it's cheap
+      if (g_device->calibrated_timestamps && (g_window->frame_counter & 255) == 0) {
+        CalibrateGPUClock();
+      }
+      double to_ms = 1000.0 / (double)PlatformGetPerformanceFrequency();
+      for (uint32_t i = 0; i < frame->num_zones; i++) {
+        uint64_t start = GPUToCPUTime(timestamps[2*i]);
+        uint64_t end = GPUToCPUTime(timestamps[2*i+1]);
+        if (end < start)
+          end = start;
+        ProfilerTrackSection(g_window->gpu_track, frame->zone_names[i], start, end - start);
+        g_window->gpu_zone_times[i] = (GPU_Zone_Time) {
+          .name         = frame->zone_names[i],
+          .milliseconds = (float)((double)(end - start) * to_ms),
+        };
+      }
+      g_window->num_gpu_zone_times = frame->num_zones;
+    } else if (err != VK_NOT_READY) {
+      LOG_ERROR("failed to get query pool timestamps with error %s", ToString_VkResult(err));
+    }
+  }
+  frame->num_zones = 0;
+  vkCmdResetQueryPool(cmd, frame->query_pool, 0, 2 * GPU_MAX_ZONES);
+}
+
+// name must be a static string. Returns zone id for cmdEndGPUZone().
+INTERNAL uint32_t
+cmdBeginGPUZone(VkCommandBuffer cmd, const char* name)
+{
+  Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
+  if (frame->query_pool == VK_NULL_HANDLE || frame->num_zones == GPU_MAX_ZONES)
+    return UINT32_MAX;
+  uint32_t zone = frame->num_zones++;
+  frame->zone_names[zone] = name;
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->query_pool, 2*zone);
+  return zone;
+}
+
+INTERNAL void
+cmdEndGPUZone(VkCommandBuffer cmd, uint32_t zone)
+{
+  if (zone == UINT32_MAX)
+    return;
+  Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame->query_pool, 2*zone+1);
+}
+
+
+/// Frame phases
+
+INTERNAL void
+RegisterFramePhases()
+{
+  // counter names must be static strings
+  GLOBAL const char* counter_names[FRAME_PHASE_COUNT] = {
+    "update (us)", "cull (us)", "record (us)", "acquire (us)",
+    "fence wait (us)", "submit (us)", "present (us)"
+  };
+  for (uint32_t i = 0; i < FRAME_PHASE_COUNT; i++) {
+    g_window->phase_counters[i] = RegisterFrameCounter(counter_names[i]);
+  }
+  g_window->phase = FRAME_PHASE_NONE;
+}
+
+/**
+   End current frame phase and start a new one. Time spent in phase is
+   added to its frame counter.
+   @param phase FRAME_PHASE_NONE to just end current phase
+   @return previous phase, so it can be resumed
+ */
+INTERNAL uint32_t
+BeginFramePhase(uint32_t phase)
+{
+  uint64_t now = PlatformGetPerformanceCounter();
+  uint32_t prev = g_window->phase;
+  if (prev != FRAME_PHASE_NONE) {
+    uint64_t us = (now - g_window->phase_start) * 1000000 / PlatformGetPerformanceFrequency();
+    AddFrameCounter(g_window->phase_counters[prev], (int64_t)us);
+  }
+  g_window->phase = phase;
+  g_window->phase_start = now;
+  return prev;
+}
+
+// get time spent in phase during previous frame
+INTERNAL float
+GetFramePhaseMilliseconds(uint32_t phase)
+{
+  return (float)GetFrameCounter(g_window->phase_counters[phase]) * 0.001f;
+}
+
+
 
 /// Functions used by other modules
 
@@ -341,9 +687,59 @@ CreateWindow(int vsync)
   if (err != VK_SUCCESS) {
     goto error;
   }
+  g_window->gpu_track = ProfilerCreateTrack("GPU");
+  RegisterFramePhases();
+  if (GPUTimestampsSupported()) {
+    CalibrateGPUClock();
+  }
+  return VK_SUCCESS;
+ error:
+  PersistentRelease(g_window);
+  g_window = NULL;
+  return err;
+}
+
+/**
+   Create a window without surface: frames are rendered to offscreen
+   images and never presented. Doesn't need platform window or display,
+   used for benchmarks and image tests.
+ */
+INTERNAL VkResult
+CreateOffscreenWindow(uint32_t width, uint32_t height)
+{
+  PROFILE_FUNCTION();
+  g_window = PersistentAllocate(sizeof(Vulkan_Window));
+  memset(g_window, 0, sizeof(Vulkan_Window));
+  g_window->images = PersistentAllocate(sizeof(Window_Image) * 8);
+  g_window->headless = 1;
+  g_window->surface = VK_NULL_HANDLE;
+  g_window->swapchain = VK_NULL_HANDLE;
+  g_window->swapchain_extent = (VkExtent2D) { width, height };
+  g_window->format = (VkSurfaceFormatKHR) { VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+  VkResult err = CreateMainPass();
+  if (err != VK_SUCCESS) {
+    LOG_FATAL("failed to create render pass with error %s", ToString_VkResult(err));
+    goto error;
+  }
+  err = CreateOffscreenImages();
+  if (err != VK_SUCCESS) {
+    LOG_FATAL("failed to create offscreen images with error %s", ToString_VkResult(err));
+    goto error;
+  }
+  err = CreateWindowFrames();
+  if (err != VK_SUCCESS) {
+    goto error;
+  }
+  g_window->gpu_track = ProfilerCreateTrack("GPU");
+  RegisterFramePhases();
+  if (GPUTimestampsSupported()) {
+    CalibrateGPUClock();
+  }
+  LOG_INFO("rendering offscreen to %ux%u images", width, height);
   return VK_SUCCESS;
  error:
   PersistentRelease(g_window);
+  g_window = NULL;
   return err;
 }
 
@@ -361,10 +757,17 @@ DestroyWindow(int free_memory)
   for (uint32_t i = 0; i < g_window->num_images; i++) {
     vkDestroyFramebuffer(g_device->logical_device, g_window->images[i].framebuffer, NULL);
     vkDestroyImageView(g_device->logical_device, g_window->images[i].image_view, NULL);
+    if (g_window->headless)
+      vkDestroyImage(g_device->logical_device, g_window->images[i].image, NULL);
   }
+  if (g_window->headless)
+    FreeVideoMemory(&g_window->offscreen_memory);
   vkDestroyRenderPass(g_device->logical_device, g_window->render_pass, NULL);
-  vkDestroySwapchainKHR(g_device->logical_device, g_window->swapchain, NULL);
-  vkDestroySurfaceKHR(g_device->instance, g_window->surface, NULL);
+  // headless device might not have swapchain functions loaded
+  if (!g_window->headless) {
+    vkDestroySwapchainKHR(g_device->logical_device, g_window->swapchain, NULL);
+    vkDestroySurfaceKHR(g_device->instance, g_window->surface, NULL);
+  }
 
   if (free_memory)  {
     PersistentRelease(g_window->images);
@@ -378,6 +781,10 @@ INTERNAL VkResult
 ResizeWindow()
 {
   PROFILE_FUNCTION();
+  if (g_window->headless) {
+    // offscreen images have fixed size
+    return VK_SUCCESS;
+  }
   for (uint32_t i = 0; i < g_window->num_images; i++) {
     vkDestroyFramebuffer(g_device->logical_device, g_window->images[i].framebuffer, NULL);
     vkDestroyImageView(g_device->logical_device, g_window->images[i].image_view, NULL);
@@ -406,23 +813,31 @@ BeginRenderingToWindow()
 {
   PROFILE_FUNCTION();
   Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
-  VkResult err = vkAcquireNextImageKHR(g_device->logical_device,
-                                       g_window->swapchain,
-                                       UINT64_MAX,
-                                       frame->image_available,
-                                       VK_NULL_HANDLE,
-                                       &g_window->current_image);
-  switch (err)
-    {
-    case VK_SUCCESS:
-      break;
-    case VK_SUBOPTIMAL_KHR:
-      LOG_WARN("acquire next image: got VK_SUBOPTIMAL_KHR");
-      break;
-    default:
-      LOG_ERROR("failed to acquire next swapchain image with error %s", ToString_VkResult(err));
-      return err;
-    }
+  if (g_window->headless) {
+    // previous use of this image was waited for in PresentToScreen()
+    g_window->current_image = g_window->frame_counter % g_window->num_images;
+  } else {
+    // acquire blocks when presentation engine is behind
+    uint32_t prev_phase = BeginFramePhase(FRAME_PHASE_ACQUIRE);
+    VkResult err = vkAcquireNextImageKHR(g_device->logical_device,
+                                         g_window->swapchain,
+                                         UINT64_MAX,
+                                         frame->image_available,
+                                         VK_NULL_HANDLE,
+                                         &g_window->current_image);
+    BeginFramePhase(prev_phase);
+    switch (err)
+      {
+      case VK_SUCCESS:
+        break;
+      case VK_SUBOPTIMAL_KHR:
+        LOG_WARN("acquire next image: got VK_SUBOPTIMAL_KHR");
+        break;
+      default:
+        LOG_ERROR("failed to acquire next swapchain image with error %s", ToString_VkResult(err));
+        return err;
+      }
+  }
   // start render pass
   VkRect2D render_area = { .offset = {0, 0},
                            .extent = g_window->swapchain_extent };
@@ -454,18 +869,22 @@ PresentToScreen()
   Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
   VkResult err;
   // wait till commands from previous frame are done, so we can safely use GPU resources
+  BeginFramePhase(FRAME_PHASE_FENCE_WAIT);
   err = vkWaitForFences(g_device->logical_device, 1, &g_window->resources_available_fence,
                         VK_TRUE, UINT64_MAX);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to wait for fence with error %s", ToString_VkResult(err));
+    BeginFramePhase(FRAME_PHASE_NONE);
     return err;
   }
   err = vkResetFences(g_device->logical_device, 1, &g_window->resources_available_fence);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to reset fence before presenting image with error %s", ToString_VkResult(err));
+    BeginFramePhase(FRAME_PHASE_NONE);
     return err;
   }
   // submit commands
+  BeginFramePhase(FRAME_PHASE_SUBMIT);
   VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
   VkSubmitInfo submit_info = {
     .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
@@ -477,9 +896,15 @@ PresentToScreen()
     .signalSemaphoreCount = 1,
     .pSignalSemaphores    = &g_window->render_finished_semaphore,
   };
+  if (g_window->headless) {
+    // nothing to wait for and nobody waits for us
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.signalSemaphoreCount = 0;
+  }
   err = QueueSubmit(&submit_info, 1, g_window->resources_available_fence);
   if (err != VK_SUCCESS) {
     LOG_ERROR("failed to submit commands to graphics queue with error %s", ToString_VkResult(err));
+    BeginFramePhase(FRAME_PHASE_NONE);
     return err;
   }
   // update FPS
@@ -487,56 +912,151 @@ PresentToScreen()
   g_window->frames_per_second = (float)PlatformGetPerformanceFrequency() / (float)(frame->submit_time - g_window->last_submit);
   g_window->last_submit = frame->submit_time;
   // present image to screen
-  VkResult present_results[1];
-  VkPresentInfoKHR present_info = {
-    .sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores    = &g_window->render_finished_semaphore,
-    .swapchainCount     = 1,
-    .pSwapchains        = &g_window->swapchain,
-    .pImageIndices      = &g_window->current_image,
-    .pResults           = present_results,
-  };
-  err = QueuePresent(&present_info);
-  if (err != VK_SUCCESS && err != VK_SUBOPTIMAL_KHR) {
-    LOG_ERROR("queue failed to present with error %s", ToString_VkResult(err));
+  BeginFramePhase(FRAME_PHASE_PRESENT);
+  if (!g_window->headless) {
+    VkResult present_results[1];
+    VkPresentInfoKHR present_info = {
+      .sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores    = &g_window->render_finished_semaphore,
+      .swapchainCount     = 1,
+      .pSwapchains        = &g_window->swapchain,
+      .pImageIndices      = &g_window->current_image,
+      .pResults           = present_results,
+    };
+    err = QueuePresent(&present_info);
+    if (err != VK_SUCCESS && err != VK_SUBOPTIMAL_KHR) {
+      LOG_ERROR("queue failed to present with error %s", ToString_VkResult(err));
+    }
   }
+  BeginFramePhase(FRAME_PHASE_NONE);
   g_window->frame_counter++;
   g_window->current_image = UINT32_MAX;
   return err;
 }
 
-INTERNAL VkQueryPool
-GetTimestampsGPU(uint32_t count, uint64_t* results)
+// Read back last rendered offscreen image and write it as binary
+// PPM. Only works in headless mode. Returns 0 on success.
+INTERNAL int
+SaveWindowImage(const char* path)
 {
-  Window_Frame* frame = &g_window->frames[g_window->frame_counter % 2];
-  if (frame->query_pool == VK_NULL_HANDLE) {
-    // create query pool
-    VkQueryPoolCreateInfo query_pool_info = {
-      .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
-      .queryType  = VK_QUERY_TYPE_TIMESTAMP,
-      .queryCount = count
-    };
-    VkResult err = vkCreateQueryPool(g_device->logical_device, &query_pool_info, NULL,
-                                     &frame->query_pool);
-    if (err != VK_SUCCESS) {
-      LOG_ERROR("failed to create query pool for timestamps with error %s",
-                ToString_VkResult(err));
-      return VK_NULL_HANDLE;
-    }
-  } else {
-    VkResult err = vkGetQueryPoolResults(g_device->logical_device, frame->query_pool,
-                                         0,
-                                         count,
-                                         sizeof(uint64_t) * count,
-                                         results,
-                                         sizeof(uint64_t),
-                                         VK_QUERY_RESULT_64_BIT);
-    if (err != VK_SUCCESS) {
-      LOG_ERROR("failed to get query pool timestampts with error %s", ToString_VkResult(err));
-      return VK_NULL_HANDLE;
+  PROFILE_FUNCTION();
+  if (!g_window->headless) {
+    LOG_WARN("SaveWindowImage: only offscreen window can be saved");
+    return -1;
+  }
+  vkDeviceWaitIdle(g_device->logical_device);
+  // frame_counter was incremented in PresentToScreen()
+  uint32_t image_index = (g_window->frame_counter + g_window->num_images - 1) % g_window->num_images;
+  uint32_t width = g_window->swapchain_extent.width;
+  uint32_t height = g_window->swapchain_extent.height;
+  VkDeviceSize size = (VkDeviceSize)width * height * 4;
+
+  int ret = -1;
+  Video_Memory memory = { 0 };
+  VkCommandBuffer cmd = VK_NULL_HANDLE;
+  VkBuffer buffer;
+  VkResult err = CreateBuffer(&buffer, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, "window-readback-buffer");
+  if (err != VK_SUCCESS) {
+    LOG_ERROR("failed to create readback buffer with error %s", ToString_VkResult(err));
+    return -1;
+  }
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(g_device->logical_device, buffer, &requirements);
+  err = AllocateVideoMemory(&memory, requirements.size,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            requirements.memoryTypeBits, "window/readback-memory");
+  if (err != VK_SUCCESS) {
+    goto end;
+  }
+  void* mapped = NULL;
+  err = BufferBindToMemory(&memory, buffer, &requirements, &mapped, NULL);
+  if (err != VK_SUCCESS || mapped == NULL) {
+    goto end;
+  }
+  err = AllocateCommandBuffers(&cmd, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, "readback-command-buffer");
+  if (err != VK_SUCCESS) {
+    LOG_ERROR("failed to allocate command buffer for readback with error %s", ToString_VkResult(err));
+    cmd = VK_NULL_HANDLE;
+    goto end;
+  }
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(cmd, &begin_info);
+  // render pass already left the image in TRANSFER_SRC_OPTIMAL
+  VkImageMemoryBarrier barrier = {
+    .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT,
+    .oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image               = g_window->images[image_index].image,
+    .subresourceRange    = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+  };
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0, 0, NULL, 0, NULL, 1, &barrier);
+  VkBufferImageCopy region = {
+    .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+    .imageExtent      = { width, height, 1 },
+  };
+  vkCmdCopyImageToBuffer(cmd, g_window->images[image_index].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         buffer, 1, &region);
+  VkBufferMemoryBarrier buffer_barrier = {
+    .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer              = buffer,
+    .size                = VK_WHOLE_SIZE,
+  };
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 0, NULL, 1, &buffer_barrier, 0, NULL);
+  vkEndCommandBuffer(cmd);
+  VkSubmitInfo submit_info = {
+    .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .commandBufferCount = 1,
+    .pCommandBuffers    = &cmd,
+  };
+  err = QueueSubmit(&submit_info, 1, VK_NULL_HANDLE);
+  if (err != VK_SUCCESS) {
+    LOG_ERROR("failed to submit readback with error %s", ToString_VkResult(err));
+    goto end;
+  }
+  vkQueueWaitIdle(g_device->graphics_queue);
+
+  void* file = PlatformOpenFileForWrite(path);
+  if (file == NULL) {
+    LOG_ERROR("failed to open file '%s' for writing", path);
+    goto end;
+  }
+  char header[64];
+  int header_size = stbsp_snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+  PlatformWriteToFile(file, header, header_size);
+  // drop alpha, one row at a time
+  uint8_t* row = PersistentAllocate(width * 3);
+  const uint8_t* pixels = mapped;
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      row[x*3+0] = pixels[(y*width + x)*4 + 0];
+      row[x*3+1] = pixels[(y*width + x)*4 + 1];
+      row[x*3+2] = pixels[(y*width + x)*4 + 2];
     }
+    PlatformWriteToFile(file, row, width * 3);
   }
-  vkCmdResetQueryPool(frame->cmd, frame->query_pool, 0, count);
-  return frame->query_pool;
+  PersistentRelease(row);
+  PlatformCloseFileForWrite(file);
+  LOG_INFO("saved %ux%u frame to '%s'", width, height, path);
+  ret = 0;
+ end:
+  if (cmd)
+    vkFreeCommandBuffers(g_device->logical_device, g_device->command_pool, 1, &cmd);
+  vkDestroyBuffer(g_device->logical_device, buffer, NULL);
+  if (memory.handle)
+    FreeVideoMemory(&memory);
+  return ret;
 }
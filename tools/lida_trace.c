@@ -0,0 +1,24 @@
+/*
+  lida_trace.c
+  Convert binary trace written by the profiler to Chrome trace JSON.
+
+  usage: lida_trace [INPUT] [OUTPUT]
+  By default converts 'trace.lprof' to 'trace.json'.
+ */
+
+#include "../bench/lida_bench.h"
+
+int
+main(int argc, char** argv)
+{
+  if (argc > 3) {
+    fprintf(stderr, "usage: %s [INPUT] [OUTPUT]\n", argv[0]);
+    return 1;
+  }
+  BenchInit();
+  const char* input = (argc > 1) ? argv[1] : "trace.lprof";
+  const char* output = (argc > 2) ? argv[2] : "trace.json";
+  int ret = ProfilerConvertTrace(input, output);
+  BenchFree();
+  return (ret == 0) ? 0 : 1;
+}